@@ -23,6 +23,10 @@
 #define MSGID_NYX_MOD_GET_STRTOD_ERR                                        "NYXUTIL_GET_STRTOD_ERR"
 #define MSGID_NYX_MOD_SYSFS_ERR                                             "NYXUTIL_SYSFS_ERR"
 #define MSGID_NYX_MOD_GET_DIR_ERR                                           "NYXUTIL_GET_DIR_ERR"
+#define MSGID_NYX_MOD_SYSFS_ATTR_ERR                                        "NYXUTIL_SYSFS_ATTR_ERR"
+#define MSGID_NYX_MOD_PSY_UDEV_ERR                                          "NYXUTIL_PSY_UDEV_ERR"
+#define MSGID_NYX_MOD_PSY_MONITOR_ERR                                       "NYXUTIL_PSY_MONITOR_ERR"
+#define MSGID_NYX_MOD_PSY_SUBSCRIBE_ERR                                     "NYXUTIL_PSY_SUBSCRIBE_ERR"
 
 /** Battery*/
 #define MSGID_NYX_MOD_UDEV_ERR                                              "NYXBAT_UDEV_ERR"
@@ -58,6 +62,8 @@
 #define MSGID_NYX_MOD_DISP_OPEN_ALREADY_ERR                                 "NYXDIS_OPEN_ALREADY_ERR"
 #define MSGID_NYX_MOD_DISP_OPEN_ERR                                         "NYXDIS_OPEN_ERR"
 #define MSGID_NYX_MOD_DISP_OUT_OF_MEMORY                                    "NYXDIS_OUT_OF_MEM"
+#define MSGID_NYX_MOD_DISP_DRM_ERR                                          "NYXDIS_DRM_ERR"
+#define MSGID_NYX_MOD_DISP_UDEV_ERR                                         "NYXDIS_UDEV_ERR"
 
 /*Security lib open*/
 #define MSGID_NYX_MOD_SECU_OPEN_ERR                                         "NYXSEC_OPEN_ERR"
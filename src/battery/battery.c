@@ -28,52 +28,182 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <fcntl.h>
+#include <limits.h>
 
 #include <nyx/nyx_module.h>
 #include <nyx/module/nyx_utils.h>
 #include <nyx/module/nyx_log.h>
 #include "msgid.h"
 
-#include <glib.h>
-#include <libudev.h>
-
 #include "battery.h"
 #include "utils.h"
-
-#define CHARGE_MIN_TEMPERATURE_C 0
-#define CHARGE_MAX_TEMPERATURE_C 57
-#define BATTERY_MAX_TEMPERATURE_C  60
+#include "power_supply.h"
+#include "perf_counters.h"
 
 #define PATH_LEN 256
 
-char *battery_sysfs_path = NULL;
+const char *battery_sysfs_path = NULL;
 
 nyx_battery_ctia_t battery_ctia_params;
 
 int current_battery_percentage;
 bool current_battery_present;
 
-struct udev *udev = NULL;
-struct udev_monitor *mon = NULL;
-guint watch = 0;
+/*
+ * Status decoded from the uevent currently being dispatched. While the
+ * battery callback runs, queries are answered from here instead of sysfs.
+ */
+nyx_battery_status_t battery_event_state;
+bool battery_event_state_valid = false;
+bool battery_event_state_fresh = false;
+
+/*
+ * Optional coalescing window: uevents arriving within battery_coalesce_ms of
+ * the first one are folded into one sysfs re-read and at most one callback.
+ */
+unsigned int battery_coalesce_ms = 0;
+guint battery_coalesce_timer = 0;
+bool battery_reread_pending = false;
+bool battery_callback_pending = false;
+
+guint power_supply_subscription = 0;
+
+/* runtime counters, see battery_read_counters() */
+enum
+{
+	BATTERY_COUNTER_UEVENTS,
+	BATTERY_COUNTER_UEVENTS_DECODED,
+	BATTERY_COUNTER_REREADS,
+	BATTERY_COUNTER_CALLBACKS,
+	BATTERY_COUNTER_TIMER_WAKEUPS,
+	BATTERY_COUNTER_SYSFS_READS,
+	BATTERY_COUNTER_COUNT
+};
+
+static const char *const battery_counter_names[BATTERY_COUNTER_COUNT] =
+{
+	"uevents",
+	"uevents_decoded",
+	"rereads",
+	"callbacks",
+	"timer_wakeups",
+	"sysfs_reads",
+};
+
+static uint64_t battery_counters[BATTERY_COUNTER_COUNT];
 
 extern nyx_device_t *nyxDev;
 extern void *battery_callback_context;
 extern nyx_device_callback_function_t battery_callback;
 
-char batt_capacity_path[PATH_LEN] = {0,};
-char batt_energy_now_path[PATH_LEN] = {0,};
-char batt_energy_full_path[PATH_LEN] = {0,};
-char batt_energy_full_design_path[PATH_LEN] = {0,};
-char batt_charge_now_path[PATH_LEN] = {0,};
-char batt_charge_full_path[PATH_LEN] = {0,};
-char batt_charge_full_design_path[PATH_LEN] = {0,};
-char batt_temperature_path[PATH_LEN] = {0,};
-char batt_voltage_path[PATH_LEN] = {0,};
-char batt_current_path[PATH_LEN] = {0,};
-char batt_present_path[PATH_LEN] = {0,};
+/*
+ * Attribute handles are opened once in detect_battery_sysfs_paths() and
+ * re-read with pread(), so a status poll does not pay open/close per value.
+ */
+sysfs_attr_t batt_capacity_attr = SYSFS_ATTR_INITIALIZER;
+sysfs_attr_t batt_energy_now_attr = SYSFS_ATTR_INITIALIZER;
+sysfs_attr_t batt_energy_full_attr = SYSFS_ATTR_INITIALIZER;
+sysfs_attr_t batt_charge_now_attr = SYSFS_ATTR_INITIALIZER;
+sysfs_attr_t batt_charge_full_attr = SYSFS_ATTR_INITIALIZER;
+sysfs_attr_t batt_charge_full_design_attr = SYSFS_ATTR_INITIALIZER;
+sysfs_attr_t batt_temperature_attr = SYSFS_ATTR_INITIALIZER;
+sysfs_attr_t batt_voltage_attr = SYSFS_ATTR_INITIALIZER;
+sysfs_attr_t batt_current_attr = SYSFS_ATTR_INITIALIZER;
+sysfs_attr_t batt_present_attr = SYSFS_ATTR_INITIALIZER;
+sysfs_attr_t batt_current_avg_attr = SYSFS_ATTR_INITIALIZER;
+sysfs_attr_t batt_charge_counter_attr = SYSFS_ATTR_INITIALIZER;
+sysfs_attr_t batt_time_to_empty_attr = SYSFS_ATTR_INITIALIZER;
+sysfs_attr_t batt_time_to_full_attr = SYSFS_ATTR_INITIALIZER;
+/* writable alert nodes, armed so the fuel gauge only wakes us at a threshold */
+sysfs_attr_t batt_capacity_alert_min_attr = SYSFS_ATTR_INITIALIZER;
+sysfs_attr_t batt_alarm_attr = SYSFS_ATTR_INITIALIZER;
+sysfs_attr_t batt_temp_alert_min_attr = SYSFS_ATTR_INITIALIZER;
+sysfs_attr_t batt_temp_alert_max_attr = SYSFS_ATTR_INITIALIZER;
 char batt_fake_battery_path[PATH_LEN] = {0,};
 
+static sysfs_attr_t *const battery_attrs[] =
+{
+	&batt_capacity_attr,
+	&batt_energy_now_attr,
+	&batt_energy_full_attr,
+	&batt_charge_now_attr,
+	&batt_charge_full_attr,
+	&batt_charge_full_design_attr,
+	&batt_temperature_attr,
+	&batt_voltage_attr,
+	&batt_current_attr,
+	&batt_present_attr,
+	&batt_current_avg_attr,
+	&batt_charge_counter_attr,
+	&batt_time_to_empty_attr,
+	&batt_time_to_full_attr,
+};
+
+#define BATTERY_ATTR_COUNT (sizeof(battery_attrs) / sizeof(battery_attrs[0]))
+
+/*
+ * Optional nodes many fuel gauges lack. They are read on every status poll,
+ * so whether they exist is probed once per device in
+ * detect_battery_optional_attrs() rather than by a failing open() each time.
+ */
+bool batt_has_current_avg = false;
+bool batt_has_charge_counter = false;
+bool batt_has_time_to_empty = false;
+bool batt_has_time_to_full = false;
+bool batt_has_charge_full = false;
+
+/*
+ * Ring buffer of current samples, fed by battery uevents and the optional
+ * sample timer, used to report a moving-average current and derive the
+ * time-to-empty/full estimates.
+ */
+#define BATTERY_SAMPLE_COUNT 16
+/* samples older than this no longer count towards the average */
+#define BATTERY_SAMPLE_MAX_AGE_US (5 * 60 * G_USEC_PER_SEC)
+
+typedef struct
+{
+	gint64 timestamp;
+	int32_t current;
+} battery_sample_t;
+
+battery_sample_t battery_samples[BATTERY_SAMPLE_COUNT];
+unsigned int battery_sample_next = 0;
+unsigned int battery_sample_count = 0;
+guint battery_sample_timer = 0;
+
+/*
+ * Notification thresholds. Once a wakeup percentage or a critical voltage is
+ * set, percentage changes alone no longer fire the status callback; it fires
+ * when a threshold is crossed, when the temperature moves between the CTIA
+ * zones, or when the battery is inserted/removed.
+ */
+typedef enum
+{
+	BATTERY_TEMP_UNKNOWN = 0,
+	BATTERY_TEMP_BELOW_CHARGE_MIN,
+	BATTERY_TEMP_NORMAL,
+	BATTERY_TEMP_ABOVE_CHARGE_MAX,
+	BATTERY_TEMP_ABOVE_CRIT_MAX,
+} battery_temp_zone_t;
+
+int battery_wakeup_percent = 0;         /* 0: disabled */
+int battery_critical_voltage_mv = 0;    /* 0: disabled */
+battery_temp_zone_t battery_temp_zone = BATTERY_TEMP_UNKNOWN;
+bool battery_below_wakeup = false;
+bool battery_voltage_critical = false;
+
+/* Which set of nodes battery_percent() reads, resolved once per device */
+typedef enum
+{
+	BATTERY_PERCENT_UNSUPPORTED = 0,
+	BATTERY_PERCENT_CAPACITY,
+	BATTERY_PERCENT_ENERGY,
+	BATTERY_PERCENT_CHARGE,
+} battery_percent_source_t;
+
+battery_percent_source_t battery_percent_source = BATTERY_PERCENT_UNSUPPORTED;
+
 nyx_battery_ctia_t *get_battery_ctia_params(void)
 {
 	battery_ctia_params.charge_min_temp_c = CHARGE_MIN_TEMPERATURE_C;
@@ -84,6 +214,58 @@ nyx_battery_ctia_t *get_battery_ctia_params(void)
 	return &battery_ctia_params;
 }
 
+/**
+ * @brief Probe which nodes the battery exposes for its charge level
+ *
+ * The capacity node is preferred but it's not supported by all power class
+ * devices, so fall back to the energy and then the charge ratio.
+ */
+static void detect_battery_percent_source(void)
+{
+	if (sysfs_attr_exists(&batt_capacity_attr))
+	{
+		battery_percent_source = BATTERY_PERCENT_CAPACITY;
+	}
+	else if (sysfs_attr_exists(&batt_energy_full_attr))
+	{
+		battery_percent_source = BATTERY_PERCENT_ENERGY;
+	}
+	else if (sysfs_attr_exists(&batt_charge_now_attr))
+	{
+		battery_percent_source = BATTERY_PERCENT_CHARGE;
+	}
+	else
+	{
+		battery_percent_source = BATTERY_PERCENT_UNSUPPORTED;
+	}
+}
+
+static void detect_battery_optional_attrs(void)
+{
+	batt_has_current_avg = sysfs_attr_exists(&batt_current_avg_attr);
+	batt_has_charge_counter = sysfs_attr_exists(&batt_charge_counter_attr);
+	batt_has_time_to_empty = sysfs_attr_exists(&batt_time_to_empty_attr);
+	batt_has_time_to_full = sysfs_attr_exists(&batt_time_to_full_attr);
+	batt_has_charge_full = sysfs_attr_exists(&batt_charge_full_attr);
+}
+
+static int battery_ratio_percent(sysfs_attr_t *now_attr, sysfs_attr_t *full_attr)
+{
+	int now, full;
+
+	if ((now = sysfs_attr_read_value(now_attr)) < 0)
+	{
+		return -1;
+	}
+
+	if ((full = sysfs_attr_read_value(full_attr)) <= 0)
+	{
+		return -1;
+	}
+
+	return (100 * now / full);
+}
+
 /**
  * @brief Read battery percentage
  *
@@ -91,51 +273,22 @@ nyx_battery_ctia_t *get_battery_ctia_params(void)
  */
 int battery_percent(void)
 {
-	int now, full;
-	int capacity;
-
 	// TODO: Might first confirm that battery is present?
 
-	/* try capacity node first but keep in mind it's not supported by all power class devices */
-	if ((capacity = nyx_utils_read_value(batt_capacity_path)) < 0)
+	switch (battery_percent_source)
 	{
-		/* capacity node is not available so next try is energy_full path */
-		if (g_file_test(batt_energy_full_path, G_FILE_TEST_EXISTS))
-		{
-			if ((now = nyx_utils_read_value(batt_energy_now_path)) < 0)
-			{
-				return -1;
-			}
+		case BATTERY_PERCENT_CAPACITY:
+			return sysfs_attr_read_value(&batt_capacity_attr);
 
-			if ((full = nyx_utils_read_value(batt_energy_full_path)) < 0)
-			{
-				return -1;
-			}
+		case BATTERY_PERCENT_ENERGY:
+			return battery_ratio_percent(&batt_energy_now_attr, &batt_energy_full_attr);
 
-			capacity = (100 * now / full);
-		}
-		/* as last try we can use charge_now path */
-		else if (g_file_test(batt_charge_now_path, G_FILE_TEST_EXISTS))
-		{
-			if ((full = nyx_utils_read_value(batt_charge_full_path)) < 0)
-			{
-				return -1;
-			}
+		case BATTERY_PERCENT_CHARGE:
+			return battery_ratio_percent(&batt_charge_now_attr, &batt_charge_full_attr);
 
-			if ((now = nyx_utils_read_value(batt_charge_now_path)) < 0)
-			{
-				return -1;
-			}
-
-			capacity = (100 * now / full);
-		}
-		else
-		{
+		default:
 			return -1;
-		}
 	}
-
-	return capacity;
 }
 
 /**
@@ -147,7 +300,7 @@ int battery_temperature(void)
 {
 	int temp;
 
-	if ((temp = nyx_utils_read_value(batt_temperature_path)) < 0)
+	if ((temp = sysfs_attr_read_value(&batt_temperature_attr)) < 0)
 	{
 		return -1;
 	}
@@ -165,7 +318,7 @@ int battery_voltage(void)
 {
 	int voltage;
 
-	if ((voltage = nyx_utils_read_value(batt_voltage_path)) < 0)
+	if ((voltage = sysfs_attr_read_value(&batt_voltage_attr)) < 0)
 	{
 		return -1;
 	}
@@ -174,15 +327,15 @@ int battery_voltage(void)
 }
 
 /**
- * @brief Read the amount of current being drawn by the battery (negative = charging!)
+ * @brief Read the current flowing into the battery (positive = charging)
  *
- * @retval Current (integer)
+ * @retval Current (integer), or -1 on error or while discharging
  */
 int battery_current(void)
 {
 	signed int current;
 
-	if ((current = nyx_utils_read_value(batt_current_path)) < 0)
+	if ((current = sysfs_attr_read_value(&batt_current_attr)) < 0)
 	{
 		return -1;
 	}
@@ -190,16 +343,142 @@ int battery_current(void)
 	return current;
 }
 
+static void battery_add_sample(int32_t current)
+{
+	battery_samples[battery_sample_next].timestamp = g_get_monotonic_time();
+	battery_samples[battery_sample_next].current = current;
+
+	battery_sample_next = (battery_sample_next + 1) % BATTERY_SAMPLE_COUNT;
+
+	if (battery_sample_count < BATTERY_SAMPLE_COUNT)
+	{
+		battery_sample_count++;
+	}
+}
+
+static void battery_sample_current(void)
+{
+	int32_t current;
+
+	if (sysfs_attr_read_int(&batt_current_attr, &current))
+	{
+		battery_add_sample(current);
+	}
+}
+
+static void battery_reset_samples(void)
+{
+	battery_sample_next = 0;
+	battery_sample_count = 0;
+}
+
 /**
- * @brief Read average current being drawn by the battery.
+ * @brief Mean of the recent current samples
  *
- * @retval Current (integer)
+ * @retval false if there is no sample younger than BATTERY_SAMPLE_MAX_AGE_US
  */
+static bool battery_sampled_avg_current(int32_t *avg)
+{
+	gint64 now = g_get_monotonic_time();
+	int64_t sum = 0;
+	unsigned int used = 0;
+	unsigned int i;
 
+	for (i = 0; i < battery_sample_count; i++)
+	{
+		if (now - battery_samples[i].timestamp <= BATTERY_SAMPLE_MAX_AGE_US)
+		{
+			sum += battery_samples[i].current;
+			used++;
+		}
+	}
+
+	if (0 == used)
+	{
+		return false;
+	}
+
+	*avg = (int32_t)(sum / used);
+	return true;
+}
+
+/**
+ * @brief Average current flowing into the battery, positive while charging
+ *
+ * Prefers the fuel gauge's own average, then the recent samples and finally
+ * the instantaneous current, read unclamped.
+ *
+ * @retval false if none of them could be read
+ */
+static bool battery_read_avg_current(int32_t *avg)
+{
+	if (batt_has_current_avg && sysfs_attr_read_int(&batt_current_avg_attr, avg))
+	{
+		return true;
+	}
+
+	if (battery_sampled_avg_current(avg))
+	{
+		return true;
+	}
+
+	return sysfs_attr_read_int(&batt_current_attr, avg);
+}
+
+/**
+ * @brief Read average current flowing into the battery (positive = charging)
+ *
+ * @retval Current (integer), or -1 if it can't be read
+ */
 int battery_avg_current(void)
 {
-	// return battery_current for this device unless we have a way to separately read "average" current
-	return battery_current();
+	int32_t avg;
+
+	if (!battery_read_avg_current(&avg))
+	{
+		return -1;
+	}
+
+	return avg;
+}
+
+/* Seconds to move charge_uah at current_ua, or -1 if that does not fit */
+static int battery_charge_seconds(int32_t charge_uah, int32_t current_ua)
+{
+	int64_t seconds = (int64_t) charge_uah * 3600 / current_ua;
+
+	return (seconds > INT_MAX) ? -1 : (int) seconds;
+}
+
+static gboolean battery_sample_timeout(gpointer data)
+{
+	PERF_COUNTER_INC(battery_counters[BATTERY_COUNTER_TIMER_WAKEUPS]);
+
+	if (battery_is_present())
+	{
+		battery_sample_current();
+	}
+
+	return TRUE;
+}
+
+/**
+ * @brief Sample the battery current every interval_s seconds in addition to
+ * the uevent driven samples; 0 stops the timer
+ */
+void battery_set_sample_interval(unsigned int interval_s)
+{
+	if (0 != battery_sample_timer)
+	{
+		g_source_remove(battery_sample_timer);
+		battery_sample_timer = 0;
+	}
+
+	if (interval_s > 0)
+	{
+		battery_sample_timer = g_timeout_add_seconds(interval_s,
+		                       battery_sample_timeout, NULL);
+	}
 }
 
 /**
@@ -211,10 +490,10 @@ double battery_full40(void)
 {
 	int charge_full;
 
-	if (!g_file_test(batt_charge_full_path, G_FILE_TEST_EXISTS) ||
-	        ((charge_full = nyx_utils_read_value(batt_charge_full_path)) < 0))
+	if (!batt_has_charge_full ||
+	        ((charge_full = sysfs_attr_read_value(&batt_charge_full_attr)) < 0))
 	{
-		if ((charge_full = nyx_utils_read_value(batt_charge_full_design_path)) < 0)
+		if ((charge_full = sysfs_attr_read_value(&batt_charge_full_design_attr)) < 0)
 		{
 			return -1;
 		}
@@ -232,7 +511,18 @@ double battery_full40(void)
 
 double battery_rawcoulomb(void)
 {
-	return -1;
+	int charge;
+
+	/* charge_counter is the unfiltered coulomb counter, charge_now may be compensated */
+	if ((!batt_has_charge_counter ||
+	        (charge = sysfs_attr_read_value(&batt_charge_counter_attr)) < 0) &&
+	        (charge = sysfs_attr_read_value(&batt_charge_now_attr)) < 0)
+	{
+		return -1;
+	}
+
+	/* Divide the value by 1000 to convert from uAh to mAh */
+	return (double) charge / 1000;
 }
 
 /**
@@ -245,7 +535,7 @@ double battery_coulomb(void)
 {
 	int charge_now;
 
-	if ((charge_now = nyx_utils_read_value(batt_charge_now_path)) < 0)
+	if ((charge_now = sysfs_attr_read_value(&batt_charge_now_attr)) < 0)
 	{
 		return -1;
 	}
@@ -261,14 +551,84 @@ double battery_coulomb(void)
  */
 double battery_age(void)
 {
-	return -1;
+	int full, design;
+
+	if ((full = sysfs_attr_read_value(&batt_charge_full_attr)) < 0 ||
+	        (design = sysfs_attr_read_value(&batt_charge_full_design_attr)) <= 0)
+	{
+		return -1;
+	}
+
+	/* remaining capacity relative to the designed capacity, in percent */
+	return (100.0 * full) / design;
+}
+
+/**
+ * @brief Estimate the time until the battery is empty
+ *
+ * @retval Seconds, or -1 if the battery is not discharging or it can't be
+ * estimated
+ */
+int battery_time_to_empty(void)
+{
+	int32_t seconds;
+	int32_t avg;
+	int charge_now;
+
+	if (batt_has_time_to_empty &&
+	        sysfs_attr_read_int(&batt_time_to_empty_attr, &seconds))
+	{
+		return seconds;
+	}
+
+	/* a positive current means charging, see battery_read_status() */
+	if (!battery_read_avg_current(&avg) || avg >= 0 ||
+	        (charge_now = sysfs_attr_read_value(&batt_charge_now_attr)) < 0)
+	{
+		return -1;
+	}
+
+	return battery_charge_seconds(charge_now, -avg);
+}
+
+/**
+ * @brief Estimate the time until the battery is full
+ *
+ * @retval Seconds, or -1 if the battery is not charging or it can't be
+ * estimated
+ */
+int battery_time_to_full(void)
+{
+	int32_t seconds;
+	int32_t avg;
+	int charge_now, charge_full;
+
+	if (batt_has_time_to_full &&
+	        sysfs_attr_read_int(&batt_time_to_full_attr, &seconds))
+	{
+		return seconds;
+	}
+
+	if (!battery_read_avg_current(&avg) || avg <= 0 ||
+	        (charge_now = sysfs_attr_read_value(&batt_charge_now_attr)) < 0 ||
+	        (charge_full = sysfs_attr_read_value(&batt_charge_full_attr)) < 0)
+	{
+		return -1;
+	}
+
+	if (charge_now >= charge_full)
+	{
+		return 0;
+	}
+
+	return battery_charge_seconds(charge_full - charge_now, avg);
 }
 
 bool battery_is_present(void)
 {
 	int present;
 
-	if ((present = nyx_utils_read_value(batt_present_path)) < 0)
+	if ((present = sysfs_attr_read_value(&batt_present_attr)) < 0)
 	{
 		return false;
 	}
@@ -276,170 +636,603 @@ bool battery_is_present(void)
 	return (1 == present);
 }
 
-gboolean _handle_event(GIOChannel *channel, GIOCondition condition,
-                       gpointer data)
+static void battery_open_attrs(void)
 {
-	struct udev_device *dev;
+	size_t i;
 
-	if ((condition  & G_IO_IN) == G_IO_IN)
+	for (i = 0; i < BATTERY_ATTR_COUNT; i++)
 	{
-		dev = udev_monitor_receive_device(mon);
+		sysfs_attr_open(battery_attrs[i]);
+	}
+}
 
-		if (dev)
-		{
-			/*Initiate callback only if battery percentage or present parameters change*/
-			int prev_battery_percentage = current_battery_percentage;
-			bool prev_battery_present = current_battery_present;
-
-			current_battery_present = battery_is_present();
-			current_battery_percentage = current_battery_present ? battery_percent() : 0;
-
-			if ((current_battery_present != prev_battery_present) ||
-			        (current_battery_percentage != prev_battery_percentage))
-			{
-				if (battery_callback != NULL)
-				{
-					battery_callback(nyxDev, NYX_CALLBACK_STATUS_DONE, battery_callback_context);
-				}
-			}
-		}
-		else
-		{
-			if (battery_callback != NULL)
-			{
-				battery_callback(nyxDev, NYX_CALLBACK_STATUS_DONE, battery_callback_context);
-			}
-		}
+static void battery_close_attrs(void)
+{
+	size_t i;
+
+	for (i = 0; i < BATTERY_ATTR_COUNT; i++)
+	{
+		sysfs_attr_close(battery_attrs[i]);
 	}
+}
 
-	return TRUE;
+/**
+ * @brief Check whether a uevent belongs to the battery supply we are reading
+ */
+static bool is_battery_device(const power_supply_t *supply)
+{
+	const char *name;
+
+	if (!battery_sysfs_path)
+	{
+		return false;
+	}
+
+	name = strrchr(battery_sysfs_path, '/');
+	name = name ? name + 1 : battery_sysfs_path;
+
+	return (strcmp(supply->name, name) == 0);
 }
 
-static void detect_battery_sysfs_paths()
+/**
+ * @brief Drop or refresh the cached attribute fds when the battery supply
+ * itself is removed or re-added
+ */
+static void battery_handle_hotplug(const power_supply_t *supply)
 {
-	battery_sysfs_path = find_power_supply_sysfs_path("Battery");
+	const char *action = supply->action;
 
-	if (battery_sysfs_path)
+	if (!is_battery_device(supply))
 	{
-		snprintf(batt_capacity_path, PATH_LEN, "%s/capacity", battery_sysfs_path);
-		snprintf(batt_energy_now_path, PATH_LEN, "%s/energy_now", battery_sysfs_path);
-		snprintf(batt_energy_full_path, PATH_LEN, "%s/energy_full", battery_sysfs_path);
-		snprintf(batt_charge_now_path, PATH_LEN, "%s/charge_now", battery_sysfs_path);
-		snprintf(batt_charge_full_path, PATH_LEN, "%s/charge_full", battery_sysfs_path);
-		snprintf(batt_charge_full_design_path, PATH_LEN, "%s/charge_full_design",
-		         battery_sysfs_path);
-		snprintf(batt_temperature_path, PATH_LEN, "%s/temp", battery_sysfs_path);
-		snprintf(batt_voltage_path, PATH_LEN, "%s/voltage_now", battery_sysfs_path);
-		snprintf(batt_current_path, PATH_LEN, "%s/current_now", battery_sysfs_path);
-		snprintf(batt_present_path, PATH_LEN, "%s/present", battery_sysfs_path);
-		snprintf(batt_fake_battery_path, PATH_LEN, "%s/pseudo_batt",
-		         battery_sysfs_path);
+		return;
+	}
+
+	if (strcmp(action, "remove") == 0)
+	{
+		battery_close_attrs();
+	}
+	else if (strcmp(action, "add") == 0)
+	{
+		battery_close_attrs();
+		battery_open_attrs();
+		detect_battery_percent_source();
+		detect_battery_optional_attrs();
+	}
+	else if (strcmp(action, "change") == 0)
+	{
+		detect_battery_percent_source();
 	}
 }
 
-static void battery_cleanup(void)
+static int32_t uevent_ratio_percent(const power_supply_t *supply,
+                                    const char *now_name, const char *full_name)
+{
+	int32_t now, full;
+
+	if (!power_supply_property_int(supply, now_name, &now) ||
+	        !power_supply_property_int(supply, full_name, &full))
+	{
+		return battery_percent();
+	}
+
+	if (now < 0 || full <= 0)
+	{
+		return -1;
+	}
+
+	return (100 * now / full);
+}
+
+/**
+ * @brief Fill a battery status from the POWER_SUPPLY_* properties of a
+ * battery uevent
+ *
+ * Values the driver did not put into the uevent are read from sysfs as
+ * usual. Returns false if the uevent carries no battery properties at all
+ * (e.g. a remove event), in which case nothing is filled.
+ */
+static bool battery_status_from_uevent(const power_supply_t *supply,
+                                       nyx_battery_status_t *state)
 {
-	// battery_init sets g_io_channel_set_close_on_unref, and calls g_io_channel_unref.
-	// This leaves one ref associated with the watch, so removing the watch should close the channel.
-	if (0 != watch)
+	int32_t val;
+	int32_t full_design;
+
+	if (!power_supply_property_int(supply, "PRESENT", &val))
 	{
-		g_source_remove(watch);
-		watch = 0;
+		return false;
 	}
 
-	if (NULL != mon)
+	memset(state, 0, sizeof(nyx_battery_status_t));
+	state->present = (1 == val);
+
+	if (!state->present)
 	{
-		udev_monitor_filter_remove(mon);
-		mon = NULL;
+		state->charging = false;
+		return true;
 	}
 
-	if (NULL != udev)
+	switch (battery_percent_source)
 	{
-		udev_unref(udev);
-		udev = NULL;
+		case BATTERY_PERCENT_CAPACITY:
+			state->percentage = power_supply_property_int(supply, "CAPACITY", &val) ?
+			                    val : battery_percent();
+			break;
+
+		case BATTERY_PERCENT_ENERGY:
+			state->percentage = uevent_ratio_percent(supply, "ENERGY_NOW", "ENERGY_FULL");
+			break;
+
+		case BATTERY_PERCENT_CHARGE:
+			state->percentage = uevent_ratio_percent(supply, "CHARGE_NOW", "CHARGE_FULL");
+			break;
+
+		default:
+			state->percentage = -1;
+			break;
 	}
 
-	return;
+	state->temperature = power_supply_property_int(supply, "TEMP", &val) ?
+	                     val : battery_temperature();
+	state->voltage = power_supply_property_int(supply, "VOLTAGE_NOW", &val) ?
+	                 val : battery_voltage();
+	if (power_supply_property_int(supply, "CURRENT_NOW", &val))
+	{
+		state->current = val;
+		battery_add_sample(val);
+	}
+	else
+	{
+		state->current = battery_current();
+	}
+
+	if (power_supply_property_int(supply, "CURRENT_AVG", &val))
+	{
+		state->avg_current = val;
+	}
+	else if (!battery_sampled_avg_current(&state->avg_current))
+	{
+		state->avg_current = state->current;
+	}
+
+	state->capacity = power_supply_property_int(supply, "CHARGE_NOW", &val) ?
+	                  (double) val / 1000 : battery_coulomb();
+	if (power_supply_property_int(supply, "CHARGE_COUNTER", &val) ||
+	        power_supply_property_int(supply, "CHARGE_NOW", &val))
+	{
+		state->capacity_raw = (double) val / 1000;
+	}
+	else
+	{
+		state->capacity_raw = battery_rawcoulomb();
+	}
+
+	if (power_supply_property_int(supply, "CHARGE_FULL", &val) ||
+	        power_supply_property_int(supply, "CHARGE_FULL_DESIGN", &val))
+	{
+		state->capacity_full40 = (double) val / 1000;
+	}
+	else
+	{
+		state->capacity_full40 = battery_full40();
+	}
+
+	if (power_supply_property_int(supply, "CHARGE_FULL", &val) &&
+	        power_supply_property_int(supply, "CHARGE_FULL_DESIGN", &full_design) &&
+	        full_design > 0)
+	{
+		state->age = (100.0 * val) / full_design;
+	}
+	else
+	{
+		state->age = battery_age();
+	}
+
+	state->charging = (state->avg_current > 0);
+
+	return true;
 }
 
-nyx_error_t battery_init(void)
+/**
+ * @brief Return the status decoded from the uevent being dispatched
+ *
+ * Only valid from within the battery status callback; returns false
+ * otherwise so the caller reads sysfs.
+ */
+bool battery_get_event_status(nyx_battery_status_t *state)
 {
-	int fd;
-	GIOChannel *channel = NULL;
+	if (!battery_event_state_valid || !state)
+	{
+		return false;
+	}
 
-	udev = udev_new();
+	memcpy(state, &battery_event_state, sizeof(nyx_battery_status_t));
+	return true;
+}
+
+static bool battery_thresholds_enabled(void)
+{
+	return (battery_wakeup_percent > 0) || (battery_critical_voltage_mv > 0);
+}
 
-	if (!udev)
+/* temperatures are in tenths of a degree Celsius, the CTIA limits in degrees */
+static battery_temp_zone_t battery_temp_zone_of(int temperature)
+{
+	nyx_battery_ctia_t *ctia = get_battery_ctia_params();
+
+	if (temperature >= ctia->battery_crit_max_temp * 10)
 	{
-		nyx_error(MSGID_NYX_MOD_UDEV_ERR, 0 ,
-		          "Could not initialize udev component; battery status updates will not be available");
-		return NYX_ERROR_GENERIC;
+		return BATTERY_TEMP_ABOVE_CRIT_MAX;
 	}
 
-	/*Initialize the sysfs paths*/
-	detect_battery_sysfs_paths();
+	if (temperature > ctia->charge_max_temp_c * 10)
+	{
+		return BATTERY_TEMP_ABOVE_CHARGE_MAX;
+	}
 
-	// initialize current battery present/percentage values
-	current_battery_present = battery_is_present();
-	current_battery_percentage = current_battery_present ? battery_percent() : 0;
+	if (temperature < ctia->charge_min_temp_c * 10)
+	{
+		return BATTERY_TEMP_BELOW_CHARGE_MIN;
+	}
 
-	mon = udev_monitor_new_from_netlink(udev, "kernel");
+	return BATTERY_TEMP_NORMAL;
+}
 
-	if (mon == NULL)
+/**
+ * @brief Arm the fuel gauge's temperature alerts at the edges of the zone
+ * we are in, so the next uevent is the one leaving it
+ */
+static void battery_arm_temp_alerts(battery_temp_zone_t zone)
+{
+	nyx_battery_ctia_t *ctia = get_battery_ctia_params();
+	int limits[] =
 	{
-		nyx_error(MSGID_NYX_MOD_UDEV_MONITOR_ERR, 0,
-		          "Failed to create udev monitor for kernel events");
-		battery_cleanup();
-		return NYX_ERROR_GENERIC;
+		ctia->charge_min_temp_c * 10,
+		ctia->charge_max_temp_c * 10,
+		ctia->battery_crit_max_temp * 10,
+	};
+	/* zone n (1-based) lies between limits[n - 2] and limits[n - 1] */
+	int lower = (int)zone - 2;
+	int upper = (int)zone - 1;
+
+	if (BATTERY_TEMP_UNKNOWN == zone)
+	{
+		return;
 	}
 
-	if (udev_monitor_filter_add_match_subsystem_devtype(mon, "power_supply",
-	        NULL) < 0)
+	if (lower >= 0 && sysfs_attr_exists(&batt_temp_alert_min_attr))
 	{
-		nyx_error(MSGID_NYX_MOD_UDEV_SUBSYSTEM_ERR, 0,
-		          "Failed to setup udev filter for power_supply subsytem events");
-		battery_cleanup();
-		return NYX_ERROR_GENERIC;
+		sysfs_attr_write_int(&batt_temp_alert_min_attr, limits[lower]);
 	}
 
-	if (udev_monitor_enable_receiving(mon) < 0)
+	if (upper < (int)(sizeof(limits) / sizeof(limits[0])) &&
+	        sysfs_attr_exists(&batt_temp_alert_max_attr))
 	{
-		nyx_error(MSGID_NYX_MOD_UDEV_RECV_ERR, 0,
-		          "Failed to enable receiving kernel events for power_supply subsytem\n");
-		battery_cleanup();
-		return NYX_ERROR_GENERIC;
+		sysfs_attr_write_int(&batt_temp_alert_max_attr, limits[upper]);
 	}
+}
+
+/**
+ * @brief Arm the fuel gauge's low capacity alert at the wakeup percentage
+ *
+ * capacity_alert_min takes a percentage; the older alarm node takes a level
+ * in the units of charge_now or energy_now.
+ */
+static void battery_arm_capacity_alert(void)
+{
+	int full;
 
-	/* Setup io watch for uevents */
-	fd = udev_monitor_get_fd(mon);
+	if (sysfs_attr_exists(&batt_capacity_alert_min_attr))
+	{
+		sysfs_attr_write_int(&batt_capacity_alert_min_attr, battery_wakeup_percent);
+		return;
+	}
 
-	if (-1 == fd)
+	if (!sysfs_attr_exists(&batt_alarm_attr))
 	{
-		battery_cleanup();
-		return NYX_ERROR_GENERIC;
+		return;
 	}
 
-	channel = g_io_channel_unix_new(fd);
+	full = (BATTERY_PERCENT_ENERGY == battery_percent_source) ?
+	       sysfs_attr_read_value(&batt_energy_full_attr) :
+	       sysfs_attr_read_value(&batt_charge_full_attr);
 
-	if (!channel)
+	if (full > 0)
 	{
-		battery_cleanup();
-		return NYX_ERROR_GENERIC;
+		sysfs_attr_write_int(&batt_alarm_attr,
+		                     (int32_t)((int64_t) full * battery_wakeup_percent / 100));
 	}
+}
 
-	/* add watch event (which adds a ref) before calling g_io_channel_unref */
-	watch = g_io_add_watch(channel, G_IO_IN | G_IO_HUP | G_IO_NVAL, _handle_event,
-	                       NULL);
+/**
+ * @brief Track the threshold state for a new reading
+ *
+ * @retval true if any threshold was crossed
+ */
+static bool battery_thresholds_crossed(int percentage, int temperature,
+                                       int voltage)
+{
+	battery_temp_zone_t zone = battery_temp_zone_of(temperature);
+	bool below_wakeup = (battery_wakeup_percent > 0) && (percentage >= 0) &&
+	                    (percentage <= battery_wakeup_percent);
+	/* voltages are in uV */
+	bool voltage_critical = (battery_critical_voltage_mv > 0) && (voltage > 0) &&
+	                        (voltage / 1000 < battery_critical_voltage_mv);
+	bool crossed = false;
+
+	if (zone != battery_temp_zone)
+	{
+		/* the first reading only establishes the zone */
+		crossed = (BATTERY_TEMP_UNKNOWN != battery_temp_zone);
+		battery_temp_zone = zone;
+		battery_arm_temp_alerts(zone);
+	}
+
+	if (below_wakeup != battery_below_wakeup)
+	{
+		battery_below_wakeup = below_wakeup;
+		crossed = true;
+	}
+
+	if (voltage_critical != battery_voltage_critical)
+	{
+		battery_voltage_critical = voltage_critical;
+		crossed = true;
+	}
+
+	return crossed;
+}
 
-	/* Remove the ref from g_io_channel_unix_new so we won't leak the channel if g_io_add_watch failed */
-	/* watch holds another ref which is removed in battery_cleanup */
-	g_io_channel_set_close_on_unref(channel, TRUE);
-	g_io_channel_unref(channel);
+/**
+ * @brief Apply a new reading and decide whether the status callback fires
+ */
+static void battery_note_reading(bool present, int percentage, int temperature,
+                                 int voltage)
+{
+	int prev_battery_percentage = current_battery_percentage;
+	bool prev_battery_present = current_battery_present;
+	bool crossed = false;
+
+	current_battery_present = present;
+	current_battery_percentage = present ? percentage : 0;
+
+	if (present)
+	{
+		crossed = battery_thresholds_crossed(percentage, temperature, voltage);
+	}
+
+	if ((current_battery_present != prev_battery_present) || crossed ||
+	        (!battery_thresholds_enabled() &&
+	         (current_battery_percentage != prev_battery_percentage)))
+	{
+		battery_callback_pending = true;
+	}
+}
+
+static void battery_update_present_percent(void)
+{
+	bool present = battery_is_present();
 
-	if (0 == watch)
+	if (present)
 	{
+		battery_sample_current();
+		battery_note_reading(true, battery_percent(), battery_temperature(),
+		                     battery_critical_voltage_mv > 0 ? battery_voltage() : -1);
+	}
+	else
+	{
+		battery_note_reading(false, 0, 0, -1);
+	}
+}
+
+/**
+ * @brief Do the deferred sysfs re-read, if any, and fire the pending callback
+ */
+static void battery_flush_events(void)
+{
+	if (battery_reread_pending)
+	{
+		battery_reread_pending = false;
+		battery_event_state_fresh = false;
+		PERF_COUNTER_INC(battery_counters[BATTERY_COUNTER_REREADS]);
+		battery_update_present_percent();
+	}
+
+	if (battery_callback_pending)
+	{
+		battery_callback_pending = false;
+
+		if (battery_callback != NULL)
+		{
+			battery_event_state_valid = battery_event_state_fresh;
+			PERF_COUNTER_INC(battery_counters[BATTERY_COUNTER_CALLBACKS]);
+			battery_callback(nyxDev, NYX_CALLBACK_STATUS_DONE, battery_callback_context);
+			battery_event_state_valid = false;
+		}
+	}
+
+	battery_event_state_fresh = false;
+}
+
+static gboolean battery_coalesce_timeout(gpointer data)
+{
+	PERF_COUNTER_INC(battery_counters[BATTERY_COUNTER_TIMER_WAKEUPS]);
+	battery_coalesce_timer = 0;
+	battery_flush_events();
+
+	return FALSE;
+}
+
+void _handle_event(const power_supply_t *supply, void *context)
+{
+	PERF_TRACE(nyx_battery, handle_event__entry, supply ? supply->name : NULL);
+	PERF_COUNTER_INC(battery_counters[BATTERY_COUNTER_UEVENTS]);
+
+	if (supply)
+	{
+		battery_handle_hotplug(supply);
+
+		if (is_battery_device(supply) &&
+		        battery_status_from_uevent(supply, &battery_event_state))
+		{
+			PERF_COUNTER_INC(battery_counters[BATTERY_COUNTER_UEVENTS_DECODED]);
+			/* decoded values are applied per uevent so no change is missed */
+			battery_event_state_fresh = true;
+			battery_note_reading(battery_event_state.present,
+			                     battery_event_state.percentage,
+			                     battery_event_state.temperature,
+			                     battery_event_state.voltage);
+		}
+		else
+		{
+			battery_reread_pending = true;
+		}
+	}
+	else
+	{
+		battery_callback_pending = true;
+	}
+
+	if (0 == battery_coalesce_ms)
+	{
+		battery_flush_events();
+	}
+	else if (0 == battery_coalesce_timer)
+	{
+		battery_coalesce_timer = g_timeout_add(battery_coalesce_ms,
+		                                       battery_coalesce_timeout, NULL);
+	}
+
+	PERF_TRACE(nyx_battery, handle_event__return);
+}
+
+/**
+ * @brief Set the window in ms over which uevents are coalesced; 0 disables
+ * coalescing and flushes anything pending
+ */
+void battery_set_coalesce_ms(unsigned int window_ms)
+{
+	battery_coalesce_ms = window_ms;
+
+	if (0 == window_ms && 0 != battery_coalesce_timer)
+	{
+		g_source_remove(battery_coalesce_timer);
+		battery_coalesce_timer = 0;
+		battery_flush_events();
+	}
+}
+
+/**
+ * @brief Copy the runtime counters, see perf_counters_read()
+ */
+nyx_error_t battery_read_counters(nyx_perf_counter_t *counters, int *count)
+{
+	PERF_COUNTER_SET(battery_counters[BATTERY_COUNTER_SYSFS_READS],
+	                 sysfs_attr_read_count());
+
+	return perf_counters_read(battery_counter_names, battery_counters,
+	                          BATTERY_COUNTER_COUNT, counters, count);
+}
+
+static void detect_battery_sysfs_paths()
+{
+	battery_sysfs_path = find_power_supply_sysfs_path("Battery");
+
+	if (battery_sysfs_path)
+	{
+		sysfs_attr_init(&batt_capacity_attr, battery_sysfs_path, "capacity");
+		sysfs_attr_init(&batt_energy_now_attr, battery_sysfs_path, "energy_now");
+		sysfs_attr_init(&batt_energy_full_attr, battery_sysfs_path, "energy_full");
+		sysfs_attr_init(&batt_charge_now_attr, battery_sysfs_path, "charge_now");
+		sysfs_attr_init(&batt_charge_full_attr, battery_sysfs_path, "charge_full");
+		sysfs_attr_init(&batt_charge_full_design_attr, battery_sysfs_path,
+		                "charge_full_design");
+		sysfs_attr_init(&batt_temperature_attr, battery_sysfs_path, "temp");
+		sysfs_attr_init(&batt_voltage_attr, battery_sysfs_path, "voltage_now");
+		sysfs_attr_init(&batt_current_attr, battery_sysfs_path, "current_now");
+		sysfs_attr_init(&batt_present_attr, battery_sysfs_path, "present");
+		sysfs_attr_init(&batt_current_avg_attr, battery_sysfs_path, "current_avg");
+		sysfs_attr_init(&batt_charge_counter_attr, battery_sysfs_path,
+		                "charge_counter");
+		sysfs_attr_init(&batt_time_to_empty_attr, battery_sysfs_path,
+		                "time_to_empty_now");
+		sysfs_attr_init(&batt_time_to_full_attr, battery_sysfs_path,
+		                "time_to_full_now");
+		sysfs_attr_init(&batt_capacity_alert_min_attr, battery_sysfs_path,
+		                "capacity_alert_min");
+		sysfs_attr_init(&batt_alarm_attr, battery_sysfs_path, "alarm");
+		sysfs_attr_init(&batt_temp_alert_min_attr, battery_sysfs_path,
+		                "temp_alert_min");
+		sysfs_attr_init(&batt_temp_alert_max_attr, battery_sysfs_path,
+		                "temp_alert_max");
+		snprintf(batt_fake_battery_path, PATH_LEN, "%s/pseudo_batt",
+		         battery_sysfs_path);
+
+		battery_open_attrs();
+	}
+
+	detect_battery_percent_source();
+	detect_battery_optional_attrs();
+}
+
+static void battery_cleanup(void)
+{
+	if (0 != power_supply_subscription)
+	{
+		power_supply_unsubscribe(power_supply_subscription);
+		power_supply_subscription = 0;
+	}
+
+	if (0 != battery_coalesce_timer)
+	{
+		g_source_remove(battery_coalesce_timer);
+		battery_coalesce_timer = 0;
+	}
+
+	battery_reread_pending = false;
+	battery_callback_pending = false;
+
+	battery_set_sample_interval(0);
+	battery_reset_samples();
+
+	battery_wakeup_percent = 0;
+	battery_critical_voltage_mv = 0;
+	power_supply_set_critical_voltage_mv(0);
+	battery_temp_zone = BATTERY_TEMP_UNKNOWN;
+	battery_below_wakeup = false;
+	battery_voltage_critical = false;
+	sysfs_attr_close(&batt_capacity_alert_min_attr);
+	sysfs_attr_close(&batt_alarm_attr);
+	sysfs_attr_close(&batt_temp_alert_min_attr);
+	sysfs_attr_close(&batt_temp_alert_max_attr);
+
+	battery_close_attrs();
+
+	battery_sysfs_path = NULL;
+	release_power_supply_sysfs_paths();
+
+	return;
+}
+
+nyx_error_t battery_init(void)
+{
+	nyx_error_t error;
+
+	/*Initialize the sysfs paths*/
+	detect_battery_sysfs_paths();
+
+	// initialize current battery present/percentage values and the temperature zone
+	battery_update_present_percent();
+	battery_callback_pending = false;
+
+	/* uevents come from the power supply monitor shared with the charger module */
+	error = power_supply_subscribe(_handle_event, NULL, &power_supply_subscription);
+
+	if (NYX_ERROR_NONE != error)
+	{
+		nyx_error(MSGID_NYX_MOD_UDEV_MONITOR_ERR, 0,
+		          "Failed to subscribe to power_supply events; battery status updates will not be available");
 		battery_cleanup();
-		return NYX_ERROR_GENERIC;
+		return error;
 	}
 
 	return NYX_ERROR_NONE;
@@ -467,10 +1260,32 @@ bool battery_authenticate(void)
 	return true;
 }
 
+/**
+ * @brief Fire the status callback when the charge drops to or rises above
+ * percentage instead of on every change; 0 disables the threshold
+ */
 void battery_set_wakeup_percent(int percentage)
 {
-	/* not supported */
-	return;
+	battery_wakeup_percent = percentage;
+	battery_below_wakeup = (percentage > 0) &&
+	                       (current_battery_percentage <= percentage);
+
+	battery_arm_capacity_alert();
+}
+
+/**
+ * @brief Fire the status callback when the voltage drops below voltage_mv
+ * or recovers; 0 disables the threshold
+ */
+void battery_set_critical_voltage_mv(int voltage_mv)
+{
+	int voltage;
+
+	battery_critical_voltage_mv = voltage_mv;
+	power_supply_set_critical_voltage_mv(voltage_mv);
+	voltage = battery_voltage();
+	battery_voltage_critical = (voltage_mv > 0) && (voltage > 0) &&
+	                           (voltage / 1000 < voltage_mv);
 }
 
 void battery_set_fakemode(bool enable)
@@ -23,6 +23,7 @@
 
 #include <nyx/common/nyx_error.h>
 #include <nyx/common/nyx_battery_common.h>
+#include "perf_counters.h"
 
 // These functions are implemented in device/battery.c or emulator/fake_battery.c
 
@@ -42,10 +43,24 @@ double battery_rawcoulomb(void);
 double battery_coulomb(void);
 double battery_age(void);
 bool battery_is_present(void);
+bool battery_get_event_status(nyx_battery_status_t *state);
+
+// called by battery_get_time_estimates() in batterylib.c, in seconds or -1
+int battery_time_to_empty(void);
+int battery_time_to_full(void);
 
 // not currently supported by device/battery.c or emulator/fake_battery.c (stub implementations)
 bool battery_authenticate(void);
+
+// notification thresholds, see battery_set_wakeup_percentage() in batterylib.c
 void battery_set_wakeup_percent(int);
+void battery_set_critical_voltage_mv(int voltage_mv);
+
+void battery_set_coalesce_ms(unsigned int window_ms);
+void battery_set_sample_interval(unsigned int interval_s);
+
+// runtime counters, see battery_query_counters() in batterylib.c
+nyx_error_t battery_read_counters(nyx_perf_counter_t *counters, int *count);
 
 void battery_set_fakemode(bool);
 nyx_error_t battery_get_fakemode(bool *);
@@ -35,6 +35,11 @@
 
 #include "battery.h"
 
+/* upper bound for the uevent coalescing window */
+#define BATTERY_COALESCE_WINDOW_MAX_MS 10000
+#define BATTERY_SAMPLE_INTERVAL_MAX_S 3600
+#define BATTERY_CRITICAL_VOLTAGE_MAX_MV 5000
+
 nyx_device_t *nyxDev = NULL;
 
 void *battery_callback_context = NULL;
@@ -95,6 +100,26 @@ nyx_error_t nyx_module_open(nyx_instance_t i, nyx_device_t **d)
 	                           NYX_BATTERY_GET_FAKE_MODE_MODULE_METHOD,
 	                           "battery_get_fake_mode");
 
+	nyx_module_register_method(i, (nyx_device_t *)nyxDev,
+	                           NYX_BATTERY_SET_COALESCE_WINDOW_MODULE_METHOD,
+	                           "battery_set_coalesce_window");
+
+	nyx_module_register_method(i, (nyx_device_t *)nyxDev,
+	                           NYX_BATTERY_GET_TIME_ESTIMATES_MODULE_METHOD,
+	                           "battery_get_time_estimates");
+
+	nyx_module_register_method(i, (nyx_device_t *)nyxDev,
+	                           NYX_BATTERY_SET_SAMPLE_INTERVAL_MODULE_METHOD,
+	                           "battery_set_sample_interval_seconds");
+
+	nyx_module_register_method(i, (nyx_device_t *)nyxDev,
+	                           NYX_BATTERY_SET_CRITICAL_VOLTAGE_MODULE_METHOD,
+	                           "battery_set_critical_voltage");
+
+	nyx_module_register_method(i, (nyx_device_t *)nyxDev,
+	                           NYX_BATTERY_QUERY_COUNTERS_MODULE_METHOD,
+	                           "battery_query_counters");
+
 	nyx_error_t result = battery_init();
 
 	if (NYX_ERROR_NONE != result)
@@ -130,6 +155,12 @@ void battery_read_status(nyx_battery_status_t *state)
 {
 	if (state)
 	{
+		/* while a uevent is being dispatched its properties are already decoded */
+		if (battery_get_event_status(state))
+		{
+			return;
+		}
+
 		memset(state, 0, sizeof(nyx_battery_status_t));
 
 		state->present = battery_is_present();
@@ -280,3 +311,83 @@ nyx_error_t battery_get_fake_mode(nyx_device_handle_t handle,
 
 	return err;
 }
+
+nyx_error_t battery_set_coalesce_window(nyx_device_handle_t handle,
+                                        unsigned int window_ms)
+{
+	if (handle != nyxDev)
+	{
+		return NYX_ERROR_INVALID_HANDLE;
+	}
+
+	if (window_ms > BATTERY_COALESCE_WINDOW_MAX_MS)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	battery_set_coalesce_ms(window_ms);
+	return NYX_ERROR_NONE;
+}
+
+nyx_error_t battery_get_time_estimates(nyx_device_handle_t handle,
+                                       int *time_to_empty, int *time_to_full)
+{
+	if (handle != nyxDev)
+	{
+		return NYX_ERROR_INVALID_HANDLE;
+	}
+
+	if (!time_to_empty || !time_to_full)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	*time_to_empty = battery_time_to_empty();
+	*time_to_full = battery_time_to_full();
+	return NYX_ERROR_NONE;
+}
+
+nyx_error_t battery_set_sample_interval_seconds(nyx_device_handle_t handle,
+        unsigned int interval_s)
+{
+	if (handle != nyxDev)
+	{
+		return NYX_ERROR_INVALID_HANDLE;
+	}
+
+	if (interval_s > BATTERY_SAMPLE_INTERVAL_MAX_S)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	battery_set_sample_interval(interval_s);
+	return NYX_ERROR_NONE;
+}
+
+nyx_error_t battery_set_critical_voltage(nyx_device_handle_t handle,
+        int voltage_mv)
+{
+	if (handle != nyxDev)
+	{
+		return NYX_ERROR_INVALID_HANDLE;
+	}
+
+	if (voltage_mv < 0 || voltage_mv > BATTERY_CRITICAL_VOLTAGE_MAX_MV)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	battery_set_critical_voltage_mv(voltage_mv);
+	return NYX_ERROR_NONE;
+}
+
+nyx_error_t battery_query_counters(nyx_device_handle_t handle,
+                                   nyx_perf_counter_t *counters, int *count)
+{
+	if (handle != nyxDev)
+	{
+		return NYX_ERROR_INVALID_HANDLE;
+	}
+
+	return battery_read_counters(counters, count);
+}
@@ -150,6 +150,11 @@ bool battery_is_present(void)
 	return test_battery_is_present_retval;
 }
 
+bool battery_get_event_status(nyx_battery_status_t *state)
+{
+	return false;
+}
+
 bool battery_is_authenticated(const char *pair_challenge,
                               const char *pair_response)
 {
@@ -167,6 +172,43 @@ void battery_set_wakeup_percent(int percentage)
 	return;
 }
 
+int test_battery_critical_voltage_mv = 0;
+void battery_set_critical_voltage_mv(int voltage_mv)
+{
+	test_battery_critical_voltage_mv = voltage_mv;
+}
+
+unsigned int test_battery_coalesce_ms = 0;
+void battery_set_coalesce_ms(unsigned int window_ms)
+{
+	test_battery_coalesce_ms = window_ms;
+}
+
+unsigned int test_battery_sample_interval = 0;
+void battery_set_sample_interval(unsigned int interval_s)
+{
+	test_battery_sample_interval = interval_s;
+}
+
+int test_battery_time_to_empty_retval = -1;
+int battery_time_to_empty(void)
+{
+	return test_battery_time_to_empty_retval;
+}
+
+int test_battery_time_to_full_retval = -1;
+int battery_time_to_full(void)
+{
+	return test_battery_time_to_full_retval;
+}
+
+int test_battery_read_counters_count = 0;
+nyx_error_t battery_read_counters(nyx_perf_counter_t *counters, int *count)
+{
+	*count = test_battery_read_counters_count;
+	return NYX_ERROR_NONE;
+}
+
 #define CHARGE_MIN_TEMPERATURE_C 0
 #define CHARGE_MAX_TEMPERATURE_C 57
 #define BATTERY_MAX_TEMPERATURE_C  60
@@ -473,6 +515,125 @@ static void test_battery_set_wakeup_percentage(api_test_fixture *fixture,
 	                  fixture->fixture_device, testPercentage));
 }
 
+//
+// Test for the battery_set_coalesce_window API
+// nyx_error_t battery_set_coalesce_window(nyx_device_handle_t handle, unsigned int window_ms)
+//
+static void test_battery_set_coalesce_window(api_test_fixture *fixture,
+        gconstpointer unused)
+{
+	// Force a failed call
+	g_assert_true(NYX_ERROR_INVALID_HANDLE == battery_set_coalesce_window(NULL,
+	              100));
+
+	// Force another failed call
+	test_battery_coalesce_ms = 0;
+	g_assert_true(NYX_ERROR_INVALID_VALUE == battery_set_coalesce_window(
+	                  fixture->fixture_device, BATTERY_COALESCE_WINDOW_MAX_MS + 1));
+	g_assert_true(0 == test_battery_coalesce_ms);
+
+	// Check for no error
+	g_assert_true(NYX_ERROR_NONE == battery_set_coalesce_window(
+	                  fixture->fixture_device, 250));
+	g_assert_true(250 == test_battery_coalesce_ms);
+
+	// Check that coalescing can be switched off again
+	g_assert_true(NYX_ERROR_NONE == battery_set_coalesce_window(
+	                  fixture->fixture_device, 0));
+	g_assert_true(0 == test_battery_coalesce_ms);
+}
+
+// Test for the battery_get_time_estimates API
+// nyx_error_t battery_get_time_estimates(nyx_device_handle_t handle, int *time_to_empty, int *time_to_full)
+//
+static void test_battery_get_time_estimates(api_test_fixture *fixture,
+        gconstpointer unused)
+{
+	int tte = 0, ttf = 0;
+
+	// Force a failed call
+	g_assert_true(NYX_ERROR_INVALID_HANDLE == battery_get_time_estimates(NULL,
+	              &tte, &ttf));
+
+	// Force another failed call
+	g_assert_true(NYX_ERROR_INVALID_VALUE == battery_get_time_estimates(
+	                  fixture->fixture_device, NULL, &ttf));
+	g_assert_true(NYX_ERROR_INVALID_VALUE == battery_get_time_estimates(
+	                  fixture->fixture_device, &tte, NULL));
+
+	// Check for no error
+	test_battery_time_to_empty_retval = 7200;
+	test_battery_time_to_full_retval = -1;
+	g_assert_true(NYX_ERROR_NONE == battery_get_time_estimates(
+	                  fixture->fixture_device, &tte, &ttf));
+	g_assert_true(7200 == tte);
+	g_assert_true(-1 == ttf);
+}
+
+// Test for the battery_set_sample_interval_seconds API
+// nyx_error_t battery_set_sample_interval_seconds(nyx_device_handle_t handle, unsigned int interval_s)
+//
+static void test_battery_set_sample_interval(api_test_fixture *fixture,
+        gconstpointer unused)
+{
+	// Force a failed call
+	g_assert_true(NYX_ERROR_INVALID_HANDLE == battery_set_sample_interval_seconds(
+	                  NULL, 30));
+
+	// Force another failed call
+	test_battery_sample_interval = 0;
+	g_assert_true(NYX_ERROR_INVALID_VALUE == battery_set_sample_interval_seconds(
+	                  fixture->fixture_device, BATTERY_SAMPLE_INTERVAL_MAX_S + 1));
+	g_assert_true(0 == test_battery_sample_interval);
+
+	// Check for no error
+	g_assert_true(NYX_ERROR_NONE == battery_set_sample_interval_seconds(
+	                  fixture->fixture_device, 30));
+	g_assert_true(30 == test_battery_sample_interval);
+}
+
+// Test for the battery_set_critical_voltage API
+// nyx_error_t battery_set_critical_voltage(nyx_device_handle_t handle, int voltage_mv)
+//
+static void test_battery_set_critical_voltage(api_test_fixture *fixture,
+        gconstpointer unused)
+{
+	// Force a failed call
+	g_assert_true(NYX_ERROR_INVALID_HANDLE == battery_set_critical_voltage(NULL,
+	              3400));
+
+	// Force other failed calls
+	test_battery_critical_voltage_mv = 0;
+	g_assert_true(NYX_ERROR_INVALID_VALUE == battery_set_critical_voltage(
+	                  fixture->fixture_device, -1));
+	g_assert_true(NYX_ERROR_INVALID_VALUE == battery_set_critical_voltage(
+	                  fixture->fixture_device, BATTERY_CRITICAL_VOLTAGE_MAX_MV + 1));
+	g_assert_true(0 == test_battery_critical_voltage_mv);
+
+	// Check for no error
+	g_assert_true(NYX_ERROR_NONE == battery_set_critical_voltage(
+	                  fixture->fixture_device, 3400));
+	g_assert_true(3400 == test_battery_critical_voltage_mv);
+}
+
+// Test for the battery_query_counters API
+// nyx_error_t battery_query_counters(nyx_device_handle_t handle, nyx_perf_counter_t *counters, int *count)
+//
+static void test_battery_query_counters(api_test_fixture *fixture,
+                                        gconstpointer unused)
+{
+	int count = 0;
+
+	// Force a failed call
+	g_assert_true(NYX_ERROR_INVALID_HANDLE == battery_query_counters(NULL, NULL,
+	              &count));
+
+	// Check for no error
+	test_battery_read_counters_count = 6;
+	g_assert_true(NYX_ERROR_NONE == battery_query_counters(fixture->fixture_device,
+	              NULL, &count));
+	g_assert_true(6 == count);
+}
 
 //
 // Set-up GLib, then register and run the tests.
@@ -491,6 +652,16 @@ int main(int argc, char **argv)
 	            test_battery_get_ctia_parameters);
 	ADD_APITEST("/battery/api/battery_set_wakeup_percentage",
 	            test_battery_set_wakeup_percentage);
+	ADD_APITEST("/battery/api/battery_set_coalesce_window",
+	            test_battery_set_coalesce_window);
+	ADD_APITEST("/battery/api/battery_get_time_estimates",
+	            test_battery_get_time_estimates);
+	ADD_APITEST("/battery/api/battery_set_sample_interval_seconds",
+	            test_battery_set_sample_interval);
+	ADD_APITEST("/battery/api/battery_set_critical_voltage",
+	            test_battery_set_critical_voltage);
+	ADD_APITEST("/battery/api/battery_query_counters",
+	            test_battery_query_counters);
 
 	return g_test_run();
 }
@@ -92,17 +92,24 @@ nyx_device_callback_function_t battery_callback = &test_battery_callback;
 //*****************************************************************************
 //*****************************************************************************
 
-// Pull in the unit under test
-#include "../device/battery.c"
+// Pull in the unit under test, along with the power supply monitor it
+// subscribes to (so the udev/glib mocks below still apply)
+#include "../battery.c"
+#include "../../utils/power_supply.c"
 
 //*****************************************************************************
 //*****************************************************************************
 
 // mock out calls to nyx-modules: utils.c
-char *find_power_supply_sysfs_path(const char *device_type)
+const char *find_power_supply_sysfs_path(const char *device_type)
 {
 	// return whatever they asked for: Battery, USB, Mains, Touch, or Wireless (from _detect_battery_sysfs_paths() in device/battery.c)
-	return (char *) device_type;
+	return device_type;
+}
+
+void release_power_supply_sysfs_paths(void)
+{
+	return;
 }
 
 // define paths used in _detect_battery_sysfs_paths() in device/battery.c
@@ -116,6 +123,14 @@ static char *test_batt_temperature_path = "Battery/temp";
 static char *test_batt_voltage_path = "Battery/voltage_now";
 static char *test_batt_current_path = "Battery/current_now";
 static char *test_batt_present_path = "Battery/present";
+static char *test_batt_current_avg_path = "Battery/current_avg";
+static char *test_batt_charge_counter_path = "Battery/charge_counter";
+static char *test_batt_time_to_empty_path = "Battery/time_to_empty_now";
+static char *test_batt_time_to_full_path = "Battery/time_to_full_now";
+static char *test_batt_capacity_alert_min_path = "Battery/capacity_alert_min";
+static char *test_batt_alarm_path = "Battery/alarm";
+static char *test_batt_temp_alert_min_path = "Battery/temp_alert_min";
+static char *test_batt_temp_alert_max_path = "Battery/temp_alert_max";
 
 // define (mocked) values returns for above paths
 int32_t test_batt_capacity_path_retval = 0;
@@ -128,6 +143,14 @@ int32_t test_batt_temperature_path_retval = 0;
 int32_t test_batt_voltage_path_retval = 0;
 int32_t test_batt_current_path_retval = 0;
 int32_t test_batt_present_path_retval = 0;
+int32_t test_batt_current_avg_path_retval = 0;
+int32_t test_batt_charge_counter_path_retval = 0;
+int32_t test_batt_time_to_empty_path_retval = 0;
+int32_t test_batt_time_to_full_path_retval = 0;
+int32_t test_batt_capacity_alert_min_path_retval = 0;
+int32_t test_batt_alarm_path_retval = 0;
+int32_t test_batt_temp_alert_min_path_retval = 0;
+int32_t test_batt_temp_alert_max_path_retval = 0;
 
 #define ifMatchReturnRetvalForTestPath(value) if (0 == strncmp(path, value, PATH_LEN)) { return value##_retval; }
 // ifMatchReturnRetvalForTestPath(batt_capacity) expands to:
@@ -136,10 +159,37 @@ int32_t test_batt_present_path_retval = 0;
 //  return test_batt_capacity_path_retval;
 // }
 
-// return appropriate _retval value for calls to nyx_utils_read_value
-int32_t nyx_utils_read_value(char *path)
+// mock out the sysfs attribute handles from utils.c
+void sysfs_attr_init(sysfs_attr_t *attr, const char *dir, const char *name)
+{
+	attr->fd = -1;
+	snprintf(attr->path, SYSFS_ATTR_PATH_LEN, "%s/%s", dir, name);
+}
+
+bool sysfs_attr_open(sysfs_attr_t *attr)
+{
+	return true;
+}
+
+void sysfs_attr_close(sysfs_attr_t *attr)
+{
+	return;
+}
+
+bool sysfs_attr_exists(sysfs_attr_t *attr);
+
+// return appropriate _retval value for calls to sysfs_attr_read_value
+int32_t sysfs_attr_read_value(sysfs_attr_t *attr)
 {
-	//fprintf(stderr,"path (%s) passed to nyx_utils_read_value\n", path);
+	const char *path = attr->path;
+
+	// a missing node fails to open, so reads of it always fail
+	if (!sysfs_attr_exists(attr))
+	{
+		return -1;
+	}
+
+	//fprintf(stderr,"path (%s) passed to sysfs_attr_read_value\n", path);
 	ifMatchReturnRetvalForTestPath(test_batt_capacity_path)
 	else ifMatchReturnRetvalForTestPath(test_batt_energy_now_path)
 		else ifMatchReturnRetvalForTestPath(test_batt_energy_full_path)
@@ -150,14 +200,68 @@ int32_t nyx_utils_read_value(char *path)
 							else ifMatchReturnRetvalForTestPath(test_batt_voltage_path)
 								else ifMatchReturnRetvalForTestPath(test_batt_current_path)
 									else ifMatchReturnRetvalForTestPath(test_batt_present_path)
+										else ifMatchReturnRetvalForTestPath(test_batt_current_avg_path)
+										else ifMatchReturnRetvalForTestPath(test_batt_charge_counter_path)
+										else ifMatchReturnRetvalForTestPath(test_batt_time_to_empty_path)
+										else ifMatchReturnRetvalForTestPath(test_batt_time_to_full_path)
+										else ifMatchReturnRetvalForTestPath(test_batt_capacity_alert_min_path)
+										else ifMatchReturnRetvalForTestPath(test_batt_alarm_path)
+										else ifMatchReturnRetvalForTestPath(test_batt_temp_alert_min_path)
+										else ifMatchReturnRetvalForTestPath(test_batt_temp_alert_max_path)
 
 										// bad path: print error, force g_assert, and return -1
-										fprintf(stderr, "Bad path (%s) passed to nyx_utils_read_value\n", path);
+										fprintf(stderr, "Bad path (%s) passed to sysfs_attr_read_value\n", path);
 
-	g_assert_true(path == (const char *)"Bad path passed to nyx_utils_read_value");
+	g_assert_true(path == (const char *)"Bad path passed to sysfs_attr_read_value");
 	return -1;
 }
 
+bool sysfs_attr_read_int(sysfs_attr_t *attr, int32_t *value)
+{
+	if (!sysfs_attr_exists(attr))
+	{
+		return false;
+	}
+
+	*value = sysfs_attr_read_value(attr);
+	return true;
+}
+
+uint64_t test_sysfs_attr_read_count_retval = 0;
+uint64_t sysfs_attr_read_count(void)
+{
+	return test_sysfs_attr_read_count_retval;
+}
+
+// writes land in the _retval of the path so tests can check them
+bool sysfs_attr_write_int(sysfs_attr_t *attr, int32_t value)
+{
+	const char *path = attr->path;
+
+	if (0 == strncmp(path, test_batt_capacity_alert_min_path, PATH_LEN))
+	{
+		test_batt_capacity_alert_min_path_retval = value;
+	}
+	else if (0 == strncmp(path, test_batt_alarm_path, PATH_LEN))
+	{
+		test_batt_alarm_path_retval = value;
+	}
+	else if (0 == strncmp(path, test_batt_temp_alert_min_path, PATH_LEN))
+	{
+		test_batt_temp_alert_min_path_retval = value;
+	}
+	else if (0 == strncmp(path, test_batt_temp_alert_max_path, PATH_LEN))
+	{
+		test_batt_temp_alert_max_path_retval = value;
+	}
+	else
+	{
+		return false;
+	}
+
+	return true;
+}
+
 //*****************************************************************************
 //*****************************************************************************
 
@@ -239,11 +343,90 @@ int udev_monitor_get_fd(struct udev_monitor *udev_monitor)
 	return testUdevMonitorGetFd_retval;
 }
 
-int udev_monitor_filter_remove(struct udev_monitor *udev_monitor)
+struct udev_monitor *udev_monitor_unref(struct udev_monitor *udev_monitor)
+{
+	return NULL;
+}
+
+// no supplies are present when the shared monitor enumerates them
+struct udev_enumerate
+{
+	int opaque;
+};
+struct udev_enumerate testUdevEnumerateStruct;
+struct udev_enumerate *udev_enumerate_new(struct udev *udev)
+{
+	return &testUdevEnumerateStruct;
+}
+
+int udev_enumerate_add_match_subsystem(struct udev_enumerate *udev_enumerate,
+                                       const char *subsystem)
+{
+	return 0;
+}
+
+int udev_enumerate_scan_devices(struct udev_enumerate *udev_enumerate)
 {
 	return 0;
 }
 
+struct udev_list_entry *udev_enumerate_get_list_entry(struct udev_enumerate
+        *udev_enumerate)
+{
+	return NULL;
+}
+
+struct udev_enumerate *udev_enumerate_unref(struct udev_enumerate
+        *udev_enumerate)
+{
+	return NULL;
+}
+
+struct udev_device *udev_device_new_from_syspath(struct udev *udev,
+        const char *syspath)
+{
+	return NULL;
+}
+
+// no uevent properties, so _handle_event() falls back to reading sysfs
+struct udev_list_entry *udev_device_get_properties_list_entry(
+    struct udev_device *udev_device)
+{
+	return NULL;
+}
+
+struct udev_list_entry *udev_list_entry_get_next(struct udev_list_entry
+        *list_entry)
+{
+	return NULL;
+}
+
+const char *udev_list_entry_get_name(struct udev_list_entry *list_entry)
+{
+	return NULL;
+}
+
+const char *udev_list_entry_get_value(struct udev_list_entry *list_entry)
+{
+	return NULL;
+}
+
+const char *testUdevDeviceAction_retval = "change";
+const char *udev_device_get_action(struct udev_device *udev_device)
+{
+	return testUdevDeviceAction_retval;
+}
+
+const char *udev_device_get_sysname(struct udev_device *udev_device)
+{
+	return "Battery";
+}
+
+struct udev_device *udev_device_unref(struct udev_device *udev_device)
+{
+	return NULL;
+}
+
 void udev_unref(struct udev *udev)
 {
 	// is this a request for our valid "test" udev?
@@ -273,6 +456,14 @@ int32_t test_batt_temperature_path_exists = false;
 int32_t test_batt_voltage_path_exists = false;
 int32_t test_batt_current_path_exists = false;
 int32_t test_batt_present_path_exists = false;
+int32_t test_batt_current_avg_path_exists = false;
+int32_t test_batt_charge_counter_path_exists = false;
+int32_t test_batt_time_to_empty_path_exists = false;
+int32_t test_batt_time_to_full_path_exists = false;
+int32_t test_batt_capacity_alert_min_path_exists = false;
+int32_t test_batt_alarm_path_exists = false;
+int32_t test_batt_temp_alert_min_path_exists = false;
+int32_t test_batt_temp_alert_max_path_exists = false;
 
 #define ifMatchReturnExistsForTestPath(value) if (0 == strncmp(path, value, PATH_LEN)) { return value##_exists; }
 // ifMatchReturnExistsForTestPath(batt_capacity) expands to:
@@ -281,18 +472,12 @@ int32_t test_batt_present_path_exists = false;
 //  return test_batt_capacity_path_exists;
 // }
 
-// return appropriate _exists value for calls to g_file_test
-gboolean g_file_test(const gchar *path, GFileTest test)
+// return appropriate _exists value for calls to sysfs_attr_exists
+bool sysfs_attr_exists(sysfs_attr_t *attr)
 {
-	//fprintf(stderr,"path (%s) passed to g_file_test\n", path);
-	if (G_FILE_TEST_EXISTS != test)
-	{
-		fprintf(stderr, "Un-mocked test (%d) passed to g_file_test\n",
-		        G_FILE_TEST_EXISTS);
-		g_assert_true(path == (const char *)"Un-mocked test passed to g_file_test");
-		return -1;
-	}
+	const char *path = attr->path;
 
+	//fprintf(stderr,"path (%s) passed to sysfs_attr_exists\n", path);
 	ifMatchReturnExistsForTestPath(test_batt_capacity_path)
 	else ifMatchReturnExistsForTestPath(test_batt_energy_now_path)
 		else ifMatchReturnExistsForTestPath(test_batt_energy_full_path)
@@ -303,12 +488,20 @@ gboolean g_file_test(const gchar *path, GFileTest test)
 							else ifMatchReturnExistsForTestPath(test_batt_voltage_path)
 								else ifMatchReturnExistsForTestPath(test_batt_current_path)
 									else ifMatchReturnExistsForTestPath(test_batt_present_path)
+										else ifMatchReturnExistsForTestPath(test_batt_current_avg_path)
+										else ifMatchReturnExistsForTestPath(test_batt_charge_counter_path)
+										else ifMatchReturnExistsForTestPath(test_batt_time_to_empty_path)
+										else ifMatchReturnExistsForTestPath(test_batt_time_to_full_path)
+										else ifMatchReturnExistsForTestPath(test_batt_capacity_alert_min_path)
+										else ifMatchReturnExistsForTestPath(test_batt_alarm_path)
+										else ifMatchReturnExistsForTestPath(test_batt_temp_alert_min_path)
+										else ifMatchReturnExistsForTestPath(test_batt_temp_alert_max_path)
 
 										// bad path: print error, force g_assert, and return -1
-										fprintf(stderr, "Bad path (%s) passed to g_file_test\n", path);
+										fprintf(stderr, "Bad path (%s) passed to sysfs_attr_exists\n", path);
 
-	g_assert_true(path == (const char *)"Bad path passed to g_file_test");
-	return -1;
+	g_assert_true(path == (const char *)"Bad path passed to sysfs_attr_exists");
+	return false;
 }
 
 
@@ -604,6 +797,14 @@ void reset_battery_path_retvals(void)
 	test_batt_voltage_path_exists = false;
 	test_batt_current_path_exists = false;
 	test_batt_present_path_exists = false;
+	test_batt_current_avg_path_exists = false;
+	test_batt_charge_counter_path_exists = false;
+	test_batt_time_to_empty_path_exists = false;
+	test_batt_time_to_full_path_exists = false;
+	test_batt_capacity_alert_min_path_exists = false;
+	test_batt_alarm_path_exists = false;
+	test_batt_temp_alert_min_path_exists = false;
+	test_batt_temp_alert_max_path_exists = false;
 
 	test_batt_capacity_path_retval = -1;
 	test_batt_energy_now_path_retval = -1;
@@ -615,6 +816,18 @@ void reset_battery_path_retvals(void)
 	test_batt_voltage_path_retval = -1;
 	test_batt_current_path_retval = -1;
 	test_batt_present_path_retval = -1;
+	test_batt_current_avg_path_retval = -1;
+	test_batt_charge_counter_path_retval = -1;
+	test_batt_time_to_empty_path_retval = -1;
+	test_batt_time_to_full_path_retval = -1;
+	test_batt_capacity_alert_min_path_retval = -1;
+	test_batt_alarm_path_retval = -1;
+	test_batt_temp_alert_min_path_retval = -1;
+	test_batt_temp_alert_max_path_retval = -1;
+
+	battery_sample_count = 0;
+	battery_sample_next = 0;
+	detect_battery_optional_attrs();
 }
 
 //
@@ -626,18 +839,21 @@ test_battery_percent(/*api_test_fixture *fixture, gconstpointer unused*/)
 {
 	// Check for failure returned from test_batt_capacity_path if NO paths available
 	reset_battery_path_retvals();
+	detect_battery_percent_source();
 	g_assert_true(-1 == battery_percent());
 
 	// Check for failure returned from test_batt_capacity_path if (only) invalid capacity
 	reset_battery_path_retvals();
 	test_batt_capacity_path_exists = true;
 	test_batt_capacity_path_retval = -1;
+	detect_battery_percent_source();
 	g_assert_true(-1 == battery_percent());
 
 	// Check for correct return value from test_batt_capacity_path using valid capacity
 	reset_battery_path_retvals();
 	test_batt_capacity_path_exists = true;
 	test_batt_capacity_path_retval = 80;
+	detect_battery_percent_source();
 	g_assert_true(80 == battery_percent());
 
 
@@ -647,6 +863,7 @@ test_battery_percent(/*api_test_fixture *fixture, gconstpointer unused*/)
 	test_batt_energy_full_path_exists = true;
 	test_batt_energy_now_path_retval = -1;
 	test_batt_energy_full_path_retval = 1000000;
+	detect_battery_percent_source();
 	g_assert_true(-1 == battery_percent());
 
 	// Check for failure returned from test_batt_capacity_path using invalid energy_full
@@ -655,6 +872,7 @@ test_battery_percent(/*api_test_fixture *fixture, gconstpointer unused*/)
 	test_batt_energy_full_path_exists = true;
 	test_batt_energy_now_path_retval = 800000;
 	test_batt_energy_full_path_retval = -1;
+	detect_battery_percent_source();
 	g_assert_true(-1 == battery_percent());
 
 	// Check for correct return value from test_batt_capacity_path using energy_now / energy_full
@@ -663,6 +881,7 @@ test_battery_percent(/*api_test_fixture *fixture, gconstpointer unused*/)
 	test_batt_energy_full_path_exists = true;
 	test_batt_energy_now_path_retval = 800000;
 	test_batt_energy_full_path_retval = 1000000;
+	detect_battery_percent_source();
 	g_assert_true(80 == battery_percent());
 
 
@@ -672,6 +891,7 @@ test_battery_percent(/*api_test_fixture *fixture, gconstpointer unused*/)
 	test_batt_charge_full_path_exists = true;
 	test_batt_charge_now_path_retval = -1;
 	test_batt_charge_full_path_retval = 2300000;
+	detect_battery_percent_source();
 	g_assert_true(-1 == battery_percent());
 
 	// Check for failure returned from test_batt_capacity_path using invalid charge_full
@@ -680,6 +900,7 @@ test_battery_percent(/*api_test_fixture *fixture, gconstpointer unused*/)
 	test_batt_charge_full_path_exists = true;
 	test_batt_charge_now_path_retval = 1840000;
 	test_batt_charge_full_path_retval = -1;
+	detect_battery_percent_source();
 	g_assert_true(-1 == battery_percent());
 
 	// Check for correct return value from test_batt_capacity_path using charge_now / charge_full
@@ -688,8 +909,20 @@ test_battery_percent(/*api_test_fixture *fixture, gconstpointer unused*/)
 	test_batt_charge_full_path_exists = true;
 	test_batt_charge_now_path_retval = 1840000;
 	test_batt_charge_full_path_retval = 2300000;
+	detect_battery_percent_source();
 	g_assert_true(80 == battery_percent());
 
+	// Check that the capacity node wins over the ratio nodes once probed
+	reset_battery_path_retvals();
+	test_batt_capacity_path_exists = true;
+	test_batt_charge_now_path_exists = true;
+	test_batt_charge_full_path_exists = true;
+	test_batt_capacity_path_retval = 75;
+	test_batt_charge_now_path_retval = 1840000;
+	test_batt_charge_full_path_retval = 2300000;
+	detect_battery_percent_source();
+	g_assert_true(BATTERY_PERCENT_CAPACITY == battery_percent_source);
+	g_assert_true(75 == battery_percent());
 }
 
 //
@@ -797,6 +1030,108 @@ test_battery_avg_current(/*api_test_fixture *fixture, gconstpointer unused*/)
 	test_batt_current_path_retval = 371870;
 	// TODO: Should this be in mA or uA?  Device returns uA but emulator returns mA!
 	g_assert_true(371870 == battery_current());
+
+	// Check that the fuel gauge's own average wins
+	reset_battery_path_retvals();
+	test_batt_current_path_exists = true;
+	test_batt_current_path_retval = 371870;
+	test_batt_current_avg_path_exists = true;
+	test_batt_current_avg_path_retval = 250000;
+	detect_battery_optional_attrs();
+	g_assert_true(250000 == battery_avg_current());
+
+	// Check that a node found missing at detect time is not read again
+	reset_battery_path_retvals();
+	test_batt_current_path_exists = true;
+	test_batt_current_path_retval = 371870;
+	test_batt_current_avg_path_exists = true;
+	test_batt_current_avg_path_retval = 250000;
+	g_assert_true(371870 == battery_avg_current());
+
+	// Check the mean of the recent samples without a current_avg node
+	reset_battery_path_retvals();
+	test_batt_current_path_exists = true;
+	test_batt_current_path_retval = -100000;
+	battery_sample_current();
+	test_batt_current_path_retval = -300000;
+	battery_sample_current();
+	g_assert_true(-200000 == battery_avg_current());
+
+	// Check the fall back to the instantaneous current without samples
+	reset_battery_path_retvals();
+	test_batt_current_path_exists = true;
+	test_batt_current_path_retval = 371870;
+	g_assert_true(371870 == battery_avg_current());
+
+	// Check that the fall back keeps a discharging current
+	test_batt_current_path_retval = -371870;
+	g_assert_true(-371870 == battery_avg_current());
+
+	// Check for failure without any current reading
+	reset_battery_path_retvals();
+	g_assert_true(-1 == battery_avg_current());
+}
+
+//
+// Tests for the battery_time_to_empty and battery_time_to_full API methods
+// int battery_time_to_empty(void)
+// int battery_time_to_full(void)
+//
+static void
+test_battery_time_estimates(/*api_test_fixture *fixture, gconstpointer unused*/)
+{
+	// Check for failure without current or charge readings
+	reset_battery_path_retvals();
+	g_assert_true(-1 == battery_time_to_empty());
+	g_assert_true(-1 == battery_time_to_full());
+
+	// Check that the kernel's own estimates win
+	reset_battery_path_retvals();
+	test_batt_time_to_empty_path_exists = true;
+	test_batt_time_to_empty_path_retval = 5400;
+	test_batt_time_to_full_path_exists = true;
+	test_batt_time_to_full_path_retval = 0;
+	detect_battery_optional_attrs();
+	g_assert_true(5400 == battery_time_to_empty());
+	g_assert_true(0 == battery_time_to_full());
+
+	// Check the estimates derived from a discharging current
+	reset_battery_path_retvals();
+	test_batt_current_avg_path_exists = true;
+	test_batt_current_avg_path_retval = -500000;
+	detect_battery_optional_attrs();
+	test_batt_charge_now_path_exists = true;
+	test_batt_charge_now_path_retval = 1000000;
+	test_batt_charge_full_path_exists = true;
+	test_batt_charge_full_path_retval = 2000000;
+	g_assert_true(7200 == battery_time_to_empty());
+	g_assert_true(-1 == battery_time_to_full());
+
+	// Check the estimates derived from a charging current
+	test_batt_current_avg_path_retval = 1000000;
+	g_assert_true(-1 == battery_time_to_empty());
+	g_assert_true(3600 == battery_time_to_full());
+
+	// Check that a full battery has no time left to charge
+	test_batt_charge_now_path_retval = 2000000;
+	g_assert_true(0 == battery_time_to_full());
+
+	// Check the estimate from the instantaneous current without an average
+	reset_battery_path_retvals();
+	test_batt_current_path_exists = true;
+	test_batt_current_path_retval = -500000;
+	test_batt_charge_now_path_exists = true;
+	test_batt_charge_now_path_retval = 1000000;
+	g_assert_true(7200 == battery_time_to_empty());
+
+	// Check for failure when the current can't be read at all
+	test_batt_current_path_exists = false;
+	g_assert_true(-1 == battery_time_to_empty());
+
+	// Check for failure when the estimate does not fit
+	test_batt_current_path_exists = true;
+	test_batt_current_path_retval = -1;
+	g_assert_true(-1 == battery_time_to_empty());
 }
 
 //
@@ -816,15 +1151,23 @@ test_battery_full40(/*api_test_fixture *fixture, gconstpointer unused*/)
 	reset_battery_path_retvals();
 	test_batt_charge_full_path_exists = true;
 	test_batt_charge_full_path_retval = -1;
+	detect_battery_optional_attrs();
 	g_assert_true(-1 == battery_full40());
 
 	// Check for correct return value from test_batt_charge_full_path
 	reset_battery_path_retvals();
 	test_batt_charge_full_path_exists = true;
 	test_batt_charge_full_path_retval = 2300000;
+	detect_battery_optional_attrs();
 	// TODO: Should this be in mA or uA?  Device returns uA but emulator returns mA!
 	g_assert_true((2300000 / 1000) == battery_full40());
 
+	// Check that a node found missing when the device was probed is not read
+	reset_battery_path_retvals();
+	test_batt_charge_full_path_exists = true;
+	test_batt_charge_full_path_retval = 2300000;
+	g_assert_true(-1 == battery_full40());
+
 
 	// Check for failure returned from test_batt_charge_full_design_path
 	reset_battery_path_retvals();
@@ -853,8 +1196,21 @@ test_battery_full40(/*api_test_fixture *fixture, gconstpointer unused*/)
 static void
 test_battery_rawcoulomb(/*api_test_fixture *fixture, gconstpointer unused*/)
 {
-	// Check for failure returned from battery_rawcoulomb (not implemented)
+	// Check for failure without charge_counter and charge_now
+	reset_battery_path_retvals();
 	g_assert_true(-1 == battery_rawcoulomb());
+
+	// Check for the fall back to test_batt_charge_now_path
+	reset_battery_path_retvals();
+	test_batt_charge_now_path_exists = true;
+	test_batt_charge_now_path_retval = 1840000;
+	g_assert_true(1840 == battery_rawcoulomb());
+
+	// Check that test_batt_charge_counter_path wins
+	test_batt_charge_counter_path_exists = true;
+	test_batt_charge_counter_path_retval = 1850000;
+	detect_battery_optional_attrs();
+	g_assert_true(1850 == battery_rawcoulomb());
 }
 
 //
@@ -890,8 +1246,25 @@ test_battery_coulomb(/*api_test_fixture *fixture, gconstpointer unused*/)
 static void
 test_battery_age(/*api_test_fixture *fixture, gconstpointer unused*/)
 {
-	// Check for failure returned from battery_age (not implemented)
+	// Check for failure returned from test_batt_charge_full_design_path
+	reset_battery_path_retvals();
+	test_batt_charge_full_path_exists = true;
+	test_batt_charge_full_path_retval = 1800000;
 	g_assert_true(-1 == battery_age());
+
+	// Check for failure returned from test_batt_charge_full_path
+	reset_battery_path_retvals();
+	test_batt_charge_full_design_path_exists = true;
+	test_batt_charge_full_design_path_retval = 2000000;
+	g_assert_true(-1 == battery_age());
+
+	// Check for correct return value
+	reset_battery_path_retvals();
+	test_batt_charge_full_path_exists = true;
+	test_batt_charge_full_path_retval = 1800000;
+	test_batt_charge_full_design_path_exists = true;
+	test_batt_charge_full_design_path_retval = 2000000;
+	g_assert_true(90 == battery_age());
 }
 
 //
@@ -949,6 +1322,100 @@ test_get_battery_ctia_params(/*api_test_fixture *fixture, gconstpointer unused*/
 	//g_assert_true(battery_ctia_params->skip_battery_authentication);
 }
 
+//
+// Tests for the threshold notifications
+// void battery_set_wakeup_percent(int percentage)
+// void battery_set_critical_voltage_mv(int voltage_mv)
+//
+static void
+test_battery_thresholds(/*api_test_fixture *fixture, gconstpointer unused*/)
+{
+	reset_battery_path_retvals();
+	battery_temp_zone = BATTERY_TEMP_UNKNOWN;
+	current_battery_present = true;
+	current_battery_percentage = 50;
+
+	// Check that every percentage change fires without thresholds
+	battery_callback_pending = false;
+	battery_note_reading(true, 49, 250, 3800000);
+	g_assert_true(battery_callback_pending);
+
+	// Check that the capacity alert is armed at the wakeup percentage
+	test_batt_capacity_alert_min_path_exists = true;
+	battery_set_wakeup_percent(20);
+	g_assert_true(20 == test_batt_capacity_alert_min_path_retval);
+
+	// Check that changes above the threshold no longer fire
+	battery_callback_pending = false;
+	battery_note_reading(true, 48, 250, 3800000);
+	g_assert_false(battery_callback_pending);
+
+	// Check that crossing the threshold fires only once
+	battery_note_reading(true, 20, 250, 3800000);
+	g_assert_true(battery_callback_pending);
+	battery_callback_pending = false;
+	battery_note_reading(true, 19, 250, 3800000);
+	g_assert_false(battery_callback_pending);
+
+	// Check that leaving the charging temperature range fires and re-arms the alerts
+	test_batt_temp_alert_min_path_exists = true;
+	test_batt_temp_alert_max_path_exists = true;
+	battery_note_reading(true, 19, 580, 3800000);
+	g_assert_true(battery_callback_pending);
+	g_assert_true(570 == test_batt_temp_alert_min_path_retval);
+	g_assert_true(600 == test_batt_temp_alert_max_path_retval);
+
+	// Check that dropping below the critical voltage fires
+	test_batt_voltage_path_exists = true;
+	test_batt_voltage_path_retval = 3800000;
+	battery_set_critical_voltage_mv(3400);
+	battery_callback_pending = false;
+	battery_note_reading(true, 19, 580, 3300000);
+	g_assert_true(battery_callback_pending);
+
+	// Check the fall back to the alarm node, in the units of charge_now
+	reset_battery_path_retvals();
+	test_batt_alarm_path_exists = true;
+	test_batt_charge_full_path_exists = true;
+	test_batt_charge_full_path_retval = 2000000;
+	battery_percent_source = BATTERY_PERCENT_CHARGE;
+	battery_set_wakeup_percent(10);
+	g_assert_true(200000 == test_batt_alarm_path_retval);
+
+	battery_set_wakeup_percent(0);
+	battery_set_critical_voltage_mv(0);
+	battery_callback_pending = false;
+}
+
+static void test_battery_read_counters(void)
+{
+	nyx_perf_counter_t counters[BATTERY_COUNTER_COUNT];
+	int count = 0;
+
+	// Check that a NULL buffer only returns the number of counters
+	g_assert_true(NYX_ERROR_INVALID_VALUE == battery_read_counters(NULL, NULL));
+	g_assert_true(NYX_ERROR_NONE == battery_read_counters(NULL, &count));
+	g_assert_true(BATTERY_COUNTER_COUNT == count);
+
+	// Check that the counters and the shared sysfs read count are copied
+	memset(battery_counters, 0, sizeof(battery_counters));
+	battery_counters[BATTERY_COUNTER_UEVENTS] = 3;
+	test_sysfs_attr_read_count_retval = 42;
+	count = BATTERY_COUNTER_COUNT;
+	g_assert_true(NYX_ERROR_NONE == battery_read_counters(counters, &count));
+	g_assert_true(BATTERY_COUNTER_COUNT == count);
+	g_assert_cmpstr("uevents", ==, counters[BATTERY_COUNTER_UEVENTS].name);
+	g_assert_true(3 == counters[BATTERY_COUNTER_UEVENTS].value);
+	g_assert_true(42 == counters[BATTERY_COUNTER_SYSFS_READS].value);
+
+	// Check that a short buffer is not overrun
+	count = 1;
+	counters[1].value = 1234;
+	g_assert_true(NYX_ERROR_NONE == battery_read_counters(counters, &count));
+	g_assert_true(BATTERY_COUNTER_COUNT == count);
+	g_assert_true(1234 == counters[1].value);
+}
+
 //
 // Set-up GLib, then register and run the tests.
 int main(int argc, char **argv)
@@ -965,6 +1432,8 @@ int main(int argc, char **argv)
 	g_test_add_func("/battery/device/battery_current", test_battery_current);
 	g_test_add_func("/battery/device/battery_avg_current",
 	                test_battery_avg_current);
+	g_test_add_func("/battery/device/battery_time_estimates",
+	                test_battery_time_estimates);
 
 	g_test_add_func("/battery/device/battery_full40", test_battery_full40);
 	g_test_add_func("/battery/device/battery_rawcoulomb", test_battery_rawcoulomb);
@@ -974,12 +1443,14 @@ int main(int argc, char **argv)
 	g_test_add_func("/battery/device/battery_is_present", test_battery_is_present);
 	g_test_add_func("/battery/device/get_battery_ctia_params",
 	                test_get_battery_ctia_params);
+	g_test_add_func("/battery/device/battery_thresholds", test_battery_thresholds);
+	g_test_add_func("/battery/device/battery_read_counters",
+	                test_battery_read_counters);
 
 	// TODO: Add test for _handle_event() callback function?
 
 	// not currently supported by device/battery.c or emulator/fake_battery.c (stub implementations)
 	// g_test_add_func("/battery/device/battery_authenticate", test_battery_authenticate);
-	// g_test_add_func("/battery/device/battery_set_wakeup_percent", test_battery_set_wakeup_percent);
 
 	return g_test_run();
 }
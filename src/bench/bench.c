@@ -0,0 +1,382 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+/**
+* @file bench.c
+*
+* @brief Timing, syscall counting and fake sysfs helpers for the
+* microbenchmarks.
+*
+* Latency is sampled per operation with CLOCK_MONOTONIC and reported as
+* percentiles. Syscalls per operation are counted in a separate pass by a
+* forked ptrace tracer, so the tracing overhead never shows up in the
+* timings. Where ptrace is not permitted the count is reported as n/a.
+*/
+
+#include <errno.h>
+#include <ftw.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/ptrace.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include <nyx/nyx_module.h>
+#include "bench.h"
+
+#define BENCH_DEFAULT_ITERATIONS 2000
+#define BENCH_SYSCALL_ITERATIONS 50
+#define BENCH_THROUGHPUT_NS      (200 * 1000 * 1000LL)
+
+enum
+{
+	TRACER_STARTING,
+	TRACER_ATTACHED,
+	TRACER_FAILED,
+	TRACER_DETACH,
+};
+
+/* shared with the tracer process */
+struct bench_shared
+{
+	volatile int state;
+	volatile int counting;
+	volatile long stops;
+};
+
+static int bench_iterations = BENCH_DEFAULT_ITERATIONS;
+static bool bench_count = true;
+static struct bench_shared *bench_shared = NULL;
+static char bench_root[] = "/tmp/nyx-bench-XXXXXX";
+static bool bench_root_created = false;
+
+/*
+ * Only the functions under test register methods; nyx-lib is never
+ * involved.
+ */
+nyx_error_t nyx_module_register_method(nyx_instance_t instance,
+                                       nyx_device_t *device_in_ptr,
+                                       module_method_t method,
+                                       const char *symbol_str)
+{
+	return NYX_ERROR_NONE;
+}
+
+static long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int compare_ll(const void *a, const void *b)
+{
+	long long x = *(const long long *)a;
+	long long y = *(const long long *)b;
+
+	return (x > y) - (x < y);
+}
+
+/**
+ * Options: -n <iterations> for the latency samples, -s to skip counting
+ * syscalls.
+ */
+void bench_init(int argc, char **argv)
+{
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:s")) != -1)
+	{
+		switch (opt)
+		{
+			case 'n':
+				bench_iterations = atoi(optarg) > 0 ? atoi(optarg) : 1;
+				break;
+
+			case 's':
+				bench_count = false;
+				break;
+
+			default:
+				fprintf(stderr, "usage: %s [-n iterations] [-s]\n", argv[0]);
+				exit(EXIT_FAILURE);
+		}
+	}
+
+	bench_shared = mmap(NULL, sizeof(*bench_shared), PROT_READ | PROT_WRITE,
+	                    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+	if (MAP_FAILED == bench_shared)
+	{
+		bench_shared = NULL;
+		bench_count = false;
+	}
+
+	atexit(bench_cleanup);
+
+	printf("%-40s %10s %10s %10s %10s %12s\n", "benchmark", "p50 us",
+	       "p90 us", "p99 us", "max us", "syscalls/op");
+}
+
+/* Traces the parent and counts its syscall stops while counting is set. */
+static void bench_tracer(pid_t pid)
+{
+	int status;
+
+	if (ptrace(PTRACE_SEIZE, pid, NULL,
+	           (void *)(long)PTRACE_O_TRACESYSGOOD) < 0 ||
+	        ptrace(PTRACE_INTERRUPT, pid, NULL, NULL) < 0 ||
+	        waitpid(pid, &status, __WALL) < 0 ||
+	        ptrace(PTRACE_SYSCALL, pid, NULL, NULL) < 0)
+	{
+		bench_shared->state = TRACER_FAILED;
+		return;
+	}
+
+	bench_shared->state = TRACER_ATTACHED;
+
+	while (waitpid(pid, &status, __WALL) == pid)
+	{
+		int sig = 0;
+
+		if (WIFEXITED(status) || WIFSIGNALED(status))
+		{
+			return;
+		}
+
+		if (WSTOPSIG(status) == (SIGTRAP | 0x80))
+		{
+			if (TRACER_DETACH == bench_shared->state)
+			{
+				ptrace(PTRACE_DETACH, pid, NULL, NULL);
+				return;
+			}
+
+			/* one stop on entry and one on exit */
+			if (bench_shared->counting)
+			{
+				bench_shared->stops++;
+			}
+		}
+		else if ((status >> 16) == 0)
+		{
+			/* a signal for the tracee, pass it on */
+			sig = WSTOPSIG(status);
+		}
+
+		ptrace(PTRACE_SYSCALL, pid, NULL, (void *)(long)sig);
+	}
+}
+
+/* Returns the syscalls per call of fn, or a negative value if unknown. */
+static double bench_count_syscalls(bench_fn_t fn, void *ctx)
+{
+	if (!bench_count)
+	{
+		return -1;
+	}
+
+	bench_shared->state = TRACER_STARTING;
+	bench_shared->counting = 0;
+	bench_shared->stops = 0;
+
+	/* Yama only lets us be traced by a non-ancestor when we say so */
+	prctl(PR_SET_PTRACER, PR_SET_PTRACER_ANY, 0, 0, 0);
+
+	pid_t parent = getpid();
+	pid_t child = fork();
+
+	if (child < 0)
+	{
+		return -1;
+	}
+
+	if (0 == child)
+	{
+		bench_tracer(parent);
+		_exit(0);
+	}
+
+	while (TRACER_STARTING == bench_shared->state)
+	{
+		sched_yield();
+	}
+
+	if (TRACER_ATTACHED != bench_shared->state)
+	{
+		waitpid(child, NULL, 0);
+		bench_count = false;
+		return -1;
+	}
+
+	bench_shared->counting = 1;
+
+	for (int i = 0; i < BENCH_SYSCALL_ITERATIONS; i++)
+	{
+		fn(ctx);
+	}
+
+	bench_shared->counting = 0;
+	bench_shared->state = TRACER_DETACH;
+
+	/* any syscall lets the tracer see the request and detach */
+	getppid();
+	waitpid(child, NULL, 0);
+
+	return bench_shared->stops / 2.0 / BENCH_SYSCALL_ITERATIONS;
+}
+
+/**
+ * Runs fn for the configured number of iterations, after a short warm-up,
+ * and prints latency percentiles and syscalls per call.
+ */
+void bench_latency(const char *name, bench_fn_t fn, void *ctx)
+{
+	long long *samples = calloc(bench_iterations, sizeof(long long));
+
+	if (NULL == samples)
+	{
+		return;
+	}
+
+	for (int i = 0; i < bench_iterations / 10; i++)
+	{
+		fn(ctx);
+	}
+
+	for (int i = 0; i < bench_iterations; i++)
+	{
+		long long start = now_ns();
+		fn(ctx);
+		samples[i] = now_ns() - start;
+	}
+
+	qsort(samples, bench_iterations, sizeof(long long), compare_ll);
+
+	double syscalls = bench_count_syscalls(fn, ctx);
+	char count[16] = "n/a";
+
+	if (syscalls >= 0)
+	{
+		snprintf(count, sizeof(count), "%.1f", syscalls);
+	}
+
+	printf("%-40s %10.2f %10.2f %10.2f %10.2f %12s\n", name,
+	       samples[bench_iterations / 2] / 1000.0,
+	       samples[(bench_iterations * 90) / 100] / 1000.0,
+	       samples[(bench_iterations * 99) / 100] / 1000.0,
+	       samples[bench_iterations - 1] / 1000.0, count);
+
+	free(samples);
+}
+
+/**
+ * Runs fn, which processes bytes per call, for a fixed time and prints
+ * calls and megabytes per second.
+ */
+void bench_throughput(const char *name, size_t bytes, bench_fn_t fn,
+                      void *ctx)
+{
+	long long ops = 0;
+	long long start = now_ns();
+	long long elapsed;
+
+	fn(ctx);
+
+	do
+	{
+		fn(ctx);
+		ops++;
+		elapsed = now_ns() - start;
+	}
+	while (elapsed < BENCH_THROUGHPUT_NS);
+
+	double seconds = elapsed / 1e9;
+
+	printf("%-40s %14.0f ops/s %10.2f MB/s\n", name, ops / seconds,
+	       ops * (double)bytes / seconds / (1024 * 1024));
+}
+
+/**
+ * Creates (once) and returns <root>/<name>, a directory standing in for a
+ * sysfs device. The caller frees the path.
+ */
+char *bench_fake_dir(const char *name)
+{
+	if (!bench_root_created)
+	{
+		if (NULL == mkdtemp(bench_root))
+		{
+			perror("mkdtemp");
+			exit(EXIT_FAILURE);
+		}
+
+		bench_root_created = true;
+	}
+
+	char *dir = NULL;
+
+	if (asprintf(&dir, "%s/%s", bench_root, name) < 0)
+	{
+		exit(EXIT_FAILURE);
+	}
+
+	mkdir(dir, 0755);
+	return dir;
+}
+
+void bench_fake_attr(const char *dir, const char *attr, const char *value)
+{
+	char path[512];
+
+	snprintf(path, sizeof(path), "%s/%s", dir, attr);
+
+	FILE *fp = fopen(path, "w");
+
+	if (NULL == fp)
+	{
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+
+	fprintf(fp, "%s\n", value);
+	fclose(fp);
+}
+
+static int remove_entry(const char *path, const struct stat *st, int flag,
+                        struct FTW *ftw)
+{
+	return remove(path);
+}
+
+void bench_cleanup(void)
+{
+	if (bench_root_created)
+	{
+		nftw(bench_root, remove_entry, 8, FTW_DEPTH | FTW_PHYS);
+		bench_root_created = false;
+	}
+}
@@ -0,0 +1,41 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+/**
+ * @file bench.h
+ *
+ * @brief Minimal harness for the module microbenchmarks.
+ */
+
+#ifndef BENCH_H_
+#define BENCH_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef void (*bench_fn_t)(void *ctx);
+
+void bench_init(int argc, char **argv);
+void bench_latency(const char *name, bench_fn_t fn, void *ctx);
+void bench_throughput(const char *name, size_t bytes, bench_fn_t fn,
+                      void *ctx);
+
+char *bench_fake_dir(const char *name);
+void bench_fake_attr(const char *dir, const char *attr, const char *value);
+void bench_cleanup(void);
+
+#endif // BENCH_H_
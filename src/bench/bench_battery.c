@@ -0,0 +1,107 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+/**
+* @file bench_battery.c
+*
+* @brief Latency of battery_read_status() and of the battery uevent paths,
+* against a fake power_supply tree.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <nyx/nyx_module.h>
+#include "battery.h"
+#include "bench.h"
+#include "bench_power_supply.h"
+
+static const char *const battery_attrs[] =
+{
+	"present", "1",
+	"status", "Discharging",
+	"capacity", "87",
+	"temp", "295",
+	"voltage_now", "4012000",
+	"current_now", "-350000",
+	"current_avg", "-340000",
+	"charge_now", "2610000",
+	"charge_full", "3000000",
+	"charge_full_design", "3100000",
+	"charge_counter", "2610000",
+	NULL
+};
+
+static const char *const battery_uevent[] =
+{
+	"POWER_SUPPLY_NAME", "battery",
+	"POWER_SUPPLY_STATUS", "Discharging",
+	"POWER_SUPPLY_PRESENT", "1",
+	"POWER_SUPPLY_CAPACITY", "87",
+	"POWER_SUPPLY_TEMP", "295",
+	"POWER_SUPPLY_VOLTAGE_NOW", "4012000",
+	"POWER_SUPPLY_CURRENT_NOW", "-350000",
+	"POWER_SUPPLY_CURRENT_AVG", "-340000",
+	"POWER_SUPPLY_CHARGE_NOW", "2610000",
+	"POWER_SUPPLY_CHARGE_FULL", "3000000",
+	"POWER_SUPPLY_CHARGE_FULL_DESIGN", "3100000",
+	"POWER_SUPPLY_CHARGE_COUNTER", "2610000",
+	NULL
+};
+
+void battery_read_status(nyx_battery_status_t *state);
+
+static void read_status(void *ctx)
+{
+	nyx_battery_status_t status;
+
+	battery_read_status(&status);
+}
+
+static void dispatch(void *ctx)
+{
+	bench_uevent_dispatch();
+}
+
+int main(int argc, char **argv)
+{
+	bench_init(argc, argv);
+
+	bench_power_supply_add("Battery", "battery", battery_attrs);
+
+	if (battery_init() != NYX_ERROR_NONE)
+	{
+		fprintf(stderr, "battery_init failed\n");
+		return EXIT_FAILURE;
+	}
+
+	bench_latency("battery_read_status", read_status, NULL);
+
+	bench_uevent_set("change", "battery", battery_uevent);
+	bench_latency("uevent battery (properties)", dispatch, NULL);
+
+	/* drivers that only send the bare uevent force a sysfs re-read */
+	bench_uevent_set("change", "battery", NULL);
+	bench_latency("uevent battery (re-read)", dispatch, NULL);
+
+	bench_uevent_set("change", "ac", NULL);
+	bench_latency("uevent other supply", dispatch, NULL);
+
+	battery_deinit();
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,132 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+/**
+* @file bench_charger.c
+*
+* @brief Latency of core_charger_read_status() and of the charger uevent
+* paths, against a fake power_supply tree.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <nyx/nyx_module.h>
+#include "charger.h"
+#include "bench.h"
+#include "bench_power_supply.h"
+
+static const char *const battery_attrs[] =
+{
+	"present", "1",
+	"status", "Charging",
+	"voltage_now", "4012000",
+	"temp", "295",
+	NULL
+};
+
+static const char *const online_attrs[] =
+{
+	"online", "1",
+	NULL
+};
+
+static const char *const offline_attrs[] =
+{
+	"online", "0",
+	NULL
+};
+
+static const char *const usb_online[] =
+{
+	"POWER_SUPPLY_NAME", "usb",
+	"POWER_SUPPLY_ONLINE", "1",
+	NULL
+};
+
+static const char *const usb_offline[] =
+{
+	"POWER_SUPPLY_NAME", "usb",
+	"POWER_SUPPLY_ONLINE", "0",
+	NULL
+};
+
+static const char *const battery_uevent[] =
+{
+	"POWER_SUPPLY_NAME", "battery",
+	"POWER_SUPPLY_STATUS", "Charging",
+	"POWER_SUPPLY_PRESENT", "1",
+	"POWER_SUPPLY_VOLTAGE_NOW", "4012000",
+	"POWER_SUPPLY_TEMP", "295",
+	NULL
+};
+
+static void read_status(void *ctx)
+{
+	nyx_charger_status_t status;
+
+	core_charger_read_status(&status);
+}
+
+static void dispatch(void *ctx)
+{
+	bench_uevent_dispatch();
+}
+
+/* plug and unplug on alternate calls so every uevent is an edge */
+static void dispatch_toggle(void *ctx)
+{
+	int *plugged = ctx;
+
+	*plugged = !*plugged;
+	bench_uevent_set("change", "usb", *plugged ? usb_online : usb_offline);
+	bench_uevent_dispatch();
+}
+
+int main(int argc, char **argv)
+{
+	int plugged = 1;
+
+	bench_init(argc, argv);
+
+	bench_power_supply_add("Battery", "battery", battery_attrs);
+	bench_power_supply_add("USB", "usb", online_attrs);
+	bench_power_supply_add("Mains", "ac", offline_attrs);
+	bench_power_supply_add("Wireless", "wireless", offline_attrs);
+
+	if (core_charger_init() != NYX_ERROR_NONE)
+	{
+		fprintf(stderr, "core_charger_init failed\n");
+		return EXIT_FAILURE;
+	}
+
+	bench_latency("core_charger_read_status", read_status, NULL);
+
+	bench_uevent_set("change", "usb", usb_online);
+	bench_latency("uevent usb (no change)", dispatch, NULL);
+	bench_latency("uevent usb (plug/unplug)", dispatch_toggle, &plugged);
+
+	bench_uevent_set("change", "battery", battery_uevent);
+	bench_latency("uevent battery (properties)", dispatch, NULL);
+
+	bench_uevent_set("change", "usb", NULL);
+	bench_latency("uevent usb (re-read)", dispatch, NULL);
+
+	core_charger_deinit();
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,85 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+/**
+* @file bench_device_info.c
+*
+* @brief Latency of device_info_query() for each query type.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <nyx/nyx_module.h>
+#include "bench.h"
+
+typedef struct
+{
+	const char *name;
+	nyx_device_info_type_t query;
+	nyx_device_t *device;
+} device_info_bench_t;
+
+static device_info_bench_t queries[] =
+{
+	{ "device_info_query nduid", NYX_DEVICE_INFO_NDUID },
+	{ "device_info_query device_name", NYX_DEVICE_INFO_DEVICE_NAME },
+	{ "device_info_query ram_size", NYX_DEVICE_INFO_RAM_SIZE },
+	{ "device_info_query storage_size", NYX_DEVICE_INFO_STORAGE_SIZE },
+	{ "device_info_query storage_free", NYX_DEVICE_INFO_STORAGE_FREE },
+	{ "device_info_query bt_addr", NYX_DEVICE_INFO_BT_ADDR },
+	{ "device_info_query wifi_addr", NYX_DEVICE_INFO_WIFI_ADDR },
+	{ "device_info_query wired_addr", NYX_DEVICE_INFO_WIRED_ADDR },
+};
+
+nyx_error_t device_info_query(nyx_device_handle_t d,
+                              nyx_device_info_type_t query, const char **dest);
+
+/* the module entry points, normally resolved by nyx-lib */
+nyx_error_t nyx_module_open(nyx_instance_t i, nyx_device_t **d);
+nyx_error_t nyx_module_close(nyx_device_handle_t d);
+
+static void query(void *ctx)
+{
+	device_info_bench_t *bench = ctx;
+	const char *value;
+
+	device_info_query(bench->device, bench->query, &value);
+}
+
+int main(int argc, char **argv)
+{
+	nyx_device_t *device = NULL;
+
+	bench_init(argc, argv);
+
+	if (nyx_module_open(NULL, &device) != NYX_ERROR_NONE)
+	{
+		fprintf(stderr, "nyx_module_open failed\n");
+		return EXIT_FAILURE;
+	}
+
+	for (size_t i = 0; i < sizeof(queries) / sizeof(queries[0]); i++)
+	{
+		queries[i].device = device;
+		bench_latency(queries[i].name, query, &queries[i]);
+	}
+
+	nyx_module_close(device);
+
+	return EXIT_SUCCESS;
+}
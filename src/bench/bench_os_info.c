@@ -0,0 +1,84 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+/**
+* @file bench_os_info.c
+*
+* @brief Latency of os_info_query() for each query type.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <nyx/nyx_module.h>
+#include "bench.h"
+
+typedef struct
+{
+	const char *name;
+	nyx_os_info_query_t query;
+	nyx_device_t *device;
+} os_info_bench_t;
+
+static os_info_bench_t queries[] =
+{
+	{ "os_info_query kernel_version", NYX_OS_INFO_CORE_OS_KERNEL_VERSION },
+	{ "os_info_query core_os_name", NYX_OS_INFO_CORE_OS_NAME },
+	{ "os_info_query core_os_release", NYX_OS_INFO_CORE_OS_RELEASE },
+	{ "os_info_query core_os_codename", NYX_OS_INFO_CORE_OS_RELEASE_CODENAME },
+	{ "os_info_query webos_imagename", NYX_OS_INFO_WEBOS_IMAGENAME },
+	{ "os_info_query webos_build_id", NYX_OS_INFO_WEBOS_BUILD_ID },
+	{ "os_info_query encryption_key_type", NYX_OS_INFO_ENCRYPTION_KEY_TYPE },
+};
+
+nyx_error_t os_info_query(nyx_device_handle_t d, nyx_os_info_query_t query,
+                          const char **dest);
+
+/* the module entry points, normally resolved by nyx-lib */
+nyx_error_t nyx_module_open(nyx_instance_t i, nyx_device_t **d);
+nyx_error_t nyx_module_close(nyx_device_handle_t d);
+
+static void query(void *ctx)
+{
+	os_info_bench_t *bench = ctx;
+	const char *value;
+
+	os_info_query(bench->device, bench->query, &value);
+}
+
+int main(int argc, char **argv)
+{
+	nyx_device_t *device = NULL;
+
+	bench_init(argc, argv);
+
+	if (nyx_module_open(NULL, &device) != NYX_ERROR_NONE)
+	{
+		fprintf(stderr, "nyx_module_open failed\n");
+		return EXIT_FAILURE;
+	}
+
+	for (size_t i = 0; i < sizeof(queries) / sizeof(queries[0]); i++)
+	{
+		queries[i].device = device;
+		bench_latency(queries[i].name, query, &queries[i]);
+	}
+
+	nyx_module_close(device);
+
+	return EXIT_SUCCESS;
+}
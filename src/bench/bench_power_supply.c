@@ -0,0 +1,291 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+/**
+* @file bench_power_supply.c
+*
+* @brief Stands in for libudev and the sysfs lookup so that the battery and
+* charger modules run their real read and uevent paths against a fake
+* power_supply tree.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <libudev.h>
+
+#include "bench.h"
+#include "bench_power_supply.h"
+
+/*
+ * The real sysfs attribute helpers are used; only the power_supply lookup is
+ * replaced by the fake devices below.
+ */
+#define find_power_supply_sysfs_path utils_find_power_supply_sysfs_path
+#define release_power_supply_sysfs_paths utils_release_power_supply_sysfs_paths
+#include "../utils/utils.c"
+#undef find_power_supply_sysfs_path
+#undef release_power_supply_sysfs_paths
+
+/* Pulled in whole so that the uevent handler can be driven directly. */
+#include "../utils/power_supply.c"
+
+#define BENCH_MAX_SUPPLIES   8
+#define BENCH_MAX_PROPERTIES 32
+
+struct udev
+{
+	int unused;
+};
+
+struct udev_monitor
+{
+	int fds[2];
+};
+
+struct udev_list_entry
+{
+	const char *name;
+	const char *value;
+	struct udev_list_entry *next;
+};
+
+struct udev_device
+{
+	const char *action;
+	const char *sysname;
+	struct udev_list_entry *properties;
+};
+
+typedef struct
+{
+	const char *type;
+	char *path;
+} bench_supply_t;
+
+static bench_supply_t bench_supplies[BENCH_MAX_SUPPLIES];
+static int bench_supply_count = 0;
+
+static struct udev bench_udev;
+static struct udev_monitor bench_monitor = { { -1, -1 } };
+static struct udev_device bench_event;
+static struct udev_list_entry bench_properties[BENCH_MAX_PROPERTIES];
+
+const char *bench_power_supply_add(const char *type, const char *name,
+                                   const char *const *attrs)
+{
+	if (bench_supply_count == BENCH_MAX_SUPPLIES)
+	{
+		return NULL;
+	}
+
+	char *dir = bench_fake_dir(name);
+
+	for (; attrs && attrs[0] && attrs[1]; attrs += 2)
+	{
+		bench_fake_attr(dir, attrs[0], attrs[1]);
+	}
+
+	bench_supplies[bench_supply_count].type = type;
+	bench_supplies[bench_supply_count].path = dir;
+	bench_supply_count++;
+
+	return dir;
+}
+
+void bench_uevent_set(const char *action, const char *name,
+                      const char *const *properties)
+{
+	struct udev_list_entry *prev = NULL;
+	int i = 0;
+
+	bench_event.action = action;
+	bench_event.sysname = name;
+	bench_event.properties = NULL;
+
+	for (; properties && properties[0] && properties[1] &&
+	        i < BENCH_MAX_PROPERTIES; properties += 2, i++)
+	{
+		bench_properties[i].name = properties[0];
+		bench_properties[i].value = properties[1];
+		bench_properties[i].next = NULL;
+
+		if (prev)
+		{
+			prev->next = &bench_properties[i];
+		}
+		else
+		{
+			bench_event.properties = &bench_properties[i];
+		}
+
+		prev = &bench_properties[i];
+	}
+}
+
+void bench_uevent_dispatch(void)
+{
+	psy_handle_event(NULL, G_IO_IN, NULL);
+}
+
+const char *find_power_supply_sysfs_path(const char *device_type)
+{
+	for (int i = 0; i < bench_supply_count; i++)
+	{
+		if (strcmp(bench_supplies[i].type, device_type) == 0)
+		{
+			return bench_supplies[i].path;
+		}
+	}
+
+	return NULL;
+}
+
+void release_power_supply_sysfs_paths(void)
+{
+}
+
+struct udev *udev_new(void)
+{
+	return &bench_udev;
+}
+
+struct udev *udev_ref(struct udev *udev)
+{
+	return udev;
+}
+
+struct udev *udev_unref(struct udev *udev)
+{
+	return NULL;
+}
+
+struct udev_monitor *udev_monitor_new_from_netlink(struct udev *udev,
+        const char *name)
+{
+	/* a descriptor that never becomes readable, to give GLib something to watch */
+	if (bench_monitor.fds[0] < 0 && pipe(bench_monitor.fds) < 0)
+	{
+		return NULL;
+	}
+
+	return &bench_monitor;
+}
+
+int udev_monitor_filter_add_match_subsystem_devtype(struct udev_monitor
+        *udev_monitor, const char *subsystem, const char *devtype)
+{
+	return 0;
+}
+
+int udev_monitor_enable_receiving(struct udev_monitor *udev_monitor)
+{
+	return 0;
+}
+
+int udev_monitor_get_fd(struct udev_monitor *udev_monitor)
+{
+	return udev_monitor->fds[0];
+}
+
+struct udev_monitor *udev_monitor_unref(struct udev_monitor *udev_monitor)
+{
+	return NULL;
+}
+
+struct udev_device *udev_monitor_receive_device(struct udev_monitor
+        *udev_monitor)
+{
+	return bench_event.sysname ? &bench_event : NULL;
+}
+
+const char *udev_device_get_action(struct udev_device *udev_device)
+{
+	return udev_device->action;
+}
+
+const char *udev_device_get_sysname(struct udev_device *udev_device)
+{
+	return udev_device->sysname;
+}
+
+struct udev_list_entry *udev_device_get_properties_list_entry(
+    struct udev_device *udev_device)
+{
+	return udev_device->properties;
+}
+
+const char *udev_device_get_sysattr_value(struct udev_device *udev_device,
+        const char *sysattr)
+{
+	return NULL;
+}
+
+struct udev_device *udev_device_new_from_syspath(struct udev *udev,
+        const char *syspath)
+{
+	return NULL;
+}
+
+struct udev_device *udev_device_unref(struct udev_device *udev_device)
+{
+	return NULL;
+}
+
+struct udev_enumerate *udev_enumerate_new(struct udev *udev)
+{
+	return NULL;
+}
+
+int udev_enumerate_add_match_subsystem(struct udev_enumerate
+                                       *udev_enumerate, const char *subsystem)
+{
+	return -1;
+}
+
+int udev_enumerate_scan_devices(struct udev_enumerate *udev_enumerate)
+{
+	return -1;
+}
+
+struct udev_list_entry *udev_enumerate_get_list_entry(
+    struct udev_enumerate *udev_enumerate)
+{
+	return NULL;
+}
+
+struct udev_enumerate *udev_enumerate_unref(struct udev_enumerate
+        *udev_enumerate)
+{
+	return NULL;
+}
+
+struct udev_list_entry *udev_list_entry_get_next(struct udev_list_entry
+        *list_entry)
+{
+	return list_entry->next;
+}
+
+const char *udev_list_entry_get_name(struct udev_list_entry *list_entry)
+{
+	return list_entry->name;
+}
+
+const char *udev_list_entry_get_value(struct udev_list_entry *list_entry)
+{
+	return list_entry->value;
+}
@@ -0,0 +1,46 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+/**
+ * @file bench_power_supply.h
+ *
+ * @brief Fake power_supply devices and synthetic uevents for the battery
+ * and charger benchmarks.
+ */
+
+#ifndef BENCH_POWER_SUPPLY_H_
+#define BENCH_POWER_SUPPLY_H_
+
+/**
+ * Add a fake power supply of the given type ("Battery", "USB", ...) named
+ * name. attrs is a NULL terminated list of attribute/value pairs written
+ * into its directory. Returns the directory, which stays valid until exit.
+ */
+const char *bench_power_supply_add(const char *type, const char *name,
+                                   const char *const *attrs);
+
+/**
+ * Set the uevent returned by the next receive: action and sysname plus a
+ * NULL terminated list of property/value pairs.
+ */
+void bench_uevent_set(const char *action, const char *name,
+                      const char *const *properties);
+
+/* Dispatch the current synthetic uevent as if the monitor fd was readable. */
+void bench_uevent_dispatch(void);
+
+#endif // BENCH_POWER_SUPPLY_H_
@@ -0,0 +1,176 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+/**
+* @file bench_security2.c
+*
+* @brief Throughput of the security2 ciphers, HMAC and RSA by buffer size.
+*
+* The module is opened as nyx-lib would open it; the algorithm functions are
+* then called directly, as the security2_* entry points only check their
+* arguments before forwarding.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <nyx/nyx_module.h>
+#include "security2.h"
+#include "bench.h"
+
+#define MAX_BUFFER_SIZE 65536
+
+typedef enum
+{
+	BENCH_AES_CBC,
+	BENCH_3DES_CBC,
+	BENCH_HMAC,
+	BENCH_RSA_SIGN,
+	BENCH_RSA_SIGN_HANDLE,
+} security2_op_t;
+
+typedef struct
+{
+	security2_op_t op;
+	int keybits;
+	const unsigned char *key;
+	int keylen;
+	int handle;
+	int size;
+} security2_bench_t;
+
+static unsigned char src[MAX_BUFFER_SIZE];
+static unsigned char dest[MAX_BUFFER_SIZE + EVP_MAX_BLOCK_LENGTH];
+
+static void run(void *ctx)
+{
+	security2_bench_t *bench = ctx;
+	unsigned char iv[EVP_MAX_IV_LENGTH] = { 0 };
+	int destlen = sizeof(dest);
+
+	switch (bench->op)
+	{
+		case BENCH_AES_CBC:
+			aes_crypt(bench->key, bench->keybits, 1, NYX_SECURITY_MODE_CBC, src,
+			          bench->size, dest, &destlen, iv, sizeof(iv),
+			          NYX_SECURITY_PADDING_PKCS5, NULL, 0);
+			break;
+
+		case BENCH_3DES_CBC:
+			des3_crypt(bench->key, 1, NYX_SECURITY_MODE_CBC, src, bench->size,
+			           dest, &destlen, iv, 8, NYX_SECURITY_PADDING_PKCS5, NULL, 0);
+			break;
+
+		case BENCH_HMAC:
+			hmac(bench->key, bench->keybits, src, bench->size, dest, &destlen);
+			break;
+
+		case BENCH_RSA_SIGN:
+			rsa_crypt(bench->key, bench->keylen, NYX_SECURITY_RSA_SIGN, src,
+			          bench->size, dest, &destlen);
+			break;
+
+		case BENCH_RSA_SIGN_HANDLE:
+			rsa_crypt_handle(bench->handle, NYX_SECURITY_RSA_SIGN, src, bench->size,
+			                 dest, &destlen);
+			break;
+	}
+}
+
+static void run_sizes(const char *name, security2_bench_t *bench,
+                      const int *sizes)
+{
+	char label[64];
+
+	for (; *sizes; sizes++)
+	{
+		bench->size = *sizes;
+		snprintf(label, sizeof(label), "%s %d", name, *sizes);
+		bench_throughput(label, *sizes, run, bench);
+	}
+}
+
+/* the module entry points, normally resolved by nyx-lib */
+nyx_error_t nyx_module_open(nyx_instance_t i, nyx_device_t **d);
+nyx_error_t nyx_module_close(nyx_device_handle_t d);
+
+int main(int argc, char **argv)
+{
+	static const int sizes[] = { 16, 256, 4096, 65536, 0 };
+	static const int rsa_sizes[] = { 32, 128, 4096, 0 };
+	unsigned char aes_key[256 / 8];
+	unsigned char des3_key[192 / 8];
+	unsigned char hmac_key[256 / 8];
+	nyx_device_t *device = NULL;
+
+	bench_init(argc, argv);
+
+	if (nyx_module_open(NULL, &device) != NYX_ERROR_NONE)
+	{
+		fprintf(stderr, "nyx_module_open failed\n");
+		return EXIT_FAILURE;
+	}
+
+	memset(src, 0x5a, sizeof(src));
+
+	if (aes_generate_key(256, aes_key) != NYX_ERROR_NONE ||
+	        des3_generate_key(192, des3_key) != NYX_ERROR_NONE ||
+	        hmac_generate_key(256, hmac_key) != NYX_ERROR_NONE)
+	{
+		fprintf(stderr, "key generation failed\n");
+		return EXIT_FAILURE;
+	}
+
+	run_sizes("aes128-cbc", &(security2_bench_t) { BENCH_AES_CBC, 128, aes_key },
+	          sizes);
+	run_sizes("aes256-cbc", &(security2_bench_t) { BENCH_AES_CBC, 256, aes_key },
+	          sizes);
+	run_sizes("3des-cbc", &(security2_bench_t) { BENCH_3DES_CBC, 192, des3_key },
+	          sizes);
+	run_sizes("hmac-sha256", &(security2_bench_t) { BENCH_HMAC, 256, hmac_key },
+	          sizes);
+
+	int keylen = 0;
+	int publen = 0;
+
+	rsa_generate_key(2048, NULL, &keylen, NULL, &publen);
+
+	unsigned char *rsa_key = malloc(keylen);
+	unsigned char *rsa_pub = malloc(publen);
+	security2_bench_t rsa = { BENCH_RSA_SIGN, 2048, rsa_key, keylen };
+
+	if (!rsa_key || !rsa_pub ||
+	        rsa_generate_key(2048, rsa_key, &keylen, rsa_pub, &publen) != NYX_ERROR_NONE ||
+	        rsa_load_key(rsa_key, keylen, &rsa.handle) != NYX_ERROR_NONE)
+	{
+		fprintf(stderr, "RSA key generation failed\n");
+		return EXIT_FAILURE;
+	}
+
+	/* a serialized key is parsed on every call, a loaded one only once */
+	run_sizes("rsa2048-sign", &rsa, rsa_sizes);
+	rsa.op = BENCH_RSA_SIGN_HANDLE;
+	run_sizes("rsa2048-sign (handle)", &rsa, rsa_sizes);
+
+	rsa_unload_key(rsa.handle);
+	free(rsa_key);
+	free(rsa_pub);
+	nyx_module_close(device);
+
+	return EXIT_SUCCESS;
+}
@@ -27,8 +27,9 @@
 #include <pthread.h>
 #include <unistd.h>
 #include <time.h>
-#include <libudev.h>
 #include <utils.h>
+#include <power_supply.h>
+#include <perf_counters.h>
 
 #include <nyx/nyx_module.h>
 #include <nyx/module/nyx_utils.h>
@@ -37,9 +38,33 @@
 #define STATUS_LEN 64
 #define PATH_LEN 128
 
-struct udev *udev = NULL;
-struct udev_monitor *mon = NULL;
-guint watch = 0;
+guint power_supply_subscription = 0;
+
+/* runtime counters, see core_charger_read_counters() */
+enum
+{
+	CHARGER_COUNTER_UEVENTS,
+	CHARGER_COUNTER_UEVENTS_DECODED,
+	CHARGER_COUNTER_REREADS,
+	CHARGER_COUNTER_STATUS_CALLBACKS,
+	CHARGER_COUNTER_STATE_CALLBACKS,
+	CHARGER_COUNTER_TIMER_WAKEUPS,
+	CHARGER_COUNTER_SYSFS_READS,
+	CHARGER_COUNTER_COUNT
+};
+
+static const char *const charger_counter_names[CHARGER_COUNTER_COUNT] =
+{
+	"uevents",
+	"uevents_decoded",
+	"rereads",
+	"status_callbacks",
+	"state_change_callbacks",
+	"timer_wakeups",
+	"sysfs_reads",
+};
+
+static uint64_t charger_counters[CHARGER_COUNTER_COUNT];
 
 extern nyx_device_t *nyxDev;
 extern void *charger_status_callback_context;
@@ -52,12 +77,61 @@ char *battery_status = NULL;
 
 char batt_present_path[PATH_LEN] = {0,};
 char batt_status_path[PATH_LEN] = {0,};
-char charger_usb_sysfs_online_path[PATH_LEN] = {0,};
-char charger_ac_sysfs_online_path[PATH_LEN] = {0,};
-char charger_touch_sysfs_online_path[PATH_LEN] = {0,};
-char charger_wireless_sysfs_online_path[PATH_LEN] = {0,};
+sysfs_attr_t batt_voltage_attr = SYSFS_ATTR_INITIALIZER;
+sysfs_attr_t batt_temp_attr = SYSFS_ATTR_INITIALIZER;
+
+/* current level of the NYX_BATTERY_CRITICAL_VOLTAGE/TEMPERATURE_LIMIT conditions */
+static bool battery_voltage_critical = false;
+static bool battery_temperature_limit = false;
+
+/* power supplies we track, used to match the device of a uevent */
+typedef enum
+{
+	POWER_SUPPLY_USB = 0,
+	POWER_SUPPLY_AC,
+	POWER_SUPPLY_TOUCH,
+	POWER_SUPPLY_WIRELESS,
+	POWER_SUPPLY_BATTERY,
+	POWER_SUPPLY_COUNT,
+	POWER_SUPPLY_UNKNOWN = POWER_SUPPLY_COUNT,
+} power_supply_id_t;
+
+#define CHARGER_SUPPLY_COUNT POWER_SUPPLY_BATTERY
+#define CHARGER_SOURCE(id) (1u << (id))
+#define CHARGER_ALL_SOURCES (CHARGER_SOURCE(CHARGER_SUPPLY_COUNT) - 1)
+
+const char *power_supply_sysfs_paths[POWER_SUPPLY_COUNT] = {NULL,};
+
+/* "online" node of each charger, kept open between reads */
+sysfs_attr_t charger_online_attrs[CHARGER_SUPPLY_COUNT] =
+{
+	SYSFS_ATTR_INITIALIZER,
+	SYSFS_ATTR_INITIALIZER,
+	SYSFS_ATTR_INITIALIZER,
+	SYSFS_ATTR_INITIALIZER,
+};
+
+/* last known "online" value of each charger, -1 if unknown */
+int32_t charger_online[CHARGER_SUPPLY_COUNT] = {-1, -1, -1, -1};
 
 static nyx_charger_event_t current_event = NYX_NO_NEW_EVENT;
+
+/*
+ * Optional coalescing window: uevents arriving within charger_coalesce_ms of
+ * the first one share one sysfs re-read and at most one callback per kind.
+ * Event bits raised inside a window are latched until the next query so a
+ * short-lived edge (e.g. NYX_CHARGE_COMPLETE) is still reported.
+ */
+unsigned int charger_coalesce_ms = 0;
+guint charger_coalesce_timer = 0;
+static nyx_charger_event_t latched_event = NYX_NO_NEW_EVENT;
+/* chargers whose online node has to be re-read */
+static unsigned int charger_reread_sources = 0;
+static bool battery_reread_pending = false;
+/* re-read the battery too if one of the re-read chargers changed */
+static bool battery_reread_on_charger_change = false;
+static bool fire_charger_status_pending = false;
+static bool fire_state_change_pending = false;
 nyx_charger_status_t gChargerStatus =
 {
 	.charger_max_current = 0,
@@ -67,30 +141,76 @@ nyx_charger_status_t gChargerStatus =
 	.is_charging = false,
 };
 
-nyx_error_t core_charger_read_status(nyx_charger_status_t *status)
+static void _charger_update_status(void)
 {
-	/* before we start to update the charger status we reset it completely */
-	memset(&gChargerStatus, 0, sizeof(nyx_charger_status_t));
+	/* only the fields derived from the online values are ours to update */
+	gChargerStatus.connected = 0;
+	gChargerStatus.powered = 0;
+	gChargerStatus.is_charging = false;
 
-	/* function returns -1 on invalid file path, so check for 1, instead of true */
-	if (nyx_utils_read_value(charger_usb_sysfs_online_path) == 1)
+	/* online values are -1 on invalid file path, so check for 1, instead of true */
+	if (charger_online[POWER_SUPPLY_USB] == 1)
 	{
 		gChargerStatus.connected |= NYX_CHARGER_PC_CONNECTED;
 		gChargerStatus.powered |= NYX_CHARGER_USB_POWERED;
 	}
-	else if (nyx_utils_read_value(charger_ac_sysfs_online_path) == 1)
+	else if (charger_online[POWER_SUPPLY_AC] == 1)
 	{
 		gChargerStatus.connected |= NYX_CHARGER_WALL_CONNECTED;
 		gChargerStatus.powered |= NYX_CHARGER_DIRECT_POWERED;
 	}
 
-	if ((nyx_utils_read_value(charger_usb_sysfs_online_path) == 1) ||
-	        (nyx_utils_read_value(charger_ac_sysfs_online_path) == 1) ||
-	        (nyx_utils_read_value(charger_touch_sysfs_online_path) == 1) ||
-	        (nyx_utils_read_value(charger_wireless_sysfs_online_path) == 1))
+	if ((charger_online[POWER_SUPPLY_USB] == 1) ||
+	        (charger_online[POWER_SUPPLY_AC] == 1) ||
+	        (charger_online[POWER_SUPPLY_TOUCH] == 1) ||
+	        (charger_online[POWER_SUPPLY_WIRELESS] == 1))
 	{
 		gChargerStatus.is_charging = true;
 	}
+}
+
+/**
+ * Read the online node of each charger in sources once, through the cached
+ * descriptors, and update the charger status if any of them changed.
+ *
+ * Returns the CHARGER_SOURCE() mask of the chargers that changed.
+ */
+static unsigned int _charger_read_online(unsigned int sources)
+{
+	unsigned int changed = 0;
+	int32_t online;
+	int i;
+
+	for (i = 0; i < CHARGER_SUPPLY_COUNT; i++)
+	{
+		if (!(sources & CHARGER_SOURCE(i)))
+		{
+			continue;
+		}
+
+		if (!sysfs_attr_read_int(&charger_online_attrs[i], &online))
+		{
+			online = -1;
+		}
+
+		if (online != charger_online[i])
+		{
+			charger_online[i] = online;
+			changed |= CHARGER_SOURCE(i);
+		}
+	}
+
+	if (changed)
+	{
+		_charger_update_status();
+	}
+
+	return changed;
+}
+
+nyx_error_t core_charger_read_status(nyx_charger_status_t *status)
+{
+	_charger_read_online(CHARGER_ALL_SOURCES);
 
 	if (status)
 	{
@@ -115,7 +235,84 @@ void _battery_read_status()
 		{
 			strcpy(battery_status, status);
 		}
+
+		if (!sysfs_attr_read_int(&batt_voltage_attr, &curr_battery_state->voltage))
+		{
+			curr_battery_state->voltage = -1;
+		}
+
+		if (!sysfs_attr_read_int(&batt_temp_attr, &curr_battery_state->temperature))
+		{
+			/* unknown, see _has_battery_limits_changed() */
+			curr_battery_state->temperature = INT32_MIN;
+		}
+	}
+}
+
+/**
+ * Update the battery present/status values from the POWER_SUPPLY_* properties
+ * of a battery uevent. Returns false if the uevent does not carry them.
+ */
+static bool _battery_status_from_uevent(const power_supply_t *supply)
+{
+	int32_t present;
+	const char *status;
+
+	if (!curr_battery_state || !battery_status)
+	{
+		return false;
+	}
+
+	status = power_supply_property_string(supply, "STATUS");
+
+	if (!status || !power_supply_property_int(supply, "PRESENT", &present))
+	{
+		return false;
+	}
+
+	memset(curr_battery_state, 0, sizeof(nyx_battery_status_t));
+	curr_battery_state->present = (1 == present);
+	g_strlcpy(battery_status, status, STATUS_LEN);
+
+	if (!power_supply_property_int(supply, "VOLTAGE_NOW",
+	                               &curr_battery_state->voltage) &&
+	        !sysfs_attr_read_int(&batt_voltage_attr, &curr_battery_state->voltage))
+	{
+		curr_battery_state->voltage = -1;
+	}
+
+	if (!power_supply_property_int(supply, "TEMP",
+	                               &curr_battery_state->temperature) &&
+	        !sysfs_attr_read_int(&batt_temp_attr, &curr_battery_state->temperature))
+	{
+		curr_battery_state->temperature = INT32_MIN;
+	}
+
+	return true;
+}
+
+static power_supply_id_t _match_power_supply(const power_supply_t *supply)
+{
+	const char *name;
+	int i;
+
+	for (i = 0; i < POWER_SUPPLY_COUNT; i++)
+	{
+		if (!power_supply_sysfs_paths[i])
+		{
+			continue;
+		}
+
+		name = strrchr(power_supply_sysfs_paths[i], '/');
+		name = name ? name + 1 : power_supply_sysfs_paths[i];
+
+		if (strcmp(supply->name, name) == 0)
+		{
+			return (power_supply_id_t)i;
+		}
 	}
+
+	return POWER_SUPPLY_UNKNOWN;
 }
 
 bool _has_charger_state_changed(char *old_state, char *new_state)
@@ -172,6 +369,53 @@ bool _has_battery_state_changed(int old_state, int new_state)
 	return false;
 }
 
+/**
+ * Raise NYX_BATTERY_CRITICAL_VOLTAGE while the voltage (in uV) is below the
+ * critical voltage configured in the battery module, if any, and
+ * NYX_BATTERY_TEMPERATURE_LIMIT while the temperature (in tenths of a degree
+ * C) is outside the charging range; the bits are cleared again when the
+ * condition ends. Unknown readings (voltage
+ * <= 0, temperature INT32_MIN) keep the previous level.
+ */
+bool _has_battery_limits_changed(int32_t voltage, int32_t temperature)
+{
+	bool changed = false;
+
+	bool absent = curr_battery_state && !curr_battery_state->present;
+
+	/* without a battery neither condition holds */
+	if (voltage > 0 || absent)
+	{
+		int critical_mv = power_supply_critical_voltage_mv();
+		bool critical = !absent && (critical_mv > 0) &&
+		                (voltage / 1000 < critical_mv);
+
+		if (critical != battery_voltage_critical)
+		{
+			battery_voltage_critical = critical;
+			current_event = critical ? (current_event | NYX_BATTERY_CRITICAL_VOLTAGE) :
+			                (current_event & ~NYX_BATTERY_CRITICAL_VOLTAGE);
+			changed = true;
+		}
+	}
+
+	if (temperature != INT32_MIN || absent)
+	{
+		bool limit = !absent && ((temperature < CHARGE_MIN_TEMPERATURE_C * 10) ||
+		                         (temperature > CHARGE_MAX_TEMPERATURE_C * 10));
+
+		if (limit != battery_temperature_limit)
+		{
+			battery_temperature_limit = limit;
+			current_event = limit ? (current_event | NYX_BATTERY_TEMPERATURE_LIMIT) :
+			                (current_event & ~NYX_BATTERY_TEMPERATURE_LIMIT);
+			changed = true;
+		}
+	}
+
+	return changed;
+}
+
 bool _has_charger_connected_state_changed(bool old_state, bool new_state)
 {
 	if (old_state != new_state)
@@ -193,200 +437,307 @@ bool _has_charger_connected_state_changed(bool old_state, bool new_state)
 	return false;
 }
 
-gboolean _handle_power_supply_event(GIOChannel *channel, GIOCondition condition,
-                                    gpointer data)
+static void _latch_raised_events(nyx_charger_event_t before)
 {
-	struct udev_device *dev;
-	bool fire_charger_status_cb = false;
-	bool fire_state_change_cb = false;
-
-	if ((condition & G_IO_IN) == G_IO_IN)
+	if (charger_coalesce_ms)
 	{
-		dev = udev_monitor_receive_device(mon);
-
-		if (dev)
-		{
-			/* something related to power supply has changed; set the modified event and notify connected clients so
-			 * they can query the new status */
-
-			/* Check for event changes and initiate state callback for particular events as below:
-			 * NYX_CHARGE_COMPLETE if battery/status from NULL/Charging to Full, NYX_CHARGE_RESTART if battery/status from Full to Charging,
-			 * NYX_CHARGER_CONNECTED if USB,AC or any other charger online is from 0 to 1,
-			 * NYX_CHARGER_DISCONNECTED if any charger online from 1 to 0,
-			 * NYX_CHARGER_FAULT if online=1 and battery/status=Not Charging/Discharging? - TODO: not implemented since we are not sure of the state change for this event
-			 * NYX_BATTERY_PRESENT if battery is present (0-1)
-			 * NYX_BATTERY_ABSENT if battery is absent (1-0)
-			 * NYX_BATTERY_CRITICAL_VOLTAGE if Battery voltage below threshold - TODO: not implemented since we do not get kobject for voltage changes
-			 * NYX_BATTERY_TEMPERATURE_LIMIT if Battery temperature below/above limits - TODO: not implemented since we do not get kobject for temperature changes
-			 */
-
-			bool prev_charging = gChargerStatus.is_charging;
-			core_charger_read_status(NULL);
-
-			if (_has_charger_connected_state_changed(prev_charging,
-			        gChargerStatus.is_charging))
-			{
-				fire_charger_status_cb = true;
-				fire_state_change_cb = true;
-			}
-
-			if (fire_charger_status_cb && charger_status_callback)
-			{
-				charger_status_callback(nyxDev, NYX_CALLBACK_STATUS_DONE,
-				                        charger_status_callback_context);
-				fire_charger_status_cb = false;
-			}
-
-			/* Keep a note of previous values */
-			char *prev_batt_status = g_strdup(battery_status);
-			int prev_batt_present = curr_battery_state->present;
-
-			_battery_read_status();
-
-			if ((_has_charger_state_changed(prev_batt_status, battery_status)) ||
-			        (_has_battery_state_changed(prev_batt_present, curr_battery_state->present)))
-			{
-				fire_state_change_cb = true;
-			}
-
-			g_free(prev_batt_status);
-
-			if (fire_state_change_cb && state_change_callback)
-			{
-				state_change_callback(nyxDev, NYX_CALLBACK_STATUS_DONE,
-				                      state_change_callback_context);
-				fire_state_change_cb = false;
-			}
-		}
+		latched_event |= (current_event & ~before);
 	}
-
-	return TRUE;
 }
 
-void _charger_init_events()
+static void _check_charger_connected(bool prev_charging)
 {
-	_has_charger_state_changed(NULL, battery_status);
-	_has_battery_state_changed(0, curr_battery_state->present);
-	_has_charger_connected_state_changed(0, gChargerStatus.is_charging);
+	nyx_charger_event_t before = current_event;
+
+	if (_has_charger_connected_state_changed(prev_charging,
+	        gChargerStatus.is_charging))
+	{
+		fire_charger_status_pending = true;
+		fire_state_change_pending = true;
+	}
+
+	_latch_raised_events(before);
 }
 
-void _detect_charger_sysfs_paths()
+static void _check_battery_state(char *prev_batt_status, int prev_batt_present)
 {
-	char *battery_sysfs_path = find_power_supply_sysfs_path("Battery");
-	char *charger_usb_sysfs_path = find_power_supply_sysfs_path("USB");
-	char *charger_ac_sysfs_path = find_power_supply_sysfs_path("Mains");
-	char *charger_touch_sysfs_path = find_power_supply_sysfs_path("Touch");
-	char *charger_wireless_sysfs_path = find_power_supply_sysfs_path("Wireless");
+	nyx_charger_event_t before = current_event;
+
+	bool changed = _has_charger_state_changed(prev_batt_status, battery_status);
+
+	changed |= _has_battery_state_changed(prev_batt_present,
+	                                      curr_battery_state->present);
+	changed |= _has_battery_limits_changed(curr_battery_state->voltage,
+	                                       curr_battery_state->temperature);
 
-	if (charger_usb_sysfs_path)
+	if (changed)
 	{
-		snprintf(charger_usb_sysfs_online_path, PATH_LEN, "%s/online",
-		         charger_usb_sysfs_path);
+		fire_state_change_pending = true;
 	}
 
-	if (charger_ac_sysfs_path)
+	_latch_raised_events(before);
+}
+
+/**
+ * Do the deferred sysfs re-reads, if any, and fire the pending callbacks.
+ */
+static void _flush_power_supply_events(void)
+{
+	if (charger_reread_sources)
 	{
-		snprintf(charger_ac_sysfs_online_path, PATH_LEN, "%s/online",
-		         charger_ac_sysfs_path);
+		bool prev_charging = gChargerStatus.is_charging;
+		unsigned int changed;
+
+		PERF_COUNTER_INC(charger_counters[CHARGER_COUNTER_REREADS]);
+		changed = _charger_read_online(charger_reread_sources);
+
+		charger_reread_sources = 0;
+		_check_charger_connected(prev_charging);
+
+		/* a charger that came or went changes the battery status as well */
+		if (changed && battery_reread_on_charger_change)
+		{
+			battery_reread_pending = true;
+		}
 	}
 
-	if (charger_touch_sysfs_path)
+	battery_reread_on_charger_change = false;
+
+	if (fire_charger_status_pending && charger_status_callback)
 	{
-		snprintf(charger_touch_sysfs_online_path, PATH_LEN, "%s/online",
-		         charger_touch_sysfs_path);
+		PERF_COUNTER_INC(charger_counters[CHARGER_COUNTER_STATUS_CALLBACKS]);
+		charger_status_callback(nyxDev, NYX_CALLBACK_STATUS_DONE,
+		                        charger_status_callback_context);
 	}
 
-	if (charger_wireless_sysfs_path)
+	fire_charger_status_pending = false;
+
+	if (battery_reread_pending)
 	{
-		snprintf(charger_wireless_sysfs_online_path, PATH_LEN, "%s/online",
-		         charger_wireless_sysfs_path);
+		/* Keep a note of previous values */
+		char *prev_batt_status = g_strdup(battery_status);
+		int prev_batt_present = curr_battery_state->present;
+
+		battery_reread_pending = false;
+		PERF_COUNTER_INC(charger_counters[CHARGER_COUNTER_REREADS]);
+		_battery_read_status();
+		_check_battery_state(prev_batt_status, prev_batt_present);
+
+		g_free(prev_batt_status);
 	}
 
-	if (battery_sysfs_path)
+	if (fire_state_change_pending && state_change_callback)
 	{
-		snprintf(batt_present_path, PATH_LEN, "%s/present", battery_sysfs_path);
-		snprintf(batt_status_path, PATH_LEN, "%s/status", battery_sysfs_path);
+		PERF_COUNTER_INC(charger_counters[CHARGER_COUNTER_STATE_CALLBACKS]);
+		state_change_callback(nyxDev, NYX_CALLBACK_STATUS_DONE,
+		                      state_change_callback_context);
 	}
+
+	fire_state_change_pending = false;
 }
 
-static void _charger_cleanup(void)
+static gboolean _coalesce_timeout(gpointer data)
+{
+	PERF_COUNTER_INC(charger_counters[CHARGER_COUNTER_TIMER_WAKEUPS]);
+	charger_coalesce_timer = 0;
+	_flush_power_supply_events();
+
+	return FALSE;
+}
+
+void _handle_power_supply_event(const power_supply_t *supply, void *context)
 {
-	// _charger_init sets g_io_channel_set_close_on_unref, and calls g_io_channel_unref.
-	// This leaves one ref associated with the watch, so removing the watch should close the channel.
-	if (0 != watch)
+	if (!supply)
 	{
-		g_source_remove(watch);
-		watch = 0;
+		return;
 	}
 
-	if (NULL != curr_battery_state)
+	PERF_TRACE(nyx_charger, handle_power_supply_event__entry, supply->name);
+	PERF_COUNTER_INC(charger_counters[CHARGER_COUNTER_UEVENTS]);
+
+	/* something related to power supply has changed; set the modified event and notify connected clients so
+	 * they can query the new status */
+
+	/* Check for event changes and initiate state callback for particular events as below:
+	 * NYX_CHARGE_COMPLETE if battery/status from NULL/Charging to Full, NYX_CHARGE_RESTART if battery/status from Full to Charging,
+	 * NYX_CHARGER_CONNECTED if USB,AC or any other charger online is from 0 to 1,
+	 * NYX_CHARGER_DISCONNECTED if any charger online from 1 to 0,
+	 * NYX_CHARGER_FAULT if online=1 and battery/status=Not Charging/Discharging? - TODO: not implemented since we are not sure of the state change for this event
+	 * NYX_BATTERY_PRESENT if battery is present (0-1)
+	 * NYX_BATTERY_ABSENT if battery is absent (1-0)
+	 * NYX_BATTERY_CRITICAL_VOLTAGE while battery voltage is below the configured critical voltage
+	 * NYX_BATTERY_TEMPERATURE_LIMIT while battery temperature is outside the charging range
+	 * (both are only noticed when the battery reports a uevent, e.g. on its alert interrupts)
+	 */
+
+	/* If the uevent carries the POWER_SUPPLY_* properties of the supply that
+	 * changed, take the new state from there; the other supplies have not
+	 * changed. Decoded values are applied and checked for edges per uevent.
+	 * Anything else (unknown supply, remove events, drivers that report
+	 * nothing) is re-read from sysfs when the events are flushed, limited to
+	 * the supply that sent the uevent: battery/status is only re-read for a
+	 * charger if its online value turns out to have changed. */
+	power_supply_id_t id = _match_power_supply(supply);
+	int32_t online;
+
+	if (id < CHARGER_SUPPLY_COUNT &&
+	        power_supply_property_int(supply, "ONLINE", &online))
 	{
-		free(curr_battery_state);
-		curr_battery_state = NULL;
-	}
+		bool prev_charging = gChargerStatus.is_charging;
 
-	if (NULL != battery_status)
+		PERF_COUNTER_INC(charger_counters[CHARGER_COUNTER_UEVENTS_DECODED]);
+
+		/* as on the sysfs path, a charger that came or went changes the
+		 * battery status as well */
+		if (online != charger_online[id])
+		{
+			battery_reread_pending = true;
+		}
+
+		charger_online[id] = online;
+		_charger_update_status();
+		_check_charger_connected(prev_charging);
+	}
+	else if (id < CHARGER_SUPPLY_COUNT)
 	{
-		free(battery_status);
-		battery_status = NULL;
+		charger_reread_sources |= CHARGER_SOURCE(id);
+		battery_reread_on_charger_change = true;
 	}
+	else if (id == POWER_SUPPLY_BATTERY)
+	{
+		char *prev_batt_status = g_strdup(battery_status);
+		int prev_batt_present = curr_battery_state->present;
 
-	if (NULL != mon)
+		if (_battery_status_from_uevent(supply))
+		{
+			PERF_COUNTER_INC(charger_counters[CHARGER_COUNTER_UEVENTS_DECODED]);
+			_check_battery_state(prev_batt_status, prev_batt_present);
+		}
+		else
+		{
+			battery_reread_pending = true;
+		}
+
+		g_free(prev_batt_status);
+	}
+	else
 	{
-		udev_monitor_filter_remove(mon);
-		mon = NULL;
+		/* not a supply we know by name, it may be any of them */
+		charger_reread_sources = CHARGER_ALL_SOURCES;
+		battery_reread_pending = true;
 	}
 
-	if (NULL != udev)
+	if (0 == charger_coalesce_ms)
 	{
-		udev_unref(udev);
-		udev = NULL;
+		_flush_power_supply_events();
+	}
+	else if (0 == charger_coalesce_timer)
+	{
+		charger_coalesce_timer = g_timeout_add(charger_coalesce_ms, _coalesce_timeout,
+		                                       NULL);
 	}
 
-	return;
+	PERF_TRACE(nyx_charger, handle_power_supply_event__return);
 }
 
-nyx_error_t core_charger_init(void)
+void _charger_init_events()
+{
+	_has_charger_state_changed(NULL, battery_status);
+	_has_battery_state_changed(0, curr_battery_state->present);
+	_has_charger_connected_state_changed(0, gChargerStatus.is_charging);
+	_has_battery_limits_changed(curr_battery_state->voltage,
+	                            curr_battery_state->temperature);
+}
+
+void _detect_charger_sysfs_paths()
 {
-	int fd;
-	GIOChannel *channel = NULL;
+	const char *battery_sysfs_path = find_power_supply_sysfs_path("Battery");
+	const char *charger_usb_sysfs_path = find_power_supply_sysfs_path("USB");
+	const char *charger_ac_sysfs_path = find_power_supply_sysfs_path("Mains");
+	const char *charger_touch_sysfs_path = find_power_supply_sysfs_path("Touch");
+	const char *charger_wireless_sysfs_path = find_power_supply_sysfs_path("Wireless");
+	int i;
+
+	power_supply_sysfs_paths[POWER_SUPPLY_USB] = charger_usb_sysfs_path;
+	power_supply_sysfs_paths[POWER_SUPPLY_AC] = charger_ac_sysfs_path;
+	power_supply_sysfs_paths[POWER_SUPPLY_TOUCH] = charger_touch_sysfs_path;
+	power_supply_sysfs_paths[POWER_SUPPLY_WIRELESS] = charger_wireless_sysfs_path;
+	power_supply_sysfs_paths[POWER_SUPPLY_BATTERY] = battery_sysfs_path;
+
+	for (i = 0; i < CHARGER_SUPPLY_COUNT; i++)
+	{
+		if (power_supply_sysfs_paths[i])
+		{
+			sysfs_attr_init(&charger_online_attrs[i], power_supply_sysfs_paths[i],
+			                "online");
+		}
+	}
 
-	udev = udev_new();
+	if (battery_sysfs_path)
+	{
+		snprintf(batt_present_path, PATH_LEN, "%s/present", battery_sysfs_path);
+		snprintf(batt_status_path, PATH_LEN, "%s/status", battery_sysfs_path);
+		sysfs_attr_init(&batt_voltage_attr, battery_sysfs_path, "voltage_now");
+		sysfs_attr_init(&batt_temp_attr, battery_sysfs_path, "temp");
+	}
+}
 
-	if (!udev)
+static void _charger_cleanup(void)
+{
+	int i;
+
+	if (0 != power_supply_subscription)
 	{
-		nyx_error(MSGID_NYX_MOD_CHARG_ERR, 0,
-		          "Could not initialize udev component; charger status updates will not be available");
-		return NYX_ERROR_GENERIC;
+		power_supply_unsubscribe(power_supply_subscription);
+		power_supply_subscription = 0;
 	}
 
-	mon = udev_monitor_new_from_netlink(udev, "kernel");
+	if (0 != charger_coalesce_timer)
+	{
+		g_source_remove(charger_coalesce_timer);
+		charger_coalesce_timer = 0;
+	}
 
-	if (mon == NULL)
+	charger_reread_sources = 0;
+	battery_reread_pending = false;
+	battery_reread_on_charger_change = false;
+	fire_charger_status_pending = false;
+	fire_state_change_pending = false;
+	battery_voltage_critical = false;
+	battery_temperature_limit = false;
+	sysfs_attr_close(&batt_voltage_attr);
+	sysfs_attr_close(&batt_temp_attr);
+
+	for (i = 0; i < CHARGER_SUPPLY_COUNT; i++)
 	{
-		nyx_error(MSGID_NYX_MOD_NETLINK_ERR, 0,
-		          "Failed to create udev monitor for kernel events");
-		_charger_cleanup();
-		return NYX_ERROR_GENERIC;
+		sysfs_attr_close(&charger_online_attrs[i]);
+		charger_online[i] = -1;
 	}
 
-	if (udev_monitor_filter_add_match_subsystem_devtype(mon, "power_supply",
-	        NULL) < 0)
+	_charger_update_status();
+
+	if (NULL != curr_battery_state)
 	{
-		nyx_error(MSGID_NYX_MOD_CHR_SUB_ERR, 0,
-		          "Failed to setup udev filter for power_supply subsytem events");
-		_charger_cleanup();
-		return NYX_ERROR_GENERIC;
+		free(curr_battery_state);
+		curr_battery_state = NULL;
 	}
 
-	if (udev_monitor_enable_receiving(mon) < 0)
+	if (NULL != battery_status)
 	{
-		nyx_error(MSGID_NYX_MOD_ENABLE_REV_ERR, 0,
-		          "Failed to enable receiving kernel events for power_supply subsytem\n");
-		_charger_cleanup();
-		return NYX_ERROR_GENERIC;
+		free(battery_status);
+		battery_status = NULL;
 	}
 
+	memset(power_supply_sysfs_paths, 0, sizeof(power_supply_sysfs_paths));
+	release_power_supply_sysfs_paths();
+
+	return;
+}
+
+nyx_error_t core_charger_init(void)
+{
+	nyx_error_t error;
+
 	/* Initialize charger sysfs paths */
 	_detect_charger_sysfs_paths();
 	/* Initialize battery and charger status */
@@ -413,36 +764,16 @@ nyx_error_t core_charger_init(void)
 	/* Initialize events */
 	_charger_init_events();
 
-	/* Setup io watch for uevents */
-	fd = udev_monitor_get_fd(mon);
-
-	if (-1 == fd)
-	{
-		_charger_cleanup();
-		return NYX_ERROR_GENERIC;
-	}
-
-	channel = g_io_channel_unix_new(fd);
+	/* uevents come from the power supply monitor shared with the battery module */
+	error = power_supply_subscribe(_handle_power_supply_event, NULL,
+	                               &power_supply_subscription);
 
-	if (!channel)
-	{
-		_charger_cleanup();
-		return NYX_ERROR_GENERIC;
-	}
-
-	/* add watch event (which adds a ref) before calling g_io_channel_unref */
-	watch = g_io_add_watch(channel, G_IO_IN | G_IO_HUP | G_IO_NVAL,
-	                       _handle_power_supply_event, NULL);
-
-	/* Remove the ref from g_io_channel_unix_new so we won't leak the channel if g_io_add_watch failed */
-	/* watch holds another ref which is removed in _charger_cleanup */
-	g_io_channel_set_close_on_unref(channel, TRUE);
-	g_io_channel_unref(channel);
-
-	if (0 == watch)
+	if (NYX_ERROR_NONE != error)
 	{
+		nyx_error(MSGID_NYX_MOD_NETLINK_ERR, 0,
+		          "Failed to subscribe to power_supply events; charger status updates will not be available");
 		_charger_cleanup();
-		return NYX_ERROR_GENERIC;
+		return error;
 	}
 
 	return NYX_ERROR_NONE;
@@ -470,7 +801,35 @@ nyx_error_t core_charger_disable_charging(nyx_charger_status_t *status)
 
 nyx_error_t core_charger_query_charger_event(nyx_charger_event_t *event)
 {
-	*event = current_event;
+	*event = current_event | latched_event;
+	latched_event = NYX_NO_NEW_EVENT;
 
 	return NYX_ERROR_NONE;
 }
+
+nyx_error_t core_charger_set_coalesce_window(unsigned int window_ms)
+{
+	charger_coalesce_ms = window_ms;
+
+	/* switching coalescing off flushes whatever is pending */
+	if (0 == window_ms && 0 != charger_coalesce_timer)
+	{
+		g_source_remove(charger_coalesce_timer);
+		charger_coalesce_timer = 0;
+		_flush_power_supply_events();
+	}
+
+	return NYX_ERROR_NONE;
+}
+
+/**
+ * Copy the runtime counters, see perf_counters_read().
+ */
+nyx_error_t core_charger_read_counters(nyx_perf_counter_t *counters, int *count)
+{
+	PERF_COUNTER_SET(charger_counters[CHARGER_COUNTER_SYSFS_READS],
+	                 sysfs_attr_read_count());
+
+	return perf_counters_read(charger_counter_names, charger_counters,
+	                          CHARGER_COUNTER_COUNT, counters, count);
+}
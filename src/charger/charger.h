@@ -17,11 +17,15 @@
 #ifndef CHARGER_H_
 #define CHARGER_H_
 
+#include "perf_counters.h"
+
 nyx_error_t core_charger_init(void);
 nyx_error_t core_charger_deinit(void);
 nyx_error_t core_charger_read_status(nyx_charger_status_t *status);
 nyx_error_t core_charger_enable_charging(nyx_charger_status_t *status);
 nyx_error_t core_charger_disable_charging(nyx_charger_status_t *status);
 nyx_error_t core_charger_query_charger_event(nyx_charger_event_t *event);
+nyx_error_t core_charger_set_coalesce_window(unsigned int window_ms);
+nyx_error_t core_charger_read_counters(nyx_perf_counter_t *counters, int *count);
 
 #endif
@@ -33,6 +33,9 @@
 
 #include "charger.h"
 
+/* upper bound for the uevent coalescing window */
+#define CHARGER_COALESCE_WINDOW_MAX_MS 10000
+
 nyx_device_t *nyxDev = NULL;
 void *charger_status_callback_context = NULL;
 void *state_change_callback_context = NULL;
@@ -88,6 +91,14 @@ nyx_error_t nyx_module_open(nyx_instance_t i, nyx_device_t **d)
 	                           NYX_CHARGER_QUERY_CHARGER_EVENT_MODULE_METHOD,
 	                           "charger_query_charger_event");
 
+	nyx_module_register_method(i, (nyx_device_t *)nyxDev,
+	                           NYX_CHARGER_SET_COALESCE_WINDOW_MODULE_METHOD,
+	                           "charger_set_coalesce_window");
+
+	nyx_module_register_method(i, (nyx_device_t *)nyxDev,
+	                           NYX_CHARGER_QUERY_COUNTERS_MODULE_METHOD,
+	                           "charger_query_counters");
+
 	nyx_error_t result = core_charger_init();
 
 	if (NYX_ERROR_NONE != result)
@@ -220,3 +231,30 @@ nyx_error_t charger_query_charger_event(nyx_device_handle_t handle,
 
 	return core_charger_query_charger_event(event);
 }
+
+nyx_error_t charger_set_coalesce_window(nyx_device_handle_t handle,
+                                        unsigned int window_ms)
+{
+	if (handle != nyxDev)
+	{
+		return NYX_ERROR_INVALID_HANDLE;
+	}
+
+	if (window_ms > CHARGER_COALESCE_WINDOW_MAX_MS)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	return core_charger_set_coalesce_window(window_ms);
+}
+
+nyx_error_t charger_query_counters(nyx_device_handle_t handle,
+                                   nyx_perf_counter_t *counters, int *count)
+{
+	if (handle != nyxDev)
+	{
+		return NYX_ERROR_INVALID_HANDLE;
+	}
+
+	return core_charger_read_counters(counters, count);
+}
@@ -184,6 +184,20 @@ nyx_error_t _charger_query_charger_event(nyx_charger_event_t *event)
 	return testChargerQueryChargerEvent_retval;
 }
 
+unsigned int testChargerCoalesceWindow = 0;
+nyx_error_t core_charger_set_coalesce_window(unsigned int window_ms)
+{
+	testChargerCoalesceWindow = window_ms;
+	return NYX_ERROR_NONE;
+}
+
+int testChargerReadCountersCount = 0;
+nyx_error_t core_charger_read_counters(nyx_perf_counter_t *counters, int *count)
+{
+	*count = testChargerReadCountersCount;
+	return NYX_ERROR_NONE;
+}
+
 //*****************************************************************************
 //*****************************************************************************
 
@@ -447,6 +461,49 @@ static void test_charger_query_charger_event(api_test_fixture *fixture,
 	g_assert_true(testEvent == NYX_CHARGER_CONNECTED);
 }
 
+//
+// Tests for the charger_set_coalesce_window API method
+// nyx_error_t charger_set_coalesce_window(nyx_device_handle_t handle, unsigned int window_ms)
+//
+static void test_charger_set_coalesce_window(api_test_fixture *fixture,
+        gconstpointer unused)
+{
+	// Force a failed call
+	g_assert_true(NYX_ERROR_INVALID_HANDLE == charger_set_coalesce_window(NULL,
+	              100));
+
+	// Force another failed call
+	testChargerCoalesceWindow = 0;
+	g_assert_true(NYX_ERROR_INVALID_VALUE == charger_set_coalesce_window(
+	                  fixture->fixture_device, CHARGER_COALESCE_WINDOW_MAX_MS + 1));
+	g_assert_true(0 == testChargerCoalesceWindow);
+
+	// Check for no error
+	g_assert_true(NYX_ERROR_NONE == charger_set_coalesce_window(
+	                  fixture->fixture_device, 250));
+	g_assert_true(250 == testChargerCoalesceWindow);
+}
+
+//
+// Tests for the charger_query_counters API method
+// nyx_error_t charger_query_counters(nyx_device_handle_t handle, nyx_perf_counter_t *counters, int *count)
+//
+static void test_charger_query_counters(api_test_fixture *fixture,
+                                        gconstpointer unused)
+{
+	int count = 0;
+
+	// Force a failed call
+	g_assert_true(NYX_ERROR_INVALID_HANDLE == charger_query_counters(NULL, NULL,
+	              &count));
+
+	// Check for no error
+	testChargerReadCountersCount = 7;
+	g_assert_true(NYX_ERROR_NONE == charger_query_counters(fixture->fixture_device,
+	              NULL, &count));
+	g_assert_true(7 == count);
+}
+
 
 //
 // Set-up GLib, then register and run the tests.
@@ -467,6 +524,10 @@ int main(int argc, char **argv)
 	            test_charger_register_state_change_callback);
 	ADD_APITEST("/charger/api/charger_query_charger_event",
 	            test_charger_query_charger_event);
+	ADD_APITEST("/charger/api/charger_set_coalesce_window",
+	            test_charger_set_coalesce_window);
+	ADD_APITEST("/charger/api/charger_query_counters",
+	            test_charger_query_counters);
 
 	return g_test_run();
 }
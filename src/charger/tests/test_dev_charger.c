@@ -78,15 +78,43 @@ nyx_device_callback_function_t state_change_callback = NULL;
 
 // Pull in the unit under test
 #include "../device/charger.c"
+#include "../../utils/power_supply.c"
 
 //*****************************************************************************
 //*****************************************************************************
 
 // mock out calls to nyx-modules: utils.c
-char *find_power_supply_sysfs_path(const char *device_type)
+const char *find_power_supply_sysfs_path(const char *device_type)
 {
 	// return whatever they asked for: Battery, USB, Mains, Touch, or Wireless (from _detect_charger_sysfs_paths() in device/charger.c)
-	return (char *) device_type;
+	return device_type;
+}
+
+void release_power_supply_sysfs_paths(void)
+{
+	return;
+}
+
+// no sysfs attribute (online, voltage_now, temp) is readable in these tests
+void sysfs_attr_init(sysfs_attr_t *attr, const char *dir, const char *name)
+{
+	attr->fd = -1;
+	snprintf(attr->path, SYSFS_ATTR_PATH_LEN, "%s/%s", dir, name);
+}
+
+void sysfs_attr_close(sysfs_attr_t *attr)
+{
+	return;
+}
+
+bool sysfs_attr_read_int(sysfs_attr_t *attr, int32_t *value)
+{
+	return false;
+}
+
+uint64_t sysfs_attr_read_count(void)
+{
+	return 0;
 }
 
 // TODO: Called by _battery_read_status(), which checks for -1 (but doesn't care about ret_string)
@@ -219,11 +247,89 @@ int udev_monitor_get_fd(struct udev_monitor *udev_monitor)
 	return testUdevMonitorGetFd_retval;
 }
 
-int udev_monitor_filter_remove(struct udev_monitor *udev_monitor)
+struct udev_monitor *udev_monitor_unref(struct udev_monitor *udev_monitor)
+{
+	return NULL;
+}
+
+// no supplies are present when the shared monitor enumerates them
+struct udev_enumerate
+{
+	int opaque;
+};
+struct udev_enumerate testUdevEnumerateStruct;
+struct udev_enumerate *udev_enumerate_new(struct udev *udev)
+{
+	return &testUdevEnumerateStruct;
+}
+
+int udev_enumerate_add_match_subsystem(struct udev_enumerate *udev_enumerate,
+                                       const char *subsystem)
+{
+	return 0;
+}
+
+int udev_enumerate_scan_devices(struct udev_enumerate *udev_enumerate)
 {
 	return 0;
 }
 
+struct udev_list_entry *udev_enumerate_get_list_entry(struct udev_enumerate
+        *udev_enumerate)
+{
+	return NULL;
+}
+
+struct udev_enumerate *udev_enumerate_unref(struct udev_enumerate
+        *udev_enumerate)
+{
+	return NULL;
+}
+
+struct udev_device *udev_device_new_from_syspath(struct udev *udev,
+        const char *syspath)
+{
+	return NULL;
+}
+
+// no uevent properties, so _handle_power_supply_event() falls back to sysfs
+struct udev_list_entry *udev_device_get_properties_list_entry(
+    struct udev_device *udev_device)
+{
+	return NULL;
+}
+
+struct udev_list_entry *udev_list_entry_get_next(struct udev_list_entry
+        *list_entry)
+{
+	return NULL;
+}
+
+const char *udev_list_entry_get_name(struct udev_list_entry *list_entry)
+{
+	return NULL;
+}
+
+const char *udev_list_entry_get_value(struct udev_list_entry *list_entry)
+{
+	return NULL;
+}
+
+const char *udev_device_get_action(struct udev_device *udev_device)
+{
+	return "change";
+}
+
+const char *udev_device_get_sysname(struct udev_device *udev_device)
+{
+	return "USB";
+}
+
+struct udev_device *udev_device_unref(struct udev_device *udev_device)
+{
+	return NULL;
+}
+
 void udev_unref(struct udev *udev)
 {
 	// is this a request for our valid "test" udev?
@@ -25,16 +25,33 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/statvfs.h>
+#include <sys/sysinfo.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <net/if.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <stdint.h>
 #include <string.h>
+#include <limits.h>
+#include <sys/syscall.h>
+#include <time.h>
 #include <openssl/sha.h>
 
 #include <nyx/nyx_module.h>
 #include <nyx/module/nyx_utils.h>
 #include "msgid.h"
+#include "info_cache.h"
+#include "perf_counters.h"
+
+/* "18446744073709551615 GB" and the terminating NUL */
+#define SIZE_STR_LEN 24
 
 // Internal device info structure
 typedef struct
@@ -46,20 +63,103 @@ typedef struct
 	const char *wifi_mac;
 	const char *wired_mac;
 	const char *bdaddr;
+	int link_events_fd; /* rtnetlink link events, invalidate the MAC cache */
+	char ram_size[SIZE_STR_LEN];
+	char storage_size[SIZE_STR_LEN];
+	char storage_free[SIZE_STR_LEN];
+	time_t storage_free_time; /* CLOCK_MONOTONIC seconds of storage_free */
+	info_cache_t cache;       /* values shared by all processes this boot */
+	unsigned int cache_fields; /* bits of the fields the shared cache holds */
 } device_info_device_t;
 
+/* runtime counters, see device_info_query_counters() */
+enum
+{
+	DEVICE_INFO_COUNTER_QUERIES,
+	DEVICE_INFO_COUNTER_CACHE_HITS,
+	DEVICE_INFO_COUNTER_CACHE_MISSES,
+	DEVICE_INFO_COUNTER_SYSTEM_READS,
+	DEVICE_INFO_COUNTER_COUNT
+};
+
+static const char *const device_info_counter_names[DEVICE_INFO_COUNTER_COUNT] =
+{
+	"queries",
+	"cache_hits",
+	"cache_misses",
+	"system_reads",
+};
+
+static uint64_t device_info_counters[DEVICE_INFO_COUNTER_COUNT];
+
+/*
+ * Fields of the shared cache. Only values that are fixed for the boot are
+ * stored; the network MACs follow link events and are always read here.
+ * Bump device_info_cache_layout when changing the list.
+ */
+enum
+{
+	CACHE_NDUID,
+	CACHE_BDADDR,
+	CACHE_RAM_SIZE,
+	CACHE_STORAGE_SIZE,
+	CACHE_FIELDS
+};
+
+static const uint32_t device_info_cache_layout = 1;
+
 static const unsigned int  NDUID_LEN = SHA_DIGEST_LENGTH *
                                        2; /* 2 hex chars per byte */
-static const char *const  NDUID_DIR = WEBOS_INSTALL_EXECSTATEDIR "/nyx";
-static const char *const  NDUID_PATH = WEBOS_INSTALL_EXECSTATEDIR "/nyx/nduid";
+/* the benchmarks point this at a scratch directory */
+#ifndef NDUID_STATE_DIR
+#define NDUID_STATE_DIR WEBOS_INSTALL_EXECSTATEDIR "/nyx"
+#endif
+
+static const char *const  NDUID_DIR = NDUID_STATE_DIR;
+static const char *const  NDUID_PATH = NDUID_STATE_DIR "/nduid";
 
-static const char *const  read_eth0_mac =
-    "ifconfig eth0 2>&1 | awk '/HWaddr/ {print $5}'";
-static const char *const  read_wifi_mac =
-    "ifconfig wlan0 2>&1 | awk '/HWaddr/ {print $5}'";
+/* filesystem whose size is reported as the device storage */
+static const char *const  storage_path = "/";
 
-static const char *const  read_bdaddr =
-    "hcitool dev 2>&1 | awk '/hci0/ {print $2}'";
+/* STORAGE_FREE is recomputed at most this often */
+static const time_t storage_free_interval = 10;
+
+/* physical RAM is sold in these steps; the kernel reserves part of it */
+static const uint64_t ram_size_step = 256ULL * 1024 * 1024;
+
+static const char *const  wired_ifname = "eth0";
+static const char *const  wifi_ifname = "wlan0";
+
+/* "xx:xx:xx:xx:xx:xx" and the terminating NUL */
+#define HWADDR_STR_LEN 18
+
+/*
+ * HCI device info as returned by HCIGETDEVINFO, mirroring the BlueZ
+ * <bluetooth/hci.h> ABI so that the module does not need BlueZ to build.
+ */
+#ifndef AF_BLUETOOTH
+#define AF_BLUETOOTH 31
+#endif
+#define BTPROTO_HCI   1
+#define HCIGETDEVINFO _IOR('H', 211, int)
+
+struct hci_dev_info_abi
+{
+	uint16_t dev_id;
+	char name[8];
+	uint8_t bdaddr[6];
+	uint32_t flags;
+	uint8_t type;
+	uint8_t features[8];
+	uint32_t pkt_type;
+	uint32_t link_policy;
+	uint32_t link_mode;
+	uint16_t acl_mtu;
+	uint16_t acl_pkts;
+	uint16_t sco_mtu;
+	uint16_t sco_pkts;
+	uint32_t stat[10];
+};
 
 NYX_DECLARE_MODULE(NYX_DEVICE_DEVICE_INFO, "DeviceInfo");
 
@@ -102,103 +202,153 @@ error:
 static nyx_error_t write_device_nduid(const char nduid[NDUID_LEN + 1])
 {
 	nyx_error_t error = NYX_ERROR_NONE;
-	struct stat st;
+	char tmp_path[PATH_MAX];
 
-	if (stat(NDUID_DIR, &st) != 0)
+	/* EEXIST also covers a racing first query that has just created it */
+	if (mkdir(NDUID_DIR, 0755) < 0 && errno != EEXIST)
 	{
-		if (mkdir(NDUID_DIR, 0755) < 0)
-		{
-			return NYX_ERROR_GENERIC;
-		}
+		return NYX_ERROR_GENERIC;
 	}
 
-	FILE *fp = fopen(NDUID_PATH, "w");
+	/*
+	 * Write a private temporary file and link it into place, so nduid is
+	 * never half written and, when first queries race, exactly one writer
+	 * wins; the others find the file already there.
+	 */
+	snprintf(tmp_path, sizeof(tmp_path), "%s.XXXXXX", NDUID_PATH);
 
-	if (!fp)
+	int fd = mkostemp(tmp_path, O_CLOEXEC);
+
+	if (fd < 0)
 	{
 		nyx_error(MSGID_NYX_MOD_WRITE_NDUID_ERR, 0, "Error in opening file : %s",
-		          NDUID_PATH);
-		error = NYX_ERROR_NOT_FOUND;
-		goto error;
+		          tmp_path);
+		return NYX_ERROR_NOT_FOUND;
 	}
 
-	int ret = fwrite(nduid, NDUID_LEN, 1, fp);
-
-	if (ret <= 0)
+	if (write(fd, nduid, NDUID_LEN) != NDUID_LEN || fsync(fd) < 0)
 	{
 		error = NYX_ERROR_GENERIC;
 		goto error;
 	}
 
-	ret = chmod(NDUID_PATH, S_IRUSR | S_IRGRP | S_IROTH);
-
-	if (ret < 0)
+	if (fchmod(fd, S_IRUSR | S_IRGRP | S_IROTH) < 0)
 	{
 		nyx_error(MSGID_NYX_MOD_CHMOD_ERR, 0, "Error in changing permissions for %s",
-		          NDUID_PATH);
+		          tmp_path);
 		error = NYX_ERROR_GENERIC;
+		goto error;
 	}
 
-error:
-
-	if (fp)
+	if (link(tmp_path, NDUID_PATH) < 0 && errno != EEXIST)
 	{
-		fclose(fp);
+		nyx_error(MSGID_NYX_MOD_WRITE_NDUID_ERR, 0, "Error in linking %s",
+		          tmp_path);
+		error = NYX_ERROR_GENERIC;
 	}
 
+error:
+	close(fd);
+	unlink(tmp_path);
+
 	return error;
 }
 
-static nyx_error_t generate_device_nduid(char nduid[NDUID_LEN + 1])
+/* Fills buf from the kernel entropy pool, falling back to /dev/urandom. */
+static nyx_error_t read_random_bytes(unsigned char *buf, size_t len)
 {
-	// Arbitrary bits selected as salt for SHA1 hashing
-	char salt[] = {0x55, 0xaa, 0x30, 0x08, 0xce, 0xfa, 0xbe, 0xba};
-	unsigned long offset = 0;
-	unsigned char input[random_bytes + sizeof(salt)];
-	unsigned char result[SHA_DIGEST_LENGTH];
-	char *unique_id = NULL;
-	nyx_error_t error = NYX_ERROR_NONE;
-	FILE *fp = NULL;
+	size_t done = 0;
 
-	memcpy(input, salt, sizeof(salt));
-	offset = sizeof(salt);
+#ifdef SYS_getrandom
 
-	// Using random bytes from /dev/urandom to get unique id
-	// However unique ids like disk UUID, MAC address, IMEI no., and others
-	// can be used when implementing for other MACHINE-s.
+	while (done < len)
+	{
+		long ret = syscall(SYS_getrandom, buf + done, len - done, 0);
 
-	fp = fopen("/dev/urandom", "r");
+		if (ret < 0 && errno == EINTR)
+		{
+			continue;
+		}
 
-	if (fp)
+		if (ret <= 0)
+		{
+			break;
+		}
+
+		done += ret;
+	}
+
+	if (done == len)
+	{
+		return NYX_ERROR_NONE;
+	}
+
+	/* only kernels without the syscall fall through */
+	if (errno != ENOSYS)
 	{
-		unique_id = malloc(random_bytes);
+		nyx_error(MSGID_NYX_MOD_URANDOM_ERR, 0, "Error in reading random bytes");
+		return NYX_ERROR_GENERIC;
+	}
+
+	done = 0;
+#endif
 
-		if (!unique_id)
+	int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+
+	if (fd < 0)
+	{
+		nyx_error(MSGID_NYX_MOD_URANDOM_OPEN_ERR, 0, "Error in opening /dev/urandom");
+		return NYX_ERROR_GENERIC;
+	}
+
+	while (done < len)
+	{
+		ssize_t ret = read(fd, buf + done, len - done);
+
+		if (ret < 0 && errno == EINTR)
 		{
-			error = NYX_ERROR_OUT_OF_MEMORY;
-			goto error;
+			continue;
 		}
 
-		int ret = fread(unique_id, random_bytes, 1, fp);
-
 		if (ret <= 0)
 		{
-			nyx_error(MSGID_NYX_MOD_URANDOM_ERR, 0, "Error in reading from /dev/urandom");
-			error = NYX_ERROR_GENERIC;
-			goto error;
+			break;
 		}
+
+		done += ret;
 	}
-	else
+
+	close(fd);
+
+	if (done != len)
 	{
-		nyx_error(MSGID_NYX_MOD_URANDOM_OPEN_ERR, 0, "Error in opening /dev/urandom");
-		error = NYX_ERROR_GENERIC;
-		goto error;
+		nyx_error(MSGID_NYX_MOD_URANDOM_ERR, 0, "Error in reading from /dev/urandom");
+		return NYX_ERROR_GENERIC;
 	}
 
-	memcpy(input + offset, unique_id, random_bytes);
-	offset += random_bytes;
+	return NYX_ERROR_NONE;
+}
+
+static nyx_error_t generate_device_nduid(char nduid[NDUID_LEN + 1])
+{
+	// Arbitrary bits selected as salt for SHA1 hashing
+	char salt[] = {0x55, 0xaa, 0x30, 0x08, 0xce, 0xfa, 0xbe, 0xba};
+	unsigned char input[random_bytes + sizeof(salt)];
+	unsigned char result[SHA_DIGEST_LENGTH];
+
+	memcpy(input, salt, sizeof(salt));
+
+	// Using random bytes from the kernel to get unique id
+	// However unique ids like disk UUID, MAC address, IMEI no., and others
+	// can be used when implementing for other MACHINE-s.
+	nyx_error_t error = read_random_bytes(input + sizeof(salt), random_bytes);
+
+	if (NYX_ERROR_NONE != error)
+	{
+		return error;
+	}
 
-	SHA1(input, offset, result);
+	SHA1(input, sizeof(input), result);
 
 	/* Need 3 bytes to print out a byte as a hex string */
 	char *sptr;
@@ -214,15 +364,13 @@ static nyx_error_t generate_device_nduid(char nduid[NDUID_LEN + 1])
 
 	error = write_device_nduid(nduid);
 
-error:
-
-	if (fp)
+	if (NYX_ERROR_NONE != error)
 	{
-		fclose(fp);
+		return error;
 	}
 
-	free(unique_id);
-	return error;
+	/* another writer may have won, report what is on disk */
+	return read_device_nduid(nduid);
 }
 
 static nyx_error_t get_device_nduid(char nduid[NDUID_LEN + 1])
@@ -241,61 +389,283 @@ static nyx_error_t get_device_nduid(char nduid[NDUID_LEN + 1])
 }
 
 /*
-* Input parameters:
-* command - command line command to execute
-* target  - output from the command. If *target != NULL, it must be
-*           a dynamically allocated buffer (since it will be freed)
+* Reads the MAC address of a network interface, from sysfs or, if that is
+* not mounted, with SIOCGIFHWADDR. target receives a newly allocated
+* "xx:xx:xx:xx:xx:xx" string.
 */
-static nyx_error_t execute_read_info(const char *command, char **target)
+static nyx_error_t read_netdev_hwaddr(const char *ifname, char **target)
 {
-	FILE *fp = NULL;
-	nyx_error_t retVal = NYX_ERROR_GENERIC;
+	char path[64];
+	char addr[HWADDR_STR_LEN] = "";
+
+	snprintf(path, sizeof(path), "/sys/class/net/%s/address", ifname);
+
+	FILE *fp = fopen(path, "r");
+
+	if (fp)
+	{
+		if (!fgets(addr, sizeof(addr), fp))
+		{
+			addr[0] = '\0';
+		}
+
+		fclose(fp);
+	}
 
-	if (NULL != *target)
+	if (strlen(addr) != HWADDR_STR_LEN - 1)
 	{
-		free(*target);
-		*target = NULL;
+		struct ifreq ifr;
+		int sock = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+
+		if (sock < 0)
+		{
+			return NYX_ERROR_DEVICE_UNAVAILABLE;
+		}
+
+		memset(&ifr, 0, sizeof(ifr));
+		strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+
+		if (ioctl(sock, SIOCGIFHWADDR, &ifr) < 0)
+		{
+			close(sock);
+			return NYX_ERROR_DEVICE_UNAVAILABLE;
+		}
+
+		close(sock);
+
+		const unsigned char *hw = (const unsigned char *)ifr.ifr_hwaddr.sa_data;
+		snprintf(addr, sizeof(addr), "%02x:%02x:%02x:%02x:%02x:%02x",
+		         hw[0], hw[1], hw[2], hw[3], hw[4], hw[5]);
 	}
 
-	fp = popen(command, "r");
+	*target = strdup(addr);
+	return *target ? NYX_ERROR_NONE : NYX_ERROR_OUT_OF_MEMORY;
+}
 
-	if (NULL != fp)
+/*
+* Reads the address of hci0 with HCIGETDEVINFO, formatted like hcitool
+* (upper case, most significant byte first).
+*/
+static nyx_error_t read_hci_bdaddr(char **target)
+{
+	struct hci_dev_info_abi info;
+	char addr[HWADDR_STR_LEN];
+	int sock = socket(AF_BLUETOOTH, SOCK_RAW | SOCK_CLOEXEC, BTPROTO_HCI);
+
+	if (sock < 0)
+	{
+		return NYX_ERROR_DEVICE_UNAVAILABLE;
+	}
+
+	memset(&info, 0, sizeof(info));
+	info.dev_id = 0;
+
+	if (ioctl(sock, HCIGETDEVINFO, &info) < 0)
 	{
-		size_t temp_size = 0;
-		ssize_t read_count = 0;
-		// when delim is set to 'EOF' getdelim supports multiple lines
-		read_count = getdelim(target, &temp_size, EOF, fp);
+		close(sock);
+		return NYX_ERROR_DEVICE_UNAVAILABLE;
+	}
+
+	close(sock);
+
+	/* bdaddr_t is stored little endian */
+	snprintf(addr, sizeof(addr), "%02X:%02X:%02X:%02X:%02X:%02X",
+	         info.bdaddr[5], info.bdaddr[4], info.bdaddr[3],
+	         info.bdaddr[2], info.bdaddr[1], info.bdaddr[0]);
+
+	*target = strdup(addr);
+	return *target ? NYX_ERROR_NONE : NYX_ERROR_OUT_OF_MEMORY;
+}
+
+static int open_link_events(void)
+{
+	struct sockaddr_nl addr;
+	int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC,
+	                NETLINK_ROUTE);
+
+	if (fd < 0)
+	{
+		return -1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+	addr.nl_groups = RTMGRP_LINK;
+
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+	{
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+static void free_cached(const char **value)
+{
+	free((void *) *value);
+	*value = NULL;
+}
 
-		if (-1 == read_count)
+/*
+* Drops the cached network MACs if a link was added, removed or changed
+* since the last query. Without an event socket nothing is cached.
+*/
+static void refresh_netdev_cache(device_info_device_t *dev)
+{
+	char buf[4096];
+	int changed = (dev->link_events_fd < 0);
+	ssize_t len;
+
+	while (dev->link_events_fd >= 0 &&
+	        (len = recv(dev->link_events_fd, buf, sizeof(buf), 0)) != 0)
+	{
+		if (len < 0)
 		{
-			if (*target)
+			/* ENOBUFS means events were lost, assume the worst */
+			if (errno == ENOBUFS)
 			{
-				free(*target);
-				*target = NULL;
+				changed = 1;
+				continue;
 			}
 
-			retVal = NYX_ERROR_DEVICE_UNAVAILABLE;
+			if (errno == EINTR)
+			{
+				continue;
+			}
+
+			break;
 		}
-		else
+
+		struct nlmsghdr *nlh;
+
+		for (nlh = (struct nlmsghdr *)buf; NLMSG_OK(nlh, (size_t)len);
+		        nlh = NLMSG_NEXT(nlh, len))
 		{
-			// remove unnecessary extra endline character
-			if (read_count > 0 && (*target)[read_count - 1] == '\n')
+			if (nlh->nlmsg_type == RTM_NEWLINK || nlh->nlmsg_type == RTM_DELLINK)
 			{
-				(*target)[read_count - 1] = '\0';
+				changed = 1;
 			}
+		}
+	}
+
+	if (changed)
+	{
+		free_cached(&dev->wifi_mac);
+		free_cached(&dev->wired_mac);
+	}
+}
+
+/*
+* Formats a byte count as "<n> KB", "<n> MB" or "<n> GB", rounded to the
+* nearest unit.
+*/
+static void format_size(uint64_t bytes, char *dest, size_t dest_len)
+{
+	static const char *const units[] = { "KB", "MB", "GB" };
+	uint64_t val = (bytes + 512) / 1024;
+	int unit = 0;
+
+	while (val >= 1024 && unit < 2)
+	{
+		val = (val + 512) / 1024;
+		unit++;
+	}
+
+	snprintf(dest, dest_len, "%llu %s", (unsigned long long)val, units[unit]);
+}
+
+static nyx_error_t read_ram_size(char *dest, size_t dest_len)
+{
+	struct sysinfo info;
+
+	if (sysinfo(&info) < 0)
+	{
+		return NYX_ERROR_GENERIC;
+	}
+
+	/* MemTotal lacks what the kernel reserved, round up to the module size */
+	uint64_t bytes = (uint64_t)info.totalram * info.mem_unit;
+	bytes = (bytes + ram_size_step - 1) / ram_size_step * ram_size_step;
+
+	format_size(bytes, dest, dest_len);
+	return NYX_ERROR_NONE;
+}
+
+static nyx_error_t read_storage_size(char *total, char *avail, size_t len)
+{
+	struct statvfs buf;
+
+	if (statvfs(storage_path, &buf) < 0)
+	{
+		nyx_error(MSGID_NYX_MOD_STORAGE_ERR, 0,
+		          "Error in getting root storage size");
+		return NYX_ERROR_GENERIC;
+	}
+
+	if (total)
+	{
+		format_size((uint64_t)buf.f_blocks * buf.f_frsize, total, len);
+	}
+
+	if (avail)
+	{
+		format_size((uint64_t)buf.f_bavail * buf.f_frsize, avail, len);
+	}
+
+	return NYX_ERROR_NONE;
+}
 
-			retVal = NYX_ERROR_NONE;
+#ifdef NYX_INFO_CACHE_DIR
+static const char *const cache_path = NYX_INFO_CACHE_DIR "/device_info.cache";
 
+/*
+* Publishes the cached fields resolved so far for later openers, together
+* with those of the cache this process mapped. It is written again whenever
+* a field the shared cache lacks gets resolved, e.g. a BDADDR once the
+* adapter shows up. Nothing is read just for the cache, and a failed write
+* is not retried until another field is resolved.
+*/
+static void publish_info_cache(device_info_device_t *dev)
+{
+	const char *values[CACHE_FIELDS] = { NULL, };
+	unsigned int fields = 0;
+
+	values[CACHE_NDUID] = dev->nduid_str;
+	values[CACHE_BDADDR] = dev->bdaddr;
+	values[CACHE_RAM_SIZE] = dev->ram_size[0] ? dev->ram_size : NULL;
+	values[CACHE_STORAGE_SIZE] = dev->storage_size[0] ? dev->storage_size : NULL;
+
+	for (unsigned int i = 0; i < CACHE_FIELDS; i++)
+	{
+		if (NULL == values[i])
+		{
+			values[i] = info_cache_get(&dev->cache, i);
 		}
 
-		pclose(fp);
+		if (values[i])
+		{
+			fields |= 1u << i;
+		}
 	}
-	else
+
+	if (0 == (fields & ~dev->cache_fields))
 	{
-		retVal = NYX_ERROR_DEVICE_UNAVAILABLE;
+		return;
 	}
 
-	return retVal;
+	dev->cache_fields = fields;
+	info_cache_write(cache_path, device_info_cache_layout, values,
+	                 CACHE_FIELDS);
+}
+#endif
+
+static time_t monotonic_seconds(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec;
 }
 
 nyx_error_t nyx_module_open(nyx_instance_t i, nyx_device_t **d)
@@ -322,34 +692,54 @@ nyx_error_t nyx_module_open(nyx_instance_t i, nyx_device_t **d)
 	                           NYX_DEVICE_INFO_GET_INFO_MODULE_METHOD, "device_info_get_info");
 	nyx_module_register_method(i, (nyx_device_t *)device,
 	                           NYX_DEVICE_INFO_QUERY_MODULE_METHOD, "device_info_query");
+	nyx_module_register_method(i, (nyx_device_t *)device,
+	                           NYX_DEVICE_INFO_QUERY_COUNTERS_MODULE_METHOD,
+	                           "device_info_query_counters");
 
-	device->nduid_str = (const char *)malloc(sizeof(char) * (NDUID_LEN + 1));
+	/* the NDUID is read or generated on its first query */
+	device->nduid_str = NULL;
 
-	if (device->nduid_str == NULL)
+	device->product_name = DEVICEINFO_PRODUCT_NAME;
+	device->device_name = WEBOS_TARGET_MACHINE;
+	device->wifi_mac = NULL;
+	device->wired_mac = NULL;
+	device->bdaddr = NULL;
+	device->link_events_fd = open_link_events();
+
+#ifdef NYX_INFO_CACHE_DIR
+
+	if (info_cache_map(&device->cache, cache_path, device_info_cache_layout,
+	                   CACHE_FIELDS))
 	{
-		nyx_error(MSGID_NYX_MOD_MALLOC_ERR2, 0 , "Error in allocation memory");
-		error = NYX_ERROR_OUT_OF_MEMORY;
-		goto out;
+		for (unsigned int f = 0; f < CACHE_FIELDS; f++)
+		{
+			if (info_cache_get(&device->cache, f))
+			{
+				device->cache_fields |= 1u << f;
+			}
+		}
+
+		*d = (nyx_device_t *)device;
+		return error;
 	}
 
-	error = get_device_nduid((char *)device->nduid_str);
+#endif
 
-	if (error)
+	/* totals do not change while running, the free space is read on demand */
+	if (read_ram_size(device->ram_size, SIZE_STR_LEN) != NYX_ERROR_NONE)
 	{
-		goto nduid_err;
+		device->ram_size[0] = '\0';
 	}
 
-	device->product_name = DEVICEINFO_PRODUCT_NAME;
-	device->device_name = WEBOS_TARGET_MACHINE;
-	device->wifi_mac = NULL;
-	device->wired_mac = NULL;
-	device->bdaddr = NULL;
+	if (read_storage_size(device->storage_size, NULL,
+	                      SIZE_STR_LEN) != NYX_ERROR_NONE)
+	{
+		device->storage_size[0] = '\0';
+	}
 
 	*d = (nyx_device_t *)device;
 	return error;
 
-nduid_err:
-	free((void *) device->nduid_str);
 out:
 	free(device);
 	*d = NULL;
@@ -383,6 +773,12 @@ nyx_error_t nyx_module_close(nyx_device_handle_t d)
 		device_info->bdaddr = NULL;
 	}
 
+	if (device_info->link_events_fd >= 0)
+	{
+		close(device_info->link_events_fd);
+	}
+
+	info_cache_unmap(&device_info->cache);
 	free((void *) device_info->nduid_str);
 	free(device_info);
 	return NYX_ERROR_NONE;
@@ -411,6 +807,48 @@ static nyx_error_t copy_line(const char *src, char *dest, size_t dest_len)
 	return NYX_ERROR_NONE;
 }
 
+/*
+* Looks the query up in the shared cache, *dest then points into the
+* mapping. Returns false for uncached queries and absent values.
+*/
+static bool query_info_cache(device_info_device_t *dev,
+                             nyx_device_info_type_t query, const char **dest)
+{
+	const char *value = NULL;
+
+	switch (query)
+	{
+		case NYX_DEVICE_INFO_NDUID:
+			value = info_cache_get(&dev->cache, CACHE_NDUID);
+			break;
+
+		case NYX_DEVICE_INFO_BT_ADDR:
+			value = info_cache_get(&dev->cache, CACHE_BDADDR);
+			break;
+
+		case NYX_DEVICE_INFO_RAM_SIZE:
+			value = info_cache_get(&dev->cache, CACHE_RAM_SIZE);
+			break;
+
+		case NYX_DEVICE_INFO_STORAGE_SIZE:
+			value = info_cache_get(&dev->cache, CACHE_STORAGE_SIZE);
+			break;
+
+		default:
+			return false;
+	}
+
+	if (NULL == value)
+	{
+		PERF_COUNTER_INC(device_info_counters[DEVICE_INFO_COUNTER_CACHE_MISSES]);
+		return false;
+	}
+
+	PERF_COUNTER_INC(device_info_counters[DEVICE_INFO_COUNTER_CACHE_HITS]);
+	*dest = value;
+	return true;
+}
+
 nyx_error_t device_info_query(nyx_device_handle_t d,
                               nyx_device_info_type_t query, const char **dest)
 {
@@ -426,6 +864,13 @@ nyx_error_t device_info_query(nyx_device_handle_t d,
 	// return an empty string if there's an error
 	*dest = "";
 
+	PERF_COUNTER_INC(device_info_counters[DEVICE_INFO_COUNTER_QUERIES]);
+
+	if (query_info_cache(dev, query, dest))
+	{
+		return NYX_ERROR_NONE;
+	}
+
 	switch (query)
 	{
 		case NYX_DEVICE_INFO_BATT_CH:
@@ -439,20 +884,68 @@ nyx_error_t device_info_query(nyx_device_handle_t d,
 		case NYX_DEVICE_INFO_PRODUCT_ID:
 		case NYX_DEVICE_INFO_RADIO_TYPE:
 		case NYX_DEVICE_INFO_SERIAL_NUMBER:
-		case NYX_DEVICE_INFO_STORAGE_FREE:
+			error = NYX_ERROR_NOT_IMPLEMENTED;
+			break;
 
-		// Need to figure out the right way to get ram size
-		// The "MemTotal" value in /proc/meminfo doesn't match with the actual size
 		case NYX_DEVICE_INFO_RAM_SIZE:
+			if ('\0' == dev->ram_size[0])
+			{
+				PERF_COUNTER_INC(device_info_counters[DEVICE_INFO_COUNTER_SYSTEM_READS]);
+				error = read_ram_size(dev->ram_size, SIZE_STR_LEN);
+			}
+
+			if (NYX_ERROR_NONE == error)
+			{
+				*dest = dev->ram_size;
+			}
+
+			break;
 
-		// Need to figure out how to round off the value obtained
-		// from running statfs on root filesystem
 		case NYX_DEVICE_INFO_STORAGE_SIZE:
-			error = NYX_ERROR_NOT_IMPLEMENTED;
+			if ('\0' == dev->storage_size[0])
+			{
+				PERF_COUNTER_INC(device_info_counters[DEVICE_INFO_COUNTER_SYSTEM_READS]);
+				error = read_storage_size(dev->storage_size, NULL, SIZE_STR_LEN);
+			}
+
+			if (NYX_ERROR_NONE == error)
+			{
+				*dest = dev->storage_size;
+			}
+
+			break;
+
+		case NYX_DEVICE_INFO_STORAGE_FREE:
+		{
+			time_t now = monotonic_seconds();
+
+			if ('\0' == dev->storage_free[0] ||
+			        now - dev->storage_free_time >= storage_free_interval)
+			{
+				PERF_COUNTER_INC(device_info_counters[DEVICE_INFO_COUNTER_SYSTEM_READS]);
+				error = read_storage_size(NULL, dev->storage_free, SIZE_STR_LEN);
+				dev->storage_free_time = now;
+			}
+
+			if (NYX_ERROR_NONE == error)
+			{
+				*dest = dev->storage_free;
+			}
+			else
+			{
+				dev->storage_free[0] = '\0';
+			}
+
 			break;
+		}
 
+		/* addresses are cached once read; a missing device is retried */
 		case NYX_DEVICE_INFO_BT_ADDR:
-			error = execute_read_info(read_bdaddr, (char **)&dev->bdaddr);
+			if (NULL == dev->bdaddr)
+			{
+				PERF_COUNTER_INC(device_info_counters[DEVICE_INFO_COUNTER_SYSTEM_READS]);
+				error = read_hci_bdaddr((char **)&dev->bdaddr);
+			}
 
 			if (NYX_ERROR_NONE == error)
 			{
@@ -462,7 +955,13 @@ nyx_error_t device_info_query(nyx_device_handle_t d,
 			break;
 
 		case NYX_DEVICE_INFO_WIFI_ADDR:
-			error = execute_read_info(read_wifi_mac, (char **)&dev->wifi_mac);
+			refresh_netdev_cache(dev);
+
+			if (NULL == dev->wifi_mac)
+			{
+				PERF_COUNTER_INC(device_info_counters[DEVICE_INFO_COUNTER_SYSTEM_READS]);
+				error = read_netdev_hwaddr(wifi_ifname, (char **)&dev->wifi_mac);
+			}
 
 			if (NYX_ERROR_NONE == error)
 			{
@@ -472,7 +971,13 @@ nyx_error_t device_info_query(nyx_device_handle_t d,
 			break;
 
 		case NYX_DEVICE_INFO_WIRED_ADDR:
-			error = execute_read_info(read_eth0_mac, (char **)&dev->wired_mac);
+			refresh_netdev_cache(dev);
+
+			if (NULL == dev->wired_mac)
+			{
+				PERF_COUNTER_INC(device_info_counters[DEVICE_INFO_COUNTER_SYSTEM_READS]);
+				error = read_netdev_hwaddr(wired_ifname, (char **)&dev->wired_mac);
+			}
 
 			if (NYX_ERROR_NONE == error)
 			{
@@ -490,6 +995,29 @@ nyx_error_t device_info_query(nyx_device_handle_t d,
 			break;
 
 		case NYX_DEVICE_INFO_NDUID:
+			if (NULL == dev->nduid_str)
+			{
+				char *nduid = malloc(NDUID_LEN + 1);
+
+				if (NULL == nduid)
+				{
+					nyx_error(MSGID_NYX_MOD_MALLOC_ERR2, 0 , "Error in allocation memory");
+					error = NYX_ERROR_OUT_OF_MEMORY;
+					break;
+				}
+
+				PERF_COUNTER_INC(device_info_counters[DEVICE_INFO_COUNTER_SYSTEM_READS]);
+				error = get_device_nduid(nduid);
+
+				if (NYX_ERROR_NONE != error)
+				{
+					free(nduid);
+					break;
+				}
+
+				dev->nduid_str = nduid;
+			}
+
 			*dest = dev->nduid_str;
 			break;
 
@@ -498,137 +1026,46 @@ nyx_error_t device_info_query(nyx_device_handle_t d,
 			break;
 	}
 
-	return error;
-}
+#ifdef NYX_INFO_CACHE_DIR
 
-/* device_info_get_info is deprecated */
-nyx_error_t device_info_get_info(nyx_device_handle_t d,
-                                 nyx_device_info_type_t type, char *dest, size_t dest_len)
-{
-	const char *tmp_dest = NULL;
-
-	nyx_error_t err = device_info_query(d, type, &tmp_dest);
-
-	if (NYX_ERROR_NONE == err)
+	/* only once a cached value has been resolved for a real query */
+	if (NYX_ERROR_NONE == error && (NYX_DEVICE_INFO_NDUID == query ||
+	                                NYX_DEVICE_INFO_BT_ADDR == query ||
+	                                NYX_DEVICE_INFO_RAM_SIZE == query ||
+	                                NYX_DEVICE_INFO_STORAGE_SIZE == query))
 	{
-		err = copy_line(tmp_dest, dest, dest_len);
+		publish_info_cache(dev);
 	}
 
-	return err;
-}
-
-// TODO: Work on the following code to get appropriate ram size and storage size values
-
-#if 0
-#include <sys/vfs.h>
-#include <sys/ioctl.h>
-#include <limits.h>
-
-// This overestimates, as it includes any U or L suffix characters. Note that sizeof() counts the terminating '\0'.
-#define _MAX_DIGITS_INTEGER(max_val) (sizeof(#max_val)+1) /* +1 for a possible minus sign */
-#define MAX_DIGITS_INTEGER(max_val) _MAX_DIGITS_INTEGER(max_val)
-
-static const size_t numeric_string_len = MAX_DIGITS_INTEGER(
-            ULLONG_MAX) + 3; /* +3 for the " [KMG]B" unit of measure */
+#endif
 
-// KB to MB or MB to GB conversion factor
-static const unsigned int bytes_converter = 1024;
+	return error;
+}
 
-tatic nyx_error_t get_ram_size(char *ram_size, int size_len)
+nyx_error_t device_info_query_counters(nyx_device_handle_t d,
+                                       nyx_perf_counter_t *counters, int *count)
 {
-	char line[256];
-	int val;
-	nyx_error_t error = NYX_ERROR_NONE;
-
-	if (numeric_string_len >= size_len)
-	{
-		return NYX_ERROR_VALUE_OUT_OF_RANGE;
-	}
-
-	FILE *fp = fopen("/proc/meminfo", "r");
-
-	if (!fp)
-	{
-		nyx_error(MSGID_NYX_MOD_MEMINFO_OPEN_ERR, 0, "Unable to open /proc/meminfo");
-		error = NYX_ERROR_NOT_FOUND;
-		goto error;
-	}
-
-	if (fgets(line, sizeof(line), fp) <= 0)
-	{
-		error = NYX_ERROR_GENERIC;
-		goto error;
-	}
-
-	sscanf(line, "MemTotal:        %dKB", &val);
-
-	// Convert Bytes to MB or GB
-	if (val > bytes_converter)
-	{
-		// Round off the value
-		val = (val + 500) / bytes_converter;
-
-		if (val > bytes_converter)
-		{
-			val = (val + 500) / bytes_converter;
-			sprintf(ram_size, "%d GB", val);
-		}
-		else
-		{
-			sprintf(ram_size, "%d MB", val);
-		}
-	}
-	else
-	{
-		sprintf(ram_size, "%d KB", val);
-	}
-
-error:
-
-	if (fp)
+	if (NULL == d)
 	{
-		fclose(fp);
+		return NYX_ERROR_INVALID_HANDLE;
 	}
 
-	return error;
+	return perf_counters_read(device_info_counter_names, device_info_counters,
+	                          DEVICE_INFO_COUNTER_COUNT, counters, count);
 }
 
-
-static nyx_error_t get_storage_size(char *storage_size, int size_len)
+/* device_info_get_info is deprecated */
+nyx_error_t device_info_get_info(nyx_device_handle_t d,
+                                 nyx_device_info_type_t type, char *dest, size_t dest_len)
 {
-	uint64_t lluBytes, size;
-
-	struct statfs buf;
-
-	if (numeric_string_len >= size_len)
-	{
-		return NYX_ERROR_VALUE_OUT_OF_RANGE;
-	}
-
-	if (0 == statfs("/", &buf))
-	{
-		lluBytes = buf.f_blocks * (uint64_t) buf.f_bsize;
-	}
-	else
-	{
-		nyx_error(MSGID_NYX_MOD_STORAGE_ERR, 0, "Error in getting root storage size");
-		return NYX_ERROR_GENERIC;
-	}
+	const char *tmp_dest = NULL;
 
-	// Convert bytes to MB or GB
-	size = lluBytes / (bytes_converter * bytes_converter);
+	nyx_error_t err = device_info_query(d, type, &tmp_dest);
 
-	if (size > bytes_converter)
-	{
-		// Round off the value
-		size = (size + 500) / bytes_converter;
-		sprintf(storage_size, "%llu GB", size);
-	}
-	else
+	if (NYX_ERROR_NONE == err)
 	{
-		sprintf(storage_size, "%llu MB", size);
+		err = copy_line(tmp_dest, dest, dest_len);
 	}
 
-	return NYX_ERROR_NONE;
+	return err;
 }
-#endif
@@ -25,33 +25,31 @@
 #include <fcntl.h>
 #include <nyx/nyx_module.h>
 #include <linux/fb.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <sys/ioctl.h>
 #include <unistd.h>
 #include <string.h>
 #include "msgid.h"
+#ifdef HAVE_LIBDRM
+#include "display_drm.h"
+#endif
 
 #define MM_PER_INCH     25.4f
 
 NYX_DECLARE_MODULE(NYX_DEVICE_DISPLAY, "Display");
 
-nyx_error_t nyx_module_open(nyx_instance_t i, nyx_device_t **d)
+// Internal display structure
+typedef struct
 {
-	if (NULL == d || NULL != *d)
-	{
-		nyx_error(MSGID_NYX_MOD_DISP_OPEN_ERR, 0, "Display device  open.error");
-		return NYX_ERROR_INVALID_VALUE;
-	}
-
-	nyx_display_device_t *device = (nyx_display_device_t *)calloc(sizeof(
-	                                   nyx_display_device_t), 1);
-
-	if (NULL == device)
-	{
-		nyx_error(MSGID_NYX_MOD_DISP_OUT_OF_MEMORY, 0, "Out of memory");
-		return NYX_ERROR_OUT_OF_MEMORY;
-	}
+	nyx_display_device_t original;
+#ifdef HAVE_LIBDRM
+	display_drm_t drm;
+#endif
+} display_device_t;
 
+static nyx_error_t read_fb_metrics(nyx_display_metrics_t *metrics)
+{
 	nyx_error_t error = NYX_ERROR_NONE;
 
 	int16_t fd;
@@ -60,7 +58,6 @@ nyx_error_t nyx_module_open(nyx_instance_t i, nyx_device_t **d)
 
 	if (fd < 0)
 	{
-		free(device);
 		return NYX_ERROR_INVALID_FILE_ACCESS;
 	}
 
@@ -86,22 +83,126 @@ nyx_error_t nyx_module_open(nyx_instance_t i, nyx_device_t **d)
 		goto out;
 	}
 
-	device->display_metrics.horizontal_pixels = scr_info.xres;
-	device->display_metrics.vertical_pixels = scr_info.yres;
+	metrics->horizontal_pixels = scr_info.xres;
+	metrics->vertical_pixels = scr_info.yres;
 
 	/* height & width variables in fb_var_screeninfo are in mm, so converting them to inches
 	 using MM_PER_INCH macro */
 
-	device->display_metrics.horizontal_dpi = ((float)scr_info.xres *
-	        MM_PER_INCH) / (float)scr_info.width;
-	device->display_metrics.vertical_dpi = ((float)scr_info.yres * MM_PER_INCH) /
-	                                       (float)scr_info.height;
+	metrics->horizontal_dpi = ((float)scr_info.xres *
+	                           MM_PER_INCH) / (float)scr_info.width;
+	metrics->vertical_dpi = ((float)scr_info.yres * MM_PER_INCH) /
+	                        (float)scr_info.height;
 
 out:
+	close(fd);
+	return error;
+}
+
+#ifdef HAVE_LIBDRM
+/*
+* Fills the metrics from the preferred (or first) mode of the first
+* connected output, for boards without a framebuffer device.
+*/
+static nyx_error_t read_drm_metrics(display_drm_t *drm,
+                                    nyx_display_metrics_t *metrics)
+{
+	const display_output_t *out = display_drm_primary(drm);
+
+	if (NULL == out)
+	{
+		return NYX_ERROR_DEVICE_UNAVAILABLE;
+	}
+
+	const display_mode_t *mode = &out->modes[0];
+
+	for (unsigned int m = 0; m < out->mode_count; m++)
+	{
+		if (out->modes[m].preferred)
+		{
+			mode = &out->modes[m];
+			break;
+		}
+	}
+
+	if (out->mm_width == 0 || out->mm_height == 0)
+	{
+		return NYX_ERROR_VALUE_OUT_OF_RANGE;
+	}
 
-	if (fd >= 0)
+	metrics->horizontal_pixels = mode->width;
+	metrics->vertical_pixels = mode->height;
+	metrics->horizontal_dpi = ((float)mode->width * MM_PER_INCH) /
+	                          (float)out->mm_width;
+	metrics->vertical_dpi = ((float)mode->height * MM_PER_INCH) /
+	                        (float)out->mm_height;
+
+	return NYX_ERROR_NONE;
+}
+#endif
+
+nyx_error_t nyx_module_open(nyx_instance_t i, nyx_device_t **d)
+{
+	if (NULL == d || NULL != *d)
+	{
+		nyx_error(MSGID_NYX_MOD_DISP_OPEN_ERR, 0, "Display device  open.error");
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	display_device_t *device = (display_device_t *)calloc(sizeof(
+	                               display_device_t), 1);
+
+	if (NULL == device)
 	{
-		close(fd);
+		nyx_error(MSGID_NYX_MOD_DISP_OUT_OF_MEMORY, 0, "Out of memory");
+		return NYX_ERROR_OUT_OF_MEMORY;
+	}
+
+	nyx_display_metrics_t *metrics = &device->original.display_metrics;
+	nyx_error_t error = read_fb_metrics(metrics);
+
+#ifdef HAVE_LIBDRM
+	display_drm_t drm = DISPLAY_DRM_INITIALIZER;
+	device->drm = drm;
+
+	if (display_drm_open(&device->drm) == NYX_ERROR_NONE)
+	{
+		nyx_module_register_method(i, (nyx_device_t *)device,
+		                           NYX_DISPLAY_GET_OUTPUT_COUNT_MODULE_METHOD,
+		                           "display_get_output_count");
+		nyx_module_register_method(i, (nyx_device_t *)device,
+		                           NYX_DISPLAY_GET_OUTPUT_MODULE_METHOD,
+		                           "display_get_output");
+		nyx_module_register_method(i, (nyx_device_t *)device,
+		                           NYX_DISPLAY_GET_MODE_MODULE_METHOD,
+		                           "display_get_mode");
+
+		/* DRM-only boards have no fb0 */
+		if (NYX_ERROR_NONE != error)
+		{
+			error = read_drm_metrics(&device->drm, metrics);
+		}
+
+		/*
+		 * The outputs can still be queried, and one may be connected later.
+		 * Neither reader fills the metrics on failure, so they stay zero,
+		 * which is what the metrics query then reports.
+		 */
+		if (NYX_ERROR_NONE != error)
+		{
+			nyx_error(MSGID_NYX_MOD_DISP_DRM_ERR, 0,
+			          "No display metrics available (%d)", error);
+			error = NYX_ERROR_NONE;
+		}
+	}
+
+#endif
+
+	/* neither fb0 nor a KMS card, nothing is left open */
+	if (NYX_ERROR_INVALID_FILE_ACCESS == error)
+	{
+		free(device);
+		return error;
 	}
 
 	*d = (nyx_device_t *)device;
@@ -110,6 +211,122 @@ out:
 
 nyx_error_t nyx_module_close(nyx_device_handle_t d)
 {
+#ifdef HAVE_LIBDRM
+
+	if (NULL != d)
+	{
+		display_drm_close(&((display_device_t *)d)->drm);
+	}
+
+#endif
 	free(d);
 	return NYX_ERROR_NONE;
 }
+
+#ifdef HAVE_LIBDRM
+/**
+ * Reports the number of outputs, probing them again if a display was
+ * plugged or unplugged since the last call. Output and mode indices stay
+ * valid until the next call.
+ */
+nyx_error_t display_get_output_count(nyx_device_handle_t d, int *count)
+{
+	if (NULL == d)
+	{
+		return NYX_ERROR_INVALID_HANDLE;
+	}
+
+	if (NULL == count)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	display_device_t *device = (display_device_t *)d;
+	nyx_error_t error = display_drm_refresh(&device->drm);
+
+	*count = (NYX_ERROR_NONE == error) ? (int)device->drm.output_count : 0;
+	return error;
+}
+
+nyx_error_t display_get_output(nyx_device_handle_t d, int output,
+                               const char **name, bool *connected, int *mode_count)
+{
+	if (NULL == d)
+	{
+		return NYX_ERROR_INVALID_HANDLE;
+	}
+
+	display_device_t *device = (display_device_t *)d;
+
+	if (output < 0 || (unsigned int)output >= device->drm.output_count)
+	{
+		return NYX_ERROR_VALUE_OUT_OF_RANGE;
+	}
+
+	const display_output_t *out = &device->drm.outputs[output];
+
+	if (name)
+	{
+		*name = out->name;
+	}
+
+	if (connected)
+	{
+		*connected = out->connected;
+	}
+
+	if (mode_count)
+	{
+		*mode_count = out->mode_count;
+	}
+
+	return NYX_ERROR_NONE;
+}
+
+nyx_error_t display_get_mode(nyx_device_handle_t d, int output, int mode,
+                             int *width, int *height, int *refresh_mhz, bool *preferred)
+{
+	if (NULL == d)
+	{
+		return NYX_ERROR_INVALID_HANDLE;
+	}
+
+	display_device_t *device = (display_device_t *)d;
+
+	if (output < 0 || (unsigned int)output >= device->drm.output_count)
+	{
+		return NYX_ERROR_VALUE_OUT_OF_RANGE;
+	}
+
+	const display_output_t *out = &device->drm.outputs[output];
+
+	if (mode < 0 || (unsigned int)mode >= out->mode_count)
+	{
+		return NYX_ERROR_VALUE_OUT_OF_RANGE;
+	}
+
+	const display_mode_t *info = &out->modes[mode];
+
+	if (width)
+	{
+		*width = info->width;
+	}
+
+	if (height)
+	{
+		*height = info->height;
+	}
+
+	if (refresh_mhz)
+	{
+		*refresh_mhz = info->refresh_mhz;
+	}
+
+	if (preferred)
+	{
+		*preferred = info->preferred;
+	}
+
+	return NYX_ERROR_NONE;
+}
+#endif
@@ -0,0 +1,330 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+/*
+********************************************************************************
+* @file display_drm.c
+*
+* @brief DRM/KMS backend of the DISPLAY module.
+*
+* Probing a connector makes the kernel read the EDID, which can take tens
+* of milliseconds per output, so the outputs are probed once and kept
+* until the udev monitor reports a drm uevent (hotplug, mode change).
+********************************************************************************
+*/
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <libudev.h>
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+#include <nyx/module/nyx_log.h>
+#include "msgid.h"
+#include "display_drm.h"
+
+#define DRM_CARD_MAX 8
+
+/* indexed by DRM_MODE_CONNECTOR_*, as the kernel names them in sysfs */
+static const char *const connector_type_names[] =
+{
+	"Unknown", "VGA", "DVI-I", "DVI-D", "DVI-A", "Composite", "SVIDEO",
+	"LVDS", "Component", "DIN", "DP", "HDMI-A", "HDMI-B", "TV", "eDP",
+	"Virtual", "DSI", "DPI", "Writeback", "SPI", "USB",
+};
+
+static uint32_t mode_refresh_mhz(const drmModeModeInfo *mode)
+{
+	uint64_t num = (uint64_t)mode->clock * 1000000;
+	uint64_t den = (uint64_t)mode->htotal * mode->vtotal;
+
+	if (0 == den)
+	{
+		return mode->vrefresh * 1000;
+	}
+
+	if (mode->flags & DRM_MODE_FLAG_INTERLACE)
+	{
+		num *= 2;
+	}
+
+	if (mode->flags & DRM_MODE_FLAG_DBLSCAN)
+	{
+		den *= 2;
+	}
+
+	if (mode->vscan > 1)
+	{
+		den *= mode->vscan;
+	}
+
+	return (num + den / 2) / den;
+}
+
+static void free_outputs(display_drm_t *drm)
+{
+	for (unsigned int i = 0; i < drm->output_count; i++)
+	{
+		free(drm->outputs[i].modes);
+	}
+
+	free(drm->outputs);
+	drm->outputs = NULL;
+	drm->output_count = 0;
+	drm->valid = false;
+}
+
+static nyx_error_t probe_outputs(display_drm_t *drm)
+{
+	drmModeRes *res = drmModeGetResources(drm->fd);
+
+	if (NULL == res)
+	{
+		return NYX_ERROR_DEVICE_UNAVAILABLE;
+	}
+
+	free_outputs(drm);
+
+	drm->outputs = calloc(res->count_connectors, sizeof(display_output_t));
+
+	if (NULL == drm->outputs && res->count_connectors > 0)
+	{
+		drmModeFreeResources(res);
+		return NYX_ERROR_OUT_OF_MEMORY;
+	}
+
+	for (int i = 0; i < res->count_connectors; i++)
+	{
+		drmModeConnector *conn = drmModeGetConnector(drm->fd, res->connectors[i]);
+
+		if (NULL == conn)
+		{
+			continue;
+		}
+
+		display_output_t *out = &drm->outputs[drm->output_count];
+		const char *type = connector_type_names[0];
+
+		if (conn->connector_type < sizeof(connector_type_names) /
+		        sizeof(connector_type_names[0]))
+		{
+			type = connector_type_names[conn->connector_type];
+		}
+
+		snprintf(out->name, sizeof(out->name), "%s-%u", type,
+		         conn->connector_type_id);
+		out->connected = (DRM_MODE_CONNECTED == conn->connection);
+		out->mm_width = conn->mmWidth;
+		out->mm_height = conn->mmHeight;
+
+		if (conn->count_modes > 0)
+		{
+			out->modes = calloc(conn->count_modes, sizeof(display_mode_t));
+		}
+
+		for (int m = 0; out->modes && m < conn->count_modes; m++)
+		{
+			const drmModeModeInfo *info = &conn->modes[m];
+
+			out->modes[m].width = info->hdisplay;
+			out->modes[m].height = info->vdisplay;
+			out->modes[m].refresh_mhz = mode_refresh_mhz(info);
+			out->modes[m].preferred = (info->type & DRM_MODE_TYPE_PREFERRED) != 0;
+			out->mode_count++;
+		}
+
+		drm->output_count++;
+		drmModeFreeConnector(conn);
+	}
+
+	drmModeFreeResources(res);
+	drm->valid = true;
+	return NYX_ERROR_NONE;
+}
+
+/* Opens the first card that has connectors; render-only GPUs have none. */
+static int open_kms_card(void)
+{
+	char path[32];
+
+	for (int i = 0; i < DRM_CARD_MAX; i++)
+	{
+		snprintf(path, sizeof(path), "/dev/dri/card%d", i);
+
+		int fd = open(path, O_RDWR | O_CLOEXEC);
+
+		if (fd < 0)
+		{
+			continue;
+		}
+
+		/*
+		 * The first opener of a card becomes its master implicitly. The
+		 * module only reads KMS state, so leave the master role to the
+		 * compositor; this fails harmlessly when we were not master.
+		 */
+		drmDropMaster(fd);
+
+		drmModeRes *res = drmModeGetResources(fd);
+		bool kms = res && res->count_connectors > 0;
+
+		if (res)
+		{
+			drmModeFreeResources(res);
+		}
+
+		if (kms)
+		{
+			return fd;
+		}
+
+		close(fd);
+	}
+
+	return -1;
+}
+
+/*
+* The module has no callbacks, so rather than watching the monitor from a
+* main loop the pending uevents are drained whenever the outputs are
+* asked for. Without a monitor every refresh probes again.
+*/
+static void drain_uevents(display_drm_t *drm)
+{
+	struct udev_device *dev;
+
+	if (NULL == drm->monitor)
+	{
+		drm->valid = false;
+		return;
+	}
+
+	while ((dev = udev_monitor_receive_device(drm->monitor)) != NULL)
+	{
+		drm->valid = false;
+		udev_device_unref(dev);
+	}
+}
+
+static void open_monitor(display_drm_t *drm)
+{
+	drm->udev = udev_new();
+
+	if (NULL == drm->udev)
+	{
+		nyx_error(MSGID_NYX_MOD_DISP_UDEV_ERR, 0,
+		          "Could not initialize udev; display hotplug will not be tracked");
+		return;
+	}
+
+	drm->monitor = udev_monitor_new_from_netlink(drm->udev, "kernel");
+
+	if (NULL == drm->monitor ||
+	        udev_monitor_filter_add_match_subsystem_devtype(drm->monitor, "drm",
+	                NULL) < 0 ||
+	        udev_monitor_enable_receiving(drm->monitor) < 0)
+	{
+		nyx_error(MSGID_NYX_MOD_DISP_UDEV_ERR, 0,
+		          "Failed to set up the udev monitor for drm events");
+
+		if (drm->monitor)
+		{
+			udev_monitor_unref(drm->monitor);
+			drm->monitor = NULL;
+		}
+	}
+}
+
+nyx_error_t display_drm_open(display_drm_t *drm)
+{
+	drm->fd = open_kms_card();
+
+	if (drm->fd < 0)
+	{
+		return NYX_ERROR_DEVICE_UNAVAILABLE;
+	}
+
+	/* start listening before the first probe so no hotplug is missed */
+	open_monitor(drm);
+
+	nyx_error_t error = probe_outputs(drm);
+
+	if (NYX_ERROR_NONE != error)
+	{
+		nyx_error(MSGID_NYX_MOD_DISP_DRM_ERR, 0, "Failed to read DRM connectors");
+		display_drm_close(drm);
+	}
+
+	return error;
+}
+
+void display_drm_close(display_drm_t *drm)
+{
+	free_outputs(drm);
+
+	if (drm->monitor)
+	{
+		udev_monitor_unref(drm->monitor);
+		drm->monitor = NULL;
+	}
+
+	if (drm->udev)
+	{
+		udev_unref(drm->udev);
+		drm->udev = NULL;
+	}
+
+	if (drm->fd >= 0)
+	{
+		close(drm->fd);
+		drm->fd = -1;
+	}
+}
+
+/**
+ * Probes the outputs again if a drm uevent arrived since the last probe.
+ * Pointers into the previous output list are invalid afterwards.
+ */
+nyx_error_t display_drm_refresh(display_drm_t *drm)
+{
+	if (drm->fd < 0)
+	{
+		return NYX_ERROR_DEVICE_UNAVAILABLE;
+	}
+
+	drain_uevents(drm);
+
+	return drm->valid ? NYX_ERROR_NONE : probe_outputs(drm);
+}
+
+/**
+ * Returns the first connected output that has modes, or NULL.
+ */
+const display_output_t *display_drm_primary(const display_drm_t *drm)
+{
+	for (unsigned int i = 0; i < drm->output_count; i++)
+	{
+		if (drm->outputs[i].connected && drm->outputs[i].mode_count > 0)
+		{
+			return &drm->outputs[i];
+		}
+	}
+
+	return NULL;
+}
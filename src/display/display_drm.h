@@ -0,0 +1,70 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+/**
+ * @file display_drm.h
+ *
+ * @brief DRM/KMS backend of the display module: the connectors of the
+ * first KMS card and their modes, cached until a drm hotplug uevent.
+ */
+
+#ifndef DISPLAY_DRM_H_
+#define DISPLAY_DRM_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <nyx/nyx_module.h>
+
+struct udev;
+struct udev_monitor;
+
+typedef struct
+{
+	uint16_t width;
+	uint16_t height;
+	uint32_t refresh_mhz;   // millihertz, from the pixel clock
+	bool preferred;
+} display_mode_t;
+
+typedef struct
+{
+	char name[32];          // kernel style, e.g. "HDMI-A-1"
+	bool connected;
+	uint32_t mm_width;
+	uint32_t mm_height;
+	unsigned int mode_count;
+	display_mode_t *modes;
+} display_output_t;
+
+typedef struct
+{
+	int fd;
+	struct udev *udev;
+	struct udev_monitor *monitor;
+	bool valid;             // outputs match the last hotplug state
+	unsigned int output_count;
+	display_output_t *outputs;
+} display_drm_t;
+
+#define DISPLAY_DRM_INITIALIZER { -1, NULL, NULL, false, 0, NULL }
+
+nyx_error_t display_drm_open(display_drm_t *drm);
+void display_drm_close(display_drm_t *drm);
+nyx_error_t display_drm_refresh(display_drm_t *drm);
+const display_output_t *display_drm_primary(const display_drm_t *drm);
+
+#endif // DISPLAY_DRM_H_
@@ -66,7 +66,7 @@ static const struct aes_algo_data_t *aes_algo_data_lookup(int keylen,
 
 nyx_error_t aes_generate_key(int keylen, int *index)
 {
-	if (!aes_supported_keylength(keylen))
+	if (!aes_supported_keylength(keylen) || !keystore_index_valid(*index))
 	{
 		return NYX_ERROR_INVALID_VALUE;
 	}
@@ -85,9 +85,14 @@ nyx_error_t aes_generate_key(int keylen, int *index)
 		goto error;
 	}
 
-	keystore_key_replace(keystore.aes, aes_key, index);
+	nyx_error_t result = keystore_key_replace(keystore.aes, aes_key, index);
 
-	return NYX_ERROR_NONE;
+	if (result != NYX_ERROR_NONE)
+	{
+		aes_destroy_key(aes_key);
+	}
+
+	return result;
 
 error:
 	aes_destroy_key(aes_key);
@@ -15,9 +15,82 @@
 // SPDX-License-Identifier: Apache-2.0
 
 #include <security.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <openssl/pem.h>
 
+/* append-only log of keys added since the key file was last written */
+#define SECURITY_KEYSTORE_JOURNAL_PATH SECURITY_KEYSTORE_DIR "/keystore.journal"
+
+/* journal records after which the writer folds them into the key file */
+#define KEYSTORE_COMPACT_RECORDS 64
+
+/*
+ * Binary index file: a header, one entry per key and the raw key blobs
+ * (AES key bytes, RSA private key DER). The file is mapped read-only and a
+ * key is only decoded when first looked up. Fields are in host byte order;
+ * the file never leaves the device.
+ */
+#define KEYSTORE_INDEX_MAGIC   0x4b59584e /* "NXYK" */
+#define KEYSTORE_INDEX_VERSION 1
+
+enum
+{
+	KEYSTORE_INDEX_AES = 0,
+	KEYSTORE_INDEX_RSA = 1,
+};
+
+struct keystore_index_header_t
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t count;
+	uint32_t reserved;
+};
+
+struct keystore_index_entry_t
+{
+	uint32_t type;
+	int32_t index;
+	int32_t keylen;
+	uint32_t offset; /**< from the start of the file */
+	uint32_t length;
+};
+
+static struct
+{
+	void *base;
+	size_t size;
+} keystore_map;
+
+/* guards both key tables against the journal writer */
+static pthread_mutex_t keystore_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct
+{
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	GString *pending; /* records queued but not yet written */
+	int records;      /* records in the journal file */
+	int running;
+	int stop;
+	int fd;
+} journal =
+{
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+	.fd = -1,
+};
+
+static void keystore_journal_stop(void);
+
 void aes_destroy_key(gpointer p)
 {
 	struct aes_key_t *key = (struct aes_key_t *) p;
@@ -36,260 +109,896 @@ void rsa_destroy_key(gpointer p)
 	g_free(key);
 }
 
-int keystore_init(struct keystore_t *store)
+/* key store file format
+ *
+ * Keys are kept in the binary index file described above. Older releases
+ * wrote a plain key-value file using GKeyFile, which is still read when no
+ * index file exists:
+ *
+ * [aes]
+ * <index>=<keylen>;<base64_encoded_key>
+ * [rsa]
+ * <index>=<keylen>;<base64_encoded_asn1_rsa_key>
+ *
+ * Keys added since either file was written are in the journal, one record per
+ * line, later records overriding earlier ones:
+ *
+ * <section>\t<index>\t<keylen>;<base64>\n
+ *
+ * A record without its newline was cut short by a crash and is ignored.
+ */
+
+static void aeskey_to_list(gconstpointer value, gchar *list[2])
 {
-	store->aes = g_hash_table_new_full(NULL, NULL, NULL, aes_destroy_key);
+	const struct aes_key_t *aes_key = (const struct aes_key_t *)value;
+
+	g_assert(aes_key != NULL);
 
-	if (store->aes == NULL)
+	list[0] = g_strdup_printf("%d", aes_key->keylen);
+	list[1] = g_base64_encode(aes_key->key, aes_key->keylen / 8);
+}
+
+static unsigned char *aeskey_to_blob(gconstpointer value, int *length,
+                                     int *keylen)
+{
+	const struct aes_key_t *aes_key = (const struct aes_key_t *)value;
+
+	*keylen = aes_key->keylen;
+	*length = aes_key->keylen / 8;
+	return g_memdup(aes_key->key, *length);
+}
+
+static gpointer aeskey_from_blob(const unsigned char *blob, int length,
+                                 int keylen)
+{
+	struct aes_key_t *aes_key = NULL;
+
+	if (keylen == length * 8 && length <= EVP_MAX_KEY_LENGTH)
 	{
-		return NYX_ERROR_OUT_OF_MEMORY;
+		aes_key = g_malloc(sizeof(struct aes_key_t));
+		aes_key->keylen = keylen;
+		memcpy(aes_key->key, blob, length);
 	}
 
-	store->rsa = g_hash_table_new_full(NULL, NULL, NULL, rsa_destroy_key);
+	return aes_key;
+}
+
+static gpointer aeskey_from_list(gchar **list)
+{
+	gsize keybits_len = 0;
+	guchar *keybits = g_base64_decode(list[1], &keybits_len);
+	gpointer aes_key = aeskey_from_blob(keybits, keybits_len, atoi(list[0]));
 
-	if (store->rsa == NULL)
+	g_free(keybits);
+	return aes_key;
+}
+
+static unsigned char *rsakey_to_blob(gconstpointer value, int *length,
+                                     int *keylen)
+{
+	const struct rsa_key_t *rsa_key = (const struct rsa_key_t *)value;
+	int pkcs_len = i2d_RSAPrivateKey(rsa_key->rsa, NULL);
+	unsigned char *pkcs_buf = g_malloc(pkcs_len);
+	unsigned char *tmp = pkcs_buf;
+
+	i2d_RSAPrivateKey(rsa_key->rsa, &tmp);
+
+	*keylen = rsa_key->keylen;
+	*length = pkcs_len;
+	return pkcs_buf;
+}
+
+static gpointer rsakey_from_blob(const unsigned char *blob, int length,
+                                 int keylen)
+{
+	struct rsa_key_t *rsa_key = NULL;
+	RSA *rsa = d2i_RSAPrivateKey(NULL, &blob, length);
+
+	if (NULL != rsa)
 	{
-		return NYX_ERROR_OUT_OF_MEMORY;
+		rsa_key = g_malloc(sizeof(struct rsa_key_t));
+		rsa_key->keylen = keylen;
+		rsa_key->rsa = rsa;
 	}
 
-	return NYX_ERROR_NONE;
+	return rsa_key;
 }
 
-void keystore_destroy(struct keystore_t *store)
+static void rsakey_to_list(gconstpointer value, gchar *list[2])
+{
+	const struct rsa_key_t *rsa_key = (const struct rsa_key_t *)value;
+
+	g_assert(rsa_key != NULL);
+
+	int pkcs_len = 0;
+	int keylen;
+	unsigned char *pkcs_buf = rsakey_to_blob(rsa_key, &pkcs_len, &keylen);
+
+	list[0] = g_strdup_printf("%d", rsa_key->keylen);
+	list[1] = g_base64_encode(pkcs_buf, pkcs_len);
+
+	g_free(pkcs_buf);
+}
+
+static gpointer rsakey_from_list(gchar **list)
 {
-	g_hash_table_destroy(store->aes);
-	g_hash_table_destroy(store->rsa);
+	gsize keybits_len = 0;
+	guchar *keybits = g_base64_decode(list[1], &keybits_len);
+	gpointer rsa_key = rsakey_from_blob(keybits, keybits_len, atoi(list[0]));
+
+	g_free(keybits);
+	return rsa_key;
 }
 
-gpointer keystore_key_lookup(GHashTable *keys, int index)
+static struct keystore_table_t *keystore_table_new(const char *section,
+        GDestroyNotify destroy, keystore_to_list_t to_list,
+        keystore_from_list_t from_list, keystore_to_blob_t to_blob,
+        keystore_from_blob_t from_blob)
 {
-	return g_hash_table_lookup(keys, GINT_TO_POINTER(index));
+	struct keystore_table_t *keys = g_new0(struct keystore_table_t, 1);
+
+	keys->section = section;
+	keys->destroy = destroy;
+	keys->to_list = to_list;
+	keys->from_list = from_list;
+	keys->to_blob = to_blob;
+	keys->from_blob = from_blob;
+	return keys;
 }
 
-void keystore_key_replace(GHashTable *keys, gpointer key, int *index)
+static void keystore_table_free(struct keystore_table_t *keys)
 {
-	if (*index == -1)
+	int i;
+
+	if (keys == NULL)
+	{
+		return;
+	}
+
+	for (i = 0; i < keys->count; ++i)
+	{
+		if (keys->slots[i])
+		{
+			keys->destroy(keys->slots[i]);
+		}
+	}
+
+	g_free(keys->slots);
+	g_free(keys->blobs);
+	g_free(keys->slot_index);
+	g_free(keys->index_slot);
+	g_free(keys->free_indices);
+	g_free(keys);
+}
+
+/* Grows index_slot (and the free stack, which never exceeds it) to cover index. */
+static void keystore_table_reserve_index(struct keystore_table_t *keys,
+        int index)
+{
+	int capacity = keys->index_capacity ? keys->index_capacity : 16;
+
+	if (index < keys->index_capacity)
 	{
-		/* client don't care where to put key, find next free index */
-		int i;
+		return;
+	}
 
-		for (i = 0; g_hash_table_lookup(keys, GINT_TO_POINTER(i)) != NULL; ++i);
+	while (capacity <= index)
+	{
+		capacity *= 2;
+	}
 
-		*index = i;
+	keys->index_slot = g_renew(int, keys->index_slot, capacity);
+	memset(keys->index_slot + keys->index_capacity, 0,
+	       (capacity - keys->index_capacity) * sizeof(int));
+	keys->free_indices = g_renew(int, keys->free_indices, capacity);
+	keys->index_capacity = capacity;
+}
+
+static int keystore_table_alloc_index(struct keystore_table_t *keys)
+{
+	/* the stack may hold indices that were since taken explicitly */
+	while (keys->free_count > 0)
+	{
+		int index = keys->free_indices[--keys->free_count];
+
+		if (keys->index_slot[index] == 0)
+		{
+			return index;
+		}
 	}
 
-	g_hash_table_replace(keys, GINT_TO_POINTER(*index), key);
+	return keys->next_index;
 }
 
-/* key store file format
- *
- * Plain key-value file using GKeyFile
- *
- * [aes]
- * <index>=<keylen>;<base64_encoded_key>
- * [rsa]
- * <index>=<keylen>;<base64_encoded_asn1_rsa_key>
+
+/* An index is either -1 (any free index) or in [0, SECURITY_KEYSTORE_INDEX_MAX]. */
+gboolean keystore_index_valid(int index)
+{
+	return index >= -1 && index <= SECURITY_KEYSTORE_INDEX_MAX;
+}
+
+/*
+ * Stores key at *index, or at a free index if *index is -1. A NULL key with
+ * a blob stores the key undecoded. The caller still owns key on error.
  */
+static nyx_error_t keystore_table_insert(struct keystore_table_t *keys,
+        gpointer key, const struct keystore_blob_t *blob, int *index)
+{
+	static const struct keystore_blob_t no_blob;
+
+	if (!keystore_index_valid(*index))
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	if (blob == NULL)
+	{
+		blob = &no_blob;
+	}
+
+	if (*index == -1)
+	{
+		/* client don't care where to put key, take any free index */
+		*index = keystore_table_alloc_index(keys);
+
+		if (*index > SECURITY_KEYSTORE_INDEX_MAX)
+		{
+			*index = -1;
+			return NYX_ERROR_OUT_OF_MEMORY;
+		}
+	}
+
+	keystore_table_reserve_index(keys, *index);
+
+	if (keys->index_slot[*index] != 0)
+	{
+		int s = keys->index_slot[*index] - 1;
+
+		if (keys->slots[s] != key)
+		{
+			if (keys->slots[s])
+			{
+				keys->destroy(keys->slots[s]);
+			}
 
-void keystore_save_aeskey(gpointer key, gpointer value, gpointer user_data)
+			keys->slots[s] = key;
+		}
+
+		keys->blobs[s] = *blob;
+		return NYX_ERROR_NONE;
+	}
+
+	/* indices skipped over by an explicit index become free */
+	while (keys->next_index < *index)
+	{
+		keys->free_indices[keys->free_count++] = keys->next_index++;
+	}
+
+	if (keys->next_index == *index)
+	{
+		keys->next_index++;
+	}
+
+	if (keys->count == keys->capacity)
+	{
+		keys->capacity = keys->capacity ? keys->capacity * 2 : 16;
+		keys->slots = g_renew(gpointer, keys->slots, keys->capacity);
+		keys->slot_index = g_renew(int, keys->slot_index, keys->capacity);
+		keys->blobs = g_renew(struct keystore_blob_t, keys->blobs, keys->capacity);
+	}
+
+	keys->slots[keys->count] = key;
+	keys->blobs[keys->count] = *blob;
+	keys->slot_index[keys->count] = *index;
+	keys->index_slot[*index] = ++keys->count;
+	return NYX_ERROR_NONE;
+}
+
+int keystore_init(struct keystore_t *store)
 {
-	const int key_index = GPOINTER_TO_INT(key);
-	const struct aes_key_t *aes_key = (const struct aes_key_t *)value;
-	GKeyFile *key_file = (GKeyFile *)user_data;
+	store->aes = keystore_table_new("aes", aes_destroy_key, aeskey_to_list,
+	                                aeskey_from_list, aeskey_to_blob, aeskey_from_blob);
+	store->rsa = keystore_table_new("rsa", rsa_destroy_key, rsakey_to_list,
+	                                rsakey_from_list, rsakey_to_blob, rsakey_from_blob);
 
-	g_assert(aes_key != NULL);
-	g_assert(key_file != NULL);
+	return NYX_ERROR_NONE;
+}
+
+/* Stops the journal writer, if it runs, so nothing touches the tables. */
+void keystore_destroy(struct keystore_t *store)
+{
+	keystore_journal_stop();
+
+	keystore_table_free(store->aes);
+	keystore_table_free(store->rsa);
+	store->aes = NULL;
+	store->rsa = NULL;
 
-	gchar *index = g_strdup_printf("%d", key_index);
-	const gchar *const list[] =
+	if (keystore_map.base)
 	{
-		g_strdup_printf("%d", aes_key->keylen),
-		g_base64_encode(aes_key->key, aes_key->keylen / 8)
-	};
+		munmap(keystore_map.base, keystore_map.size);
+		keystore_map.base = NULL;
+	}
+}
 
-	g_key_file_set_string_list(key_file, "aes", index, list, 2);
+/* Returns the key at index, decoding it on first use; keystore_lock is held. */
+static gpointer keystore_table_lookup(struct keystore_table_t *keys, int index)
+{
+	if (index < 0 || index >= keys->index_capacity ||
+	        keys->index_slot[index] == 0)
+	{
+		return NULL;
+	}
 
-	g_free(index);
-	g_free((gpointer)list[0]);
-	g_free((gpointer)list[1]);
+	int s = keys->index_slot[index] - 1;
+
+	/*
+	 * first use of a key from the index file, decode it now; a blob that
+	 * does not decode is kept, so that compaction still carries it over
+	 */
+	if (keys->slots[s] == NULL && keys->blobs[s].data)
+	{
+		keys->slots[s] = keys->from_blob(keys->blobs[s].data, keys->blobs[s].length,
+		                                 keys->blobs[s].keylen);
+
+		if (keys->slots[s])
+		{
+			keys->blobs[s].data = NULL;
+		}
+	}
+
+	return keys->slots[s];
 }
 
-static void keystore_load_aeskey(GKeyFile *keyfile, gchar *key,
-                                 struct keystore_t *keystore)
+/*
+ * Calls func(GINT_TO_POINTER(index), key, user_data) for every key with
+ * keystore_lock held, so func must not call back into the keystore.
+ */
+void keystore_foreach(struct keystore_table_t *keys, GHFunc func,
+                      gpointer user_data)
 {
-	g_assert(NULL != keyfile);
-	g_assert(NULL != key);
-	g_assert(NULL != keystore);
-	gsize length = 0;
-	gchar **list = g_key_file_get_string_list(keyfile, "aes", key, &length, NULL);
+	int i;
+
+	pthread_mutex_lock(&keystore_lock);
 
-	if (length == 2)
+	for (i = 0; i < keys->count; ++i)
 	{
-		int key_index = atoi(key);
-		int keylen = atoi(list[0]);
-		gsize keybits_len = 0;
-		guchar *keybits = g_base64_decode(list[1], &keybits_len);
-		g_assert(keylen == keybits_len * 8);
+		gpointer key = keystore_table_lookup(keys, keys->slot_index[i]);
 
-		struct aes_key_t *aes_key = g_malloc(sizeof(struct aes_key_t));
-		aes_key->keylen = keylen;
-		memcpy(aes_key->key, keybits, keybits_len);
+		if (key)
+		{
+			func(GINT_TO_POINTER(keys->slot_index[i]), key, user_data);
+		}
+	}
+
+	pthread_mutex_unlock(&keystore_lock);
+}
 
-		keystore_key_replace(keystore->aes, aes_key, &key_index);
+gpointer keystore_key_lookup(struct keystore_table_t *keys, int index)
+{
+	pthread_mutex_lock(&keystore_lock);
+	gpointer key = keystore_table_lookup(keys, index);
+	pthread_mutex_unlock(&keystore_lock);
+
+	return key;
+}
+
+/* Queues a journal record for the writer thread; a no-op until it runs. */
+static void keystore_journal_append(struct keystore_table_t *keys,
+                                    gconstpointer key, int index)
+{
+	gchar *list[2];
 
-		g_free(keybits);
+	pthread_mutex_lock(&journal.lock);
+
+	if (journal.running)
+	{
+		keys->to_list(key, list);
+		g_string_append_printf(journal.pending, "%s\t%d\t%s;%s\n", keys->section,
+		                       index, list[0], list[1]);
+		g_free(list[0]);
+		g_free(list[1]);
+		pthread_cond_signal(&journal.cond);
 	}
 
-	g_strfreev(list);
+	pthread_mutex_unlock(&journal.lock);
 }
 
-static void keystore_save_rsakey(gpointer key, gpointer value,
-                                 gpointer user_data)
+nyx_error_t keystore_key_replace(struct keystore_table_t *keys, gpointer key,
+                                 int *index)
 {
-	const int key_index = GPOINTER_TO_INT(key);
-	const struct rsa_key_t *rsa_key = (const struct rsa_key_t *)value;
-	GKeyFile *key_file = (GKeyFile *)user_data;
+	pthread_mutex_lock(&keystore_lock);
+	nyx_error_t result = keystore_table_insert(keys, key, NULL, index);
+	pthread_mutex_unlock(&keystore_lock);
 
-	g_assert(rsa_key != NULL);
-	g_assert(key_file != NULL);
+	if (result == NYX_ERROR_NONE)
+	{
+		keystore_journal_append(keys, key, *index);
+	}
 
-	gchar *index = g_strdup_printf("%d", key_index);
-	int pkcs_len = i2d_RSAPrivateKey(rsa_key->rsa, NULL);
-	unsigned char *pkcs_buf = malloc(pkcs_len);
-	unsigned char *tmp = pkcs_buf;
-	i2d_RSAPrivateKey(rsa_key->rsa, &tmp);
+	return result;
+}
 
-	const gchar *const list[] =
+/* Appends the index entries and blobs of one table; keystore_lock is held. */
+static void keystore_table_to_index(struct keystore_table_t *keys,
+                                    uint32_t type, GByteArray *entries, GByteArray *blobs)
+{
+	int i;
+
+	for (i = 0; i < keys->count; ++i)
 	{
-		g_strdup_printf("%d", rsa_key->keylen),
-		g_base64_encode(pkcs_buf, pkcs_len),
-	};
+		struct keystore_index_entry_t entry;
+		unsigned char *blob = NULL;
+		const unsigned char *data;
+		int length, keylen;
+
+		/* keys never looked up are copied without decoding them */
+		if (keys->slots[i])
+		{
+			data = blob = keys->to_blob(keys->slots[i], &length, &keylen);
+			entry.keylen = keylen;
+		}
+		else if (keys->blobs[i].data)
+		{
+			data = keys->blobs[i].data;
+			length = keys->blobs[i].length;
+			entry.keylen = keys->blobs[i].keylen;
+		}
+		else
+		{
+			continue;
+		}
 
-	g_key_file_set_string_list(key_file, "rsa", index, list, 2);
+		entry.type = type;
+		entry.index = keys->slot_index[i];
+		entry.offset = blobs->len;
+		entry.length = length;
 
-	g_free(index);
-	free(pkcs_buf);
-	g_free((gpointer)list[0]);
-	g_free((gpointer)list[1]);
+		g_byte_array_append(entries, (const guint8 *)&entry, sizeof(entry));
+		g_byte_array_append(blobs, data, length);
+		g_free(blob);
+	}
 }
 
-static void keystore_load_rsakey(GKeyFile *keyfile, gchar *key,
-                                 struct keystore_t *keystore)
+/* Maps the index file and registers every key in it undecoded. */
+static nyx_error_t keystore_index_load(struct keystore_t *keystore)
 {
-	g_assert(NULL != keyfile);
-	g_assert(NULL != key);
-	g_assert(NULL != keystore);
-	gsize length = 0;
-	gchar **list = g_key_file_get_string_list(keyfile, "rsa", key, &length, NULL);
+	struct keystore_index_header_t header;
+	struct stat st;
+	uint32_t i;
+	int fd = open(SECURITY_KEYSTORE_INDEX_PATH, O_RDONLY | O_CLOEXEC);
 
-	if (length == 2)
+	if (fd < 0)
 	{
-		int key_index = atoi(key);
-		int keylen = atoi(list[0]);
-		gsize keybits_len = 0;
-		guchar *keybits = g_base64_decode(list[1], &keybits_len);
-		const guchar *tmp = keybits;
+		return NYX_ERROR_NOT_FOUND;
+	}
 
-		struct rsa_key_t *rsa_key = g_malloc(sizeof(struct rsa_key_t));
-		rsa_key->keylen = keylen;
-		rsa_key->rsa = d2i_RSAPrivateKey(NULL, (const unsigned char **)&tmp,
-		                                 keybits_len);
+	if (fstat(fd, &st) < 0 || st.st_size < sizeof(header))
+	{
+		close(fd);
+		return NYX_ERROR_INVALID_FILE_ACCESS;
+	}
+
+	void *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (base == MAP_FAILED)
+	{
+		return NYX_ERROR_INVALID_FILE_ACCESS;
+	}
+
+	const unsigned char *data = base;
+	size_t size = st.st_size;
 
-		if (NULL != rsa_key->rsa)
+	memcpy(&header, data, sizeof(header));
+
+	if (header.magic != KEYSTORE_INDEX_MAGIC ||
+	        header.version != KEYSTORE_INDEX_VERSION ||
+	        header.count > (size - sizeof(header)) / sizeof(struct keystore_index_entry_t))
+	{
+		nyx_debug("%s: invalid keystore index", __FUNCTION__);
+		munmap(base, size);
+		return NYX_ERROR_INVALID_FILE_ACCESS;
+	}
+
+	size_t blob_start = sizeof(header) + header.count * sizeof(
+	                        struct keystore_index_entry_t);
+
+	for (i = 0; i < header.count; ++i)
+	{
+		struct keystore_index_entry_t entry;
+		struct keystore_table_t *keys = NULL;
+
+		memcpy(&entry, data + sizeof(header) + i * sizeof(entry), sizeof(entry));
+
+		switch (entry.type)
 		{
-			keystore_key_replace(keystore->rsa, rsa_key, &key_index);
+			case KEYSTORE_INDEX_AES:
+				keys = keystore->aes;
+				break;
+
+			case KEYSTORE_INDEX_RSA:
+				keys = keystore->rsa;
+				break;
 		}
 
-		g_free(keybits);
+		if (keys == NULL || entry.index < 0 ||
+		        entry.offset > size - blob_start ||
+		        entry.length > size - blob_start - entry.offset)
+		{
+			continue;
+		}
+
+		struct keystore_blob_t blob =
+		{
+			.data = data + blob_start + entry.offset,
+			.length = entry.length,
+			.keylen = entry.keylen,
+		};
+		int key_index = entry.index;
+
+		keystore_table_insert(keys, NULL, &blob, &key_index);
 	}
 
-	g_strfreev(list);
+	keystore_map.base = base;
+	keystore_map.size = size;
+
+	return NYX_ERROR_NONE;
 }
 
-nyx_error_t keystore_load(struct keystore_t *keystore)
+static void keystore_table_from_keyfile(struct keystore_table_t *keys,
+                                        GKeyFile *keyfile)
 {
-	if (FALSE == g_file_test(SECURITY_KEYSTORE_PATH, G_FILE_TEST_EXISTS))
+	gchar **indices = g_key_file_get_keys(keyfile, keys->section, NULL, NULL);
+	int i;
+
+	if (NULL == indices)
 	{
-		return NYX_ERROR_NONE;
+		return;
 	}
 
-	GKeyFile *keyfile = g_key_file_new();
-	GKeyFileFlags flags = G_KEY_FILE_NONE;
-
-	if (!g_key_file_load_from_file(keyfile, SECURITY_KEYSTORE_PATH, flags, NULL))
+	for (i = 0; indices[i] != NULL; ++i)
 	{
-		nyx_debug("%s: g_key_file_load_from_file error", __FUNCTION__);
-		g_key_file_free(keyfile);
-		return NYX_ERROR_GENERIC;
+		gsize length = 0;
+		gchar **list = g_key_file_get_string_list(keyfile, keys->section,
+		               indices[i], &length, NULL);
+
+		if (length == 2)
+		{
+			int key_index = atoi(indices[i]);
+			gpointer key = keys->from_list(list);
+
+			if (NULL != key && (key_index == -1 ||
+			                    keystore_table_insert(keys, key, NULL, &key_index) != NYX_ERROR_NONE))
+			{
+				nyx_debug("%s: invalid key index %s", __FUNCTION__, indices[i]);
+				keys->destroy(key);
+			}
+		}
+
+		g_strfreev(list);
 	}
 
+	g_strfreev(indices);
+}
+
+/*
+ * Replays the journal on top of the key file and returns the records applied.
+ * valid is set to the length up to the last complete record.
+ */
+static int keystore_journal_replay(struct keystore_t *keystore, off_t *valid)
+{
+	gchar *data = NULL;
+	int records = 0;
 	int i;
 
-	/* load aes keys */
-	gchar **aes_keys = g_key_file_get_keys(keyfile, "aes", NULL, NULL);
+	*valid = 0;
 
-	if (NULL != aes_keys)
+	if (!g_file_get_contents(SECURITY_KEYSTORE_JOURNAL_PATH, &data, NULL, NULL))
 	{
-		for (i = 0; aes_keys[i] != NULL; ++i)
+		return 0;
+	}
+
+	gchar *end = strrchr(data, '\n');
+	*valid = end ? end - data + 1 : 0;
+
+	gchar **lines = g_strsplit(data, "\n", -1);
+
+	/* the part after the last newline is empty or a torn record */
+	for (i = 0; lines[i] != NULL && lines[i + 1] != NULL; ++i)
+	{
+		gchar **fields = g_strsplit(lines[i], "\t", 3);
+
+		if (g_strv_length(fields) == 3)
 		{
-			keystore_load_aeskey(keyfile, aes_keys[i], keystore);
+			struct keystore_table_t *keys = NULL;
+
+			if (strcmp(fields[0], keystore->aes->section) == 0)
+			{
+				keys = keystore->aes;
+			}
+			else if (strcmp(fields[0], keystore->rsa->section) == 0)
+			{
+				keys = keystore->rsa;
+			}
+
+			gchar **list = g_strsplit(fields[2], ";", 2);
+			int key_index = atoi(fields[1]);
+
+			if (keys && g_strv_length(list) == 2)
+			{
+				gpointer key = keys->from_list(list);
+
+				/* -1 would take a free index, the record names a fixed one */
+				if (NULL != key && key_index != -1 &&
+				        keystore_table_insert(keys, key, NULL, &key_index) == NYX_ERROR_NONE)
+				{
+					records++;
+				}
+				else if (NULL != key)
+				{
+					keys->destroy(key);
+				}
+			}
+
+			g_strfreev(list);
 		}
 
-		g_strfreev(aes_keys);
+		g_strfreev(fields);
+	}
+
+	g_strfreev(lines);
+	g_free(data);
+
+	return records;
+}
+
+/*
+ * Rewrites the index file from memory and empties the journal. Records queued
+ * meanwhile are written to the fresh journal; replaying one whose key is
+ * already in the file is harmless.
+ */
+static nyx_error_t keystore_compact(struct keystore_t *keystore)
+{
+	nyx_error_t result = NYX_ERROR_NONE;
+	struct keystore_index_header_t header =
+	{
+		.magic = KEYSTORE_INDEX_MAGIC,
+		.version = KEYSTORE_INDEX_VERSION,
+	};
+	GByteArray *entries = g_byte_array_new();
+	GByteArray *blobs = g_byte_array_new();
+
+	pthread_mutex_lock(&keystore_lock);
+	keystore_table_to_index(keystore->aes, KEYSTORE_INDEX_AES, entries, blobs);
+	keystore_table_to_index(keystore->rsa, KEYSTORE_INDEX_RSA, entries, blobs);
+	pthread_mutex_unlock(&keystore_lock);
+
+	header.count = entries->len / sizeof(struct keystore_index_entry_t);
+	g_byte_array_prepend(entries, (const guint8 *)&header, sizeof(header));
+	g_byte_array_append(entries, blobs->data, blobs->len);
+
+	if (0 != g_mkdir_with_parents(SECURITY_KEYSTORE_DIR, 0700) ||
+	        !g_file_set_contents(SECURITY_KEYSTORE_INDEX_PATH,
+	                             (const gchar *)entries->data, entries->len, NULL))
+	{
+		nyx_debug("%s: g_file_set_contents error", __FUNCTION__);
+		result = NYX_ERROR_GENERIC;
 	}
+	else
+	{
+		/* the old key file is now stale, keep no second copy of the keys */
+		unlink(SECURITY_KEYSTORE_PATH);
 
-	/* load rsa keys */
-	gchar **rsa_keys = g_key_file_get_keys(keyfile, "rsa", NULL, NULL);
+		if (journal.fd >= 0 && ftruncate(journal.fd, 0) < 0)
+		{
+			nyx_debug("%s: ftruncate error %d", __FUNCTION__, errno);
+		}
+		else
+		{
+			journal.records = 0;
+		}
+	}
+
+	g_byte_array_free(entries, TRUE);
+	g_byte_array_free(blobs, TRUE);
 
-	if (NULL != rsa_keys)
+	return result;
+}
+
+static void *keystore_journal_writer(void *data)
+{
+	struct keystore_t *keystore = (struct keystore_t *)data;
+	GString *batch = g_string_new(NULL);
+	int stop = 0;
+
+	while (!stop)
 	{
-		for (i = 0; rsa_keys[i] != NULL; ++i)
+		pthread_mutex_lock(&journal.lock);
+
+		while (journal.pending->len == 0 && !journal.stop)
 		{
-			keystore_load_rsakey(keyfile, rsa_keys[i], keystore);
+			pthread_cond_wait(&journal.cond, &journal.lock);
 		}
 
-		g_strfreev(rsa_keys);
-	}
+		/* swap buffers so that writers are not blocked on disk I/O */
+		GString *tmp = batch;
+		batch = journal.pending;
+		journal.pending = tmp;
+		stop = journal.stop;
 
-	g_key_file_free(keyfile);
+		pthread_mutex_unlock(&journal.lock);
 
-	return NYX_ERROR_NONE;
+		if (batch->len == 0)
+		{
+			continue;
+		}
+
+		const gchar *p = batch->str;
+		gsize left = batch->len;
+
+		while (left > 0)
+		{
+			ssize_t n = write(journal.fd, p, left);
+
+			if (n < 0 && errno == EINTR)
+			{
+				continue;
+			}
+
+			if (n < 0)
+			{
+				nyx_debug("%s: write error %d", __FUNCTION__, errno);
+				break;
+			}
+
+			p += n;
+			left -= n;
+		}
+
+		fdatasync(journal.fd);
+
+		for (p = batch->str; *p; ++p)
+		{
+			journal.records += (*p == '\n');
+		}
+
+		g_string_truncate(batch, 0);
+
+		if (journal.records >= KEYSTORE_COMPACT_RECORDS)
+		{
+			keystore_compact(keystore);
+		}
+	}
+
+	g_string_free(batch, TRUE);
+	return NULL;
 }
 
-void keystore_save(struct keystore_t *keystore)
+static void keystore_journal_start(struct keystore_t *keystore, int records,
+                                   off_t valid)
 {
-	g_assert(keystore);
+	if (0 != g_mkdir_with_parents(SECURITY_KEYSTORE_DIR, 0700))
+	{
+		return;
+	}
 
-	GKeyFile *keyfile = g_key_file_new();
+	journal.fd = open(SECURITY_KEYSTORE_JOURNAL_PATH,
+	                  O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
 
-	if (NULL != keystore->aes)
+	if (journal.fd < 0)
 	{
-		g_hash_table_foreach(keystore->aes, keystore_save_aeskey, keyfile);
+		nyx_debug("%s: open error %d", __FUNCTION__, errno);
+		return;
 	}
 
-	if (NULL != keystore->rsa)
+	/* drop a torn record so the next one starts on a line of its own */
+	if (ftruncate(journal.fd, valid) < 0)
 	{
-		g_hash_table_foreach(keystore->rsa, keystore_save_rsakey, keyfile);
+		nyx_debug("%s: ftruncate error %d", __FUNCTION__, errno);
 	}
 
-	/* save to disk */
+	journal.records = records;
+	journal.pending = g_string_new(NULL);
+	journal.stop = 0;
 
-	if (0 == g_mkdir_with_parents(SECURITY_KEYSTORE_DIR, 0700))
+	if (pthread_create(&journal.thread, NULL, keystore_journal_writer,
+	                   keystore) != 0)
 	{
-		gsize length = 0;
-		gchar *keystore_data = g_key_file_to_data(keyfile, &length, NULL);
+		g_string_free(journal.pending, TRUE);
+		journal.pending = NULL;
+		close(journal.fd);
+		journal.fd = -1;
+		return;
+	}
 
-		if (!g_file_set_contents(SECURITY_KEYSTORE_PATH, keystore_data, length, NULL))
+	journal.running = 1;
+}
+
+/*
+ * Loads the index file, or the older key file when there is none yet, and
+ * replays the journal on top. The next compaction moves a key file over to
+ * the index format.
+ */
+nyx_error_t keystore_load(struct keystore_t *keystore)
+{
+	nyx_error_t result = keystore_index_load(keystore);
+
+	if (NYX_ERROR_NOT_FOUND != result && NYX_ERROR_NONE != result)
+	{
+		return NYX_ERROR_GENERIC;
+	}
+
+	if (NYX_ERROR_NOT_FOUND == result &&
+	        TRUE == g_file_test(SECURITY_KEYSTORE_PATH, G_FILE_TEST_EXISTS))
+	{
+		GKeyFile *keyfile = g_key_file_new();
+		GKeyFileFlags flags = G_KEY_FILE_NONE;
+
+		if (!g_key_file_load_from_file(keyfile, SECURITY_KEYSTORE_PATH, flags, NULL))
 		{
-			nyx_debug("%s: g_file_set_contents error", __FUNCTION__);
+			nyx_debug("%s: g_key_file_load_from_file error", __FUNCTION__);
+			g_key_file_free(keyfile);
+			return NYX_ERROR_GENERIC;
 		}
 
-		g_free(keystore_data);
+		keystore_table_from_keyfile(keystore->aes, keyfile);
+		keystore_table_from_keyfile(keystore->rsa, keyfile);
+
+		g_key_file_free(keyfile);
+	}
+
+	off_t valid;
+	int records = keystore_journal_replay(keystore, &valid);
+
+	keystore_journal_start(keystore, records, valid);
+
+	return NYX_ERROR_NONE;
+}
+
+/*
+ * Makes sure every key is on disk. With the journal running this only waits
+ * for the writer to flush what is queued, so it does not depend on the size
+ * of the keystore; without it the key file is rewritten as before.
+ */
+void keystore_save(struct keystore_t *keystore)
+{
+	g_assert(keystore);
+
+	if (!journal.running)
+	{
+		keystore_compact(keystore);
+		return;
+	}
+
+	keystore_journal_stop();
+}
+
+/* Flushes what is queued and joins the writer; a no-op when it is not running. */
+static void keystore_journal_stop(void)
+{
+	if (!journal.running)
+	{
+		return;
 	}
 
-	g_key_file_free(keyfile);
+	/* keys added from here on are only kept in memory */
+	pthread_mutex_lock(&journal.lock);
+	journal.running = 0;
+	journal.stop = 1;
+	pthread_cond_signal(&journal.cond);
+	pthread_mutex_unlock(&journal.lock);
+
+	pthread_join(journal.thread, NULL);
+
+	g_string_free(journal.pending, TRUE);
+	journal.pending = NULL;
+
+	close(journal.fd);
+	journal.fd = -1;
 }
 
+#ifdef SECURITY_KEYSTORE_DUMP
 static void aeskey_hexdump(gpointer key, gpointer value, gpointer user_data)
 {
 	struct aes_key_t *aes_key = (struct aes_key_t *)value;
@@ -322,6 +1031,7 @@ static void rsakey_hexdump(gpointer key, gpointer value, gpointer user_data)
 
 void keystore_dump(struct keystore_t *keystore)
 {
-	g_hash_table_foreach(keystore->aes, aeskey_hexdump, NULL);
-	g_hash_table_foreach(keystore->rsa, rsakey_hexdump, NULL);
+	keystore_foreach(keystore->aes, aeskey_hexdump, NULL);
+	keystore_foreach(keystore->rsa, rsakey_hexdump, NULL);
 }
+#endif
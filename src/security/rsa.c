@@ -18,6 +18,20 @@
 #include <openssl/bn.h>
 #include <openssl/err.h>
 
+#include "async_job.h"
+
+typedef struct
+{
+	int keylen;
+	int key_index;
+	nyx_error_t result;
+	security_rsa_key_cb_t callback;
+	void *user_data;
+} rsa_async_request_t;
+
+/* async generations; the keystore must outlive their workers */
+static async_job_queue_t rsa_async_jobs = ASYNC_JOB_QUEUE_INITIALIZER;
+
 nyx_error_t rsa_generate_key(int keylen, int *key_index)
 {
 	switch (keylen)
@@ -30,6 +44,12 @@ nyx_error_t rsa_generate_key(int keylen, int *key_index)
 			return NYX_ERROR_INVALID_VALUE;
 	}
 
+	/* reject a bad index before spending seconds on the key */
+	if (!keystore_index_valid(*key_index))
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
 	struct rsa_key_t *rsa_key = g_malloc(sizeof(struct rsa_key_t));
 
 	if (rsa_key == NULL)
@@ -42,24 +62,82 @@ nyx_error_t rsa_generate_key(int keylen, int *key_index)
 	BIGNUM *bn = BN_new();
 	BN_set_word(bn, RSA_F4);
 
-	if (RSA_generate_key_ex(rsa_key->rsa, rsa_key->keylen, bn, NULL) == -1)
+	if (RSA_generate_key_ex(rsa_key->rsa, rsa_key->keylen, bn, NULL) != 1)
 	{
 		nyx_debug("RSA_generate_key_ex failed");
 		ERR_print_errors_fp(stderr);
+		BN_free(bn);
 		goto error;
 	}
 
 	BN_free(bn);
 
-	keystore_key_replace(keystore.rsa, rsa_key, key_index);
+	nyx_error_t result = keystore_key_replace(keystore.rsa, rsa_key, key_index);
 
-	return NYX_ERROR_NONE;
+	if (result != NYX_ERROR_NONE)
+	{
+		rsa_destroy_key(rsa_key);
+	}
+
+	return result;
 
 error:
 	rsa_destroy_key(rsa_key);
 	return NYX_ERROR_GENERIC;
 }
 
+static void rsa_async_generate(void *data)
+{
+	rsa_async_request_t *req = (rsa_async_request_t *)data;
+
+	req->result = rsa_generate_key(req->keylen, &req->key_index);
+}
+
+/* Runs in the requester's main context. */
+static void rsa_async_complete(void *data)
+{
+	rsa_async_request_t *req = (rsa_async_request_t *)data;
+
+	req->callback(req->result, req->key_index, req->user_data);
+}
+
+/**
+ * Generates a key on a worker thread and stores it in the keystore like
+ * rsa_generate_key(). callback gets the key index in the thread-default main
+ * context of the calling thread.
+ */
+nyx_error_t rsa_generate_key_async(int keylen, security_rsa_key_cb_t callback,
+                                   void *user_data)
+{
+	if (keylen != 2048 && keylen != 4096)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	rsa_async_request_t *req = g_new0(rsa_async_request_t, 1);
+	req->keylen = keylen;
+	req->key_index = -1;
+	req->callback = callback;
+	req->user_data = user_data;
+
+	if (!async_job_start(&rsa_async_jobs, rsa_async_generate, rsa_async_complete,
+	                     g_free, req))
+	{
+		return NYX_ERROR_GENERIC;
+	}
+
+	return NYX_ERROR_NONE;
+}
+
+/*
+ * Waits until no async generation is running and drops the completions that
+ * have not run yet, so no module code is left queued in a main context.
+ */
+void rsa_async_wait(void)
+{
+	async_job_queue_drain(&rsa_async_jobs);
+}
+
 nyx_error_t rsa_crypt(int key_index, int encrypt, const char *src, int srclen,
                       char *dest, int *destlen)
 {
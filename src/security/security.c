@@ -28,11 +28,41 @@
 #include <openssl/err.h>
 
 #include "msgid.h"
+#include "perf_counters.h"
 
 NYX_DECLARE_MODULE(NYX_DEVICE_SECURITY, "Security");
 
 struct keystore_t keystore;
 
+/*
+ * runtime counters, see security_query_counters(); every operation enters
+ * through the method wrappers below, so they are bumped only there
+ */
+enum
+{
+	SECURITY_COUNTER_AES_CALLS,
+	SECURITY_COUNTER_AES_BYTES,
+	SECURITY_COUNTER_RSA_CALLS,
+	SECURITY_COUNTER_RSA_BYTES,
+	SECURITY_COUNTER_RSA_KEYS_GENERATED,
+	SECURITY_COUNTER_HASH_UPDATES,
+	SECURITY_COUNTER_HASH_BYTES,
+	SECURITY_COUNTER_COUNT
+};
+
+static const char *const security_counter_names[SECURITY_COUNTER_COUNT] =
+{
+	"aes_calls",
+	"aes_bytes",
+	"rsa_calls",
+	"rsa_bytes",
+	"rsa_keys_generated",
+	"hash_updates",
+	"hash_bytes",
+};
+
+static uint64_t security_counters[SECURITY_COUNTER_COUNT];
+
 nyx_error_t nyx_module_open(nyx_instance_t i, nyx_device_t **d)
 {
 	if ((NULL == d) || (NULL != *d))
@@ -58,11 +88,17 @@ nyx_error_t nyx_module_open(nyx_instance_t i, nyx_device_t **d)
 	{
 		{ NYX_SECURITY_CREATE_AES_KEY_MODULE_METHOD, "security_create_aes_key" },
 		{ NYX_SECURITY_CREATE_RSA_KEY_MODULE_METHOD, "security_create_rsa_key" },
+		{ NYX_SECURITY_CREATE_RSA_KEY_ASYNC_MODULE_METHOD, "security_create_rsa_key_async" },
 		{ NYX_SECURITY_CRYPT_AES_MODULE_METHOD,      "security_aes_crypt" },
 		{ NYX_SECURITY_CRYPT_RSA_MODULE_METHOD,      "security_rsa_crypt" },
 		{ NYX_SECURITY_INIT_HASH_MODULE_METHOD,      "security_init_hash" },
 		{ NYX_SECURITY_UPDATE_HASH_MODULE_METHOD,    "security_update_hash" },
 		{ NYX_SECURITY_FINALIZE_HASH_MODULE_METHOD,  "security_finalize_hash" },
+		{ NYX_SECURITY_INIT_HASH_SESSION_MODULE_METHOD,     "security_init_hash_session" },
+		{ NYX_SECURITY_UPDATE_HASH_SESSION_MODULE_METHOD,   "security_update_hash_session" },
+		{ NYX_SECURITY_FINALIZE_HASH_SESSION_MODULE_METHOD, "security_finalize_hash_session" },
+		{ NYX_SECURITY_ABORT_HASH_SESSION_MODULE_METHOD,    "security_abort_hash_session" },
+		{ NYX_SECURITY_QUERY_COUNTERS_MODULE_METHOD, "security_query_counters" },
 	};
 
 	int m;
@@ -88,6 +124,11 @@ nyx_error_t nyx_module_open(nyx_instance_t i, nyx_device_t **d)
 		result = keystore_load(&keystore);
 	}
 
+	if (result == NYX_ERROR_NONE)
+	{
+		result = sha_pool_init();
+	}
+
 	if (result != NYX_ERROR_NONE)
 	{
 		keystore_destroy(&keystore);
@@ -99,10 +140,16 @@ nyx_error_t nyx_module_open(nyx_instance_t i, nyx_device_t **d)
 
 nyx_error_t nyx_module_close(nyx_device_handle_t d)
 {
+	/* async generations still insert into the keystore */
+	rsa_async_wait();
+
+#ifdef SECURITY_KEYSTORE_DUMP
 	/* dump keystore for debugging */
 	keystore_dump(&keystore);
+#endif
 	keystore_save(&keystore);
 	keystore_destroy(&keystore);
+	sha_pool_destroy();
 	ERR_free_strings();
 	free(d);
 
@@ -119,19 +166,48 @@ nyx_error_t security_aes_crypt(nyx_device_handle_t d, int key_index,
                                nyx_security_aes_block_mode_t mode, int encrypt, const char *src, int srclen,
                                char *dest, int *destlen, int *ivlen)
 {
-	return aes_crypt(key_index, encrypt, mode, src, srclen, dest, destlen, ivlen);
+	PERF_TRACE(nyx_security, aes_crypt__entry, key_index, encrypt, srclen);
+	PERF_COUNTER_INC(security_counters[SECURITY_COUNTER_AES_CALLS]);
+	PERF_COUNTER_ADD(security_counters[SECURITY_COUNTER_AES_BYTES], srclen);
+
+	nyx_error_t result = aes_crypt(key_index, encrypt, mode, src, srclen, dest,
+	                               destlen, ivlen);
+
+	PERF_TRACE(nyx_security, aes_crypt__return, result);
+	return result;
 }
 
 nyx_error_t security_create_rsa_key(nyx_device_handle_t d, int keylen,
                                     int *key_index)
 {
+	PERF_COUNTER_INC(security_counters[SECURITY_COUNTER_RSA_KEYS_GENERATED]);
 	return rsa_generate_key(keylen, key_index);
 }
 
+nyx_error_t security_create_rsa_key_async(nyx_device_handle_t d, int keylen,
+        security_rsa_key_cb_t callback, void *user_data)
+{
+	if (NULL == callback)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	PERF_COUNTER_INC(security_counters[SECURITY_COUNTER_RSA_KEYS_GENERATED]);
+	return rsa_generate_key_async(keylen, callback, user_data);
+}
+
 nyx_error_t security_rsa_crypt(nyx_device_handle_t d, int key_index,
                                int encrypt, const char *src, int srclen, char *dest, int *destlen)
 {
-	return rsa_crypt(key_index, encrypt, src, srclen, dest, destlen);
+	PERF_TRACE(nyx_security, rsa_crypt__entry, key_index, encrypt, srclen);
+	PERF_COUNTER_INC(security_counters[SECURITY_COUNTER_RSA_CALLS]);
+	PERF_COUNTER_ADD(security_counters[SECURITY_COUNTER_RSA_BYTES], srclen);
+
+	nyx_error_t result = rsa_crypt(key_index, encrypt, src, srclen, dest,
+	                               destlen);
+
+	PERF_TRACE(nyx_security, rsa_crypt__return, result);
+	return result;
 }
 
 nyx_error_t security_init_hash(nyx_device_handle_t d, const char *hash_algo)
@@ -142,9 +218,19 @@ nyx_error_t security_init_hash(nyx_device_handle_t d, const char *hash_algo)
 nyx_error_t security_update_hash(nyx_device_handle_t d, const char *src,
                                  int srclen)
 {
+	PERF_COUNTER_INC(security_counters[SECURITY_COUNTER_HASH_UPDATES]);
+	PERF_COUNTER_ADD(security_counters[SECURITY_COUNTER_HASH_BYTES], srclen);
 	return sha_update(src, srclen);
 }
 
+static void security_encode_hash(char *dest, int destlen)
+{
+	/* base64 encode hash */
+	gchar *b64 = g_base64_encode((const guchar *)dest, destlen);
+	memcpy(dest, b64, strlen(b64) + 1);
+	g_free(b64);
+}
+
 nyx_error_t security_finalize_hash(nyx_device_handle_t d, char *dest)
 {
 	int destlen = -1;
@@ -152,11 +238,71 @@ nyx_error_t security_finalize_hash(nyx_device_handle_t d, char *dest)
 
 	if (result == NYX_ERROR_NONE)
 	{
-		/* base64 encode hash */
-		gchar *b64 = g_base64_encode((const guchar *)dest, destlen);
-		memcpy(dest, b64, strlen(b64) + 1);
-		g_free(b64);
+		security_encode_hash(dest, destlen);
+	}
+
+	return result;
+}
+
+nyx_error_t security_init_hash_session(nyx_device_handle_t d,
+                                       const char *hash_algo, int *handle)
+{
+	if (NULL == hash_algo || NULL == handle)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	return sha_session_init(hash_algo, handle);
+}
+
+nyx_error_t security_update_hash_session(nyx_device_handle_t d, int handle,
+        const char *src, int srclen)
+{
+	if (NULL == src || srclen < 0)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	PERF_COUNTER_INC(security_counters[SECURITY_COUNTER_HASH_UPDATES]);
+	PERF_COUNTER_ADD(security_counters[SECURITY_COUNTER_HASH_BYTES], srclen);
+	return sha_session_update(handle, src, srclen);
+}
+
+/* dest receives the base64 encoded hash, like security_finalize_hash() */
+nyx_error_t security_finalize_hash_session(nyx_device_handle_t d, int handle,
+        char *dest)
+{
+	int destlen = -1;
+	nyx_error_t result;
+
+	if (NULL == dest)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	result = sha_session_finalize(handle, dest, &destlen);
+
+	if (result == NYX_ERROR_NONE)
+	{
+		security_encode_hash(dest, destlen);
 	}
 
 	return result;
 }
+
+nyx_error_t security_abort_hash_session(nyx_device_handle_t d, int handle)
+{
+	return sha_session_abort(handle);
+}
+
+nyx_error_t security_query_counters(nyx_device_handle_t d,
+                                    nyx_perf_counter_t *counters, int *count)
+{
+	if (NULL == d)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	return perf_counters_read(security_counter_names, security_counters,
+	                          SECURITY_COUNTER_COUNT, counters, count);
+}
@@ -15,8 +15,15 @@
 // SPDX-License-Identifier: Apache-2.0
 
 #include <security.h>
+#include <pthread.h>
 #include <string.h>
 
+#include "slot_handle.h"
+
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+#define EVP_MD_CTX_cleanup(ctx) EVP_MD_CTX_reset(ctx)
+#endif
+
 static const struct sha_algo_data_t
 {
 	const char *name;
@@ -42,68 +49,265 @@ static const struct sha_algo_data_t *sha_algo_data_lookup(const char *name)
 	return NULL;
 }
 
-/* running hashing context (only single concurrent hash operation supported) */
-static EVP_MD_CTX *running_mdctx = NULL;
+/*
+ * Hash sessions. The contexts are allocated once by sha_pool_init() and
+ * reused, so starting a hash does not touch the heap. Handles carry the
+ * slot's generation, so a handle kept after finalize or abort does not reach
+ * the next hash started in that slot. A slot in use by one call is marked
+ * busy so that a concurrent call on the same handle fails instead of racing
+ * on the context.
+ */
+#define SHA_SESSION_MAX 8
 
-nyx_error_t sha_init(const char *name)
+static struct
+{
+	EVP_MD_CTX *mdctx;
+	int in_use;
+	int busy;
+	unsigned int generation;
+} sha_sessions[SHA_SESSION_MAX];
+
+static pthread_mutex_t sha_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * session used by the handle-less sha_init/sha_update/sha_finalize calls;
+ * guarded by legacy_lock, which is taken before sha_lock
+ */
+static int legacy_handle = 0;
+static pthread_mutex_t legacy_lock = PTHREAD_MUTEX_INITIALIZER;
+
+nyx_error_t sha_pool_init(void)
+{
+	int i;
+
+	for (i = 0; i < SHA_SESSION_MAX; i++)
+	{
+		if (!sha_sessions[i].mdctx &&
+		        !(sha_sessions[i].mdctx = EVP_MD_CTX_create()))
+		{
+			sha_pool_destroy();
+			return NYX_ERROR_OUT_OF_MEMORY;
+		}
+	}
+
+	return NYX_ERROR_NONE;
+}
+
+void sha_pool_destroy(void)
+{
+	int i;
+
+	pthread_mutex_lock(&sha_lock);
+
+	for (i = 0; i < SHA_SESSION_MAX; i++)
+	{
+		if (sha_sessions[i].mdctx)
+		{
+			EVP_MD_CTX_destroy(sha_sessions[i].mdctx);
+		}
+
+		/* the generation stays, so old handles remain invalid */
+		sha_sessions[i].mdctx = NULL;
+		sha_sessions[i].in_use = 0;
+		sha_sessions[i].busy = 0;
+	}
+
+	pthread_mutex_unlock(&sha_lock);
+
+	pthread_mutex_lock(&legacy_lock);
+	legacy_handle = 0;
+	pthread_mutex_unlock(&legacy_lock);
+}
+
+static EVP_MD_CTX *sha_session_acquire(int handle, nyx_error_t *result)
+{
+	EVP_MD_CTX *mdctx = NULL;
+	int slot = slot_handle_slot(handle, SHA_SESSION_MAX);
+
+	pthread_mutex_lock(&sha_lock);
+
+	if (slot < 0 || !sha_sessions[slot].in_use ||
+	        !slot_handle_matches(handle, sha_sessions[slot].generation))
+	{
+		*result = NYX_ERROR_INVALID_HANDLE;
+	}
+	else if (sha_sessions[slot].busy)
+	{
+		*result = NYX_ERROR_INVALID_OPERATION;
+	}
+	else
+	{
+		sha_sessions[slot].busy = 1;
+		mdctx = sha_sessions[slot].mdctx;
+		*result = NYX_ERROR_NONE;
+	}
+
+	pthread_mutex_unlock(&sha_lock);
+	return mdctx;
+}
+
+/* Releases a slot taken by sha_session_acquire(), closing it when done. */
+static void sha_session_release(int handle, int done)
+{
+	int slot = slot_handle_slot(handle, SHA_SESSION_MAX);
+
+	pthread_mutex_lock(&sha_lock);
+
+	sha_sessions[slot].busy = 0;
+
+	if (done)
+	{
+		EVP_MD_CTX_cleanup(sha_sessions[slot].mdctx);
+		sha_sessions[slot].in_use = 0;
+	}
+
+	pthread_mutex_unlock(&sha_lock);
+}
+
+nyx_error_t sha_session_init(const char *name, int *handle)
 {
 	const struct sha_algo_data_t *algo = sha_algo_data_lookup(name);
+	nyx_error_t result;
+	int i;
 
 	if (algo == NULL)
 	{
 		return NYX_ERROR_INVALID_VALUE;
 	}
 
-	if (running_mdctx != NULL)
+	pthread_mutex_lock(&sha_lock);
+
+	for (i = 0; i < SHA_SESSION_MAX; i++)
 	{
-		EVP_MD_CTX_cleanup(running_mdctx);
-		EVP_MD_CTX_destroy(running_mdctx);
+		if (sha_sessions[i].mdctx && !sha_sessions[i].in_use)
+		{
+			sha_sessions[i].in_use = 1;
+			sha_sessions[i].busy = 1;
+			*handle = slot_handle_issue(&sha_sessions[i].generation, i);
+			break;
+		}
 	}
 
-	running_mdctx = EVP_MD_CTX_create();
-	EVP_MD_CTX_init(running_mdctx);
+	pthread_mutex_unlock(&sha_lock);
 
-	if (EVP_DigestInit_ex(running_mdctx, algo->md(), NULL) != 1)
+	if (i == SHA_SESSION_MAX)
 	{
-		return NYX_ERROR_GENERIC;
+		return NYX_ERROR_OUT_OF_MEMORY;
 	}
 
+	if (EVP_DigestInit_ex(sha_sessions[i].mdctx, algo->md(), NULL) != 1)
+	{
+		result = NYX_ERROR_GENERIC;
+		sha_session_release(*handle, 1);
+		*handle = 0;
+		return result;
+	}
+
+	sha_session_release(*handle, 0);
 	return NYX_ERROR_NONE;
 }
 
-nyx_error_t sha_update(const char *src, int srclen)
+nyx_error_t sha_session_update(int handle, const char *src, int srclen)
 {
-	if (running_mdctx == NULL)
+	nyx_error_t result;
+	EVP_MD_CTX *mdctx = sha_session_acquire(handle, &result);
+
+	if (mdctx == NULL)
 	{
-		return NYX_ERROR_INVALID_VALUE;
+		return result;
 	}
 
-	if (EVP_DigestUpdate(running_mdctx, (const void *)src, (size_t)srclen) != 1)
+	if (EVP_DigestUpdate(mdctx, (const void *)src, (size_t)srclen) != 1)
 	{
-		return NYX_ERROR_GENERIC;
+		result = NYX_ERROR_GENERIC;
 	}
 
-	return NYX_ERROR_NONE;
+	sha_session_release(handle, 0);
+	return result;
 }
 
-nyx_error_t sha_finalize(char *dest, int *destlen)
+nyx_error_t sha_session_finalize(int handle, char *dest, int *destlen)
 {
-	if (running_mdctx == NULL)
+	nyx_error_t result;
+	EVP_MD_CTX *mdctx = sha_session_acquire(handle, &result);
+
+	if (mdctx == NULL)
 	{
-		return NYX_ERROR_INVALID_VALUE;
+		return result;
 	}
 
-	if (EVP_DigestFinal_ex(running_mdctx, (unsigned char *)dest,
+	if (EVP_DigestFinal_ex(mdctx, (unsigned char *)dest,
 	                       (unsigned int *)destlen) != 1)
 	{
-		return NYX_ERROR_GENERIC;
+		result = NYX_ERROR_GENERIC;
 	}
 
-	EVP_MD_CTX_cleanup(running_mdctx);
-	EVP_MD_CTX_destroy(running_mdctx);
+	sha_session_release(handle, 1);
+	return result;
+}
+
+nyx_error_t sha_session_abort(int handle)
+{
+	nyx_error_t result;
 
-	running_mdctx = NULL;
+	if (sha_session_acquire(handle, &result) == NULL)
+	{
+		return result;
+	}
 
+	sha_session_release(handle, 1);
 	return NYX_ERROR_NONE;
 }
 
+/*
+ * The handle-less calls keep their old semantics: sha_init() restarts the
+ * one legacy hash, but no longer disturbs sessions opened by other clients.
+ */
+nyx_error_t sha_init(const char *name)
+{
+	nyx_error_t result;
+
+	pthread_mutex_lock(&legacy_lock);
+
+	if (legacy_handle)
+	{
+		sha_session_abort(legacy_handle);
+		legacy_handle = 0;
+	}
+
+	result = sha_session_init(name, &legacy_handle);
+
+	pthread_mutex_unlock(&legacy_lock);
+	return result;
+}
+
+nyx_error_t sha_update(const char *src, int srclen)
+{
+	nyx_error_t result = NYX_ERROR_INVALID_VALUE;
+
+	pthread_mutex_lock(&legacy_lock);
+
+	if (legacy_handle)
+	{
+		result = sha_session_update(legacy_handle, src, srclen);
+	}
+
+	pthread_mutex_unlock(&legacy_lock);
+	return result;
+}
+
+nyx_error_t sha_finalize(char *dest, int *destlen)
+{
+	nyx_error_t result = NYX_ERROR_INVALID_VALUE;
+
+	pthread_mutex_lock(&legacy_lock);
+
+	if (legacy_handle)
+	{
+		result = sha_session_finalize(legacy_handle, dest, destlen);
+		legacy_handle = 0;
+	}
+
+	pthread_mutex_unlock(&legacy_lock);
+	return result;
+}
@@ -0,0 +1,389 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+/*
+ * Keystore persistence tests. The keystore sources are built in with the
+ * key files redirected to a scratch directory, so that what the keystore
+ * writes can be checked on disk.
+ */
+
+#define SECURITY_KEYSTORE_DIR "/tmp/nyx-test-keystore"
+
+#include "../keystore.c"
+#include "../rsa.c"
+
+struct keystore_t keystore;
+
+static void keystore_dir_clean(void)
+{
+	unlink(SECURITY_KEYSTORE_PATH);
+	unlink(SECURITY_KEYSTORE_INDEX_PATH);
+	unlink(SECURITY_KEYSTORE_JOURNAL_PATH);
+	rmdir(SECURITY_KEYSTORE_DIR);
+}
+
+/* loads the keystore the way nyx_module_open() does */
+static nyx_error_t keystore_open(void)
+{
+	g_assert_cmpint(NYX_ERROR_NONE, == , keystore_init(&keystore));
+	return keystore_load(&keystore);
+}
+
+/* queued records reach the journal, but nothing is folded into the index */
+static void keystore_crash(void)
+{
+	keystore_journal_stop();
+	keystore_destroy(&keystore);
+}
+
+/* folds everything into the index file and drops the journal */
+static void keystore_compact_only(void)
+{
+	keystore_journal_stop();
+	g_assert_cmpint(NYX_ERROR_NONE, == , keystore_compact(&keystore));
+	keystore_destroy(&keystore);
+
+	g_assert(g_file_test(SECURITY_KEYSTORE_INDEX_PATH, G_FILE_TEST_EXISTS));
+	unlink(SECURITY_KEYSTORE_JOURNAL_PATH);
+}
+
+static off_t file_size(const char *path)
+{
+	struct stat st;
+
+	return stat(path, &st) == 0 ? st.st_size : -1;
+}
+
+static int add_aes_key(int index, unsigned char fill)
+{
+	struct aes_key_t *key = g_new0(struct aes_key_t, 1);
+
+	key->keylen = 128;
+	memset(key->key, fill, key->keylen / 8);
+
+	g_assert_cmpint(NYX_ERROR_NONE, == , keystore_key_replace(keystore.aes, key,
+	                &index));
+	return index;
+}
+
+static void assert_aes_key(int index, unsigned char fill)
+{
+	struct aes_key_t *key = keystore_key_lookup(keystore.aes, index);
+	unsigned char expected[16];
+
+	memset(expected, fill, sizeof(expected));
+
+	g_assert(key != NULL);
+	g_assert_cmpint(key->keylen, == , 128);
+	g_assert(memcmp(key->key, expected, sizeof(expected)) == 0);
+}
+
+static GBytes *rsa_key_der(int index)
+{
+	struct rsa_key_t *key = keystore_key_lookup(keystore.rsa, index);
+	int length, keylen;
+
+	g_assert(key != NULL);
+	unsigned char *der = rsakey_to_blob(key, &length, &keylen);
+	return g_bytes_new_take(der, length);
+}
+
+static void test_index_reuse(void)
+{
+	int i;
+
+	keystore_dir_clean();
+	g_assert_cmpint(NYX_ERROR_NONE, == , keystore_open());
+
+	/* the indices skipped over by an explicit one are free */
+	g_assert_cmpint(add_aes_key(3, 0x30), == , 3);
+
+	gboolean seen[3] = { FALSE, };
+
+	for (i = 0; i < 3; ++i)
+	{
+		int index = add_aes_key(-1, i);
+		g_assert_cmpint(index, >= , 0);
+		g_assert_cmpint(index, < , 3);
+		g_assert(!seen[index]);
+		seen[index] = TRUE;
+	}
+
+	g_assert_cmpint(add_aes_key(-1, 0x40), == , 4);
+
+	/* replacing a key takes over its slot */
+	int count = keystore.aes->count;
+	g_assert_cmpint(add_aes_key(1, 0x11), == , 1);
+	g_assert_cmpint(keystore.aes->count, == , count);
+	assert_aes_key(1, 0x11);
+
+	/* the journal replays the replacement last */
+	keystore_save(&keystore);
+	keystore_destroy(&keystore);
+	g_assert_cmpint(NYX_ERROR_NONE, == , keystore_open());
+	assert_aes_key(1, 0x11);
+	assert_aes_key(3, 0x30);
+	assert_aes_key(4, 0x40);
+	g_assert_cmpint(keystore.aes->count, == , count);
+	g_assert_cmpint(add_aes_key(-1, 0x50), == , 5);
+
+	keystore_crash();
+	keystore_dir_clean();
+}
+
+static void test_journal_replay(void)
+{
+	int i;
+
+	keystore_dir_clean();
+	g_assert_cmpint(NYX_ERROR_NONE, == , keystore_open());
+
+	for (i = 0; i < 10; ++i)
+	{
+		add_aes_key(i, i);
+	}
+
+	keystore_crash();
+
+	/* the record being written when the process died */
+	off_t valid = file_size(SECURITY_KEYSTORE_JOURNAL_PATH);
+	g_assert_cmpint(valid, > , 0);
+
+	FILE *fp = fopen(SECURITY_KEYSTORE_JOURNAL_PATH, "a");
+	g_assert(fp != NULL);
+	fputs("aes\t42\t128;AAAA", fp);
+	fclose(fp);
+
+	g_assert_cmpint(NYX_ERROR_NONE, == , keystore_open());
+
+	for (i = 0; i < 10; ++i)
+	{
+		assert_aes_key(i, i);
+	}
+
+	g_assert(keystore_key_lookup(keystore.aes, 42) == NULL);
+	/* the torn record is cut off so the next one starts on its own line */
+	g_assert_cmpint(file_size(SECURITY_KEYSTORE_JOURNAL_PATH), == , valid);
+	g_assert(!g_file_test(SECURITY_KEYSTORE_INDEX_PATH, G_FILE_TEST_EXISTS));
+
+	keystore_crash();
+	keystore_dir_clean();
+}
+
+static void test_compaction(void)
+{
+	int rsa_index = -1;
+	int i;
+
+	keystore_dir_clean();
+	g_assert_cmpint(NYX_ERROR_NONE, == , keystore_open());
+
+	for (i = 0; i < 6; ++i)
+	{
+		add_aes_key(i, i);
+	}
+
+	add_aes_key(2, 0x22);
+	g_assert_cmpint(NYX_ERROR_NONE, == , rsa_generate_key(2048, &rsa_index));
+	GBytes *der = rsa_key_der(rsa_index);
+
+	keystore_compact_only();
+
+	/* the index file alone gives back the same keys */
+	g_assert_cmpint(NYX_ERROR_NONE, == , keystore_open());
+
+	for (i = 0; i < 6; ++i)
+	{
+		assert_aes_key(i, i == 2 ? 0x22 : i);
+	}
+
+	GBytes *loaded = rsa_key_der(rsa_index);
+	g_assert(g_bytes_equal(der, loaded));
+	g_assert_cmpint(keystore.aes->count, == , 6);
+	g_assert_cmpint(keystore.rsa->count, == , 1);
+
+	g_bytes_unref(loaded);
+	g_bytes_unref(der);
+	keystore_crash();
+	keystore_dir_clean();
+}
+
+/* writes an index file of the first size bytes of data */
+static void write_index(const gchar *data, gsize size)
+{
+	g_assert(g_file_set_contents(SECURITY_KEYSTORE_INDEX_PATH, data, size, NULL));
+}
+
+static void test_corrupt_index(void)
+{
+	struct keystore_index_header_t header;
+	gchar *data = NULL;
+	gsize size = 0;
+	int i;
+
+	keystore_dir_clean();
+	g_assert_cmpint(NYX_ERROR_NONE, == , keystore_open());
+
+	for (i = 0; i < 4; ++i)
+	{
+		add_aes_key(i, i);
+	}
+
+	keystore_compact_only();
+	g_assert(g_file_get_contents(SECURITY_KEYSTORE_INDEX_PATH, &data, &size,
+	                             NULL));
+
+	/* a blob cut short drops only that key */
+	write_index(data, size - 4);
+	g_assert_cmpint(NYX_ERROR_NONE, == , keystore_open());
+
+	for (i = 0; i < 3; ++i)
+	{
+		assert_aes_key(i, i);
+	}
+
+	g_assert(keystore_key_lookup(keystore.aes, 3) == NULL);
+	keystore_crash();
+
+	/* shorter than the header */
+	write_index(data, sizeof(header) / 2);
+	g_assert_cmpint(NYX_ERROR_GENERIC, == , keystore_open());
+	keystore_destroy(&keystore);
+
+	/* entries cut off */
+	write_index(data, sizeof(header) + sizeof(struct keystore_index_entry_t));
+	g_assert_cmpint(NYX_ERROR_GENERIC, == , keystore_open());
+	keystore_destroy(&keystore);
+
+	/* not an index file */
+	memcpy(&header, data, sizeof(header));
+	header.magic = ~header.magic;
+	memcpy(data, &header, sizeof(header));
+	write_index(data, size);
+	g_assert_cmpint(NYX_ERROR_GENERIC, == , keystore_open());
+	keystore_destroy(&keystore);
+
+	g_free(data);
+	keystore_dir_clean();
+}
+
+static void test_undecodable_key(void)
+{
+	struct keystore_index_entry_t entry;
+	gchar *data = NULL, *compacted = NULL;
+	gsize size = 0, compacted_size = 0;
+	int rsa_index = -1;
+
+	keystore_dir_clean();
+	g_assert_cmpint(NYX_ERROR_NONE, == , keystore_open());
+	g_assert_cmpint(NYX_ERROR_NONE, == , rsa_generate_key(1024, &rsa_index));
+	keystore_compact_only();
+
+	/* damage the key's DER so that the lazy decode fails */
+	g_assert(g_file_get_contents(SECURITY_KEYSTORE_INDEX_PATH, &data, &size,
+	                             NULL));
+	memcpy(&entry, data + sizeof(struct keystore_index_header_t), sizeof(entry));
+	g_assert_cmpint(entry.index, == , rsa_index);
+	memset(data + entry.offset, 0xff, entry.length);
+	write_index(data, size);
+
+	g_assert_cmpint(NYX_ERROR_NONE, == , keystore_open());
+	g_assert(keystore_key_lookup(keystore.rsa, rsa_index) == NULL);
+	g_assert(keystore_key_lookup(keystore.rsa, rsa_index) == NULL);
+
+	/* the failed lookup does not make compaction drop the record */
+	keystore_compact_only();
+	g_assert(g_file_get_contents(SECURITY_KEYSTORE_INDEX_PATH, &compacted,
+	                             &compacted_size, NULL));
+	g_assert_cmpint(compacted_size, == , size);
+	g_assert(memcmp(compacted, data, size) == 0);
+
+	g_free(compacted);
+	g_free(data);
+	keystore_dir_clean();
+}
+
+struct async_result
+{
+	int calls;
+	nyx_error_t result;
+	int key_index;
+	GThread *thread;
+};
+
+static void async_done(nyx_error_t result, int key_index, void *user_data)
+{
+	struct async_result *r = user_data;
+
+	r->calls++;
+	r->result = result;
+	r->key_index = key_index;
+	r->thread = g_thread_self();
+}
+
+static void test_async_completion(void)
+{
+	struct async_result r = { 0, };
+
+	keystore_dir_clean();
+	g_assert_cmpint(NYX_ERROR_NONE, == , keystore_open());
+
+	/* the callback runs in the requester's main context */
+	g_assert_cmpint(NYX_ERROR_NONE, == , rsa_generate_key_async(2048, async_done,
+	                &r));
+
+	while (r.calls == 0)
+	{
+		g_main_context_iteration(NULL, TRUE);
+	}
+
+	g_assert_cmpint(r.calls, == , 1);
+	g_assert_cmpint(r.result, == , NYX_ERROR_NONE);
+	g_assert(r.thread == g_thread_self());
+	g_assert(keystore_key_lookup(keystore.rsa, r.key_index) != NULL);
+
+	/* a completion not dispatched before shutdown is dropped */
+	memset(&r, 0, sizeof(r));
+	g_assert_cmpint(NYX_ERROR_NONE, == , rsa_generate_key_async(2048, async_done,
+	                &r));
+	rsa_async_wait();
+
+	while (g_main_context_iteration(NULL, FALSE))
+	{
+	}
+
+	g_assert_cmpint(r.calls, == , 0);
+
+	keystore_crash();
+	keystore_dir_clean();
+}
+
+int main(int argc, char *argv[])
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/nyx/security/keystore/index_reuse", test_index_reuse);
+	g_test_add_func("/nyx/security/keystore/journal_replay", test_journal_replay);
+	g_test_add_func("/nyx/security/keystore/compaction", test_compaction);
+	g_test_add_func("/nyx/security/keystore/corrupt_index", test_corrupt_index);
+	g_test_add_func("/nyx/security/keystore/undecodable_key",
+	                test_undecodable_key);
+	g_test_add_func("/nyx/security/keystore/async_completion",
+	                test_async_completion);
+
+	return g_test_run();
+}
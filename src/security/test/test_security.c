@@ -20,9 +20,13 @@
 #include <glib.h>
 #include <string.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <openssl/obj_mac.h>
 #include <openssl/evp.h>
 
+/* SECURITY_KEYSTORE_INDEX_MAX of the module */
+#define KEYSTORE_INDEX_MAX 65535
+
 struct Fixture
 {
 	nyx_device_handle_t device;
@@ -87,6 +91,31 @@ static void test_create_rsa_key(struct Fixture *f, gconstpointer userdata)
 	g_assert_cmpint(index, >= , 2); /* index 0,1 assigned */
 }
 
+static void test_create_key_bad_index(struct Fixture *f, gconstpointer userdata)
+{
+	const int bad[] = { -2, INT_MIN, KEYSTORE_INDEX_MAX + 1, INT_MAX };
+	int i;
+
+	for (i = 0; i < sizeof(bad) / sizeof(bad[0]); ++i)
+	{
+		int index = bad[i];
+		g_assert_cmpint(NYX_ERROR_INVALID_VALUE, == ,
+		                nyx_security_create_aes_key(f->device, 128, &index));
+		g_assert_cmpint(index, == , bad[i]);
+
+		index = bad[i];
+		g_assert_cmpint(NYX_ERROR_INVALID_VALUE, == ,
+		                nyx_security_create_rsa_key(f->device, 2048, &index));
+		g_assert_cmpint(index, == , bad[i]);
+	}
+
+	/* the highest index is still usable */
+	int index = KEYSTORE_INDEX_MAX;
+	g_assert_cmpint(NYX_ERROR_NONE, == , nyx_security_create_aes_key(f->device,
+	                128, &index));
+	g_assert_cmpint(index, == , KEYSTORE_INDEX_MAX);
+}
+
 static void test_crypt_aes(struct Fixture *f, gconstpointer userdata)
 {
 	nyx_security_aes_block_mode_t block_mode = (nyx_security_aes_block_mode_t)
@@ -174,6 +203,8 @@ int main(int argc, char *argv[])
 	         "256");
 	TEST_ADD("/nyx/security/create_key_rsa2048", test_create_rsa_key,
 	         "2048");
+	TEST_ADD("/nyx/security/create_key_bad_index", test_create_key_bad_index,
+	         NULL);
 
 	TEST_ADD("/nyx/security/crypt_aes128cbc", test_crypt_aes,
 	         GINT_TO_POINTER(NYX_SECURITY_AES_CBC));
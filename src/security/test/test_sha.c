@@ -0,0 +1,149 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+/*
+ * Hash session tests. sha.c is built in so that the session pool can be
+ * exercised without opening the module.
+ */
+
+#include "../sha.c"
+
+#define SHA256_LEN 32
+
+static const char sha256_abc[SHA256_LEN] =
+{
+	0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea,
+	0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+	0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c,
+	0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad,
+};
+
+static void test_session_digest(void)
+{
+	char dest[EVP_MAX_MD_SIZE];
+	int destlen = sizeof(dest);
+	int handle = 0;
+
+	g_assert_cmpint(NYX_ERROR_NONE, == , sha_pool_init());
+
+	/* a digest fed in pieces matches the one-shot value */
+	g_assert_cmpint(NYX_ERROR_NONE, == , sha_session_init(SN_sha256, &handle));
+	g_assert_cmpint(0, < , handle);
+	g_assert_cmpint(NYX_ERROR_NONE, == , sha_session_update(handle, "a", 1));
+	g_assert_cmpint(NYX_ERROR_NONE, == , sha_session_update(handle, "bc", 2));
+	g_assert_cmpint(NYX_ERROR_NONE, == , sha_session_finalize(handle, dest,
+	                &destlen));
+	g_assert_cmpint(SHA256_LEN, == , destlen);
+	g_assert(memcmp(dest, sha256_abc, SHA256_LEN) == 0);
+
+	/* finalize closes the session */
+	g_assert_cmpint(NYX_ERROR_INVALID_HANDLE, == , sha_session_update(handle,
+	                "a", 1));
+	g_assert_cmpint(NYX_ERROR_INVALID_HANDLE, == , sha_session_abort(handle));
+
+	/* abort closes it without output */
+	g_assert_cmpint(NYX_ERROR_NONE, == , sha_session_init(SN_sha512, &handle));
+	g_assert_cmpint(NYX_ERROR_NONE, == , sha_session_abort(handle));
+	destlen = sizeof(dest);
+	g_assert_cmpint(NYX_ERROR_INVALID_HANDLE, == , sha_session_finalize(handle,
+	                dest, &destlen));
+
+	g_assert_cmpint(NYX_ERROR_INVALID_VALUE, == , sha_session_init("md5",
+	                &handle));
+
+	sha_pool_destroy();
+}
+
+static void test_session_handles(void)
+{
+	int handles[SHA_SESSION_MAX];
+	int handle = 0;
+
+	g_assert_cmpint(NYX_ERROR_NONE, == , sha_pool_init());
+
+	g_assert_cmpint(NYX_ERROR_INVALID_HANDLE, == , sha_session_update(0, "a",
+	                1));
+	g_assert_cmpint(NYX_ERROR_INVALID_HANDLE, == , sha_session_abort(-1));
+
+	/* the pool is bounded */
+	for (int i = 0; i < SHA_SESSION_MAX; i++)
+	{
+		g_assert_cmpint(NYX_ERROR_NONE, == , sha_session_init(SN_sha256,
+		                &handles[i]));
+	}
+
+	g_assert_cmpint(NYX_ERROR_OUT_OF_MEMORY, == , sha_session_init(SN_sha256,
+	                &handle));
+
+	/* a freed slot is used again, but not under its old handle */
+	g_assert_cmpint(NYX_ERROR_NONE, == , sha_session_abort(handles[3]));
+	g_assert_cmpint(NYX_ERROR_NONE, == , sha_session_init(SN_sha256, &handle));
+	g_assert_cmpint(handles[3], != , handle);
+	g_assert_cmpint(NYX_ERROR_INVALID_HANDLE, == , sha_session_update(
+	                    handles[3], "a", 1));
+	g_assert_cmpint(NYX_ERROR_INVALID_HANDLE, == , sha_session_abort(handles[3]));
+	g_assert_cmpint(NYX_ERROR_NONE, == , sha_session_update(handle, "a", 1));
+	handles[3] = handle;
+
+	/* destroying the pool closes every session, and the handles stay dead */
+	sha_pool_destroy();
+	g_assert_cmpint(NYX_ERROR_NONE, == , sha_pool_init());
+
+	for (int i = 0; i < SHA_SESSION_MAX; i++)
+	{
+		g_assert_cmpint(NYX_ERROR_INVALID_HANDLE, == , sha_session_abort(
+		                    handles[i]));
+	}
+
+	sha_pool_destroy();
+}
+
+static void test_legacy_calls(void)
+{
+	char dest[EVP_MAX_MD_SIZE];
+	int destlen = sizeof(dest);
+	int handle = 0;
+
+	g_assert_cmpint(NYX_ERROR_NONE, == , sha_pool_init());
+
+	g_assert_cmpint(NYX_ERROR_INVALID_VALUE, == , sha_update("a", 1));
+
+	/* sha_init() restarts the legacy hash but leaves sessions alone */
+	g_assert_cmpint(NYX_ERROR_NONE, == , sha_session_init(SN_sha256, &handle));
+	g_assert_cmpint(NYX_ERROR_NONE, == , sha_init(SN_sha256));
+	g_assert_cmpint(NYX_ERROR_NONE, == , sha_update("x", 1));
+	g_assert_cmpint(NYX_ERROR_NONE, == , sha_init(SN_sha256));
+	g_assert_cmpint(NYX_ERROR_NONE, == , sha_update("abc", 3));
+	g_assert_cmpint(NYX_ERROR_NONE, == , sha_finalize(dest, &destlen));
+	g_assert(memcmp(dest, sha256_abc, SHA256_LEN) == 0);
+	g_assert_cmpint(NYX_ERROR_INVALID_VALUE, == , sha_finalize(dest, &destlen));
+
+	g_assert_cmpint(NYX_ERROR_NONE, == , sha_session_abort(handle));
+
+	sha_pool_destroy();
+}
+
+int main(int argc, char *argv[])
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/nyx/security/sha/session_digest", test_session_digest);
+	g_test_add_func("/nyx/security/sha/session_handles", test_session_handles);
+	g_test_add_func("/nyx/security/sha/legacy_calls", test_legacy_calls);
+
+	return g_test_run();
+}
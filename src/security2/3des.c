@@ -19,6 +19,25 @@
 #include <openssl/rand.h>
 #include <string.h>
 #define DES3_BLOCK_SIZE 8
+#define DES3_KEY_SIZE 24
+
+const EVP_CIPHER *des3_cipher_lookup(nyx_security_block_mode_t mode)
+{
+	switch (mode)
+	{
+		case NYX_SECURITY_MODE_ECB:
+			return EVP_des_ede3_ecb();
+
+		case NYX_SECURITY_MODE_CBC:
+			return EVP_des_ede3_cbc();
+
+		case NYX_SECURITY_MODE_CFB:
+			return EVP_des_ede3_cfb();
+
+		default:
+			return NULL;
+	}
+}
 
 nyx_error_t des3_generate_key(int keybits, unsigned char *keydata)
 {
@@ -68,39 +87,34 @@ nyx_error_t des3_crypt(const unsigned char *keydata, int encrypt,
 		return NYX_ERROR_INVALID_VALUE;
 	}
 
-	EVP_CIPHER_CTX ctx;
-	const EVP_CIPHER *cipher;
+	EVP_CIPHER_CTX *ctx;
+	const EVP_CIPHER *cipher = des3_cipher_lookup(mode);
 
 	nyx_error_t result = NYX_ERROR_NONE;
 
-	switch (mode)
+	if (!cipher)
 	{
-		case NYX_SECURITY_MODE_ECB:
-			cipher = EVP_des_ede3_ecb();
-			break;
+		nyx_debug("%s: invalid DES mode", __FUNCTION__);
+		return NYX_ERROR_INVALID_VALUE;
+	}
 
-		case NYX_SECURITY_MODE_CBC:
-			cipher = EVP_des_ede3_cbc();
-			break;
+	int updateoutlen, finaloutlen;
+	updateoutlen = *destlen;
 
-		case NYX_SECURITY_MODE_CFB:
-			cipher = EVP_des_ede3_cfb();
-			break;
+	/* pooled per thread, so a key that was used before skips the key schedule */
+	ctx = cipher_ctx_get(cipher, keydata, DES3_KEY_SIZE, encrypt, iv);
 
-		default:
-			nyx_debug("%s: invalid DES mode", __FUNCTION__);
-			return NYX_ERROR_INVALID_VALUE;
+	if (!ctx)
+	{
+		return NYX_ERROR_GENERIC;
 	}
 
-	int updateoutlen, finaloutlen;
-	EVP_CIPHER_CTX_init(&ctx);
-	updateoutlen = *destlen;
+	PERF_COUNTER_INC(security2_counters[SECURITY2_COUNTER_DES3_CALLS]);
+	PERF_COUNTER_ADD(security2_counters[SECURITY2_COUNTER_DES3_BYTES], srclen);
 
 	if (encrypt)
 	{
-		EVP_EncryptInit(&ctx, cipher, keydata, iv);
-
-		if (!EVP_EncryptUpdate(&ctx, dest,
+		if (!EVP_EncryptUpdate(ctx, dest,
 		                       &updateoutlen, (unsigned char *)src,
 		                       srclen))
 		{
@@ -112,7 +126,7 @@ nyx_error_t des3_crypt(const unsigned char *keydata, int encrypt,
 
 		finaloutlen = *destlen - updateoutlen;
 
-		if (!EVP_EncryptFinal(&ctx, dest + updateoutlen, &finaloutlen))
+		if (!EVP_EncryptFinal_ex(ctx, dest + updateoutlen, &finaloutlen))
 		{
 			nyx_debug("EVP_CipherFinal failed");
 			ERR_print_errors_fp(stderr);
@@ -122,9 +136,7 @@ nyx_error_t des3_crypt(const unsigned char *keydata, int encrypt,
 	}
 	else
 	{
-		EVP_DecryptInit(&ctx, cipher, keydata, iv);
-
-		if (!EVP_DecryptUpdate(&ctx, dest,
+		if (!EVP_DecryptUpdate(ctx, dest,
 		                       &updateoutlen, (unsigned char *)src,
 		                       srclen))
 		{
@@ -139,10 +151,10 @@ nyx_error_t des3_crypt(const unsigned char *keydata, int encrypt,
 		if (nextIvLen == DES3_BLOCK_SIZE && padding == NYX_SECURITY_PADDING_NONE &&
 		        mode != NYX_SECURITY_MODE_ECB)
 		{
-			memcpy(nextIv, &ctx.iv, DES3_BLOCK_SIZE);
+			cipher_ctx_copy_iv(ctx, nextIv, DES3_BLOCK_SIZE);
 		}
 
-		if (!EVP_DecryptFinal(&ctx, dest + updateoutlen,
+		if (!EVP_DecryptFinal_ex(ctx, dest + updateoutlen,
 		                      (int *) &finaloutlen))
 		{
 			nyx_debug("EVP_CipherFinal failed");
@@ -154,7 +166,12 @@ nyx_error_t des3_crypt(const unsigned char *keydata, int encrypt,
 
 	*destlen = updateoutlen + finaloutlen;
 out:
-	EVP_CIPHER_CTX_cleanup(&ctx);
+
+	if (NYX_ERROR_NONE != result)
+	{
+		cipher_ctx_discard(ctx);
+	}
+
 	return result;
 }
 
@@ -70,6 +70,14 @@ static const struct aes_algo_data_t *aes_algo_data_lookup(int keylen,
 	return NULL;
 }
 
+const EVP_CIPHER *aes_cipher_lookup(int keybits,
+                                    nyx_security_block_mode_t mode)
+{
+	const struct aes_algo_data_t *algo = aes_algo_data_lookup(keybits, mode);
+
+	return algo ? algo->cipher_fun() : NULL;
+}
+
 nyx_error_t aes_generate_key(int keybits, unsigned char *keydata)
 {
 
@@ -119,24 +127,31 @@ nyx_error_t aes_crypt(const unsigned char *keydata, int keybits, int encrypt,
 		return NYX_ERROR_INVALID_VALUE;
 	}
 
-	EVP_CIPHER_CTX ctx;
-	EVP_CIPHER_CTX_init(&ctx);
-	EVP_CipherInit_ex(&ctx, algo->cipher_fun(), NULL, NULL, NULL, encrypt);
-	EVP_CIPHER_CTX_set_key_length(&ctx, keybits);
-	EVP_CipherInit_ex(&ctx, NULL, NULL, keydata, iv, encrypt);
+	/* pooled per thread, so a key that was used before skips the key schedule */
+	EVP_CIPHER_CTX *ctx = cipher_ctx_get(algo->cipher_fun(), keydata, keybits / 8,
+	                                     encrypt, iv);
+
+	if (!ctx)
+	{
+		return NYX_ERROR_GENERIC;
+	}
+
+	PERF_TRACE(nyx_security2, aes_crypt__entry, keybits, encrypt, srclen);
+	PERF_COUNTER_INC(security2_counters[SECURITY2_COUNTER_AES_CALLS]);
+	PERF_COUNTER_ADD(security2_counters[SECURITY2_COUNTER_AES_BYTES], srclen);
 
 	if (mode != NYX_SECURITY_MODE_CFB)
 	{
 		int pad = padding == NYX_SECURITY_PADDING_PKCS5 ? 1 : 0;
 
-		if (!EVP_CIPHER_CTX_set_padding(&ctx, pad))
+		if (!EVP_CIPHER_CTX_set_padding(ctx, pad))
 		{
 			result = NYX_ERROR_GENERIC;
 			goto out;
 		}
 	}
 
-	if (!EVP_CipherUpdate(&ctx, dest, destlen,
+	if (!EVP_CipherUpdate(ctx, dest, destlen,
 	                      src, srclen))
 	{
 		nyx_debug("EVP_CipherUpdate failed");
@@ -148,12 +163,12 @@ nyx_error_t aes_crypt(const unsigned char *keydata, int keybits, int encrypt,
 	if (nextIvLen == AES_BLOCK_SIZE && padding == NYX_SECURITY_PADDING_NONE &&
 	        mode != NYX_SECURITY_MODE_ECB)
 	{
-		memcpy(nextIv, &ctx.iv, AES_BLOCK_SIZE);
+		cipher_ctx_copy_iv(ctx, nextIv, AES_BLOCK_SIZE);
 	}
 
 	int tmplen;
 
-	if (!EVP_CipherFinal_ex(&ctx, dest + *destlen, &tmplen))
+	if (!EVP_CipherFinal_ex(ctx, dest + *destlen, &tmplen))
 	{
 		nyx_debug("EVP_CipherFinal_ex failed");
 		ERR_print_errors_fp(stderr);
@@ -164,7 +179,98 @@ nyx_error_t aes_crypt(const unsigned char *keydata, int keybits, int encrypt,
 	*destlen += tmplen;
 
 out:
-	EVP_CIPHER_CTX_cleanup(&ctx);
+
+	if (NYX_ERROR_NONE != result)
+	{
+		cipher_ctx_discard(ctx);
+	}
+
+	PERF_TRACE(nyx_security2, aes_crypt__return, result);
+
+	return result;
+}
+
+/**
+ * Encrypts or decrypts count independent buffers, each with its own IV,
+ * under one key. The key schedule is set up once for the whole batch and
+ * each buffer only resets the IV.
+ *
+ * Returns the first error of any buffer; the outcome of each buffer is in
+ * its result field.
+ */
+nyx_error_t aes_crypt_batch(const unsigned char *keydata, int keybits,
+                            int encrypt, nyx_security_block_mode_t mode, nyx_security_padding_t padding,
+                            nyx_security2_buffer_t *buffers, int count)
+{
+	nyx_error_t result = NYX_ERROR_NONE;
+	const struct aes_algo_data_t *algo = aes_algo_data_lookup(keybits, mode);
+	EVP_CIPHER_CTX *ctx = NULL;
+	int pad = (padding == NYX_SECURITY_PADDING_PKCS5) ? 1 : 0;
+
+	if (algo == NULL || (padding != NYX_SECURITY_PADDING_NONE &&
+	                     padding != NYX_SECURITY_PADDING_PKCS5))
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	for (int i = 0; i < count; i++)
+	{
+		nyx_security2_buffer_t *buf = &buffers[i];
+		int outlen = 0;
+		int tmplen;
+
+		buf->result = NYX_ERROR_NONE;
+
+		if (!buf->src || !buf->dest || buf->srclen < 0 ||
+		        (mode != NYX_SECURITY_MODE_ECB && !buf->iv) ||
+		        buf->destlen < buf->srclen + (pad ? AES_BLOCK_SIZE : 0))
+		{
+			buf->result = NYX_ERROR_INVALID_VALUE;
+		}
+		else if (!ctx)
+		{
+			if (!(ctx = cipher_ctx_get(algo->cipher_fun(), keydata, keybits / 8, encrypt,
+			                           buf->iv)))
+			{
+				buf->result = NYX_ERROR_GENERIC;
+			}
+		}
+		else if (!EVP_CipherInit_ex(ctx, NULL, NULL, NULL, buf->iv, encrypt))
+		{
+			buf->result = NYX_ERROR_GENERIC;
+		}
+
+		if (NYX_ERROR_NONE == buf->result)
+		{
+			if ((mode != NYX_SECURITY_MODE_CFB && !EVP_CIPHER_CTX_set_padding(ctx, pad)) ||
+			        !EVP_CipherUpdate(ctx, buf->dest, &outlen, buf->src, buf->srclen) ||
+			        !EVP_CipherFinal_ex(ctx, buf->dest + outlen, &tmplen))
+			{
+				nyx_debug("%s: buffer %d failed", __FUNCTION__, i);
+				ERR_print_errors_fp(stderr);
+				buf->result = NYX_ERROR_GENERIC;
+
+				/* start over with a fresh context for the next buffer */
+				cipher_ctx_discard(ctx);
+				ctx = NULL;
+			}
+			else
+			{
+				outlen += tmplen;
+				PERF_COUNTER_INC(security2_counters[SECURITY2_COUNTER_AES_CALLS]);
+				PERF_COUNTER_ADD(security2_counters[SECURITY2_COUNTER_AES_BYTES],
+				                 buf->srclen);
+			}
+		}
+
+		buf->destlen = (NYX_ERROR_NONE == buf->result) ? outlen : 0;
+
+		if (NYX_ERROR_NONE == result)
+		{
+			result = buf->result;
+		}
+	}
+
 	return result;
 }
 
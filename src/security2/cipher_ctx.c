@@ -0,0 +1,412 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+/*
+********************************************************************************
+* @file cipher_ctx.c
+*
+* @brief Per-thread pool of keyed cipher contexts for aes_crypt() and
+* des3_crypt().
+*
+* Setting up an EVP_CIPHER_CTX runs the full key schedule, which for small
+* records costs more than the encryption itself. Each thread keeps a few
+* contexts keyed by (cipher, direction, key); a call with a key that is
+* already in the pool only resets the IV. Contexts are not shared between
+* threads, so using a pool needs no locking; the lock only guards the list
+* of pools, which the last module close frees.
+********************************************************************************
+*/
+
+#include "security2.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <openssl/crypto.h>
+
+#define CIPHER_CTX_POOL_SIZE 8
+#define CIPHER_CTX_MAX_KEY_LEN 32
+
+typedef struct
+{
+	EVP_CIPHER_CTX *ctx;
+	const EVP_CIPHER *cipher;
+	int encrypt;
+	uint32_t fingerprint;
+	int keylen;
+	unsigned char key[CIPHER_CTX_MAX_KEY_LEN];
+	unsigned long last_used;
+} cipher_ctx_slot_t;
+
+typedef struct cipher_ctx_pool
+{
+	cipher_ctx_slot_t slots[CIPHER_CTX_POOL_SIZE];
+	unsigned long clock;
+	struct cipher_ctx_pool *prev;
+	struct cipher_ctx_pool *next;
+} cipher_ctx_pool_t;
+
+static __thread cipher_ctx_pool_t *thread_pool = NULL;
+/* pool_generation thread_pool was made in; an older pool is already freed */
+static __thread unsigned int thread_pool_generation = 0;
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static cipher_ctx_pool_t *pool_list = NULL;
+static unsigned int pool_generation = 1;
+
+/* frees a thread's pool when the thread exits, deleted on the last close */
+static pthread_key_t pool_key;
+static bool pool_key_valid = false;
+
+static void slot_clear(cipher_ctx_slot_t *slot)
+{
+	if (slot->ctx)
+	{
+		EVP_CIPHER_CTX_free(slot->ctx);
+	}
+
+	OPENSSL_cleanse(slot, sizeof(*slot));
+}
+
+static void pool_free(cipher_ctx_pool_t *pool)
+{
+	for (int i = 0; i < CIPHER_CTX_POOL_SIZE; i++)
+	{
+		slot_clear(&pool->slots[i]);
+	}
+
+	free(pool);
+}
+
+/* pool_lock is held */
+static void pool_unlink(cipher_ctx_pool_t *pool)
+{
+	if (pool->prev)
+	{
+		pool->prev->next = pool->next;
+	}
+	else
+	{
+		pool_list = pool->next;
+	}
+
+	if (pool->next)
+	{
+		pool->next->prev = pool->prev;
+	}
+}
+
+/* pthread key destructor, run when a thread with a pool exits */
+static void pool_thread_exit(void *data)
+{
+	pthread_mutex_lock(&pool_lock);
+
+	/* the last close may have freed it while this thread was exiting */
+	cipher_ctx_pool_t *pool = pool_list;
+
+	while (pool && pool != data)
+	{
+		pool = pool->next;
+	}
+
+	if (pool)
+	{
+		pool_unlink(pool);
+	}
+
+	pthread_mutex_unlock(&pool_lock);
+
+	if (pool)
+	{
+		pool_free(pool);
+	}
+}
+
+static cipher_ctx_pool_t *pool_current(void)
+{
+	if (thread_pool &&
+	        thread_pool_generation != __atomic_load_n(&pool_generation, __ATOMIC_ACQUIRE))
+	{
+		thread_pool = NULL;
+	}
+
+	return thread_pool;
+}
+
+static cipher_ctx_pool_t *pool_get(void)
+{
+	cipher_ctx_pool_t *pool = pool_current();
+
+	if (pool)
+	{
+		return pool;
+	}
+
+	if (!(pool = calloc(1, sizeof(cipher_ctx_pool_t))))
+	{
+		return NULL;
+	}
+
+	pthread_mutex_lock(&pool_lock);
+
+	if (!pool_key_valid)
+	{
+		pool_key_valid = pthread_key_create(&pool_key, pool_thread_exit) == 0;
+	}
+
+	if (!pool_key_valid)
+	{
+		pthread_mutex_unlock(&pool_lock);
+		free(pool);
+		return NULL;
+	}
+
+	pool->next = pool_list;
+
+	if (pool_list)
+	{
+		pool_list->prev = pool;
+	}
+
+	pool_list = pool;
+	pthread_setspecific(pool_key, pool);
+	thread_pool_generation = pool_generation;
+
+	pthread_mutex_unlock(&pool_lock);
+
+	thread_pool = pool;
+	return pool;
+}
+
+/* FNV-1a, only used to skip most key comparisons */
+static uint32_t key_fingerprint(const unsigned char *key, int keylen)
+{
+	uint32_t hash = 2166136261u;
+
+	for (int i = 0; i < keylen; i++)
+	{
+		hash = (hash ^ key[i]) * 16777619u;
+	}
+
+	return hash;
+}
+
+static cipher_ctx_slot_t *slot_find(cipher_ctx_pool_t *pool,
+                                    const EVP_CIPHER *cipher, int encrypt, const unsigned char *key, int keylen,
+                                    uint32_t fingerprint)
+{
+	for (int i = 0; i < CIPHER_CTX_POOL_SIZE; i++)
+	{
+		cipher_ctx_slot_t *slot = &pool->slots[i];
+
+		if (slot->ctx && slot->cipher == cipher && slot->encrypt == encrypt &&
+		        slot->fingerprint == fingerprint && slot->keylen == keylen &&
+		        CRYPTO_memcmp(slot->key, key, keylen) == 0)
+		{
+			return slot;
+		}
+	}
+
+	return NULL;
+}
+
+static cipher_ctx_slot_t *slot_evict(cipher_ctx_pool_t *pool)
+{
+	cipher_ctx_slot_t *oldest = &pool->slots[0];
+
+	for (int i = 0; i < CIPHER_CTX_POOL_SIZE; i++)
+	{
+		if (!pool->slots[i].ctx)
+		{
+			return &pool->slots[i];
+		}
+
+		if (pool->slots[i].last_used < oldest->last_used)
+		{
+			oldest = &pool->slots[i];
+		}
+	}
+
+	slot_clear(oldest);
+	return oldest;
+}
+
+/**
+ * Returns a context of this thread set up for cipher with the given key and
+ * iv, ready for EVP_CipherUpdate(). Only the IV is reset if a context for
+ * the same key is pooled. The context stays owned by the pool; after a
+ * failed operation pass it to cipher_ctx_discard().
+ */
+EVP_CIPHER_CTX *cipher_ctx_get(const EVP_CIPHER *cipher,
+                               const unsigned char *keydata, int keylen, int encrypt,
+                               const unsigned char *iv)
+{
+	cipher_ctx_pool_t *pool;
+	cipher_ctx_slot_t *slot;
+	uint32_t fingerprint;
+
+	if (!cipher || !keydata || keylen <= 0 || keylen > CIPHER_CTX_MAX_KEY_LEN)
+	{
+		return NULL;
+	}
+
+	encrypt = encrypt ? 1 : 0;
+
+	if (!(pool = pool_get()))
+	{
+		return NULL;
+	}
+
+	fingerprint = key_fingerprint(keydata, keylen);
+	slot = slot_find(pool, cipher, encrypt, keydata, keylen, fingerprint);
+
+	if (slot)
+	{
+		/* the key schedule is kept, only the IV and buffered state are reset */
+		if (!EVP_CipherInit_ex(slot->ctx, NULL, NULL, NULL, iv, encrypt))
+		{
+			slot_clear(slot);
+			return NULL;
+		}
+	}
+	else
+	{
+		slot = slot_evict(pool);
+		slot->ctx = EVP_CIPHER_CTX_new();
+
+		if (!slot->ctx ||
+		        !EVP_CipherInit_ex(slot->ctx, cipher, NULL, NULL, NULL, encrypt))
+		{
+			slot_clear(slot);
+			return NULL;
+		}
+
+		/* fails for fixed length ciphers, which then use their own key length */
+		EVP_CIPHER_CTX_set_key_length(slot->ctx, keylen);
+
+		if (!EVP_CipherInit_ex(slot->ctx, NULL, NULL, keydata, iv, encrypt))
+		{
+			slot_clear(slot);
+			return NULL;
+		}
+
+		slot->cipher = cipher;
+		slot->encrypt = encrypt;
+		slot->fingerprint = fingerprint;
+		slot->keylen = keylen;
+		memcpy(slot->key, keydata, keylen);
+	}
+
+	slot->last_used = ++pool->clock;
+
+	/* padding is not reset by EVP_CipherInit_ex(), restore the default */
+	EVP_CIPHER_CTX_set_padding(slot->ctx, 1);
+
+	return slot->ctx;
+}
+
+/**
+ * Drops a context returned by cipher_ctx_get() from the pool, e.g. after an
+ * operation on it failed and left it in an unknown state.
+ */
+void cipher_ctx_discard(EVP_CIPHER_CTX *ctx)
+{
+	cipher_ctx_pool_t *pool = pool_current();
+
+	if (!pool || !ctx)
+	{
+		return;
+	}
+
+	for (int i = 0; i < CIPHER_CTX_POOL_SIZE; i++)
+	{
+		if (pool->slots[i].ctx == ctx)
+		{
+			slot_clear(&pool->slots[i]);
+			return;
+		}
+	}
+}
+
+/**
+ * Copies the current IV of ctx, i.e. the IV to continue a CBC/CFB stream
+ * with, to iv.
+ */
+void cipher_ctx_copy_iv(EVP_CIPHER_CTX *ctx, unsigned char *iv, int len)
+{
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	EVP_CIPHER_CTX_get_updated_iv(ctx, iv, len);
+#elif OPENSSL_VERSION_NUMBER >= 0x10100000L
+	memcpy(iv, EVP_CIPHER_CTX_iv(ctx), len);
+#else
+	memcpy(iv, ctx->iv, len);
+#endif
+}
+
+/**
+ * Frees the calling thread's pool. Pools of other threads are freed when
+ * those threads exit or by cipher_ctx_pool_shutdown().
+ */
+void cipher_ctx_pool_release(void)
+{
+	cipher_ctx_pool_t *pool = pool_current();
+
+	if (!pool)
+	{
+		return;
+	}
+
+	pthread_mutex_lock(&pool_lock);
+	pool_unlink(pool);
+	pthread_setspecific(pool_key, NULL);
+	pthread_mutex_unlock(&pool_lock);
+
+	pool_free(pool);
+	thread_pool = NULL;
+}
+
+/**
+ * Frees the pools of all threads and deletes the thread key, so that no
+ * destructor of this module runs once it is unloaded. For the last close;
+ * no other thread may be inside cipher_ctx_get() meanwhile.
+ */
+void cipher_ctx_pool_shutdown(void)
+{
+	pthread_mutex_lock(&pool_lock);
+
+	while (pool_list)
+	{
+		cipher_ctx_pool_t *pool = pool_list;
+
+		pool_unlink(pool);
+		pool_free(pool);
+	}
+
+	if (pool_key_valid)
+	{
+		pthread_key_delete(pool_key);
+		pool_key_valid = false;
+	}
+
+	/* pools cached by threads are gone, they make a new one on next use */
+	__atomic_add_fetch(&pool_generation, 1, __ATOMIC_RELEASE);
+
+	pthread_mutex_unlock(&pool_lock);
+
+	thread_pool = NULL;
+}
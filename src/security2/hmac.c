@@ -40,13 +40,17 @@ nyx_error_t hmac(const unsigned char *keydata, int keybits,
                  int srclen, unsigned char *dest,
                  int *destlen)
 {
-	HMAC_CTX hmacctx;
+	HMAC_CTX *hmacctx = HMAC_CTX_new();
 	nyx_error_t result = NYX_ERROR_NONE;
 
 	const EVP_MD *type = EVP_sha1();
-	HMAC_CTX_init(&hmacctx);
 
-	if (!HMAC_Init_ex(&hmacctx, (const void *)keydata,
+	if (!hmacctx)
+	{
+		return NYX_ERROR_OUT_OF_MEMORY;
+	}
+
+	if (!HMAC_Init_ex(hmacctx, (const void *)keydata,
 	                  keybits / 8, type, NULL))
 	{
 		nyx_debug("HMAC_Init failed");
@@ -54,14 +58,17 @@ nyx_error_t hmac(const unsigned char *keydata, int keybits,
 		goto out;
 	}
 
-	if (!HMAC_Update(&hmacctx, src, srclen))
+	PERF_COUNTER_INC(security2_counters[SECURITY2_COUNTER_HMAC_CALLS]);
+	PERF_COUNTER_ADD(security2_counters[SECURITY2_COUNTER_HMAC_BYTES], srclen);
+
+	if (!HMAC_Update(hmacctx, src, srclen))
 	{
 		nyx_debug("HMAC_Update failed");
 		result = NYX_ERROR_GENERIC;
 		goto out;
 	}
 
-	if (!HMAC_Final(&hmacctx, dest,
+	if (!HMAC_Final(hmacctx, dest,
 	                (unsigned int *)destlen))
 	{
 		nyx_debug("HMAC_Final failed");
@@ -70,6 +77,74 @@ nyx_error_t hmac(const unsigned char *keydata, int keybits,
 	}
 
 out:
-	HMAC_CTX_cleanup(&hmacctx);
+	HMAC_CTX_free(hmacctx);
+	return result;
+}
+
+/**
+ * Computes the HMAC-SHA1 of count independent buffers under one key. The key
+ * pads are set up once; each buffer only resets the digest state.
+ *
+ * Returns the first error of any buffer; the outcome of each buffer is in
+ * its result field.
+ */
+nyx_error_t hmac_batch(const unsigned char *keydata, int keybits,
+                       nyx_security2_buffer_t *buffers, int count)
+{
+	HMAC_CTX *hmacctx = HMAC_CTX_new();
+	nyx_error_t result = NYX_ERROR_NONE;
+
+	const EVP_MD *type = EVP_sha1();
+
+	if (!hmacctx)
+	{
+		return NYX_ERROR_OUT_OF_MEMORY;
+	}
+
+	if (!HMAC_Init_ex(hmacctx, (const void *)keydata,
+	                  keybits / 8, type, NULL))
+	{
+		nyx_debug("HMAC_Init failed");
+		HMAC_CTX_free(hmacctx);
+		return NYX_ERROR_GENERIC;
+	}
+
+	for (int i = 0; i < count; i++)
+	{
+		nyx_security2_buffer_t *buf = &buffers[i];
+		unsigned int outlen = 0;
+
+		buf->result = NYX_ERROR_NONE;
+
+		if (!buf->src || !buf->dest || buf->srclen < 0 ||
+		        buf->destlen < EVP_MD_size(type))
+		{
+			buf->result = NYX_ERROR_INVALID_VALUE;
+		}
+		/* a NULL key and digest keep the pads of the first init */
+		else if (!HMAC_Init_ex(hmacctx, NULL, 0, NULL, NULL) ||
+		         !HMAC_Update(hmacctx, buf->src, buf->srclen) ||
+		         !HMAC_Final(hmacctx, buf->dest, &outlen))
+		{
+			nyx_debug("%s: buffer %d failed", __FUNCTION__, i);
+			buf->result = NYX_ERROR_GENERIC;
+		}
+
+		buf->destlen = (NYX_ERROR_NONE == buf->result) ? (int)outlen : 0;
+
+		if (NYX_ERROR_NONE == buf->result)
+		{
+			PERF_COUNTER_INC(security2_counters[SECURITY2_COUNTER_HMAC_CALLS]);
+			PERF_COUNTER_ADD(security2_counters[SECURITY2_COUNTER_HMAC_BYTES],
+			                 buf->srclen);
+		}
+
+		if (NYX_ERROR_NONE == result)
+		{
+			result = buf->result;
+		}
+	}
+
+	HMAC_CTX_free(hmacctx);
 	return result;
-}
\ No newline at end of file
+}
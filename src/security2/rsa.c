@@ -15,9 +15,12 @@
 // SPDX-License-Identifier: Apache-2.0
 
 #include "security2.h"
+#include "slot_handle.h"
 #include <openssl/bn.h>
 #include <openssl/err.h>
 #include <openssl/x509.h>
+#include <openssl/sha.h>
+#include <pthread.h>
 #include <string.h>
 #include <stdio.h>
 
@@ -38,34 +41,16 @@ static int estimatePrivateKeyLen(int keybits)
 	return result;
 }
 
-nyx_error_t rsa_generate_key(int keybits, unsigned char *private, int *privLen,
-                             unsigned char *publicKey, int *pubKeySize)
+/* Generates a key pair on the calling thread; slow for large keys. */
+RSA *rsa_generate(int keybits)
 {
-	switch (keybits)
-	{
-		case 1024:
-		case 2048:
-		case 4096:
-			break;
-
-		default:
-			return NYX_ERROR_INVALID_VALUE;
-	}
-
-	if (private == NULL || publicKey == NULL)
-	{
-		*privLen = estimatePrivateKeyLen(keybits);
-		*pubKeySize = keybits / 8 + 32;
-		return NYX_ERROR_NONE;
-	}
-
 	RSA *rsa = RSA_new();
 
 	if (!rsa)
 	{
 		nyx_debug("RSA_new failed");
 		ERR_print_errors_fp(stderr);
-		return NYX_ERROR_GENERIC;
+		return NULL;
 	}
 
 	BIGNUM *bn = BN_new();
@@ -75,22 +60,54 @@ nyx_error_t rsa_generate_key(int keybits, unsigned char *private, int *privLen,
 		nyx_debug("BN_new failed");
 		ERR_print_errors_fp(stderr);
 		RSA_free(rsa);
-		return NYX_ERROR_GENERIC;
+		return NULL;
 	}
 
 	BN_set_word(bn, RSA_F4);
 
-	if (RSA_generate_key_ex(rsa, keybits, bn, NULL) == -1)
+	if (RSA_generate_key_ex(rsa, keybits, bn, NULL) != 1)
 	{
 		nyx_debug("RSA_generate_key_ex failed");
 		ERR_print_errors_fp(stderr);
 		RSA_free(rsa);
 		BN_free(bn);
-		return NYX_ERROR_GENERIC;
+		return NULL;
 	}
 
 	BN_free(bn);
 
+	return rsa;
+}
+
+nyx_error_t rsa_generate_key(int keybits, unsigned char *private, int *privLen,
+                             unsigned char *publicKey, int *pubKeySize)
+{
+	switch (keybits)
+	{
+		case 1024:
+		case 2048:
+		case 4096:
+			break;
+
+		default:
+			return NYX_ERROR_INVALID_VALUE;
+	}
+
+	if (private == NULL || publicKey == NULL)
+	{
+		*privLen = estimatePrivateKeyLen(keybits);
+		*pubKeySize = keybits / 8 + 32;
+		return NYX_ERROR_NONE;
+	}
+
+	/* a precomputed key from the pool saves the expensive prime search */
+	RSA *rsa = rsa_pool_take(keybits);
+
+	if (!rsa && !(rsa = rsa_generate(keybits)))
+	{
+		return NYX_ERROR_GENERIC;
+	}
+
 	//private
 	BIO *privKeyBio = NULL;
 
@@ -170,36 +187,190 @@ nyx_error_t rsa_generate_key(int keybits, unsigned char *private, int *privLen,
 	return NYX_ERROR_NONE;
 }
 
-nyx_error_t rsa_crypt(const unsigned char *keydata, int serializedKeyDataLen,
-                      nyx_security_rsa_operation_t operation, const unsigned char *src, int srclen,
-                      unsigned char *dest, int *destlen)
+/*
+ * Parsed keys are cached so repeated operations with the same serialized key
+ * skip the ASN.1 decoding and the Montgomery set-up. Entries are keyed by
+ * the SHA-256 of the key bytes and evicted least recently used first. Cached
+ * keys are handed out with an extra reference, so an entry may be evicted
+ * while another thread still uses it.
+ */
+#define RSA_KEY_CACHE_SIZE 16
+
+/* keys loaded with rsa_load_key(), addressed by slot handle */
+#define RSA_KEY_HANDLE_MAX 32
+
+typedef struct
+{
+	unsigned char digest[SHA256_DIGEST_LENGTH];
+	RSA *rsa;
+	int isPublic;
+	unsigned long last_used;
+} rsa_key_cache_entry_t;
+
+static rsa_key_cache_entry_t rsa_key_cache[RSA_KEY_CACHE_SIZE];
+static unsigned long rsa_key_cache_clock = 0;
+
+static struct
+{
+	RSA *rsa;
+	int isPublic;
+	unsigned int generation;
+} rsa_key_handles[RSA_KEY_HANDLE_MAX];
+
+static pthread_mutex_t rsa_key_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static RSA *rsa_parse_key(const unsigned char *keydata, int serializedKeyDataLen,
+                          int *isPublic)
+{
+	RSA *rsa = NULL;
+
+	d2i_RSAPrivateKey(&rsa, &keydata, serializedKeyDataLen);
+	*isPublic = 0;
+
+	if (!rsa)
+	{
+		nyx_debug("private RSA d2i failed\n");
+		d2i_RSAPublicKey(&rsa, &keydata, serializedKeyDataLen);
+		*isPublic = 1;
+
+		if (!rsa)
+		{
+			nyx_debug("public RSA d2i failed\n");
+			return NULL;
+		}
+	}
+
+	return rsa;
+}
+
+/**
+ * Returns the parsed key for the serialized key data, from the cache if it
+ * was parsed before. The caller owns one reference and must RSA_free() it.
+ */
+static RSA *rsa_key_get(const unsigned char *keydata, int serializedKeyDataLen,
+                        int *isPublic)
+{
+	unsigned char digest[SHA256_DIGEST_LENGTH];
+	rsa_key_cache_entry_t *slot = NULL;
+	RSA *rsa;
+	int i;
+
+	SHA256(keydata, serializedKeyDataLen, digest);
+
+	pthread_mutex_lock(&rsa_key_lock);
+
+	for (i = 0; i < RSA_KEY_CACHE_SIZE; i++)
+	{
+		if (rsa_key_cache[i].rsa &&
+		        memcmp(rsa_key_cache[i].digest, digest, SHA256_DIGEST_LENGTH) == 0)
+		{
+			rsa_key_cache[i].last_used = ++rsa_key_cache_clock;
+			rsa = rsa_key_cache[i].rsa;
+			*isPublic = rsa_key_cache[i].isPublic;
+			RSA_up_ref(rsa);
+			pthread_mutex_unlock(&rsa_key_lock);
+			PERF_COUNTER_INC(security2_counters[SECURITY2_COUNTER_RSA_KEY_CACHE_HITS]);
+			return rsa;
+		}
+	}
+
+	pthread_mutex_unlock(&rsa_key_lock);
+	PERF_COUNTER_INC(security2_counters[SECURITY2_COUNTER_RSA_KEY_CACHE_MISSES]);
+
+	/* parse outside the lock, it's the expensive part */
+	if (!(rsa = rsa_parse_key(keydata, serializedKeyDataLen, isPublic)))
+	{
+		return NULL;
+	}
+
+	pthread_mutex_lock(&rsa_key_lock);
+
+	for (i = 0; i < RSA_KEY_CACHE_SIZE; i++)
+	{
+		/* another thread may have cached the same key meanwhile */
+		if (rsa_key_cache[i].rsa &&
+		        memcmp(rsa_key_cache[i].digest, digest, SHA256_DIGEST_LENGTH) == 0)
+		{
+			pthread_mutex_unlock(&rsa_key_lock);
+			return rsa;
+		}
+	}
+
+	for (i = 0; i < RSA_KEY_CACHE_SIZE; i++)
+	{
+		if (!rsa_key_cache[i].rsa)
+		{
+			slot = &rsa_key_cache[i];
+			break;
+		}
+
+		if (!slot || rsa_key_cache[i].last_used < slot->last_used)
+		{
+			slot = &rsa_key_cache[i];
+		}
+	}
+
+	if (slot->rsa)
+	{
+		RSA_free(slot->rsa);
+	}
+
+	memcpy(slot->digest, digest, SHA256_DIGEST_LENGTH);
+	slot->rsa = rsa;
+	slot->isPublic = *isPublic;
+	slot->last_used = ++rsa_key_cache_clock;
+	RSA_up_ref(rsa);
+
+	pthread_mutex_unlock(&rsa_key_lock);
+
+	return rsa;
+}
+
+/**
+ * Drops all cached and loaded keys.
+ */
+void rsa_key_cache_clear(void)
 {
+	int i;
+
+	pthread_mutex_lock(&rsa_key_lock);
+
+	for (i = 0; i < RSA_KEY_CACHE_SIZE; i++)
+	{
+		if (rsa_key_cache[i].rsa)
+		{
+			RSA_free(rsa_key_cache[i].rsa);
+		}
+	}
+
+	memset(rsa_key_cache, 0, sizeof(rsa_key_cache));
+
+	/* the generations stay, so handles from before the clear remain invalid */
+	for (i = 0; i < RSA_KEY_HANDLE_MAX; i++)
+	{
+		if (rsa_key_handles[i].rsa)
+		{
+			RSA_free(rsa_key_handles[i].rsa);
+			rsa_key_handles[i].rsa = NULL;
+		}
+	}
+
+	pthread_mutex_unlock(&rsa_key_lock);
+}
+
+static nyx_error_t rsa_crypt_key(RSA *rsa, int isPublic,
+                                 nyx_security_rsa_operation_t operation, const unsigned char *src, int srclen,
+                                 unsigned char *dest, int *destlen)
+{
+	PERF_COUNTER_INC(security2_counters[SECURITY2_COUNTER_RSA_CALLS]);
+	PERF_COUNTER_ADD(security2_counters[SECURITY2_COUNTER_RSA_BYTES], srclen);
+
 	switch (operation)
 	{
 		case NYX_SECURITY_RSA_DECRYPT:
 		case NYX_SECURITY_RSA_ENCRYPT:
 		{
 			nyx_error_t result = NYX_ERROR_NONE;
-			RSA *rsa = NULL;
-			int isPublic = 0;
-			d2i_RSAPrivateKey(&rsa, &keydata,
-			                  serializedKeyDataLen);
-
-			if (!rsa)
-			{
-				nyx_debug("private RSA d2i failed\n");
-				d2i_RSAPublicKey(&rsa, &keydata,
-				                 serializedKeyDataLen);
-				isPublic = 1;
-
-				if (!rsa)
-				{
-					printf("public RSA d2i failed\n");
-					return NYX_ERROR_GENERIC;
-				}
-
-				nyx_debug("public RSA d2i succeeded\n");
-			}
 
 			if (operation == NYX_SECURITY_RSA_ENCRYPT)
 			{
@@ -207,7 +378,6 @@ nyx_error_t rsa_crypt(const unsigned char *keydata, int serializedKeyDataLen,
 				if (srclen >= (RSA_size(rsa) - 41))
 				{
 					nyx_debug("src buffer too big");
-					RSA_free(rsa);
 					return NYX_ERROR_INVALID_VALUE;
 				}
 			}
@@ -249,34 +419,20 @@ nyx_error_t rsa_crypt(const unsigned char *keydata, int serializedKeyDataLen,
 				result = NYX_ERROR_GENERIC;
 			}
 
-			RSA_free(rsa);
 			return result;
 		} //end case DECRYPT,ENCRYPT
 
 		case NYX_SECURITY_RSA_SIGN:
 		case NYX_SECURITY_RSA_VERIFY:
 		{
-			RSA *rsa = NULL;
 			SHA256_CTX sha_ctx;
 			unsigned char md[SHA256_DIGEST_LENGTH];
 			nyx_error_t result = NYX_ERROR_NONE;
-			d2i_RSAPrivateKey(&rsa, &keydata, serializedKeyDataLen);
-
-			if (!rsa)
-			{
-				d2i_RSAPublicKey(&rsa, &keydata, serializedKeyDataLen);
-
-				if (!rsa)
-				{
-					return NYX_ERROR_GENERIC;
-				}
-			}
 
 			if (!SHA256_Init(&sha_ctx) ||
 			        !SHA256_Update(&sha_ctx, src, srclen) ||
 			        !SHA256_Final(md, &sha_ctx))
 			{
-				RSA_free(rsa);
 				return NYX_ERROR_GENERIC;
 			}
 
@@ -302,7 +458,6 @@ nyx_error_t rsa_crypt(const unsigned char *keydata, int serializedKeyDataLen,
 				}
 			}
 
-			RSA_free(rsa);
 			return result;
 
 		} //end case SIGN, VERIFY
@@ -314,3 +469,119 @@ nyx_error_t rsa_crypt(const unsigned char *keydata, int serializedKeyDataLen,
 
 	return NYX_ERROR_INVALID_VALUE;
 }
+
+nyx_error_t rsa_crypt(const unsigned char *keydata, int serializedKeyDataLen,
+                      nyx_security_rsa_operation_t operation, const unsigned char *src, int srclen,
+                      unsigned char *dest, int *destlen)
+{
+	int isPublic;
+	RSA *rsa = rsa_key_get(keydata, serializedKeyDataLen, &isPublic);
+	nyx_error_t result;
+
+	if (!rsa)
+	{
+		return NYX_ERROR_GENERIC;
+	}
+
+	PERF_TRACE(nyx_security2, rsa_crypt__entry, operation, srclen);
+	result = rsa_crypt_key(rsa, isPublic, operation, src, srclen, dest, destlen);
+	PERF_TRACE(nyx_security2, rsa_crypt__return, result);
+	RSA_free(rsa);
+
+	return result;
+}
+
+/**
+ * Parses a serialized key once and returns a handle for rsa_crypt_handle().
+ */
+nyx_error_t rsa_load_key(const unsigned char *keydata, int serializedKeyDataLen,
+                         int *handle)
+{
+	int isPublic;
+	RSA *rsa = rsa_key_get(keydata, serializedKeyDataLen, &isPublic);
+	int i;
+
+	if (!rsa)
+	{
+		return NYX_ERROR_GENERIC;
+	}
+
+	pthread_mutex_lock(&rsa_key_lock);
+
+	for (i = 0; i < RSA_KEY_HANDLE_MAX; i++)
+	{
+		if (!rsa_key_handles[i].rsa)
+		{
+			rsa_key_handles[i].rsa = rsa;
+			rsa_key_handles[i].isPublic = isPublic;
+			*handle = slot_handle_issue(&rsa_key_handles[i].generation, i);
+			pthread_mutex_unlock(&rsa_key_lock);
+			return NYX_ERROR_NONE;
+		}
+	}
+
+	pthread_mutex_unlock(&rsa_key_lock);
+	RSA_free(rsa);
+
+	return NYX_ERROR_OUT_OF_MEMORY;
+}
+
+nyx_error_t rsa_crypt_handle(int handle, nyx_security_rsa_operation_t operation,
+                             const unsigned char *src, int srclen, unsigned char *dest, int *destlen)
+{
+	RSA *rsa = NULL;
+	int isPublic = 0;
+	nyx_error_t result;
+	int slot = slot_handle_slot(handle, RSA_KEY_HANDLE_MAX);
+
+	pthread_mutex_lock(&rsa_key_lock);
+
+	if (slot >= 0 && (rsa = rsa_key_handles[slot].rsa) &&
+	        slot_handle_matches(handle, rsa_key_handles[slot].generation))
+	{
+		isPublic = rsa_key_handles[slot].isPublic;
+		RSA_up_ref(rsa);
+	}
+	else
+	{
+		rsa = NULL;
+	}
+
+	pthread_mutex_unlock(&rsa_key_lock);
+
+	if (!rsa)
+	{
+		return NYX_ERROR_INVALID_HANDLE;
+	}
+
+	PERF_TRACE(nyx_security2, rsa_crypt__entry, operation, srclen);
+	result = rsa_crypt_key(rsa, isPublic, operation, src, srclen, dest, destlen);
+	PERF_TRACE(nyx_security2, rsa_crypt__return, result);
+	RSA_free(rsa);
+
+	return result;
+}
+
+nyx_error_t rsa_unload_key(int handle)
+{
+	RSA *rsa = NULL;
+	int slot = slot_handle_slot(handle, RSA_KEY_HANDLE_MAX);
+
+	pthread_mutex_lock(&rsa_key_lock);
+
+	if (slot >= 0 && slot_handle_matches(handle, rsa_key_handles[slot].generation))
+	{
+		rsa = rsa_key_handles[slot].rsa;
+		rsa_key_handles[slot].rsa = NULL;
+	}
+
+	pthread_mutex_unlock(&rsa_key_lock);
+
+	if (!rsa)
+	{
+		return NYX_ERROR_INVALID_HANDLE;
+	}
+
+	RSA_free(rsa);
+	return NYX_ERROR_NONE;
+}
@@ -0,0 +1,314 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+
+/*
+********************************************************************************
+* @file rsa_pool.c
+*
+* @brief Asynchronous RSA key generation and a pool of precomputed keys.
+*
+* Generating a 4096-bit key takes seconds on the target boards. Async
+* requests run on a worker thread of their own and report back through the
+* GLib main context that was current when they were made, so the callback
+* runs in the caller's main loop rather than on the worker.
+*
+* The pool keeps up to a configurable number of 2048-bit keys ready. It is
+* refilled by a single SCHED_IDLE thread, which the kernel only runs when
+* no other task wants the CPU.
+********************************************************************************
+*/
+
+#include "security2.h"
+#include "async_job.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+
+/* only this size is pooled; it is the default for new keys */
+#define RSA_POOL_KEYBITS 2048
+#define RSA_POOL_MAX 8
+
+static struct
+{
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_t thread;
+	int running;
+	int stop;
+	int target;
+	int count;
+	RSA *keys[RSA_POOL_MAX];
+} pool =
+{
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+};
+
+typedef struct
+{
+	int keybits;
+	security2_rsa_key_cb_t callback;
+	void *user_data;
+	nyx_error_t result;
+	unsigned char *keydata;
+	int keydatalen;
+	unsigned char *publicKey;
+	int pubKeySize;
+} rsa_async_request_t;
+
+static async_job_queue_t rsa_async_jobs = ASYNC_JOB_QUEUE_INITIALIZER;
+
+static void *rsa_pool_fill(void *data)
+{
+	struct sched_param param = { .sched_priority = 0 };
+
+	if (pthread_setschedparam(pthread_self(), SCHED_IDLE, &param) != 0)
+	{
+		nyx_debug("%s: SCHED_IDLE not available", __FUNCTION__);
+	}
+
+	pthread_mutex_lock(&pool.lock);
+
+	while (!pool.stop)
+	{
+		if (pool.count >= pool.target)
+		{
+			pthread_cond_wait(&pool.cond, &pool.lock);
+			continue;
+		}
+
+		pthread_mutex_unlock(&pool.lock);
+		RSA *rsa = rsa_generate(RSA_POOL_KEYBITS);
+		pthread_mutex_lock(&pool.lock);
+
+		/* a failure here will not fix itself, leave the pool as it is */
+		if (!rsa)
+		{
+			nyx_debug("%s: key generation failed, filler stops", __FUNCTION__);
+			break;
+		}
+
+		if (pool.count < pool.target && !pool.stop)
+		{
+			pool.keys[pool.count++] = rsa;
+		}
+		else
+		{
+			RSA_free(rsa);
+		}
+	}
+
+	/*
+	 * Unless a stopper is joining us, nobody will: detach and let the next
+	 * rsa_pool_set_size() start a new filler.
+	 */
+	if (!pool.stop)
+	{
+		pool.running = 0;
+		pthread_detach(pthread_self());
+	}
+
+	pthread_mutex_unlock(&pool.lock);
+	return NULL;
+}
+
+/* Returns a precomputed key of keybits, or NULL if none is ready. */
+RSA *rsa_pool_take(int keybits)
+{
+	RSA *rsa = NULL;
+
+	if (keybits != RSA_POOL_KEYBITS)
+	{
+		return NULL;
+	}
+
+	pthread_mutex_lock(&pool.lock);
+
+	if (pool.count > 0)
+	{
+		rsa = pool.keys[--pool.count];
+		pool.keys[pool.count] = NULL;
+		/* wake the filler to replace it */
+		pthread_cond_broadcast(&pool.cond);
+	}
+
+	pthread_mutex_unlock(&pool.lock);
+	return rsa;
+}
+
+static void rsa_pool_stop_locked(void)
+{
+	if (!pool.running)
+	{
+		return;
+	}
+
+	pool.stop = 1;
+	pthread_cond_broadcast(&pool.cond);
+	pthread_mutex_unlock(&pool.lock);
+
+	pthread_join(pool.thread, NULL);
+
+	pthread_mutex_lock(&pool.lock);
+	pool.running = 0;
+	pool.stop = 0;
+}
+
+/**
+ * Keeps count 2048-bit keys precomputed; 0 stops the filler and drops the
+ * keys that are ready.
+ */
+nyx_error_t rsa_pool_set_size(int count)
+{
+	nyx_error_t result = NYX_ERROR_NONE;
+
+	if (count < 0 || count > RSA_POOL_MAX)
+	{
+		return NYX_ERROR_VALUE_OUT_OF_RANGE;
+	}
+
+	pthread_mutex_lock(&pool.lock);
+
+	pool.target = count;
+
+	while (pool.count > pool.target)
+	{
+		RSA_free(pool.keys[--pool.count]);
+		pool.keys[pool.count] = NULL;
+	}
+
+	if (count == 0)
+	{
+		rsa_pool_stop_locked();
+	}
+	else if (!pool.running)
+	{
+		if (pthread_create(&pool.thread, NULL, rsa_pool_fill, NULL) == 0)
+		{
+			pool.running = 1;
+		}
+		else
+		{
+			result = NYX_ERROR_GENERIC;
+		}
+	}
+	else
+	{
+		pthread_cond_broadcast(&pool.cond);
+	}
+
+	pthread_mutex_unlock(&pool.lock);
+	return result;
+}
+
+static void rsa_async_request_free(void *data)
+{
+	rsa_async_request_t *req = (rsa_async_request_t *)data;
+
+	g_free(req->keydata);
+	g_free(req->publicKey);
+	g_free(req);
+}
+
+/* Runs in the requester's main context. */
+static void rsa_async_complete(void *data)
+{
+	rsa_async_request_t *req = (rsa_async_request_t *)data;
+
+	req->callback(req->result, req->keydata, req->keydatalen, req->publicKey,
+	              req->pubKeySize, req->user_data);
+}
+
+static void rsa_async_generate(void *data)
+{
+	rsa_async_request_t *req = (rsa_async_request_t *)data;
+
+	/* the first call only reports the buffer sizes */
+	req->result = rsa_generate_key(req->keybits, NULL, &req->keydatalen, NULL,
+	                               &req->pubKeySize);
+
+	if (NYX_ERROR_NONE == req->result)
+	{
+		req->keydata = g_malloc(req->keydatalen);
+		req->publicKey = g_malloc(req->pubKeySize);
+		req->result = rsa_generate_key(req->keybits, req->keydata, &req->keydatalen,
+		                               req->publicKey, &req->pubKeySize);
+	}
+
+	if (NYX_ERROR_NONE != req->result)
+	{
+		req->keydatalen = 0;
+		req->pubKeySize = 0;
+	}
+}
+
+/**
+ * Generates a key pair without blocking the caller. callback is invoked from
+ * the thread-default main context of the calling thread with the serialized
+ * private and public keys, which are only valid for the duration of the call.
+ */
+nyx_error_t rsa_generate_key_async(int keybits,
+                                   security2_rsa_key_cb_t callback, void *user_data)
+{
+	switch (keybits)
+	{
+		case 1024:
+		case 2048:
+		case 4096:
+			break;
+
+		default:
+			return NYX_ERROR_INVALID_VALUE;
+	}
+
+	rsa_async_request_t *req = g_new0(rsa_async_request_t, 1);
+	req->keybits = keybits;
+	req->callback = callback;
+	req->user_data = user_data;
+
+	if (!async_job_start(&rsa_async_jobs, rsa_async_generate, rsa_async_complete,
+	                     rsa_async_request_free, req))
+	{
+		return NYX_ERROR_GENERIC;
+	}
+
+	return NYX_ERROR_NONE;
+}
+
+/*
+ * Stops the filler, frees the pooled keys, waits for async workers and drops
+ * the completions they queued that have not run yet, so that nothing is left
+ * to run module code. Called on the last close.
+ */
+void rsa_pool_shutdown(void)
+{
+	pthread_mutex_lock(&pool.lock);
+
+	pool.target = 0;
+	rsa_pool_stop_locked();
+
+	while (pool.count > 0)
+	{
+		RSA_free(pool.keys[--pool.count]);
+		pool.keys[pool.count] = NULL;
+	}
+
+	pthread_mutex_unlock(&pool.lock);
+
+	async_job_queue_drain(&rsa_async_jobs);
+}
@@ -27,28 +27,17 @@
 #include <string.h>
 #include <openssl/err.h>
 #include <openssl/conf.h>
-#include <sys/types.h>
-#include <unistd.h>
+#include <pthread.h>
 
 /*
- * Callbacks for multithreaded OpenSSL
+ * OpenSSL 1.1 and later initialise themselves and are thread-safe without
+ * any callbacks. Older versions need the locking callbacks and the library
+ * set up once per process; that is done on the first open and kept until
+ * the process exits, since other users of OpenSSL in the process may rely
+ * on it.
  */
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
 static pthread_mutex_t *lock_crypto = NULL;
-static int is_initializing = 0;
-static int reference_count;
-
-static int sync_interlocked_exchange(int *shared, int exchange)
-{
-	int u;
-
-	do
-	{
-		u = *shared;
-	}
-	while (__sync_val_compare_and_swap(shared, u, exchange) != u);
-
-	return u;
-}
 
 static unsigned long pthreads_thread_id_callback(void)
 {
@@ -68,13 +57,72 @@ static void pthreads_crypto_locking_callback(
 		pthread_mutex_unlock(&(lock_crypto[type]));
 	}
 }
+#endif
+
+static pthread_once_t openssl_once = PTHREAD_ONCE_INIT;
+static nyx_error_t openssl_init_result = NYX_ERROR_NONE;
+
+/* number of open devices; cached key material is dropped with the last one */
+static int open_count = 0;
+
+uint64_t security2_counters[SECURITY2_COUNTER_COUNT];
+
+static const char *const security2_counter_names[SECURITY2_COUNTER_COUNT] =
+{
+	"aes_calls",
+	"aes_bytes",
+	"des3_calls",
+	"des3_bytes",
+	"hmac_calls",
+	"hmac_bytes",
+	"rsa_calls",
+	"rsa_bytes",
+	"rsa_key_cache_hits",
+	"rsa_key_cache_misses",
+	"session_updates",
+	"session_bytes",
+};
+
+static void openssl_init(void)
+{
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+	lock_crypto = OPENSSL_malloc(CRYPTO_num_locks() * sizeof(pthread_mutex_t));
+
+	if (lock_crypto == NULL)
+	{
+		openssl_init_result = NYX_ERROR_GENERIC;
+		return;
+	}
+
+	for (int i = 0; i < CRYPTO_num_locks(); i++)
+	{
+		pthread_mutex_init(&(lock_crypto[i]), NULL);
+	}
+
+	CRYPTO_set_id_callback(pthreads_thread_id_callback);
+	CRYPTO_set_locking_callback(pthreads_crypto_locking_callback);
+
+	OPENSSL_init();
+	OpenSSL_add_all_algorithms();
+	ERR_load_BIO_strings();
+	ERR_load_crypto_strings();
+	OPENSSL_config(NULL);
+#else
+
+	if (!OPENSSL_init_crypto(OPENSSL_INIT_LOAD_CRYPTO_STRINGS |
+	                         OPENSSL_INIT_ADD_ALL_CIPHERS | OPENSSL_INIT_ADD_ALL_DIGESTS |
+	                         OPENSSL_INIT_LOAD_CONFIG, NULL))
+	{
+		openssl_init_result = NYX_ERROR_GENERIC;
+	}
+
+#endif
+}
 
 NYX_DECLARE_MODULE(NYX_DEVICE_SECURITY2, "Security2");
 
 nyx_error_t nyx_module_open(nyx_instance_t i, nyx_device_t **d)
 {
-	nyx_error_t ret = NYX_ERROR_NONE;
-
 	if (NULL == d)
 	{
 		return NYX_ERROR_INVALID_VALUE;
@@ -96,6 +144,8 @@ nyx_error_t nyx_module_open(nyx_instance_t i, nyx_device_t **d)
 	{
 		{ NYX_SECURITY2_CREATE_AES_KEY_MODULE_METHOD, "security2_create_aes_key" },
 		{ NYX_SECURITY2_CREATE_RSA_KEY_MODULE_METHOD, "security2_create_rsa_key" },
+		{ NYX_SECURITY2_CREATE_RSA_KEY_ASYNC_MODULE_METHOD, "security2_create_rsa_key_async" },
+		{ NYX_SECURITY2_SET_RSA_KEY_POOL_SIZE_MODULE_METHOD, "security2_set_rsa_key_pool_size" },
 		{ NYX_SECURITY2_CRYPT_AES_MODULE_METHOD,      "security2_aes_crypt" },
 		{ NYX_SECURITY2_CRYPT_AES_SIMPLE_MODULE_METHOD,      "security2_aes_crypt_simple" },
 		{ NYX_SECURITY2_CRYPT_RSA_MODULE_METHOD,      "security2_rsa_crypt" },
@@ -104,6 +154,20 @@ nyx_error_t nyx_module_open(nyx_instance_t i, nyx_device_t **d)
 		{ NYX_SECURITY2_CRYPT_3DES_MODULE_METHOD,      "security2_des3_crypt" },
 		{ NYX_SECURITY2_CRYPT_3DES_SIMPLE_MODULE_METHOD,      "security2_des3_crypt_simple" },
 		{ NYX_SECURITY2_HMAC_MODULE_METHOD,      "security2_hmac" },
+		{ NYX_SECURITY2_CRYPT_AES_BATCH_MODULE_METHOD, "security2_aes_crypt_batch" },
+		{ NYX_SECURITY2_HMAC_BATCH_MODULE_METHOD, "security2_hmac_batch" },
+		{ NYX_SECURITY2_LOAD_RSA_KEY_MODULE_METHOD, "security2_load_rsa_key" },
+		{ NYX_SECURITY2_CRYPT_RSA_HANDLE_MODULE_METHOD, "security2_rsa_crypt_handle" },
+		{ NYX_SECURITY2_UNLOAD_RSA_KEY_MODULE_METHOD, "security2_unload_rsa_key" },
+		{ NYX_SECURITY2_HMAC_INIT_MODULE_METHOD, "security2_hmac_init" },
+		{ NYX_SECURITY2_HMAC_UPDATE_MODULE_METHOD, "security2_hmac_update" },
+		{ NYX_SECURITY2_HMAC_FINAL_MODULE_METHOD, "security2_hmac_final" },
+		{ NYX_SECURITY2_CRYPT_AES_INIT_MODULE_METHOD, "security2_aes_crypt_init" },
+		{ NYX_SECURITY2_CRYPT_3DES_INIT_MODULE_METHOD, "security2_des3_crypt_init" },
+		{ NYX_SECURITY2_CRYPT_UPDATE_MODULE_METHOD, "security2_crypt_update" },
+		{ NYX_SECURITY2_CRYPT_FINAL_MODULE_METHOD, "security2_crypt_final" },
+		{ NYX_SECURITY2_SESSION_ABORT_MODULE_METHOD, "security2_session_abort" },
+		{ NYX_SECURITY2_QUERY_COUNTERS_MODULE_METHOD, "security2_query_counters" },
 	};
 
 	int m;
@@ -121,88 +185,34 @@ nyx_error_t nyx_module_open(nyx_instance_t i, nyx_device_t **d)
 		}
 	}
 
-	while (sync_interlocked_exchange(&is_initializing, 1) != 0)
-	{
-		usleep(1);
-	}
-
-	reference_count++;
+	pthread_once(&openssl_once, openssl_init);
 
-	if (reference_count > 1)
-	{
-		goto exit;
-	}
-
-	lock_crypto = OPENSSL_malloc(CRYPTO_num_locks() * sizeof(pthread_mutex_t));
-
-	if (lock_crypto == NULL)
+	if (NYX_ERROR_NONE != openssl_init_result)
 	{
 		free(*d);
 		*d = NULL;
-		ret =  NYX_ERROR_GENERIC;
-		goto exit;
+		return openssl_init_result;
 	}
 
-	for (int i = 0; i < CRYPTO_num_locks(); i++)
-	{
-		pthread_mutex_init(&(lock_crypto[i]), NULL);
-	}
+	__sync_add_and_fetch(&open_count, 1);
 
-	CRYPTO_set_locking_callback(pthreads_crypto_locking_callback);
-
-	OPENSSL_init();
-	OpenSSL_add_all_algorithms();
-	ERR_load_BIO_strings();
-	ERR_load_crypto_strings();
-	OPENSSL_config(NULL);
-
-	CRYPTO_set_id_callback(pthreads_thread_id_callback);
-
-
-exit:
-	sync_interlocked_exchange(&is_initializing, 0);
-	return ret;
+	return NYX_ERROR_NONE;
 }
 
 nyx_error_t nyx_module_close(nyx_device_handle_t d)
 {
-	nyx_error_t ret = NYX_ERROR_NONE;
-
-	while (sync_interlocked_exchange(&is_initializing, 1) != 0)
-	{
-		usleep(1);
-	}
+	cipher_ctx_pool_release();
 
-	if (reference_count == 0)
+	if (__sync_sub_and_fetch(&open_count, 1) == 0)
 	{
-		goto exit;
+		cipher_ctx_pool_shutdown();
+		rsa_pool_shutdown();
+		rsa_key_cache_clear();
+		session_release_all();
 	}
 
-	reference_count--;
-
-	if (reference_count > 0)
-	{
-		goto exit;
-	}
-
-	CRYPTO_set_locking_callback(NULL);
-
-	for (int i = 0; i < CRYPTO_num_locks(); i++)
-	{
-		pthread_mutex_destroy(&(lock_crypto[i]));
-	}
-
-	OPENSSL_free(lock_crypto);
-	lock_crypto = NULL;
-
-	EVP_cleanup();
-	CRYPTO_cleanup_all_ex_data();
-	ERR_free_strings();
-
-exit:
 	free(d);
-	sync_interlocked_exchange(&is_initializing, 0);
-	return ret;
+	return NYX_ERROR_NONE;
 }
 
 nyx_error_t security2_create_aes_key(nyx_device_handle_t d, int keybits,
@@ -332,6 +342,27 @@ nyx_error_t security2_create_rsa_key(nyx_device_handle_t d, int keybits,
 	                        pubKeySize);
 }
 
+nyx_error_t security2_create_rsa_key_async(nyx_device_handle_t d, int keybits,
+        security2_rsa_key_cb_t callback, void *user_data)
+{
+	if (NULL == d || NULL == callback)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	return rsa_generate_key_async(keybits, callback, user_data);
+}
+
+nyx_error_t security2_set_rsa_key_pool_size(nyx_device_handle_t d, int count)
+{
+	if (NULL == d)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	return rsa_pool_set_size(count);
+}
+
 nyx_error_t security2_rsa_crypt(nyx_device_handle_t d,
                                 const unsigned char *keydata, int serializedKeyDataLen,
                                 nyx_security_rsa_operation_t operation, const unsigned char *src, int srclen,
@@ -346,3 +377,193 @@ nyx_error_t security2_rsa_crypt(nyx_device_handle_t d,
 	return rsa_crypt(keydata, serializedKeyDataLen, operation, src, srclen, dest,
 	                 destlen);
 }
+
+nyx_error_t security2_aes_crypt_batch(nyx_device_handle_t d,
+                                      const unsigned char *keydata, int keybits,
+                                      nyx_security_block_mode_t mode, int encrypt,
+                                      nyx_security_padding_t padding,
+                                      nyx_security2_buffer_t *buffers, int count)
+{
+	if (NULL == d || NULL == keydata || NULL == buffers || count <= 0)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	return aes_crypt_batch(keydata, keybits, encrypt, mode, padding, buffers,
+	                       count);
+}
+
+nyx_error_t security2_hmac_batch(nyx_device_handle_t d,
+                                 const unsigned char *keydata, int keybits,
+                                 nyx_security2_buffer_t *buffers, int count)
+{
+	if (NULL == d || NULL == keydata || NULL == buffers || count <= 0)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	return hmac_batch(keydata, keybits, buffers, count);
+}
+
+nyx_error_t security2_load_rsa_key(nyx_device_handle_t d,
+                                   const unsigned char *keydata, int serializedKeyDataLen, int *handle)
+{
+	if (NULL == d || NULL == keydata || serializedKeyDataLen <= 0 ||
+	        NULL == handle)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	return rsa_load_key(keydata, serializedKeyDataLen, handle);
+}
+
+nyx_error_t security2_rsa_crypt_handle(nyx_device_handle_t d, int handle,
+                                       nyx_security_rsa_operation_t operation, const unsigned char *src, int srclen,
+                                       unsigned char *dest, int *destlen)
+{
+	if (NULL == d || NULL == src || NULL == dest || NULL == destlen)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	return rsa_crypt_handle(handle, operation, src, srclen, dest, destlen);
+}
+
+nyx_error_t security2_unload_rsa_key(nyx_device_handle_t d, int handle)
+{
+	if (NULL == d)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	return rsa_unload_key(handle);
+}
+
+nyx_error_t security2_hmac_init(nyx_device_handle_t d,
+                                const unsigned char *keydata, int keybits, security2_digest_t digest,
+                                int *handle)
+{
+	if (NULL == d || NULL == keydata || NULL == handle)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	return hmac_session_init(keydata, keybits, digest, handle);
+}
+
+nyx_error_t security2_hmac_update(nyx_device_handle_t d, int handle,
+                                  const unsigned char *src, int srclen)
+{
+	if (NULL == d || NULL == src || srclen < 0)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	return hmac_session_update(handle, src, srclen);
+}
+
+nyx_error_t security2_hmac_final(nyx_device_handle_t d, int handle,
+                                 unsigned char *dest, int *destlen)
+{
+	if (NULL == d || NULL == dest || NULL == destlen)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	return hmac_session_final(handle, dest, destlen);
+}
+
+static nyx_error_t security2_crypt_init(const EVP_CIPHER *cipher,
+                                        const unsigned char *keydata, int keylen,
+                                        nyx_security_block_mode_t mode, int encrypt, const unsigned char *iv,
+                                        int ivlen, nyx_security_padding_t padding, int *handle)
+{
+	if (NULL == cipher)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	if (mode != NYX_SECURITY_MODE_ECB &&
+	        (NULL == iv || ivlen != EVP_CIPHER_iv_length(cipher)))
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	return cipher_session_init(cipher, keydata, keylen, encrypt,
+	                           mode != NYX_SECURITY_MODE_ECB ? iv : NULL, padding, handle);
+}
+
+nyx_error_t security2_aes_crypt_init(nyx_device_handle_t d,
+                                     const unsigned char *keydata, int keybits,
+                                     nyx_security_block_mode_t mode, int encrypt, const unsigned char *iv,
+                                     int ivlen, nyx_security_padding_t padding, int *handle)
+{
+	if (NULL == d || NULL == keydata || NULL == handle)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	return security2_crypt_init(aes_cipher_lookup(keybits, mode), keydata,
+	                            keybits / 8, mode, encrypt, iv, ivlen, padding, handle);
+}
+
+nyx_error_t security2_des3_crypt_init(nyx_device_handle_t d,
+                                      const unsigned char *keydata, nyx_security_block_mode_t mode,
+                                      int encrypt, const unsigned char *iv, int ivlen,
+                                      nyx_security_padding_t padding, int *handle)
+{
+	const EVP_CIPHER *cipher = des3_cipher_lookup(mode);
+
+	if (NULL == d || NULL == keydata || NULL == handle || NULL == cipher)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	return security2_crypt_init(cipher, keydata, EVP_CIPHER_key_length(cipher),
+	                            mode, encrypt, iv, ivlen, padding, handle);
+}
+
+nyx_error_t security2_crypt_update(nyx_device_handle_t d, int handle,
+                                   const unsigned char *src, int srclen, unsigned char *dest, int *destlen)
+{
+	if (NULL == d || NULL == src || srclen < 0 || NULL == dest ||
+	        NULL == destlen)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	return cipher_session_update(handle, src, srclen, dest, destlen);
+}
+
+nyx_error_t security2_crypt_final(nyx_device_handle_t d, int handle,
+                                  unsigned char *dest, int *destlen)
+{
+	if (NULL == d || NULL == dest || NULL == destlen)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	return cipher_session_final(handle, dest, destlen);
+}
+
+nyx_error_t security2_session_abort(nyx_device_handle_t d, int handle)
+{
+	if (NULL == d)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	return session_abort(handle);
+}
+
+nyx_error_t security2_query_counters(nyx_device_handle_t d,
+                                     nyx_perf_counter_t *counters, int *count)
+{
+	if (NULL == d)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	return perf_counters_read(security2_counter_names, security2_counters,
+	                          SECURITY2_COUNTER_COUNT, counters, count);
+}
@@ -20,8 +20,85 @@
 #include <glib.h>
 #include <openssl/evp.h>
 #include <openssl/rsa.h>
+#include <openssl/hmac.h>
 #include <nyx/nyx_client.h>
+#include "perf_counters.h"
 
+/* runtime counters, bumped with PERF_COUNTER_INC/ADD from any thread */
+typedef enum
+{
+	SECURITY2_COUNTER_AES_CALLS,
+	SECURITY2_COUNTER_AES_BYTES,
+	SECURITY2_COUNTER_DES3_CALLS,
+	SECURITY2_COUNTER_DES3_BYTES,
+	SECURITY2_COUNTER_HMAC_CALLS,
+	SECURITY2_COUNTER_HMAC_BYTES,
+	SECURITY2_COUNTER_RSA_CALLS,
+	SECURITY2_COUNTER_RSA_BYTES,
+	SECURITY2_COUNTER_RSA_KEY_CACHE_HITS,
+	SECURITY2_COUNTER_RSA_KEY_CACHE_MISSES,
+	SECURITY2_COUNTER_SESSION_UPDATES,
+	SECURITY2_COUNTER_SESSION_BYTES,
+	SECURITY2_COUNTER_COUNT
+} security2_counter_t;
+
+extern uint64_t security2_counters[SECURITY2_COUNTER_COUNT];
+
+EVP_CIPHER_CTX *cipher_ctx_get(const EVP_CIPHER *cipher,
+                               const unsigned char *keydata, int keylen, int encrypt,
+                               const unsigned char *iv);
+void cipher_ctx_discard(EVP_CIPHER_CTX *ctx);
+void cipher_ctx_copy_iv(EVP_CIPHER_CTX *ctx, unsigned char *iv, int len);
+void cipher_ctx_pool_release(void);
+void cipher_ctx_pool_shutdown(void);
+
+/* HMAC_CTX is opaque from OpenSSL 1.1 on; give older versions its API */
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+static inline HMAC_CTX *HMAC_CTX_new(void)
+{
+	HMAC_CTX *ctx = OPENSSL_malloc(sizeof(HMAC_CTX));
+
+	if (ctx)
+	{
+		HMAC_CTX_init(ctx);
+	}
+
+	return ctx;
+}
+
+static inline void HMAC_CTX_free(HMAC_CTX *ctx)
+{
+	if (ctx)
+	{
+		HMAC_CTX_cleanup(ctx);
+		OPENSSL_free(ctx);
+	}
+}
+#endif
+
+typedef enum
+{
+	SECURITY2_DIGEST_SHA1 = 0,
+	SECURITY2_DIGEST_SHA256
+} security2_digest_t;
+
+nyx_error_t hmac_session_init(const unsigned char *keydata, int keybits,
+                              security2_digest_t digest, int *handle);
+nyx_error_t hmac_session_update(int handle, const unsigned char *src,
+                                int srclen);
+nyx_error_t hmac_session_final(int handle, unsigned char *dest, int *destlen);
+nyx_error_t cipher_session_init(const EVP_CIPHER *cipher,
+                                const unsigned char *keydata, int keylen, int encrypt,
+                                const unsigned char *iv, nyx_security_padding_t padding, int *handle);
+nyx_error_t cipher_session_update(int handle, const unsigned char *src,
+                                  int srclen, unsigned char *dest, int *destlen);
+nyx_error_t cipher_session_final(int handle, unsigned char *dest,
+                                 int *destlen);
+nyx_error_t session_abort(int handle);
+void session_release_all(void);
+
+const EVP_CIPHER *aes_cipher_lookup(int keybits,
+                                    nyx_security_block_mode_t mode);
 nyx_error_t aes_generate_key(int keybits, unsigned char *keydata);
 nyx_error_t aes_crypt(const unsigned char *keydata, int keybits, int encrypt,
                       nyx_security_block_mode_t mode, const unsigned char *src, int srclen,
@@ -30,12 +107,17 @@ nyx_error_t aes_crypt(const unsigned char *keydata, int keybits, int encrypt,
                       nyx_security_padding_t padding,
                       unsigned char *nextIv, int nextIvLen);
 
+nyx_error_t aes_crypt_batch(const unsigned char *keydata, int keybits,
+                            int encrypt, nyx_security_block_mode_t mode, nyx_security_padding_t padding,
+                            nyx_security2_buffer_t *buffers, int count);
+
 nyx_error_t aes_crypt_simple(const unsigned char *keydata, int keybits,
                              int encrypt,
                              nyx_security_block_mode_t mode, const unsigned char *src, int srclen,
                              unsigned char *dest, int *destlen);
 
 
+const EVP_CIPHER *des3_cipher_lookup(nyx_security_block_mode_t mode);
 nyx_error_t  des3_generate_key(int keybits, unsigned char *keydata);
 nyx_error_t des3_crypt(const unsigned char *keydata, int encrypt,
                        nyx_security_block_mode_t mode, const unsigned char *src, int srclen,
@@ -54,11 +136,35 @@ nyx_error_t hmac(const unsigned char *keydata, int keybits,
                  int srclen, unsigned char *dest,
                  int *destlen);
 
+nyx_error_t hmac_batch(const unsigned char *keydata, int keybits,
+                       nyx_security2_buffer_t *buffers, int count);
+
 nyx_error_t rsa_generate_key(int keybits, unsigned char *keydata,
                              int *serializedKeyDataLen,
                              unsigned char *publicKey, int *pubKeySize);
 nyx_error_t rsa_crypt(const unsigned char *keydata, int serializedKeyDataLen,
                       nyx_security_rsa_operation_t operation, const unsigned char *src, int srclen,
                       unsigned char *dest, int *destlen);
+RSA *rsa_generate(int keybits);
+
+/*
+ * Completion of rsa_generate_key_async(); the key buffers are only valid
+ * during the call.
+ */
+typedef void (*security2_rsa_key_cb_t)(nyx_error_t result,
+                                       const unsigned char *keydata, int serializedKeyDataLen,
+                                       const unsigned char *publicKey, int pubKeySize, void *user_data);
+
+nyx_error_t rsa_generate_key_async(int keybits,
+                                   security2_rsa_key_cb_t callback, void *user_data);
+RSA *rsa_pool_take(int keybits);
+nyx_error_t rsa_pool_set_size(int count);
+void rsa_pool_shutdown(void);
+nyx_error_t rsa_load_key(const unsigned char *keydata, int serializedKeyDataLen,
+                         int *handle);
+nyx_error_t rsa_crypt_handle(int handle, nyx_security_rsa_operation_t operation,
+                             const unsigned char *src, int srclen, unsigned char *dest, int *destlen);
+nyx_error_t rsa_unload_key(int handle);
+void rsa_key_cache_clear(void);
 
 #endif
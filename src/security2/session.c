@@ -0,0 +1,409 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+
+/*
+********************************************************************************
+* @file session.c
+*
+* @brief Streaming HMAC and cipher sessions.
+*
+* A session keeps a keyed HMAC_CTX or EVP_CIPHER_CTX between calls so that
+* large inputs can be fed in chunks. Sessions are addressed by slot handles,
+* which a later session in the same slot does not reuse, and are owned by
+* the caller until final or abort, so unlike the per-thread cipher pool they
+* may be used from any thread. A session in use by one call is marked busy;
+* a concurrent call on the same handle fails instead of racing on the
+* context.
+********************************************************************************
+*/
+
+#include "security2.h"
+#include "slot_handle.h"
+#include <pthread.h>
+#include <string.h>
+#include <openssl/err.h>
+#include <openssl/hmac.h>
+
+#define SESSION_MAX 32
+
+typedef enum
+{
+	SESSION_FREE = 0,
+	SESSION_HMAC,
+	SESSION_CIPHER
+} session_type_t;
+
+typedef struct
+{
+	session_type_t type;
+	int busy;
+	unsigned int generation;
+	union
+	{
+		HMAC_CTX *hmac;
+		EVP_CIPHER_CTX *cipher;
+	} ctx;
+} session_t;
+
+static session_t sessions[SESSION_MAX];
+static pthread_mutex_t session_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void session_free_ctx(session_t *session)
+{
+	if (session->type == SESSION_HMAC)
+	{
+		HMAC_CTX_free(session->ctx.hmac);
+	}
+	else if (session->type == SESSION_CIPHER)
+	{
+		EVP_CIPHER_CTX_free(session->ctx.cipher);
+	}
+
+	/* the generation stays, so the old handle remains invalid */
+	session->type = SESSION_FREE;
+	session->busy = 0;
+	memset(&session->ctx, 0, sizeof(session->ctx));
+}
+
+static nyx_error_t session_add(session_type_t type, void *ctx, int *handle)
+{
+	int i;
+
+	pthread_mutex_lock(&session_lock);
+
+	for (i = 0; i < SESSION_MAX; i++)
+	{
+		if (sessions[i].type == SESSION_FREE)
+		{
+			sessions[i].type = type;
+
+			if (type == SESSION_HMAC)
+			{
+				sessions[i].ctx.hmac = ctx;
+			}
+			else
+			{
+				sessions[i].ctx.cipher = ctx;
+			}
+
+			*handle = slot_handle_issue(&sessions[i].generation, i);
+			pthread_mutex_unlock(&session_lock);
+			return NYX_ERROR_NONE;
+		}
+	}
+
+	pthread_mutex_unlock(&session_lock);
+	nyx_debug("%s: no free session", __FUNCTION__);
+	return NYX_ERROR_OUT_OF_MEMORY;
+}
+
+/*
+ * Marks the session busy and returns it, or returns NULL with *result set
+ * when the handle is invalid, of the wrong type or in use by another call.
+ */
+static session_t *session_acquire(int handle, session_type_t type,
+                                  nyx_error_t *result)
+{
+	session_t *session = NULL;
+	int slot = slot_handle_slot(handle, SESSION_MAX);
+
+	pthread_mutex_lock(&session_lock);
+
+	if (slot < 0 || sessions[slot].type != type ||
+	        !slot_handle_matches(handle, sessions[slot].generation))
+	{
+		*result = NYX_ERROR_INVALID_HANDLE;
+	}
+	else if (sessions[slot].busy)
+	{
+		*result = NYX_ERROR_INVALID_OPERATION;
+	}
+	else
+	{
+		session = &sessions[slot];
+		session->busy = 1;
+		*result = NYX_ERROR_NONE;
+	}
+
+	pthread_mutex_unlock(&session_lock);
+	return session;
+}
+
+/* Releases a session taken by session_acquire(), freeing it when done. */
+static void session_release(session_t *session, int done)
+{
+	pthread_mutex_lock(&session_lock);
+
+	if (done)
+	{
+		session_free_ctx(session);
+	}
+	else
+	{
+		session->busy = 0;
+	}
+
+	pthread_mutex_unlock(&session_lock);
+}
+
+nyx_error_t hmac_session_init(const unsigned char *keydata, int keybits,
+                              security2_digest_t digest, int *handle)
+{
+	const EVP_MD *type;
+	HMAC_CTX *hmacctx;
+	nyx_error_t result;
+
+	switch (digest)
+	{
+		case SECURITY2_DIGEST_SHA1:
+			type = EVP_sha1();
+			break;
+
+		case SECURITY2_DIGEST_SHA256:
+			type = EVP_sha256();
+			break;
+
+		default:
+			return NYX_ERROR_INVALID_VALUE;
+	}
+
+	if (!(hmacctx = HMAC_CTX_new()))
+	{
+		return NYX_ERROR_OUT_OF_MEMORY;
+	}
+
+	if (!HMAC_Init_ex(hmacctx, (const void *)keydata, keybits / 8, type, NULL))
+	{
+		nyx_debug("HMAC_Init failed");
+		HMAC_CTX_free(hmacctx);
+		return NYX_ERROR_GENERIC;
+	}
+
+	result = session_add(SESSION_HMAC, hmacctx, handle);
+
+	if (NYX_ERROR_NONE != result)
+	{
+		HMAC_CTX_free(hmacctx);
+	}
+
+	return result;
+}
+
+nyx_error_t hmac_session_update(int handle, const unsigned char *src,
+                                int srclen)
+{
+	nyx_error_t result;
+	session_t *session = session_acquire(handle, SESSION_HMAC, &result);
+
+	if (!session)
+	{
+		return result;
+	}
+
+	PERF_COUNTER_INC(security2_counters[SECURITY2_COUNTER_SESSION_UPDATES]);
+	PERF_COUNTER_ADD(security2_counters[SECURITY2_COUNTER_SESSION_BYTES], srclen);
+
+	if (!HMAC_Update(session->ctx.hmac, src, srclen))
+	{
+		nyx_debug("HMAC_Update failed");
+		result = NYX_ERROR_GENERIC;
+	}
+
+	session_release(session, 0);
+	return result;
+}
+
+/**
+ * Writes the HMAC of everything fed to the session and closes it. dest must
+ * hold at least EVP_MAX_MD_SIZE bytes.
+ */
+nyx_error_t hmac_session_final(int handle, unsigned char *dest, int *destlen)
+{
+	nyx_error_t result;
+	session_t *session = session_acquire(handle, SESSION_HMAC, &result);
+
+	if (!session)
+	{
+		return result;
+	}
+
+	if (!HMAC_Final(session->ctx.hmac, dest, (unsigned int *)destlen))
+	{
+		nyx_debug("HMAC_Final failed");
+		result = NYX_ERROR_GENERIC;
+	}
+
+	session_release(session, 1);
+	return result;
+}
+
+/**
+ * Opens a cipher session. Padding applies to ECB and CBC only; CFB is a
+ * stream mode and never pads.
+ */
+nyx_error_t cipher_session_init(const EVP_CIPHER *cipher,
+                                const unsigned char *keydata, int keylen, int encrypt,
+                                const unsigned char *iv, nyx_security_padding_t padding, int *handle)
+{
+	EVP_CIPHER_CTX *ctx;
+	nyx_error_t result;
+
+	if (padding != NYX_SECURITY_PADDING_NONE &&
+	        padding != NYX_SECURITY_PADDING_PKCS5)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	if (!(ctx = EVP_CIPHER_CTX_new()))
+	{
+		return NYX_ERROR_OUT_OF_MEMORY;
+	}
+
+	if (!EVP_CipherInit_ex(ctx, cipher, NULL, NULL, NULL, encrypt))
+	{
+		result = NYX_ERROR_GENERIC;
+		goto fail;
+	}
+
+	/* fails for fixed length ciphers, which then use their own key length */
+	EVP_CIPHER_CTX_set_key_length(ctx, keylen);
+
+	if (!EVP_CipherInit_ex(ctx, NULL, NULL, keydata, iv, encrypt))
+	{
+		nyx_debug("EVP_CipherInit_ex failed");
+		ERR_print_errors_fp(stderr);
+		result = NYX_ERROR_GENERIC;
+		goto fail;
+	}
+
+	if (EVP_CIPHER_mode(cipher) != EVP_CIPH_CFB_MODE &&
+	        !EVP_CIPHER_CTX_set_padding(ctx,
+	                                    padding == NYX_SECURITY_PADDING_PKCS5 ? 1 : 0))
+	{
+		result = NYX_ERROR_GENERIC;
+		goto fail;
+	}
+
+	result = session_add(SESSION_CIPHER, ctx, handle);
+
+	if (NYX_ERROR_NONE == result)
+	{
+		return result;
+	}
+
+fail:
+	EVP_CIPHER_CTX_free(ctx);
+	return result;
+}
+
+/**
+ * Processes one chunk. dest must hold srclen plus one cipher block; *destlen
+ * is set to the number of bytes written, which may lag the input by up to a
+ * block while the cipher buffers a partial block.
+ */
+nyx_error_t cipher_session_update(int handle, const unsigned char *src,
+                                  int srclen, unsigned char *dest, int *destlen)
+{
+	nyx_error_t result;
+	session_t *session = session_acquire(handle, SESSION_CIPHER, &result);
+
+	if (!session)
+	{
+		return result;
+	}
+
+	PERF_COUNTER_INC(security2_counters[SECURITY2_COUNTER_SESSION_UPDATES]);
+	PERF_COUNTER_ADD(security2_counters[SECURITY2_COUNTER_SESSION_BYTES], srclen);
+
+	if (!EVP_CipherUpdate(session->ctx.cipher, dest, destlen, src, srclen))
+	{
+		nyx_debug("EVP_CipherUpdate failed");
+		ERR_print_errors_fp(stderr);
+		result = NYX_ERROR_GENERIC;
+	}
+
+	session_release(session, 0);
+	return result;
+}
+
+/**
+ * Flushes the last block, including padding, and closes the session. dest
+ * must hold one cipher block.
+ */
+nyx_error_t cipher_session_final(int handle, unsigned char *dest,
+                                 int *destlen)
+{
+	nyx_error_t result;
+	session_t *session = session_acquire(handle, SESSION_CIPHER, &result);
+
+	if (!session)
+	{
+		return result;
+	}
+
+	if (!EVP_CipherFinal_ex(session->ctx.cipher, dest, destlen))
+	{
+		nyx_debug("EVP_CipherFinal_ex failed");
+		ERR_print_errors_fp(stderr);
+		result = NYX_ERROR_GENERIC;
+	}
+
+	session_release(session, 1);
+	return result;
+}
+
+/* Closes a session of either kind without producing output. */
+nyx_error_t session_abort(int handle)
+{
+	nyx_error_t result = NYX_ERROR_NONE;
+	int slot = slot_handle_slot(handle, SESSION_MAX);
+
+	pthread_mutex_lock(&session_lock);
+
+	if (slot < 0 || sessions[slot].type == SESSION_FREE ||
+	        !slot_handle_matches(handle, sessions[slot].generation))
+	{
+		result = NYX_ERROR_INVALID_HANDLE;
+	}
+	else if (sessions[slot].busy)
+	{
+		result = NYX_ERROR_INVALID_OPERATION;
+	}
+	else
+	{
+		session_free_ctx(&sessions[slot]);
+	}
+
+	pthread_mutex_unlock(&session_lock);
+	return result;
+}
+
+/* Frees all open sessions; called when the last device is closed. */
+void session_release_all(void)
+{
+	int i;
+
+	pthread_mutex_lock(&session_lock);
+
+	for (i = 0; i < SESSION_MAX; i++)
+	{
+		session_free_ctx(&sessions[i]);
+	}
+
+	pthread_mutex_unlock(&session_lock);
+}
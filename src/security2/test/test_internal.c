@@ -0,0 +1,538 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+/*
+ * Unit tests of the module internals. They are built against the module
+ * sources directly, so that the internal API can be checked against the
+ * one-shot calls and OpenSSL itself.
+ */
+
+#include "../security2.h"
+#include <glib.h>
+#include <string.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+
+#define AES_BLOCK_SIZE 16
+#define DATA_LEN 1000
+#define SESSION_MAX 32
+
+uint64_t security2_counters[SECURITY2_COUNTER_COUNT];
+
+static void fill_random(unsigned char *buf, int len)
+{
+	g_assert_cmpint(1, == , RAND_bytes(buf, len));
+}
+
+static void test_aes_batch(void)
+{
+	unsigned char key[16];
+	unsigned char ivs[3][AES_BLOCK_SIZE];
+	unsigned char data[DATA_LEN];
+	unsigned char dest[3][DATA_LEN + AES_BLOCK_SIZE];
+	unsigned char expected[DATA_LEN + AES_BLOCK_SIZE];
+	const int lens[3] = { DATA_LEN, 17, 0 };
+	nyx_security2_buffer_t buffers[4];
+	int expectedlen;
+
+	fill_random(key, sizeof(key));
+	fill_random(data, sizeof(data));
+	memset(buffers, 0, sizeof(buffers));
+
+	for (int i = 0; i < 3; i++)
+	{
+		fill_random(ivs[i], AES_BLOCK_SIZE);
+		buffers[i].src = data;
+		buffers[i].srclen = lens[i];
+		buffers[i].dest = dest[i];
+		buffers[i].destlen = sizeof(dest[i]);
+		buffers[i].iv = ivs[i];
+	}
+
+	/* too small for the padded output; the others still go through */
+	unsigned char small[AES_BLOCK_SIZE];
+	buffers[3].src = data;
+	buffers[3].srclen = AES_BLOCK_SIZE;
+	buffers[3].dest = small;
+	buffers[3].destlen = sizeof(small);
+	buffers[3].iv = ivs[0];
+
+	g_assert_cmpint(NYX_ERROR_INVALID_VALUE, == , aes_crypt_batch(key, 128, 1,
+	                NYX_SECURITY_MODE_CBC, NYX_SECURITY_PADDING_PKCS5, buffers, 4));
+	g_assert_cmpint(NYX_ERROR_INVALID_VALUE, == , buffers[3].result);
+
+	for (int i = 0; i < 3; i++)
+	{
+		expectedlen = 0;
+		g_assert_cmpint(NYX_ERROR_NONE, == , buffers[i].result);
+		g_assert_cmpint(NYX_ERROR_NONE, == , aes_crypt(key, 128, 1,
+		                NYX_SECURITY_MODE_CBC, data, lens[i], expected, &expectedlen, ivs[i],
+		                AES_BLOCK_SIZE, NYX_SECURITY_PADDING_PKCS5, NULL, 0));
+		g_assert_cmpint(expectedlen, == , buffers[i].destlen);
+		g_assert(0 == memcmp(expected, dest[i], expectedlen));
+	}
+}
+
+static void test_hmac_batch(void)
+{
+	unsigned char key[32];
+	unsigned char data[DATA_LEN];
+	unsigned char dest[3][EVP_MAX_MD_SIZE];
+	unsigned char expected[EVP_MAX_MD_SIZE];
+	const int lens[3] = { DATA_LEN, 1, 0 };
+	nyx_security2_buffer_t buffers[3];
+	int expectedlen;
+
+	fill_random(key, sizeof(key));
+	fill_random(data, sizeof(data));
+	memset(buffers, 0, sizeof(buffers));
+
+	for (int i = 0; i < 3; i++)
+	{
+		buffers[i].src = data;
+		buffers[i].srclen = lens[i];
+		buffers[i].dest = dest[i];
+		buffers[i].destlen = sizeof(dest[i]);
+	}
+
+	g_assert_cmpint(NYX_ERROR_NONE, == , hmac_batch(key, 256, buffers, 3));
+
+	for (int i = 0; i < 3; i++)
+	{
+		g_assert_cmpint(NYX_ERROR_NONE, == , buffers[i].result);
+		g_assert_cmpint(NYX_ERROR_NONE, == , hmac(key, 256, data, lens[i], expected,
+		                &expectedlen));
+		g_assert_cmpint(expectedlen, == , buffers[i].destlen);
+		g_assert(0 == memcmp(expected, dest[i], expectedlen));
+	}
+}
+
+static const int chunks[] = { 1, 7, 16, 100, 3, 513 };
+
+/* feeds src to an HMAC session in uneven chunks */
+static void hmac_session_chunked(const unsigned char *key, int keybits,
+                                 security2_digest_t digest, const unsigned char *src, int srclen,
+                                 unsigned char *dest, int *destlen)
+{
+	int handle = 0;
+	int done = 0;
+
+	g_assert_cmpint(NYX_ERROR_NONE, == , hmac_session_init(key, keybits, digest,
+	                &handle));
+
+	for (int i = 0; done < srclen; i = (i + 1) % G_N_ELEMENTS(chunks))
+	{
+		int len = MIN(chunks[i], srclen - done);
+
+		g_assert_cmpint(NYX_ERROR_NONE, == , hmac_session_update(handle, src + done,
+		                len));
+		done += len;
+	}
+
+	g_assert_cmpint(NYX_ERROR_NONE, == , hmac_session_final(handle, dest,
+	                destlen));
+}
+
+/* runs src through a cipher session in uneven chunks, returns the length */
+static int cipher_session_chunked(const EVP_CIPHER *cipher,
+                                  const unsigned char *key, int encrypt, const unsigned char *iv,
+                                  nyx_security_padding_t padding, const unsigned char *src, int srclen,
+                                  unsigned char *dest)
+{
+	int handle = 0;
+	int done = 0;
+	int outlen = 0;
+	int len;
+
+	g_assert_cmpint(NYX_ERROR_NONE, == , cipher_session_init(cipher, key,
+	                EVP_CIPHER_key_length(cipher), encrypt, iv, padding, &handle));
+
+	for (int i = 0; done < srclen; i = (i + 1) % G_N_ELEMENTS(chunks))
+	{
+		int chunk = MIN(chunks[i], srclen - done);
+
+		g_assert_cmpint(NYX_ERROR_NONE, == , cipher_session_update(handle,
+		                src + done, chunk, dest + outlen, &len));
+		done += chunk;
+		outlen += len;
+	}
+
+	g_assert_cmpint(NYX_ERROR_NONE, == , cipher_session_final(handle,
+	                dest + outlen, &len));
+
+	return outlen + len;
+}
+
+static void test_hmac_session(void)
+{
+	unsigned char key[32];
+	unsigned char data[DATA_LEN];
+	unsigned char expected[EVP_MAX_MD_SIZE];
+	unsigned char result[EVP_MAX_MD_SIZE];
+	unsigned int expectedlen = 0;
+	int resultlen = 0;
+
+	fill_random(key, sizeof(key));
+	fill_random(data, sizeof(data));
+
+	HMAC(EVP_sha256(), key, sizeof(key), data, sizeof(data), expected,
+	     &expectedlen);
+	hmac_session_chunked(key, 256, SECURITY2_DIGEST_SHA256, data, sizeof(data),
+	                     result, &resultlen);
+	g_assert_cmpint(expectedlen, == , resultlen);
+	g_assert(0 == memcmp(expected, result, resultlen));
+
+	/* SHA1 matches the one-shot call */
+	int onelen = 0;
+	g_assert_cmpint(NYX_ERROR_NONE, == , hmac(key, 256, data, sizeof(data),
+	                expected, &onelen));
+	hmac_session_chunked(key, 256, SECURITY2_DIGEST_SHA1, data, sizeof(data),
+	                     result, &resultlen);
+	g_assert_cmpint(onelen, == , resultlen);
+	g_assert(0 == memcmp(expected, result, resultlen));
+
+	/* an empty message is valid */
+	HMAC(EVP_sha1(), key, sizeof(key), NULL, 0, expected, &expectedlen);
+	hmac_session_chunked(key, 256, SECURITY2_DIGEST_SHA1, data, 0, result,
+	                     &resultlen);
+	g_assert_cmpint(expectedlen, == , resultlen);
+	g_assert(0 == memcmp(expected, result, resultlen));
+
+	int handle = 0;
+	g_assert_cmpint(NYX_ERROR_INVALID_VALUE, == , hmac_session_init(key, 256,
+	                (security2_digest_t)42, &handle));
+}
+
+static void test_cipher_session(void)
+{
+	unsigned char key[32];
+	unsigned char iv[AES_BLOCK_SIZE];
+	unsigned char data[DATA_LEN];
+	unsigned char expected[DATA_LEN + AES_BLOCK_SIZE];
+	unsigned char encrypted[DATA_LEN + AES_BLOCK_SIZE];
+	unsigned char decrypted[DATA_LEN + AES_BLOCK_SIZE];
+	int expectedlen = 0;
+	int len;
+
+	fill_random(key, sizeof(key));
+	fill_random(iv, sizeof(iv));
+	fill_random(data, sizeof(data));
+
+	/* CBC with padding, against the one-shot call */
+	const EVP_CIPHER *cipher = aes_cipher_lookup(256, NYX_SECURITY_MODE_CBC);
+	g_assert(cipher != NULL);
+
+	g_assert_cmpint(NYX_ERROR_NONE, == , aes_crypt(key, 256, 1,
+	                NYX_SECURITY_MODE_CBC, data, sizeof(data), expected, &expectedlen, iv,
+	                sizeof(iv), NYX_SECURITY_PADDING_PKCS5, NULL, 0));
+
+	len = cipher_session_chunked(cipher, key, 1, iv, NYX_SECURITY_PADDING_PKCS5,
+	                             data, sizeof(data), encrypted);
+	g_assert_cmpint(expectedlen, == , len);
+	g_assert(0 == memcmp(expected, encrypted, len));
+
+	len = cipher_session_chunked(cipher, key, 0, iv, NYX_SECURITY_PADDING_PKCS5,
+	                             encrypted, len, decrypted);
+	g_assert_cmpint(sizeof(data), == , len);
+	g_assert(0 == memcmp(data, decrypted, len));
+
+	/* CFB is a stream mode: no padding and the output matches the input */
+	cipher = aes_cipher_lookup(128, NYX_SECURITY_MODE_CFB);
+	g_assert(cipher != NULL);
+
+	len = cipher_session_chunked(cipher, key, 1, iv, NYX_SECURITY_PADDING_NONE,
+	                             data, sizeof(data), encrypted);
+	g_assert_cmpint(sizeof(data), == , len);
+
+	len = cipher_session_chunked(cipher, key, 0, iv, NYX_SECURITY_PADDING_NONE,
+	                             encrypted, len, decrypted);
+	g_assert_cmpint(sizeof(data), == , len);
+	g_assert(0 == memcmp(data, decrypted, len));
+
+	/* without padding a CBC stream must end on a block boundary */
+	cipher = aes_cipher_lookup(256, NYX_SECURITY_MODE_CBC);
+	int handle = 0;
+	g_assert_cmpint(NYX_ERROR_NONE, == , cipher_session_init(cipher, key,
+	                sizeof(key), 1, iv, NYX_SECURITY_PADDING_NONE, &handle));
+	g_assert_cmpint(NYX_ERROR_NONE, == , cipher_session_update(handle, data,
+	                AES_BLOCK_SIZE + 1, encrypted, &len));
+	g_assert_cmpint(NYX_ERROR_GENERIC, == , cipher_session_final(handle,
+	                encrypted + len, &len));
+	/* a failed final still closes the session */
+	g_assert_cmpint(NYX_ERROR_INVALID_HANDLE, == , session_abort(handle));
+}
+
+static void test_session_handles(void)
+{
+	unsigned char key[32];
+	unsigned char iv[AES_BLOCK_SIZE];
+	unsigned char buf[EVP_MAX_MD_SIZE];
+	int handles[SESSION_MAX];
+	int handle = 0;
+	int len = 0;
+
+	fill_random(key, sizeof(key));
+	fill_random(iv, sizeof(iv));
+
+	/* handles that were never handed out */
+	g_assert_cmpint(NYX_ERROR_INVALID_HANDLE, == , hmac_session_update(0, key,
+	                sizeof(key)));
+	g_assert_cmpint(NYX_ERROR_INVALID_HANDLE, == , hmac_session_final(-1, buf,
+	                &len));
+	g_assert_cmpint(NYX_ERROR_INVALID_HANDLE, == , cipher_session_final(
+	                    SESSION_MAX + 1, buf, &len));
+	g_assert_cmpint(NYX_ERROR_INVALID_HANDLE, == , session_abort(0));
+	g_assert_cmpint(NYX_ERROR_INVALID_HANDLE, == , session_abort(SESSION_MAX + 1));
+
+	/* a session is only usable with the calls of its own kind */
+	g_assert_cmpint(NYX_ERROR_NONE, == , hmac_session_init(key, 256,
+	                SECURITY2_DIGEST_SHA1, &handle));
+	g_assert_cmpint(NYX_ERROR_INVALID_HANDLE, == , cipher_session_update(handle,
+	                key, sizeof(key), buf, &len));
+	g_assert_cmpint(NYX_ERROR_INVALID_HANDLE, == , cipher_session_final(handle,
+	                buf, &len));
+
+	/* final closes the session */
+	g_assert_cmpint(NYX_ERROR_NONE, == , hmac_session_final(handle, buf, &len));
+	g_assert_cmpint(NYX_ERROR_INVALID_HANDLE, == , hmac_session_update(handle,
+	                key, sizeof(key)));
+	g_assert_cmpint(NYX_ERROR_INVALID_HANDLE, == , session_abort(handle));
+
+	/* abort closes it without output */
+	g_assert_cmpint(NYX_ERROR_NONE, == , cipher_session_init(
+	                    aes_cipher_lookup(256, NYX_SECURITY_MODE_CBC), key, sizeof(key), 1, iv,
+	                    NYX_SECURITY_PADDING_PKCS5, &handle));
+	g_assert_cmpint(NYX_ERROR_NONE, == , session_abort(handle));
+	g_assert_cmpint(NYX_ERROR_INVALID_HANDLE, == , cipher_session_final(handle,
+	                buf, &len));
+
+	/* the table is bounded */
+	for (int i = 0; i < SESSION_MAX; i++)
+	{
+		g_assert_cmpint(NYX_ERROR_NONE, == , hmac_session_init(key, 256,
+		                SECURITY2_DIGEST_SHA256, &handles[i]));
+		g_assert_cmpint(0, < , handles[i]);
+	}
+
+	g_assert_cmpint(NYX_ERROR_OUT_OF_MEMORY, == , hmac_session_init(key, 256,
+	                SECURITY2_DIGEST_SHA256, &handle));
+
+	/* a freed slot is used again, but not under its old handle */
+	g_assert_cmpint(NYX_ERROR_NONE, == , session_abort(handles[5]));
+	g_assert_cmpint(NYX_ERROR_NONE, == , hmac_session_init(key, 256,
+	                SECURITY2_DIGEST_SHA256, &handle));
+	g_assert_cmpint(handles[5], != , handle);
+	g_assert_cmpint(NYX_ERROR_INVALID_HANDLE, == , hmac_session_update(
+	                    handles[5], key, sizeof(key)));
+	g_assert_cmpint(NYX_ERROR_INVALID_HANDLE, == , session_abort(handles[5]));
+	g_assert_cmpint(NYX_ERROR_NONE, == , hmac_session_update(handle, key,
+	                sizeof(key)));
+	handles[5] = handle;
+
+	/* the last close drops whatever is still open */
+	session_release_all();
+
+	for (int i = 0; i < SESSION_MAX; i++)
+	{
+		g_assert_cmpint(NYX_ERROR_INVALID_HANDLE, == , session_abort(handles[i]));
+	}
+
+	g_assert_cmpint(NYX_ERROR_NONE, == , hmac_session_init(key, 256,
+	                SECURITY2_DIGEST_SHA256, &handle));
+	g_assert_cmpint(NYX_ERROR_NONE, == , session_abort(handle));
+}
+
+static void test_rsa_key_handles(void)
+{
+	unsigned char keydata[2048];
+	unsigned char publicKey[1024 / 8 + 32];
+	unsigned char src[32];
+	unsigned char dest[1024 / 8];
+	int keydatalen = sizeof(keydata);
+	int pubKeySize = sizeof(publicKey);
+	int destlen;
+	int stale = 0;
+	int handle = 0;
+
+	g_assert_cmpint(NYX_ERROR_NONE, == , rsa_generate_key(1024, keydata,
+	                &keydatalen, publicKey, &pubKeySize));
+	fill_random(src, sizeof(src));
+
+	g_assert_cmpint(NYX_ERROR_NONE, == , rsa_load_key(keydata, keydatalen,
+	                &stale));
+	g_assert_cmpint(NYX_ERROR_NONE, == , rsa_unload_key(stale));
+	g_assert_cmpint(NYX_ERROR_INVALID_HANDLE, == , rsa_unload_key(stale));
+
+	/* the freed slot is reused, but not under the old handle */
+	g_assert_cmpint(NYX_ERROR_NONE, == , rsa_load_key(keydata, keydatalen,
+	                &handle));
+	g_assert_cmpint(stale, != , handle);
+
+	destlen = sizeof(dest);
+	g_assert_cmpint(NYX_ERROR_INVALID_HANDLE, == , rsa_crypt_handle(stale,
+	                NYX_SECURITY_RSA_ENCRYPT, src, sizeof(src), dest, &destlen));
+	g_assert_cmpint(NYX_ERROR_INVALID_HANDLE, == , rsa_unload_key(stale));
+
+	destlen = sizeof(dest);
+	g_assert_cmpint(NYX_ERROR_NONE, == , rsa_crypt_handle(handle,
+	                NYX_SECURITY_RSA_ENCRYPT, src, sizeof(src), dest, &destlen));
+
+	/* clearing the cache on the last close drops the loaded keys too */
+	rsa_key_cache_clear();
+	g_assert_cmpint(NYX_ERROR_INVALID_HANDLE, == , rsa_unload_key(handle));
+
+	g_assert_cmpint(NYX_ERROR_INVALID_HANDLE, == , rsa_unload_key(0));
+	g_assert_cmpint(NYX_ERROR_INVALID_HANDLE, == , rsa_unload_key(-1));
+}
+
+static void test_rsa_pool(void)
+{
+	RSA *rsa = NULL;
+
+	g_assert_cmpint(NYX_ERROR_VALUE_OUT_OF_RANGE, == , rsa_pool_set_size(-1));
+	g_assert_cmpint(NYX_ERROR_VALUE_OUT_OF_RANGE, == , rsa_pool_set_size(9));
+
+	/* only 2048 bit keys are pooled */
+	g_assert_cmpint(NYX_ERROR_NONE, == , rsa_pool_set_size(1));
+	g_assert(NULL == rsa_pool_take(1024));
+	g_assert(NULL == rsa_pool_take(4096));
+
+	/* the filler runs in the background; allow it a generous while */
+	for (int i = 0; i < 1200 && !rsa; i++)
+	{
+		if (!(rsa = rsa_pool_take(2048)))
+		{
+			g_usleep(100 * 1000);
+		}
+	}
+
+	g_assert(rsa != NULL);
+	g_assert_cmpint(2048 / 8, == , RSA_size(rsa));
+	RSA_free(rsa);
+
+	/* shrinking to zero stops the filler and drops the pooled keys */
+	g_assert_cmpint(NYX_ERROR_NONE, == , rsa_pool_set_size(0));
+	g_assert(NULL == rsa_pool_take(2048));
+
+	/* and it can be restarted */
+	g_assert_cmpint(NYX_ERROR_NONE, == , rsa_pool_set_size(2));
+	g_assert_cmpint(NYX_ERROR_NONE, == , rsa_pool_set_size(0));
+}
+
+typedef struct
+{
+	int calls;
+	GThread *thread;
+	nyx_error_t result;
+	unsigned char *keydata;
+	int keydatalen;
+	int pubKeySize;
+} async_result_t;
+
+static void async_done(nyx_error_t result, const unsigned char *keydata,
+                       int serializedKeyDataLen, const unsigned char *publicKey, int pubKeySize,
+                       void *user_data)
+{
+	async_result_t *res = user_data;
+
+	res->calls++;
+	res->thread = g_thread_self();
+	res->result = result;
+	res->keydata = g_malloc(serializedKeyDataLen);
+	memcpy(res->keydata, keydata, serializedKeyDataLen);
+	res->keydatalen = serializedKeyDataLen;
+	res->pubKeySize = pubKeySize;
+}
+
+static void test_rsa_async(void)
+{
+	async_result_t res = { 0 };
+	unsigned char src[32];
+	unsigned char encrypted[1024 / 8];
+	unsigned char decrypted[1024 / 8];
+	int encryptedlen = sizeof(encrypted);
+	int decryptedlen = sizeof(decrypted);
+	int handle = 0;
+
+	g_assert_cmpint(NYX_ERROR_INVALID_VALUE, == , rsa_generate_key_async(1000,
+	                async_done, &res));
+
+	g_assert_cmpint(NYX_ERROR_NONE, == , rsa_generate_key_async(1024, async_done,
+	                &res));
+
+	while (res.calls == 0)
+	{
+		g_main_context_iteration(NULL, TRUE);
+	}
+
+	/* delivered once, on the thread that asked */
+	g_assert_cmpint(1, == , res.calls);
+	g_assert(res.thread == g_thread_self());
+	g_assert_cmpint(NYX_ERROR_NONE, == , res.result);
+	g_assert_cmpint(0, < , res.keydatalen);
+	g_assert_cmpint(0, < , res.pubKeySize);
+
+	/* the key is usable */
+	fill_random(src, sizeof(src));
+	g_assert_cmpint(NYX_ERROR_NONE, == , rsa_load_key(res.keydata, res.keydatalen,
+	                &handle));
+	g_assert_cmpint(NYX_ERROR_NONE, == , rsa_crypt_handle(handle,
+	                NYX_SECURITY_RSA_ENCRYPT, src, sizeof(src), encrypted, &encryptedlen));
+	g_assert_cmpint(NYX_ERROR_NONE, == , rsa_crypt_handle(handle,
+	                NYX_SECURITY_RSA_DECRYPT, encrypted, encryptedlen, decrypted,
+	                &decryptedlen));
+	g_assert_cmpint(sizeof(src), == , decryptedlen);
+	g_assert(0 == memcmp(src, decrypted, decryptedlen));
+	g_assert_cmpint(NYX_ERROR_NONE, == , rsa_unload_key(handle));
+
+	g_free(res.keydata);
+
+	while (g_main_context_iteration(NULL, FALSE));
+
+	g_assert_cmpint(1, == , res.calls);
+}
+
+static void test_rsa_async_shutdown(void)
+{
+	async_result_t res = { 0 };
+
+	/* shutdown waits for the worker and drops its undelivered completion */
+	g_assert_cmpint(NYX_ERROR_NONE, == , rsa_generate_key_async(1024, async_done,
+	                &res));
+	rsa_pool_shutdown();
+
+	while (g_main_context_iteration(NULL, FALSE));
+
+	g_assert_cmpint(0, == , res.calls);
+}
+
+int main(int argc, char *argv[])
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/nyx/security2/batch_aes", test_aes_batch);
+	g_test_add_func("/nyx/security2/batch_hmac", test_hmac_batch);
+	g_test_add_func("/nyx/security2/session_hmac", test_hmac_session);
+	g_test_add_func("/nyx/security2/session_cipher", test_cipher_session);
+	g_test_add_func("/nyx/security2/session_handles", test_session_handles);
+	g_test_add_func("/nyx/security2/rsa_key_handles", test_rsa_key_handles);
+	g_test_add_func("/nyx/security2/rsa_pool", test_rsa_pool);
+	g_test_add_func("/nyx/security2/rsa_async", test_rsa_async);
+	g_test_add_func("/nyx/security2/rsa_async_shutdown", test_rsa_async_shutdown);
+
+	return g_test_run();
+}
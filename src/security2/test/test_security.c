@@ -83,6 +83,48 @@ static void test_create_aes_key(struct Fixture *f, gconstpointer userdata)
 	createAndCryptAes(256, NYX_SECURITY_MODE_CFB, f);
 }
 
+/* the same key and IV must give the same ciphertext, also with another key
+ * used in between, now that contexts are reused per key */
+static void test_crypt_aes_reuse(struct Fixture *f, gconstpointer userdata)
+{
+	unsigned char key1[128 / 8];
+	unsigned char key2[128 / 8];
+	unsigned char iv[AES_BLOCK_SIZE];
+	const char *src = "1234567890123456";
+	unsigned char first[16 + EVP_MAX_BLOCK_LENGTH];
+	unsigned char other[16 + EVP_MAX_BLOCK_LENGTH];
+	unsigned char again[16 + EVP_MAX_BLOCK_LENGTH];
+	unsigned char dec[16 + EVP_MAX_BLOCK_LENGTH];
+	int firstlen = -1, otherlen = -1, againlen = -1, declen = -1;
+
+	g_assert_cmpint(NYX_ERROR_NONE, ==, nyx_security2_create_aes_key(f->device,
+	                128, key1));
+	g_assert_cmpint(NYX_ERROR_NONE, ==, nyx_security2_create_aes_key(f->device,
+	                128, key2));
+	g_assert_cmpint(0, !=, RAND_bytes(iv, AES_BLOCK_SIZE));
+
+	g_assert_cmpint(NYX_ERROR_NONE, ==, nyx_security2_crypt_aes(f->device, key1,
+	                128, NYX_SECURITY_MODE_CBC, 1, (const unsigned char *) src, 16, first,
+	                &firstlen, iv, AES_BLOCK_SIZE, NYX_SECURITY_PADDING_PKCS5, NULL, 0));
+	g_assert_cmpint(NYX_ERROR_NONE, ==, nyx_security2_crypt_aes(f->device, key2,
+	                128, NYX_SECURITY_MODE_CBC, 1, (const unsigned char *) src, 16, other,
+	                &otherlen, iv, AES_BLOCK_SIZE, NYX_SECURITY_PADDING_PKCS5, NULL, 0));
+	g_assert_cmpint(NYX_ERROR_NONE, ==, nyx_security2_crypt_aes(f->device, key1,
+	                128, NYX_SECURITY_MODE_CBC, 1, (const unsigned char *) src, 16, again,
+	                &againlen, iv, AES_BLOCK_SIZE, NYX_SECURITY_PADDING_PKCS5, NULL, 0));
+
+	g_assert_cmpint(firstlen, ==, againlen);
+	g_assert(memcmp(first, again, firstlen) == 0);
+	g_assert(otherlen != firstlen || memcmp(first, other, firstlen) != 0);
+
+	/* a decrypt with the same key must not pick up the encrypt context */
+	g_assert_cmpint(NYX_ERROR_NONE, ==, nyx_security2_crypt_aes(f->device, key1,
+	                128, NYX_SECURITY_MODE_CBC, 0, again, againlen, dec, &declen, iv,
+	                AES_BLOCK_SIZE, NYX_SECURITY_PADDING_PKCS5, NULL, 0));
+	g_assert_cmpint(declen, ==, 16);
+	g_assert(memcmp(dec, src, 16) == 0);
+}
+
 static void create3des(struct Fixture *f, nyx_security_block_mode_t block_mode)
 {
 	unsigned char data[192 / 8];
@@ -594,6 +636,9 @@ int main(int argc, char *argv[])
 	TEST_ADD("/nyx/security2/create_crypt_key_aes_cbc", test_create_aes_key,
 	         "");
 
+	TEST_ADD("/nyx/security2/crypt_aes_reuse", test_crypt_aes_reuse,
+	         "");
+
 	TEST_ADD("/nyx/security2/cerate_crypt_hmac_256", test_create_hmac_key,
 	         "");
 
@@ -0,0 +1,305 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+/*
+****************************************************************
+* @file alarm_queue.c
+*
+* @brief Any number of wake alarms on top of the single RTC alarm.
+*
+* Alarms are kept in a min-heap on their expiry. The RTC is programmed
+* for the earliest one only and re-armed whenever the head changes or
+* the alarm fires. When it fires, every alarm due within the slack is
+* run as well, so close deadlines share one wakeup.
+***************************************************************
+*/
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <time.h>
+#include <glib.h>
+#include "rtc.h"
+#include "alarm_queue.h"
+
+typedef struct
+{
+	time_t expiry;
+	unsigned int id;
+	nyx_device_callback_function_t callback;
+	void *context;
+} alarm_entry_t;
+
+/*
+ * The RTC is read directly: the cached time can trail it, and an alarm
+ * judged not yet due would be re-armed for a moment already past.
+ */
+static time_t rtc_backend_now(void)
+{
+	time_t now;
+
+	if (rtc_time(&now) < 0)
+	{
+		now = time(NULL);
+	}
+
+	return now;
+}
+
+static const alarm_backend_t rtc_backend =
+{
+	rtc_set_alarm_time,
+	rtc_clear_alarm,
+	rtc_backend_now,
+};
+
+static const alarm_backend_t *alarm_backend = &rtc_backend;
+static alarm_entry_t *alarm_heap = NULL;
+static unsigned int alarm_count = 0;
+static unsigned int alarm_capacity = 0;
+static unsigned int alarm_next_id = 1;
+static unsigned int alarm_slack = 0;     // seconds
+static time_t alarm_armed = 0;           // expiry given to the backend
+
+static void heap_swap(unsigned int a, unsigned int b)
+{
+	alarm_entry_t tmp = alarm_heap[a];
+	alarm_heap[a] = alarm_heap[b];
+	alarm_heap[b] = tmp;
+}
+
+static void heap_sift_up(unsigned int i)
+{
+	while (i > 0 && alarm_heap[(i - 1) / 2].expiry > alarm_heap[i].expiry)
+	{
+		heap_swap(i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+}
+
+static void heap_sift_down(unsigned int i)
+{
+	for (;;)
+	{
+		unsigned int smallest = i;
+		unsigned int left = 2 * i + 1;
+		unsigned int right = left + 1;
+
+		if (left < alarm_count &&
+		        alarm_heap[left].expiry < alarm_heap[smallest].expiry)
+		{
+			smallest = left;
+		}
+
+		if (right < alarm_count &&
+		        alarm_heap[right].expiry < alarm_heap[smallest].expiry)
+		{
+			smallest = right;
+		}
+
+		if (smallest == i)
+		{
+			return;
+		}
+
+		heap_swap(i, smallest);
+		i = smallest;
+	}
+}
+
+static void heap_remove_at(unsigned int i)
+{
+	alarm_count--;
+
+	if (i == alarm_count)
+	{
+		return;
+	}
+
+	alarm_heap[i] = alarm_heap[alarm_count];
+	heap_sift_up(i);
+	heap_sift_down(i);
+}
+
+/*
+ * Arms the backend for the head of the queue, if it changed. Returns false
+ * if the backend refused; a later change of the head tries again.
+ */
+static bool alarm_rearm(void)
+{
+	if (0 == alarm_count)
+	{
+		if (alarm_armed)
+		{
+			alarm_backend->clear();
+			alarm_armed = 0;
+		}
+
+		return true;
+	}
+
+	if (alarm_heap[0].expiry == alarm_armed)
+	{
+		return true;
+	}
+
+	if (!alarm_backend->set(alarm_heap[0].expiry))
+	{
+		return false;
+	}
+
+	alarm_armed = alarm_heap[0].expiry;
+	return true;
+}
+
+/**
+ * Selects what is armed for the earliest alarm, the RTC driver by default.
+ * Call before queueing alarms.
+ */
+void alarm_queue_set_backend(const alarm_backend_t *backend)
+{
+	alarm_backend = backend ? backend : &rtc_backend;
+	alarm_armed = 0;
+}
+
+bool alarm_queue_remove(unsigned int id)
+{
+	for (unsigned int i = 0; i < alarm_count; i++)
+	{
+		if (alarm_heap[i].id == id)
+		{
+			heap_remove_at(i);
+			alarm_rearm();
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * Queues a wake alarm and stores its id in *id. callback, if set, is called
+ * with NYX_CALLBACK_STATUS_DONE when the alarm fires. An alarm that would
+ * be the earliest but cannot be armed is not queued.
+ */
+nyx_error_t alarm_queue_add(time_t expiry,
+                            nyx_device_callback_function_t callback, void *context,
+                            unsigned int *id)
+{
+	if (alarm_count == alarm_capacity)
+	{
+		unsigned int capacity = alarm_capacity ? alarm_capacity * 2 : 8;
+		alarm_entry_t *heap = realloc(alarm_heap, capacity * sizeof(*heap));
+
+		if (NULL == heap)
+		{
+			return NYX_ERROR_OUT_OF_MEMORY;
+		}
+
+		alarm_heap = heap;
+		alarm_capacity = capacity;
+	}
+
+	/* 0 means failure */
+	if (0 == alarm_next_id)
+	{
+		alarm_next_id = 1;
+	}
+
+	alarm_entry_t *entry = &alarm_heap[alarm_count];
+	entry->expiry = expiry;
+	entry->id = alarm_next_id++;
+	entry->callback = callback;
+	entry->context = context;
+
+	*id = entry->id;
+	heap_sift_up(alarm_count++);
+
+	if (!alarm_rearm())
+	{
+		alarm_queue_remove(*id);
+		*id = 0;
+		return NYX_ERROR_INVALID_OPERATION;
+	}
+
+	return NYX_ERROR_NONE;
+}
+
+/**
+ * Returns the earliest queued expiry, 0 when the queue is empty.
+ */
+time_t alarm_queue_next(void)
+{
+	return alarm_count ? alarm_heap[0].expiry : 0;
+}
+
+/**
+ * Alarms due within seconds of the one that fired are run with it.
+ */
+void alarm_queue_set_slack(unsigned int seconds)
+{
+	alarm_slack = seconds;
+}
+
+/**
+ * Runs every alarm that is due, re-arms the RTC for the next one and then
+ * calls the callbacks, which may queue new alarms.
+ */
+void alarm_queue_fire(nyx_device_handle_t handle)
+{
+	unsigned int due = 0;
+
+	/* the backend has disarmed itself when the alarm fired */
+	alarm_armed = 0;
+
+	/* judged on the clock the backend was armed on */
+	time_t now = alarm_backend->now();
+
+	alarm_entry_t *fired = g_new(alarm_entry_t, alarm_count ? alarm_count : 1);
+
+	while (alarm_count && alarm_heap[0].expiry <= now + (time_t)alarm_slack)
+	{
+		fired[due++] = alarm_heap[0];
+		heap_remove_at(0);
+	}
+
+	alarm_rearm();
+
+	for (unsigned int i = 0; i < due; i++)
+	{
+		if (fired[i].callback)
+		{
+			fired[i].callback(handle, NYX_CALLBACK_STATUS_DONE, fired[i].context);
+		}
+	}
+
+	g_free(fired);
+}
+
+/**
+ * Drops all alarms without disarming the backend. The RTC alarm stays
+ * programmed, so that with the RTC backend a pending wakeup survives the
+ * module being closed; a timerfd is disarmed by alarm_timer_close().
+ */
+void alarm_queue_clear(void)
+{
+	alarm_count = 0;
+	alarm_armed = 0;
+
+	free(alarm_heap);
+	alarm_heap = NULL;
+	alarm_capacity = 0;
+}
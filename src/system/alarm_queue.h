@@ -0,0 +1,49 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+/*
+*******************************************
+* @file alarm_queue.h
+*******************************************
+*/
+
+#ifndef _ALARM_QUEUE_H_
+#define _ALARM_QUEUE_H_
+
+#include <stdbool.h>
+#include <time.h>
+#include <nyx/nyx_module.h>
+
+/* how the head of the queue becomes a wakeup */
+typedef struct
+{
+	bool (*set)(time_t expiry);
+	bool (*clear)(void);
+	time_t (*now)(void);   // the clock set() expiries are on
+} alarm_backend_t;
+
+void alarm_queue_set_backend(const alarm_backend_t *backend);
+nyx_error_t alarm_queue_add(time_t expiry,
+                            nyx_device_callback_function_t callback, void *context,
+                            unsigned int *id);
+bool alarm_queue_remove(unsigned int id);
+time_t alarm_queue_next(void);
+void alarm_queue_set_slack(unsigned int seconds);
+void alarm_queue_fire(nyx_device_handle_t handle);
+void alarm_queue_clear(void);
+
+#endif
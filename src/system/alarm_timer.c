@@ -0,0 +1,152 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+/*
+****************************************************************
+* @file alarm_timer.c
+*
+* @brief Wake alarms on a CLOCK_BOOTTIME_ALARM timerfd.
+*
+* The kernel programs the RTC itself for the earliest alarm timer, so
+* arming needs no RTC ioctl and expiry is signalled by the timerfd
+* instead of an RTC_AF read. Needs CAP_WAKE_ALARM; without it the caller
+* keeps using the RTC driver.
+*
+* Expiries are RTC times, as system_query_rtc_time() reports them, which
+* need not match the system clock. They are turned into a delay on
+* CLOCK_BOOTTIME, which keeps counting in suspend, with the cached RTC
+* offset that rtc_time_cached() derives from the same clock.
+***************************************************************
+*/
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <sys/timerfd.h>
+#include <glib.h>
+#include "alarm_timer.h"
+
+#ifndef CLOCK_BOOTTIME_ALARM
+#define CLOCK_BOOTTIME_ALARM 9
+#endif
+
+static int alarm_timer_fd = -1;
+static guint alarm_timer_watch = 0;
+
+static gboolean
+alarm_timer_event(GIOChannel *source, GIOCondition condition, gpointer ctx)
+{
+	RtcAlarmFunc func = (RtcAlarmFunc)ctx;
+	uint64_t expirations = 0;
+
+	/* EAGAIN when the timer was re-armed before we got here */
+	if (read(alarm_timer_fd, &expirations, sizeof(expirations)) ==
+	        sizeof(expirations) && expirations > 0)
+	{
+		func();
+	}
+
+	return TRUE;
+}
+
+/**
+ * Creates the alarm timer and watches it from the default main context.
+ * Returns false if the kernel or the caller's capabilities do not allow
+ * alarm timers.
+ */
+bool alarm_timer_open(RtcAlarmFunc func)
+{
+	if (alarm_timer_fd >= 0)
+	{
+		return true;
+	}
+
+	alarm_timer_fd = timerfd_create(CLOCK_BOOTTIME_ALARM,
+	                                TFD_NONBLOCK | TFD_CLOEXEC);
+
+	if (alarm_timer_fd < 0)
+	{
+		g_debug("%s: no alarm timer (%d), using the RTC", __FUNCTION__, errno);
+		return false;
+	}
+
+	GIOChannel *channel = g_io_channel_unix_new(alarm_timer_fd);
+	alarm_timer_watch = g_io_add_watch(channel, G_IO_IN, alarm_timer_event,
+	                                   func);
+	g_io_channel_unref(channel);
+
+	if (0 == alarm_timer_watch)
+	{
+		alarm_timer_close();
+		return false;
+	}
+
+	return true;
+}
+
+void alarm_timer_close(void)
+{
+	if (alarm_timer_watch)
+	{
+		g_source_remove(alarm_timer_watch);
+		alarm_timer_watch = 0;
+	}
+
+	if (alarm_timer_fd >= 0)
+	{
+		close(alarm_timer_fd);
+		alarm_timer_fd = -1;
+	}
+}
+
+/**
+ * Arms the timer for the RTC time expiry. An expiry in the past fires at
+ * once.
+ */
+bool alarm_timer_set(time_t expiry)
+{
+	struct itimerspec spec;
+	time_t now;
+
+	if (rtc_time_cached(&now) < 0)
+	{
+		return false;
+	}
+
+	memset(&spec, 0, sizeof(spec));
+
+	/* a zero it_value would disarm */
+	if (expiry > now)
+	{
+		spec.it_value.tv_sec = expiry - now;
+	}
+	else
+	{
+		spec.it_value.tv_nsec = 1;
+	}
+
+	return timerfd_settime(alarm_timer_fd, 0, &spec, NULL) == 0;
+}
+
+bool alarm_timer_clear(void)
+{
+	struct itimerspec spec;
+
+	memset(&spec, 0, sizeof(spec));
+	return timerfd_settime(alarm_timer_fd, 0, &spec, NULL) == 0;
+}
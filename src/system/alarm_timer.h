@@ -0,0 +1,36 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+/*
+*******************************************
+* @file alarm_timer.h
+*******************************************
+*/
+
+#ifndef _ALARM_TIMER_H_
+#define _ALARM_TIMER_H_
+
+#include <stdbool.h>
+#include <time.h>
+#include "rtc.h"
+
+bool alarm_timer_open(RtcAlarmFunc func);
+void alarm_timer_close(void);
+bool alarm_timer_set(time_t expiry);
+bool alarm_timer_clear(void);
+
+#endif
@@ -0,0 +1,238 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+/*
+*******************************************
+* @file power.c
+*
+* @brief Suspend, power off and reboot without shelling out.
+*
+* Requests go to logind over D-Bus when it runs, so inhibitors and a
+* clean shutdown are honoured. Without logind, suspend writes "mem" to
+* /sys/power/state and a forced power off or reboot uses reboot(2)
+* directly; a normal one falls back to the shutdown command. The async
+* variant runs the same steps on a worker thread and reports the result
+* in the caller's thread-default main context.
+*******************************************
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/reboot.h>
+#include <sys/wait.h>
+#include <glib.h>
+#include <gio/gio.h>
+
+#include <nyx/module/nyx_log.h>
+#include "async_job.h"
+#include "power.h"
+
+#define LOGIND_NAME        "org.freedesktop.login1"
+#define LOGIND_PATH        "/org/freedesktop/login1"
+#define LOGIND_MANAGER     "org.freedesktop.login1.Manager"
+#define LOGIND_TIMEOUT_MS  5000
+
+/* platform hook, preferred when installed */
+static const char *const suspend_action = "/usr/sbin/suspend_action";
+static const char *const power_state_path = "/sys/power/state";
+
+typedef struct
+{
+	power_action_t action;
+	bool force;
+	bool success;
+	power_result_cb_t callback;
+	void (*destroy)(void *user_data);
+	void *user_data;
+} power_request_t;
+
+/* async requests; their workers and completions run module code */
+static async_job_queue_t power_jobs = ASYNC_JOB_QUEUE_INITIALIZER;
+
+/* logind replies once the request is queued, not when it is carried out */
+static bool logind_call(const char *method)
+{
+	GError *error = NULL;
+	GDBusConnection *bus = g_bus_get_sync(G_BUS_TYPE_SYSTEM, NULL, &error);
+
+	if (NULL == bus)
+	{
+		nyx_debug("No system bus: %s", error->message);
+		g_error_free(error);
+		return false;
+	}
+
+	GVariant *reply = g_dbus_connection_call_sync(bus, LOGIND_NAME, LOGIND_PATH,
+	                  LOGIND_MANAGER, method, g_variant_new("(b)", FALSE), NULL,
+	                  G_DBUS_CALL_FLAGS_NO_AUTO_START, LOGIND_TIMEOUT_MS, NULL, &error);
+
+	g_object_unref(bus);
+
+	if (NULL == reply)
+	{
+		nyx_debug("logind %s failed: %s", method, error->message);
+		g_error_free(error);
+		return false;
+	}
+
+	g_variant_unref(reply);
+	return true;
+}
+
+/* succeeds only if command ran and exited with status 0 */
+static bool run_command(const char *command)
+{
+	int status = system(command);
+
+	return status != -1 && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/* the write returns after resume */
+static bool write_power_state(const char *state)
+{
+	int fd = open(power_state_path, O_WRONLY | O_CLOEXEC);
+
+	if (fd < 0)
+	{
+		return false;
+	}
+
+	ssize_t len = strlen(state);
+	ssize_t ret;
+
+	do
+	{
+		ret = write(fd, state, len);
+	}
+	while (ret < 0 && errno == EINTR);
+
+	close(fd);
+	return ret == len;
+}
+
+static bool suspend(void)
+{
+	if (access(suspend_action, R_OK | X_OK) == 0)
+	{
+		return run_command(suspend_action);
+	}
+
+	return logind_call("Suspend") || write_power_state("mem");
+}
+
+/* returns only on failure */
+static bool force_reboot(int cmd)
+{
+	sync();
+	reboot(cmd);
+	return false;
+}
+
+/**
+ * Carries out action on the calling thread. A forced request skips logind
+ * and the shutdown command and does not return on success.
+ */
+bool power_request(power_action_t action, bool force)
+{
+	switch (action)
+	{
+		case POWER_ACTION_SUSPEND:
+			return suspend();
+
+		case POWER_ACTION_POWEROFF:
+			if (force)
+			{
+				return force_reboot(RB_HALT_SYSTEM);
+			}
+
+			return logind_call("PowerOff") || run_command("shutdown -h now");
+
+		case POWER_ACTION_REBOOT:
+			if (force)
+			{
+				return force_reboot(RB_AUTOBOOT);
+			}
+
+			return logind_call("Reboot") || run_command("reboot");
+	}
+
+	return false;
+}
+
+static void power_job_run(void *data)
+{
+	power_request_t *req = data;
+
+	req->success = power_request(req->action, req->force);
+}
+
+/* Runs in the requester's main context. */
+static void power_job_done(void *data)
+{
+	power_request_t *req = data;
+
+	if (req->callback)
+	{
+		req->callback(req->success, req->user_data);
+	}
+}
+
+static void power_request_free(void *data)
+{
+	power_request_t *req = data;
+
+	if (req->destroy)
+	{
+		req->destroy(req->user_data);
+	}
+
+	g_free(req);
+}
+
+/**
+ * Runs power_request() on a worker thread. callback, if set, gets the
+ * result in the thread-default main context of the caller. destroy, if
+ * set, is called with user_data once the callback has run or was dropped
+ * by power_request_drain(). Returns false if no worker could be started.
+ */
+bool power_request_async(power_action_t action, bool force,
+                         power_result_cb_t callback, void (*destroy)(void *user_data),
+                         void *user_data)
+{
+	power_request_t *req = g_new0(power_request_t, 1);
+
+	req->action = action;
+	req->force = force;
+	req->callback = callback;
+	req->destroy = destroy;
+	req->user_data = user_data;
+
+	return async_job_start(&power_jobs, power_job_run, power_job_done,
+	                       power_request_free, req);
+}
+
+/*
+ * Waits for the async requests still running and drops the results not
+ * delivered yet, so that no module code is left queued. Called on close.
+ */
+void power_request_drain(void)
+{
+	async_job_queue_drain(&power_jobs);
+}
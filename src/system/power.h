@@ -0,0 +1,44 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+/*
+*******************************************
+* @file power.h
+*******************************************
+*/
+
+#ifndef _POWER_H_
+#define _POWER_H_
+
+#include <stdbool.h>
+
+typedef enum
+{
+	POWER_ACTION_SUSPEND,
+	POWER_ACTION_POWEROFF,
+	POWER_ACTION_REBOOT,
+} power_action_t;
+
+typedef void (*power_result_cb_t)(bool success, void *user_data);
+
+bool power_request(power_action_t action, bool force);
+bool power_request_async(power_action_t action, bool force,
+                         power_result_cb_t callback, void (*destroy)(void *user_data),
+                         void *user_data);
+void power_request_drain(void);
+
+#endif
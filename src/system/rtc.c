@@ -51,6 +51,17 @@
 
 int32_t rtc_fd = -1;
 
+/* expiry last programmed by rtc_set_alarm_time, 0 once cleared */
+static time_t rtc_alarm_expiry = 0;
+
+/*
+ * RTC time minus CLOCK_BOOTTIME, which keeps counting in suspend just as
+ * the RTC does. Re-read now and then to follow drift and hwclock writes.
+ */
+#define RTC_RESYNC_INTERVAL 600
+static time_t rtc_offset = 0;
+static time_t rtc_offset_synced = -1;   // boottime of the last read
+
 #define STD_ASCTIME_BUF_SIZE    26
 
 #if DEV_RTC_IMPLEMENTED
@@ -212,6 +223,8 @@ rtc_clear_watch(void)
 void
 rtc_close()
 {
+	rtc_offset_synced = -1;
+
 	if (rtc_fd >= 0)
 	{
 		close(rtc_fd);
@@ -289,6 +302,49 @@ time_t rtc_time(time_t *time)
 	return t;
 }
 
+static time_t boottime_seconds(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_BOOTTIME, &ts);
+	return ts.tv_sec;
+}
+
+/**
+* @brief RTC time from CLOCK_BOOTTIME and a cached offset.
+*
+* Reads the RTC only when the offset is older than RTC_RESYNC_INTERVAL.
+*/
+
+time_t rtc_time_cached(time_t *time)
+{
+	time_t boot = boottime_seconds();
+
+	if (rtc_offset_synced < 0 || boot - rtc_offset_synced >= RTC_RESYNC_INTERVAL)
+	{
+		time_t now;
+
+		if (rtc_time(&now) < 0)
+		{
+			return -1;
+		}
+
+		/* the seconds boundary of the two clocks differs by under a second */
+		boot = boottime_seconds();
+		rtc_offset = now - boot;
+		rtc_offset_synced = boot;
+	}
+
+	time_t t = boot + rtc_offset;
+
+	if (time)
+	{
+		*time = t;
+	}
+
+	return t;
+}
+
 /**
 * @brief Sets an rtc alarm to fire.
 *
@@ -307,19 +363,16 @@ rtc_set_alarm_time(time_t expiry)
 	time_t now = 0;
 	struct tm tm_time;
 	struct rtc_wkalrm alarm;
-	static time_t curr_expiry = 0;
 
-	if (expiry == curr_expiry)
+	if (expiry == rtc_alarm_expiry)
 	{
 		return true;
 	}
-	else
-	{
-		curr_expiry = expiry;
-	}
 
 	rtc_time(&now);
 
+	time_t requested = expiry;
+
 	if (expiry < now + 2)
 	{
 		g_debug("%s: expiry = now + 2", __FUNCTION__);
@@ -328,7 +381,14 @@ rtc_set_alarm_time(time_t expiry)
 
 	gmtime_r(&expiry, &tm_time);
 	tm_to_rtc_wkalrm(&tm_time, &alarm);
-	return rtc_set_alarm(&alarm);
+
+	if (!rtc_set_alarm(&alarm))
+	{
+		return false;
+	}
+
+	rtc_alarm_expiry = requested;
+	return true;
 }
 
 /**
@@ -433,6 +493,7 @@ rtc_clear_alarm(void)
 	int32_t ret;
 	struct rtc_wkalrm alarm;
 
+	rtc_alarm_expiry = 0;
 	rtc_read_alarm(&alarm);
 
 	if (alarm.enabled)
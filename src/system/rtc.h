@@ -43,6 +43,7 @@ bool rtc_clear_alarm();
 bool rtc_read_alarm(struct rtc_wkalrm *alarm);
 bool rtc_read_alarm_time(time_t *time);
 time_t rtc_time(time_t *time);
+time_t rtc_time_cached(time_t *time);
 bool rtc_read(struct tm *rtc_tm);
 bool rtc_write(struct tm *tm_time);
 bool wall_rtc_diff(time_t *ret_delta);
@@ -32,23 +32,45 @@
 #include <sys/un.h>
 #include <glib.h>
 #include "rtc.h"
+#include "power.h"
+#include "alarm_queue.h"
+#include "alarm_timer.h"
 
 #include <nyx/nyx_module.h>
 #include <nyx/module/nyx_utils.h>
 #include "msgid.h"
 
 nyx_device_t *nyxDev;
-nyx_device_callback_function_t alarm_fired_callback = NULL;
 bool reformatted = false;
 
+/* the timer is armed from the cached RTC time, judge expiries on it too */
+static time_t timer_backend_now(void)
+{
+	time_t now;
+
+	if (rtc_time_cached(&now) < 0)
+	{
+		now = time(NULL);
+	}
+
+	return now;
+}
+
+static const alarm_backend_t timer_backend =
+{
+	alarm_timer_set,
+	alarm_timer_clear,
+	timer_backend_now,
+};
+
+/* queue entry behind system_set_alarm, which keeps a single alarm */
+static unsigned int legacy_alarm_id = 0;
+
 NYX_DECLARE_MODULE(NYX_DEVICE_SYSTEM, "System");
 
 void AlarmFiredCB(void)
 {
-	if (alarm_fired_callback)
-	{
-		alarm_fired_callback(nyxDev, NYX_CALLBACK_STATUS_DONE, NULL);
-	}
+	alarm_queue_fire(nyxDev);
 }
 
 nyx_error_t nyx_module_open(nyx_instance_t i, nyx_device_t **d)
@@ -77,6 +99,18 @@ nyx_error_t nyx_module_open(nyx_instance_t i, nyx_device_t **d)
 	                           NYX_SYSTEM_SET_ALARM_MODULE_METHOD,
 	                           "system_set_alarm");
 
+	nyx_module_register_method(i, (nyx_device_t *)nyxDev,
+	                           NYX_SYSTEM_ADD_ALARM_MODULE_METHOD,
+	                           "system_add_alarm");
+
+	nyx_module_register_method(i, (nyx_device_t *)nyxDev,
+	                           NYX_SYSTEM_REMOVE_ALARM_MODULE_METHOD,
+	                           "system_remove_alarm");
+
+	nyx_module_register_method(i, (nyx_device_t *)nyxDev,
+	                           NYX_SYSTEM_SET_ALARM_SLACK_MODULE_METHOD,
+	                           "system_set_alarm_slack");
+
 	nyx_module_register_method(i, (nyx_device_t *)nyxDev,
 	                           NYX_SYSTEM_QUERY_NEXT_ALARM_MODULE_METHOD,
 	                           "system_query_next_alarm");
@@ -97,20 +131,60 @@ nyx_error_t nyx_module_open(nyx_instance_t i, nyx_device_t **d)
 	                           NYX_SYSTEM_REBOOT_MODULE_METHOD,
 	                           "system_reboot");
 
+	nyx_module_register_method(i, (nyx_device_t *)nyxDev,
+	                           NYX_SYSTEM_SUSPEND_ASYNC_MODULE_METHOD,
+	                           "system_suspend_async");
+
+	nyx_module_register_method(i, (nyx_device_t *)nyxDev,
+	                           NYX_SYSTEM_SHUTDOWN_ASYNC_MODULE_METHOD,
+	                           "system_shutdown_async");
+
+	nyx_module_register_method(i, (nyx_device_t *)nyxDev,
+	                           NYX_SYSTEM_REBOOT_ASYNC_MODULE_METHOD,
+	                           "system_reboot_async");
+
 	nyx_module_register_method(i, (nyx_device_t *)nyxDev,
 	                           NYX_SYSTEM_ERASE_PARTITION_MODULE_METHOD,
 	                           "system_erase_partition");
 
+	/*
+	 * The RTC stays open until the module is closed. Alarms go to an alarm
+	 * timer when the kernel allows one, else to the RTC driver.
+	 */
+	if (rtc_open())
+	{
+		if (alarm_timer_open(AlarmFiredCB))
+		{
+			alarm_queue_set_backend(&timer_backend);
+		}
+		else
+		{
+			rtc_add_watch(AlarmFiredCB);
+		}
+
+		/* prime the cached RTC offset */
+		rtc_time_cached(NULL);
+	}
+
 	*d = (nyx_device_t *)nyxDev;
 	return NYX_ERROR_NONE;
 }
 
 nyx_error_t nyx_module_close(nyx_device_t *d)
 {
+	power_request_drain();
+	alarm_queue_clear();
+	legacy_alarm_id = 0;
+	alarm_timer_close();
+	alarm_queue_set_backend(NULL);
 	rtc_close();
 	return NYX_ERROR_NONE;
 }
 
+/*
+* Replaces the alarm set by the previous call, time 0 removes it. Alarms
+* of system_add_alarm are not affected.
+*/
 nyx_error_t system_set_alarm(nyx_device_handle_t handle, time_t time,
                              nyx_device_callback_function_t callback_func, void *context)
 {
@@ -119,37 +193,103 @@ nyx_error_t system_set_alarm(nyx_device_handle_t handle, time_t time,
 		return NYX_ERROR_INVALID_HANDLE;
 	}
 
-	if (rtc_open() == 0)
+	if (rtc_getfd() < 0)
 	{
 		return NYX_ERROR_INVALID_OPERATION;
 	}
 
-	if (!time)
+	if (legacy_alarm_id)
+	{
+		alarm_queue_remove(legacy_alarm_id);
+		legacy_alarm_id = 0;
+	}
+
+	if (time)
 	{
-		rtc_clear_alarm();
+		/* this call never passed its context on */
+		return alarm_queue_add(time, callback_func, NULL, &legacy_alarm_id);
 	}
-	else
+
+	return NYX_ERROR_NONE;
+}
+
+/*
+* Queues one more wake alarm; any number can be pending. callback_func,
+* if set, gets context when the alarm fires. alarm_id receives the id for
+* system_remove_alarm.
+*/
+nyx_error_t system_add_alarm(nyx_device_handle_t handle, time_t time,
+                             nyx_device_callback_function_t callback_func, void *context,
+                             unsigned int *alarm_id)
+{
+	if (handle != nyxDev)
 	{
-		if (rtc_set_alarm_time(time) == 0)
-		{
-			return NYX_ERROR_INVALID_OPERATION;
-		}
+		return NYX_ERROR_INVALID_HANDLE;
+	}
 
-		if (callback_func)
-		{
-			alarm_fired_callback = callback_func;
-			rtc_add_watch(AlarmFiredCB);
-		}
-		else
-		{
-			alarm_fired_callback = NULL;
-			rtc_clear_watch();
-		}
+	if (0 == time)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	if (rtc_getfd() < 0)
+	{
+		return NYX_ERROR_INVALID_OPERATION;
+	}
+
+	unsigned int id;
+	nyx_error_t error = alarm_queue_add(time, callback_func, context, &id);
+
+	if (NYX_ERROR_NONE != error)
+	{
+		return error;
+	}
+
+	if (alarm_id)
+	{
+		*alarm_id = id;
 	}
 
 	return NYX_ERROR_NONE;
 }
 
+nyx_error_t system_remove_alarm(nyx_device_handle_t handle,
+                                unsigned int alarm_id)
+{
+	if (handle != nyxDev)
+	{
+		return NYX_ERROR_INVALID_HANDLE;
+	}
+
+	if (!alarm_queue_remove(alarm_id))
+	{
+		return NYX_ERROR_NOT_FOUND;
+	}
+
+	if (alarm_id == legacy_alarm_id)
+	{
+		legacy_alarm_id = 0;
+	}
+
+	return NYX_ERROR_NONE;
+}
+
+/*
+* Alarms due within seconds of the one that wakes the device are run on
+* the same wakeup. The default, 0, runs each alarm on time.
+*/
+nyx_error_t system_set_alarm_slack(nyx_device_handle_t handle,
+                                   unsigned int seconds)
+{
+	if (handle != nyxDev)
+	{
+		return NYX_ERROR_INVALID_HANDLE;
+	}
+
+	alarm_queue_set_slack(seconds);
+	return NYX_ERROR_NONE;
+}
+
 nyx_error_t system_query_next_alarm(nyx_device_handle_t handle, time_t *time)
 {
 	if (handle != nyxDev)
@@ -157,12 +297,15 @@ nyx_error_t system_query_next_alarm(nyx_device_handle_t handle, time_t *time)
 		return NYX_ERROR_INVALID_HANDLE;
 	}
 
-	if (rtc_open() == 0)
+	if (rtc_getfd() < 0)
 	{
 		return NYX_ERROR_INVALID_OPERATION;
 	}
 
-	if (rtc_read_alarm_time(time) < 0)
+	*time = alarm_queue_next();
+
+	/* with nothing queued here, report what the RTC holds */
+	if (0 == *time && !rtc_read_alarm_time(time))
 	{
 		return NYX_ERROR_INVALID_OPERATION;
 	}
@@ -177,12 +320,13 @@ nyx_error_t system_query_rtc_time(nyx_device_handle_t handle, time_t *time)
 		return NYX_ERROR_INVALID_HANDLE;
 	}
 
-	if (rtc_open() == 0)
+	if (rtc_getfd() < 0)
 	{
 		return NYX_ERROR_INVALID_OPERATION;
 	}
 
-	if (rtc_time(time) < 0)
+	/* no RTC ioctl unless the cached offset is due for a re-read */
+	if (rtc_time_cached(time) < 0)
 	{
 		return NYX_ERROR_INVALID_OPERATION;
 	}
@@ -191,6 +335,10 @@ nyx_error_t system_query_rtc_time(nyx_device_handle_t handle, time_t *time)
 }
 
 
+/*
+* Blocks until the suspend was handed to logind or, without logind, until
+* the system resumed.
+*/
 nyx_error_t system_suspend(nyx_device_handle_t handle, bool *success)
 {
 	if (handle != nyxDev)
@@ -198,59 +346,48 @@ nyx_error_t system_suspend(nyx_device_handle_t handle, bool *success)
 		return NYX_ERROR_INVALID_HANDLE;
 	}
 
-	int32_t ret = access("/usr/sbin/suspend_action", R_OK | X_OK);
-
-	if (ret || (success == NULL))
-	{
-		/* dummy sleep function */
-		sleep(5);
-		ret = 0;
-	}
-	else
-	{
-		ret = system("/usr/sbin/suspend_action");
-	}
+	bool ret = power_request(POWER_ACTION_SUSPEND, false);
 
 	if (success)
 	{
-		if (ret < 0)
-		{
-			*success = false;
-		}
-		else
-		{
-			*success = true;
-		}
+		*success = ret;
 	}
 
 	return NYX_ERROR_NONE;
 }
 
 
+static bool is_forced(nyx_system_shutdown_type_t type)
+{
+	return NYX_SYSTEM_EMERG_SHUTDOWN == type;
+}
+
 nyx_error_t system_shutdown(nyx_device_handle_t handle ,
                             nyx_system_shutdown_type_t type, const char *reason)
 {
-	int ret = 0;
-
 	if (handle != nyxDev)
 	{
 		return NYX_ERROR_INVALID_HANDLE;
 	}
 
-	switch (type)
+	if (!power_request(POWER_ACTION_POWEROFF, is_forced(type)))
 	{
-		case NYX_SYSTEM_EMERG_SHUTDOWN:
-			ret = system("halt -f");
-			break;
+		return NYX_ERROR_GENERIC;
+	}
 
-		case NYX_SYSTEM_NORMAL_SHUTDOWN:
-		case NYX_SYSTEM_TEST_SHUTDOWN:
-		default:
-			ret = system("shutdown -h now");
-			break;
+	return NYX_ERROR_NONE;
+}
+
+
+nyx_error_t system_reboot(nyx_device_handle_t handle ,
+                          nyx_system_shutdown_type_t type, const char *reason)
+{
+	if (handle != nyxDev)
+	{
+		return NYX_ERROR_INVALID_HANDLE;
 	}
 
-	if (ret < 0)
+	if (!power_request(POWER_ACTION_REBOOT, is_forced(type)))
 	{
 		return NYX_ERROR_GENERIC;
 	}
@@ -259,30 +396,41 @@ nyx_error_t system_shutdown(nyx_device_handle_t handle ,
 }
 
 
-nyx_error_t system_reboot(nyx_device_handle_t handle ,
-                          nyx_system_shutdown_type_t type, const char *reason)
+typedef struct
+{
+	nyx_device_callback_function_t callback;
+	void *context;
+} power_callback_t;
+
+static void power_request_done(bool success, void *user_data)
 {
-	int ret = 0;
+	power_callback_t *cb = user_data;
 
+	cb->callback(nyxDev, success ? NYX_CALLBACK_STATUS_DONE :
+	             NYX_CALLBACK_STATUS_FAILED, cb->context);
+}
+
+static nyx_error_t request_async(nyx_device_handle_t handle,
+                                 power_action_t action, bool force,
+                                 nyx_device_callback_function_t callback_func, void *context)
+{
 	if (handle != nyxDev)
 	{
 		return NYX_ERROR_INVALID_HANDLE;
 	}
 
-	switch (type)
+	if (NULL == callback_func)
 	{
-		case NYX_SYSTEM_EMERG_SHUTDOWN:
-			ret = system("reboot -f");
-			break;
-
-		case NYX_SYSTEM_NORMAL_SHUTDOWN:
-		case NYX_SYSTEM_TEST_SHUTDOWN:
-		default:
-			ret = system("reboot");
-			break;
+		return power_request_async(action, force, NULL, NULL, NULL) ?
+		       NYX_ERROR_NONE : NYX_ERROR_GENERIC;
 	}
 
-	if (ret < 0)
+	power_callback_t *cb = g_new0(power_callback_t, 1);
+	cb->callback = callback_func;
+	cb->context = context;
+
+	/* on failure cb is already freed */
+	if (!power_request_async(action, force, power_request_done, g_free, cb))
 	{
 		return NYX_ERROR_GENERIC;
 	}
@@ -290,6 +438,37 @@ nyx_error_t system_reboot(nyx_device_handle_t handle ,
 	return NYX_ERROR_NONE;
 }
 
+/*
+* The async variants return at once. callback_func, if set, is called
+* from the caller's thread-default main context with
+* NYX_CALLBACK_STATUS_DONE once the request was carried out (for suspend:
+* handed to logind, or after resume) or NYX_CALLBACK_STATUS_FAILED.
+*/
+nyx_error_t system_suspend_async(nyx_device_handle_t handle,
+                                 nyx_device_callback_function_t callback_func, void *context)
+{
+	return request_async(handle, POWER_ACTION_SUSPEND, false, callback_func,
+	                     context);
+}
+
+
+nyx_error_t system_shutdown_async(nyx_device_handle_t handle,
+                                  nyx_system_shutdown_type_t type, const char *reason,
+                                  nyx_device_callback_function_t callback_func, void *context)
+{
+	return request_async(handle, POWER_ACTION_POWEROFF, is_forced(type),
+	                     callback_func, context);
+}
+
+
+nyx_error_t system_reboot_async(nyx_device_handle_t handle,
+                                nyx_system_shutdown_type_t type, const char *reason,
+                                nyx_device_callback_function_t callback_func, void *context)
+{
+	return request_async(handle, POWER_ACTION_REBOOT, is_forced(type),
+	                     callback_func, context);
+}
+
 
 nyx_error_t system_erase_partition(nyx_device_handle_t handle,
                                    nyx_system_erase_type_t type)
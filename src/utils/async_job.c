@@ -0,0 +1,193 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+/**
+* @file async_job.c
+*
+* @brief Detached worker threads with completions queued as idle sources in
+* the requester's main context
+*/
+
+#include "async_job.h"
+
+typedef struct
+{
+	async_job_queue_t *queue;
+	async_job_func_t work;
+	async_job_func_t complete;
+	GDestroyNotify free_data;
+	void *data;
+	GMainContext *context;
+	GSource *source; /* the queued completion */
+} async_job_t;
+
+/* the queue whose completion this thread is running, if any */
+static __thread async_job_queue_t *completing = NULL;
+
+/* Also the destroy notify of the completion source. */
+static void async_job_free(gpointer data)
+{
+	async_job_t *job = (async_job_t *)data;
+	async_job_queue_t *queue = job->queue;
+
+	if (job->source)
+	{
+		pthread_mutex_lock(&queue->lock);
+		queue->completions = g_list_remove(queue->completions, job);
+		pthread_cond_broadcast(&queue->cond);
+		pthread_mutex_unlock(&queue->lock);
+	}
+
+	if (job->free_data)
+	{
+		job->free_data(job->data);
+	}
+
+	g_main_context_unref(job->context);
+	g_free(job);
+}
+
+/* Runs in the requester's main context. */
+static gboolean async_job_complete(gpointer data)
+{
+	async_job_t *job = (async_job_t *)data;
+	async_job_queue_t *outer = completing;
+
+	completing = job->queue;
+	job->complete(job->data);
+	completing = outer;
+
+	return G_SOURCE_REMOVE;
+}
+
+static void *async_job_worker(void *data)
+{
+	async_job_t *job = (async_job_t *)data;
+	async_job_queue_t *queue = job->queue;
+
+	job->work(job->data);
+
+	/* tracked, so that async_job_queue_drain() can drop it if it has not run */
+	GSource *source = g_idle_source_new();
+	g_source_set_priority(source, G_PRIORITY_DEFAULT);
+	g_source_set_callback(source, async_job_complete, job, async_job_free);
+
+	pthread_mutex_lock(&queue->lock);
+	job->source = source;
+	queue->completions = g_list_prepend(queue->completions, job);
+	pthread_mutex_unlock(&queue->lock);
+
+	g_source_attach(source, job->context);
+	g_source_unref(source);
+
+	pthread_mutex_lock(&queue->lock);
+
+	if (--queue->pending == 0)
+	{
+		pthread_cond_broadcast(&queue->cond);
+	}
+
+	pthread_mutex_unlock(&queue->lock);
+	return NULL;
+}
+
+/*
+ * Runs work(data) on a new thread, then complete(data) in the thread-default
+ * main context of the calling thread. free_data(data), if given, is called
+ * once the completion has run or been dropped. Returns false, with data
+ * already freed, if no thread could be started.
+ */
+bool async_job_start(async_job_queue_t *queue, async_job_func_t work,
+                     async_job_func_t complete, GDestroyNotify free_data, void *data)
+{
+	pthread_attr_t attr;
+	pthread_t thread;
+	int err;
+
+	async_job_t *job = g_new0(async_job_t, 1);
+	job->queue = queue;
+	job->work = work;
+	job->complete = complete;
+	job->free_data = free_data;
+	job->data = data;
+	job->context = g_main_context_ref_thread_default();
+
+	pthread_mutex_lock(&queue->lock);
+	queue->pending++;
+	pthread_mutex_unlock(&queue->lock);
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	err = pthread_create(&thread, &attr, async_job_worker, job);
+	pthread_attr_destroy(&attr);
+
+	if (err != 0)
+	{
+		pthread_mutex_lock(&queue->lock);
+		queue->pending--;
+		pthread_mutex_unlock(&queue->lock);
+		async_job_free(job);
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Waits until no worker of queue is running and drops the completions that
+ * have not run yet, so no module code is left queued in a main context.
+ */
+void async_job_queue_drain(async_job_queue_t *queue)
+{
+	pthread_mutex_lock(&queue->lock);
+
+	while (queue->pending > 0)
+	{
+		pthread_cond_wait(&queue->cond, &queue->lock);
+	}
+
+	/* the destroy notify takes the lock, so destroy the sources without it */
+	GList *sources = NULL;
+
+	for (GList *l = queue->completions; l; l = l->next)
+	{
+		async_job_t *job = l->data;
+		sources = g_list_prepend(sources, g_source_ref(job->source));
+	}
+
+	pthread_mutex_unlock(&queue->lock);
+
+	for (GList *l = sources; l; l = l->next)
+	{
+		g_source_destroy(l->data);
+	}
+
+	g_list_free_full(sources, (GDestroyNotify)g_source_unref);
+
+	pthread_mutex_lock(&queue->lock);
+
+	/*
+	 * A completion being dispatched on another thread finishes first. One
+	 * running on this thread is our caller and ends once we return.
+	 */
+	while (queue->completions && completing != queue)
+	{
+		pthread_cond_wait(&queue->cond, &queue->lock);
+	}
+
+	pthread_mutex_unlock(&queue->lock);
+}
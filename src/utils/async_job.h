@@ -0,0 +1,56 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+/**
+ * @file async_job.h
+ *
+ * @brief Work run on a detached thread whose completion is delivered in the
+ * requester's main context.
+ *
+ * A job's work function runs on a worker thread of its own. Its completion
+ * function then runs from the thread-default GLib main context that was
+ * current when the job was started, so callbacks reach the caller's main
+ * loop rather than the worker. async_job_queue_drain() waits for the
+ * workers of a queue and drops the completions that have not run yet, so
+ * that a module can be unloaded with no code of it left queued.
+ */
+
+#ifndef ASYNC_JOB_H_
+#define ASYNC_JOB_H_
+
+#include <stdbool.h>
+#include <pthread.h>
+#include <glib.h>
+
+typedef struct
+{
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int pending;        /* workers still running */
+	GList *completions; /* jobs whose completion is queued */
+} async_job_queue_t;
+
+#define ASYNC_JOB_QUEUE_INITIALIZER \
+	{ PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, NULL }
+
+typedef void (*async_job_func_t)(void *data);
+
+bool async_job_start(async_job_queue_t *queue, async_job_func_t work,
+                     async_job_func_t complete, GDestroyNotify free_data, void *data);
+void async_job_queue_drain(async_job_queue_t *queue);
+
+#endif // ASYNC_JOB_H_
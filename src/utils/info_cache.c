@@ -0,0 +1,288 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+/**
+* @file info_cache.c
+*
+* @brief Read-only, mmap-able record of constant module strings, shared
+* by all processes of one boot
+*
+* Layout: a header, one offset per field (0 when the field is absent),
+* then the NUL-terminated values. Everything is native endian, the file
+* never leaves the machine.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <nyx/module/nyx_log.h>
+#include "info_cache.h"
+
+#define INFO_CACHE_MAGIC   0x434f464eu /* "NFOC" */
+#define INFO_CACHE_VERSION 1
+#define BOOT_ID_LEN        40
+
+/* more than enough for a handful of short strings */
+#define INFO_CACHE_MAX_SIZE (64 * 1024)
+
+static const char *const boot_id_path = "/proc/sys/kernel/random/boot_id";
+
+struct info_cache_header
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t layout;      // caller's field layout, bumped when it changes
+	uint32_t count;
+	uint32_t size;        // whole file
+	char boot_id[BOOT_ID_LEN];
+};
+
+static bool read_boot_id(char boot_id[BOOT_ID_LEN])
+{
+	memset(boot_id, 0, BOOT_ID_LEN);
+
+	int fd = open(boot_id_path, O_RDONLY | O_CLOEXEC);
+
+	if (fd < 0)
+	{
+		return false;
+	}
+
+	ssize_t len = read(fd, boot_id, BOOT_ID_LEN - 1);
+	close(fd);
+
+	if (len <= 0)
+	{
+		return false;
+	}
+
+	boot_id[strcspn(boot_id, "\n")] = '\0';
+	return true;
+}
+
+/**
+ * Maps the cache at path. Fails, leaving cache empty, unless the file was
+ * written during this boot with the same layout and field count and by a
+ * trusted owner (root or the current user).
+ */
+bool info_cache_map(info_cache_t *cache, const char *path,
+                    uint32_t layout, unsigned int count)
+{
+	char boot_id[BOOT_ID_LEN];
+	struct stat st;
+
+	memset(cache, 0, sizeof(*cache));
+
+	if (!read_boot_id(boot_id))
+	{
+		return false;
+	}
+
+	int fd = open(path, O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+
+	if (fd < 0)
+	{
+		return false;
+	}
+
+	size_t data_start = sizeof(struct info_cache_header) +
+	                    count * sizeof(uint32_t);
+
+	if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) ||
+	        (st.st_uid != 0 && st.st_uid != geteuid()) ||
+	        (st.st_mode & (S_IWGRP | S_IWOTH)) ||
+	        (size_t)st.st_size <= data_start ||
+	        st.st_size > INFO_CACHE_MAX_SIZE)
+	{
+		close(fd);
+		return false;
+	}
+
+	void *base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (MAP_FAILED == base)
+	{
+		return false;
+	}
+
+	const struct info_cache_header *hdr = base;
+	const uint32_t *offsets = (const uint32_t *)(hdr + 1);
+	const char *bytes = base;
+	bool valid = hdr->magic == INFO_CACHE_MAGIC &&
+	             hdr->version == INFO_CACHE_VERSION &&
+	             hdr->layout == layout && hdr->count == count &&
+	             hdr->size == (uint32_t)st.st_size &&
+	             0 == memcmp(hdr->boot_id, boot_id, BOOT_ID_LEN) &&
+	             '\0' == bytes[st.st_size - 1];
+
+	/* the final NUL bounds every string that starts inside the data */
+	for (unsigned int i = 0; valid && i < count; i++)
+	{
+		valid = 0 == offsets[i] ||
+		        (offsets[i] >= data_start && offsets[i] < hdr->size);
+	}
+
+	if (!valid)
+	{
+		munmap(base, st.st_size);
+		return false;
+	}
+
+	cache->base = base;
+	cache->size = st.st_size;
+	cache->count = count;
+	cache->offsets = offsets;
+	return true;
+}
+
+/**
+ * Returns the value of field, pointing into the mapping, or NULL when the
+ * cache is not mapped or the writer did not have the value.
+ */
+const char *info_cache_get(const info_cache_t *cache, unsigned int field)
+{
+	if (NULL == cache->base || field >= cache->count ||
+	        0 == cache->offsets[field])
+	{
+		return NULL;
+	}
+
+	return (const char *)cache->base + cache->offsets[field];
+}
+
+void info_cache_unmap(info_cache_t *cache)
+{
+	if (NULL != cache->base)
+	{
+		munmap(cache->base, cache->size);
+	}
+
+	memset(cache, 0, sizeof(*cache));
+}
+
+/**
+ * Writes values (NULL for fields that are not known) to path for the
+ * current boot. The file is built under a temporary name and renamed, so
+ * concurrent first openers never expose a partial file; the last rename
+ * wins and both versions are valid.
+ */
+bool info_cache_write(const char *path, uint32_t layout,
+                      const char *const values[], unsigned int count)
+{
+	struct info_cache_header hdr;
+	char tmp_path[PATH_MAX];
+	char dir[PATH_MAX];
+
+	memset(&hdr, 0, sizeof(hdr));
+
+	if (!read_boot_id(hdr.boot_id))
+	{
+		return false;
+	}
+
+	size_t size = sizeof(hdr) + count * sizeof(uint32_t);
+
+	for (unsigned int i = 0; i < count; i++)
+	{
+		size += values[i] ? strlen(values[i]) + 1 : 0;
+	}
+
+	/* the reader relies on the file ending with a NUL */
+	size++;
+
+	if (size > INFO_CACHE_MAX_SIZE)
+	{
+		return false;
+	}
+
+	char *buf = calloc(1, size);
+
+	if (NULL == buf)
+	{
+		return false;
+	}
+
+	hdr.magic = INFO_CACHE_MAGIC;
+	hdr.version = INFO_CACHE_VERSION;
+	hdr.layout = layout;
+	hdr.count = count;
+	hdr.size = size;
+	memcpy(buf, &hdr, sizeof(hdr));
+
+	uint32_t *offsets = (uint32_t *)(buf + sizeof(hdr));
+	size_t pos = sizeof(hdr) + count * sizeof(uint32_t);
+
+	for (unsigned int i = 0; i < count; i++)
+	{
+		if (values[i])
+		{
+			size_t len = strlen(values[i]) + 1;
+
+			offsets[i] = pos;
+			memcpy(buf + pos, values[i], len);
+			pos += len;
+		}
+	}
+
+	snprintf(dir, sizeof(dir), "%s", path);
+
+	if (mkdir(dirname(dir), 0755) < 0 && errno != EEXIST)
+	{
+		nyx_debug("Cannot create the info cache directory for %s", path);
+		free(buf);
+		return false;
+	}
+
+	snprintf(tmp_path, sizeof(tmp_path), "%s.%d", path, (int)getpid());
+
+	bool written = false;
+	int fd = open(tmp_path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC,
+	              S_IRUSR | S_IWUSR);
+
+	if (fd >= 0)
+	{
+		written = write(fd, buf, size) == (ssize_t)size &&
+		          fchmod(fd, S_IRUSR | S_IRGRP | S_IROTH) == 0;
+		close(fd);
+
+		if (written && rename(tmp_path, path) < 0)
+		{
+			written = false;
+		}
+
+		if (!written)
+		{
+			unlink(tmp_path);
+		}
+	}
+
+	if (!written)
+	{
+		nyx_debug("Cannot write the info cache %s", path);
+	}
+
+	free(buf);
+	return written;
+}
@@ -0,0 +1,54 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+/**
+ * @file info_cache.h
+ *
+ * @brief Boot-scoped cache of constant DeviceInfo and OSInfo strings.
+ *
+ * The first process that opens a module writes the values it resolved to a
+ * read-only file under /run. Later openers map that file and hand out
+ * pointers into the mapping instead of resolving the values again. The
+ * file carries the boot id, so a stale file from a previous boot (if /run
+ * is not a tmpfs) is ignored and rewritten.
+ */
+
+#ifndef INFO_CACHE_H_
+#define INFO_CACHE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct
+{
+	void *base;
+	size_t size;
+	unsigned int count;
+	const uint32_t *offsets;
+} info_cache_t;
+
+#define INFO_CACHE_INITIALIZER { NULL, 0, 0, NULL }
+
+bool info_cache_map(info_cache_t *cache, const char *path,
+                    uint32_t layout, unsigned int count);
+const char *info_cache_get(const info_cache_t *cache, unsigned int field);
+void info_cache_unmap(info_cache_t *cache);
+bool info_cache_write(const char *path, uint32_t layout,
+                      const char *const values[], unsigned int count);
+
+#endif // INFO_CACHE_H_
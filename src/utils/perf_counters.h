@@ -0,0 +1,84 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+/**
+ * @file perf_counters.h
+ *
+ * @brief Lock-free runtime counters and optional tracepoints for the nyx
+ * modules.
+ *
+ * A module keeps its counters in a plain uint64_t array indexed by its own
+ * enum and bumps them with relaxed atomics, so counting costs one locked add
+ * and never blocks. The array is exported by the module's query_counters
+ * method through perf_counters_read().
+ *
+ * Tracepoints are USDT probes (sys/sdt.h), usable from perf, LTTng, bpftrace
+ * and SystemTap, and compiled in only with -DNYX_MODULES_TRACEPOINTS=ON. An
+ * unused probe is a single nop in the code path.
+ */
+
+#ifndef PERF_COUNTERS_H_
+#define PERF_COUNTERS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <nyx/common/nyx_error.h>
+/* nyx_perf_counter_t, the entries the query_counters methods fill in */
+#include <nyx/common/nyx_perf_counter.h>
+
+#define PERF_COUNTER_INC(counter) \
+	__atomic_fetch_add(&(counter), 1, __ATOMIC_RELAXED)
+#define PERF_COUNTER_ADD(counter, n) \
+	__atomic_fetch_add(&(counter), (uint64_t)(n), __ATOMIC_RELAXED)
+#define PERF_COUNTER_SET(counter, n) \
+	__atomic_store_n(&(counter), (uint64_t)(n), __ATOMIC_RELAXED)
+
+/**
+ * Copies a counter block of n entries into counters. *count holds the
+ * capacity of counters on entry and is set to n on return. With counters
+ * NULL only n is returned, so callers can size their buffer first.
+ */
+static inline nyx_error_t perf_counters_read(const char *const *names,
+        const uint64_t *values, int n, nyx_perf_counter_t *counters, int *count)
+{
+	int i;
+
+	if (NULL == count || (NULL != counters && *count < 0))
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	for (i = 0; NULL != counters && i < n && i < *count; i++)
+	{
+		counters[i].name = names[i];
+		counters[i].value = __atomic_load_n(&values[i], __ATOMIC_RELAXED);
+	}
+
+	*count = n;
+
+	return NYX_ERROR_NONE;
+}
+
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#define PERF_TRACE(provider, name, ...) STAP_PROBEV(provider, name, ##__VA_ARGS__)
+#else
+#define PERF_TRACE(provider, name, ...) do { } while (0)
+#endif
+
+#endif // PERF_COUNTERS_H_
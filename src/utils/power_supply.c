@@ -0,0 +1,507 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+/**
+* @file power_supply.c
+*
+* @brief Single udev monitor for the power_supply subsystem, shared by the
+* battery and charger modules.
+*
+* Both modules link against this library, so when they are loaded into the
+* same process they share one netlink socket, one GIOChannel watch and one
+* decoded snapshot per supply instead of each receiving and parsing every
+* uevent on their own.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <glib.h>
+#include <libudev.h>
+
+#include <nyx/nyx_module.h>
+#include <nyx/module/nyx_log.h>
+#include "msgid.h"
+
+#include "power_supply.h"
+
+#define POWER_SUPPLY_MAX_SUBSCRIBERS 8
+#define POWER_SUPPLY_PROPERTY_PREFIX "POWER_SUPPLY_"
+
+typedef struct
+{
+	guint id;
+	power_supply_callback_t callback;
+	void *context;
+} power_supply_subscriber_t;
+
+static struct udev *psy_udev = NULL;
+static struct udev_monitor *psy_mon = NULL;
+static guint psy_watch = 0;
+
+/* sysname -> power_supply_t */
+static GHashTable *psy_supplies = NULL;
+static unsigned int psy_generation = 0;
+static int psy_critical_voltage_mv = 0;
+
+static power_supply_subscriber_t psy_subscribers[POWER_SUPPLY_MAX_SUBSCRIBERS];
+static int psy_subscriber_count = 0;
+static guint psy_next_id = 1;
+
+static bool psy_dispatching = false;
+static bool psy_teardown_pending = false;
+
+static void psy_supply_free(gpointer data)
+{
+	power_supply_t *supply = (power_supply_t *)data;
+
+	if (supply)
+	{
+		if (supply->properties)
+		{
+			g_hash_table_destroy(supply->properties);
+		}
+
+		g_free(supply);
+	}
+}
+
+static power_supply_t *psy_supply_get(const char *name)
+{
+	power_supply_t *supply = g_hash_table_lookup(psy_supplies, name);
+
+	if (!supply)
+	{
+		supply = g_new0(power_supply_t, 1);
+		g_strlcpy(supply->name, name, POWER_SUPPLY_NAME_LEN);
+		supply->properties = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+		                     g_free);
+		g_hash_table_insert(psy_supplies, g_strdup(name), supply);
+	}
+
+	return supply;
+}
+
+/**
+ * Decode the POWER_SUPPLY_* properties of a uevent into the supply snapshot.
+ */
+static void psy_supply_update(power_supply_t *supply, struct udev_device *dev)
+{
+	struct udev_list_entry *entry;
+	const char *action = udev_device_get_action(dev);
+	const char *key;
+	const char *value;
+	size_t prefix_len = strlen(POWER_SUPPLY_PROPERTY_PREFIX);
+
+	g_strlcpy(supply->action, action ? action : "", POWER_SUPPLY_NAME_LEN);
+	g_hash_table_remove_all(supply->properties);
+
+	udev_list_entry_foreach(entry, udev_device_get_properties_list_entry(dev))
+	{
+		key = udev_list_entry_get_name(entry);
+		value = udev_list_entry_get_value(entry);
+
+		if (!key || !value || strncmp(key, POWER_SUPPLY_PROPERTY_PREFIX, prefix_len))
+		{
+			continue;
+		}
+
+		g_hash_table_insert(supply->properties, g_strdup(key + prefix_len),
+		                    g_strdup(value));
+	}
+
+	supply->version++;
+	psy_generation++;
+}
+
+static void psy_dispatch(const power_supply_t *supply)
+{
+	int i;
+
+	psy_dispatching = true;
+
+	for (i = 0; i < POWER_SUPPLY_MAX_SUBSCRIBERS; i++)
+	{
+		if (psy_subscribers[i].callback)
+		{
+			psy_subscribers[i].callback(supply, psy_subscribers[i].context);
+		}
+	}
+
+	psy_dispatching = false;
+}
+
+static void psy_monitor_cleanup(void);
+
+static gboolean psy_handle_event(GIOChannel *channel, GIOCondition condition,
+                                 gpointer data)
+{
+	struct udev_device *dev;
+	const char *sysname;
+	power_supply_t *supply;
+
+	if ((condition & G_IO_IN) != G_IO_IN)
+	{
+		return TRUE;
+	}
+
+	dev = udev_monitor_receive_device(psy_mon);
+
+	if (!dev)
+	{
+		/* nothing to decode; let subscribers re-read whatever they need */
+		psy_dispatch(NULL);
+	}
+	else
+	{
+		sysname = udev_device_get_sysname(dev);
+
+		if (!sysname)
+		{
+			udev_device_unref(dev);
+			return TRUE;
+		}
+
+		supply = psy_supply_get(sysname);
+		psy_supply_update(supply, dev);
+		udev_device_unref(dev);
+
+		psy_dispatch(supply);
+
+		if (strcmp(supply->action, "remove") == 0)
+		{
+			g_hash_table_remove(psy_supplies, supply->name);
+		}
+	}
+
+	if (psy_teardown_pending)
+	{
+		/* returning FALSE drops the watch and with it the channel */
+		psy_teardown_pending = false;
+		psy_watch = 0;
+		psy_monitor_cleanup();
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/**
+ * Fill the snapshots of the supplies present at start-up from their uevent
+ * files, so that properties that have not changed since boot can be looked
+ * up before the first uevent arrives.
+ */
+static void psy_supplies_enumerate(void)
+{
+	struct udev_enumerate *enumerate;
+	struct udev_list_entry *entry;
+	struct udev_device *dev;
+	const char *sysname;
+
+	enumerate = udev_enumerate_new(psy_udev);
+
+	if (!enumerate || udev_enumerate_add_match_subsystem(enumerate,
+	        "power_supply") < 0 || udev_enumerate_scan_devices(enumerate) < 0)
+	{
+		nyx_debug("Failed to enumerate power supplies; waiting for uevents");
+
+		if (enumerate)
+		{
+			udev_enumerate_unref(enumerate);
+		}
+
+		return;
+	}
+
+	udev_list_entry_foreach(entry, udev_enumerate_get_list_entry(enumerate))
+	{
+		dev = udev_device_new_from_syspath(psy_udev, udev_list_entry_get_name(entry));
+
+		if (!dev)
+		{
+			continue;
+		}
+
+		sysname = udev_device_get_sysname(dev);
+
+		if (sysname)
+		{
+			psy_supply_update(psy_supply_get(sysname), dev);
+		}
+
+		udev_device_unref(dev);
+	}
+
+	udev_enumerate_unref(enumerate);
+}
+
+static void psy_monitor_cleanup(void)
+{
+	// psy_monitor_init sets g_io_channel_set_close_on_unref, and calls g_io_channel_unref.
+	// This leaves one ref associated with the watch, so removing the watch should close the channel.
+	if (0 != psy_watch)
+	{
+		g_source_remove(psy_watch);
+		psy_watch = 0;
+	}
+
+	if (NULL != psy_mon)
+	{
+		udev_monitor_unref(psy_mon);
+		psy_mon = NULL;
+	}
+
+	if (NULL != psy_udev)
+	{
+		udev_unref(psy_udev);
+		psy_udev = NULL;
+	}
+
+	if (NULL != psy_supplies)
+	{
+		g_hash_table_destroy(psy_supplies);
+		psy_supplies = NULL;
+	}
+}
+
+static nyx_error_t psy_monitor_init(void)
+{
+	int fd;
+	GIOChannel *channel = NULL;
+
+	psy_udev = udev_new();
+
+	if (!psy_udev)
+	{
+		nyx_error(MSGID_NYX_MOD_PSY_UDEV_ERR, 0,
+		          "Could not initialize udev component; power supply status updates will not be available");
+		return NYX_ERROR_GENERIC;
+	}
+
+	psy_mon = udev_monitor_new_from_netlink(psy_udev, "kernel");
+
+	if (psy_mon == NULL)
+	{
+		nyx_error(MSGID_NYX_MOD_PSY_MONITOR_ERR, 0,
+		          "Failed to create udev monitor for kernel events");
+		psy_monitor_cleanup();
+		return NYX_ERROR_GENERIC;
+	}
+
+	if (udev_monitor_filter_add_match_subsystem_devtype(psy_mon, "power_supply",
+	        NULL) < 0)
+	{
+		nyx_error(MSGID_NYX_MOD_PSY_MONITOR_ERR, 0,
+		          "Failed to setup udev filter for power_supply subsytem events");
+		psy_monitor_cleanup();
+		return NYX_ERROR_GENERIC;
+	}
+
+	if (udev_monitor_enable_receiving(psy_mon) < 0)
+	{
+		nyx_error(MSGID_NYX_MOD_PSY_MONITOR_ERR, 0,
+		          "Failed to enable receiving kernel events for power_supply subsytem");
+		psy_monitor_cleanup();
+		return NYX_ERROR_GENERIC;
+	}
+
+	/* Setup io watch for uevents */
+	fd = udev_monitor_get_fd(psy_mon);
+
+	if (-1 == fd)
+	{
+		psy_monitor_cleanup();
+		return NYX_ERROR_GENERIC;
+	}
+
+	channel = g_io_channel_unix_new(fd);
+
+	if (!channel)
+	{
+		psy_monitor_cleanup();
+		return NYX_ERROR_GENERIC;
+	}
+
+	/* add watch event (which adds a ref) before calling g_io_channel_unref */
+	psy_watch = g_io_add_watch(channel, G_IO_IN | G_IO_HUP | G_IO_NVAL,
+	                           psy_handle_event, NULL);
+
+	/* Remove the ref from g_io_channel_unix_new so we won't leak the channel if g_io_add_watch failed */
+	/* watch holds another ref which is removed in psy_monitor_cleanup */
+	g_io_channel_set_close_on_unref(channel, TRUE);
+	g_io_channel_unref(channel);
+
+	if (0 == psy_watch)
+	{
+		psy_monitor_cleanup();
+		return NYX_ERROR_GENERIC;
+	}
+
+	psy_supplies = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+	                                     psy_supply_free);
+
+	/* receiving is already enabled, so nothing changes unseen in between */
+	psy_supplies_enumerate();
+
+	return NYX_ERROR_NONE;
+}
+
+nyx_error_t power_supply_subscribe(power_supply_callback_t callback,
+                                   void *context, guint *id)
+{
+	int i;
+	nyx_error_t error;
+
+	if (!callback || !id)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	for (i = 0; i < POWER_SUPPLY_MAX_SUBSCRIBERS; i++)
+	{
+		if (!psy_subscribers[i].callback)
+		{
+			break;
+		}
+	}
+
+	if (i == POWER_SUPPLY_MAX_SUBSCRIBERS)
+	{
+		nyx_error(MSGID_NYX_MOD_PSY_SUBSCRIBE_ERR, 0,
+		          "Too many power supply subscribers");
+		return NYX_ERROR_TOO_MANY_OPENS;
+	}
+
+	if (0 == psy_subscriber_count && !psy_teardown_pending)
+	{
+		error = psy_monitor_init();
+
+		if (NYX_ERROR_NONE != error)
+		{
+			return error;
+		}
+	}
+
+	psy_teardown_pending = false;
+
+	psy_subscribers[i].id = psy_next_id++;
+	psy_subscribers[i].callback = callback;
+	psy_subscribers[i].context = context;
+	psy_subscriber_count++;
+
+	*id = psy_subscribers[i].id;
+
+	return NYX_ERROR_NONE;
+}
+
+void power_supply_unsubscribe(guint id)
+{
+	int i;
+
+	for (i = 0; i < POWER_SUPPLY_MAX_SUBSCRIBERS; i++)
+	{
+		if (psy_subscribers[i].callback && psy_subscribers[i].id == id)
+		{
+			memset(&psy_subscribers[i], 0, sizeof(power_supply_subscriber_t));
+			psy_subscriber_count--;
+			break;
+		}
+	}
+
+	if (0 == psy_subscriber_count)
+	{
+		/* the snapshot being dispatched must stay valid until all callbacks return */
+		if (psy_dispatching)
+		{
+			psy_teardown_pending = true;
+		}
+		else
+		{
+			psy_monitor_cleanup();
+		}
+	}
+}
+
+/**
+ * Returns the snapshot of a supply from its last uevent, or NULL if no uevent
+ * was seen for it since the monitor was created.
+ */
+const power_supply_t *power_supply_lookup(const char *name)
+{
+	if (!psy_supplies || !name)
+	{
+		return NULL;
+	}
+
+	return g_hash_table_lookup(psy_supplies, name);
+}
+
+/**
+ * Returns a counter bumped on every uevent for any supply, so callers can
+ * tell whether anything changed since they last looked.
+ */
+unsigned int power_supply_generation(void)
+{
+	return psy_generation;
+}
+
+const char *power_supply_property_string(const power_supply_t *supply,
+        const char *key)
+{
+	if (!supply || !supply->properties || !key)
+	{
+		return NULL;
+	}
+
+	return g_hash_table_lookup(supply->properties, key);
+}
+
+bool power_supply_property_int(const power_supply_t *supply, const char *key,
+                               int32_t *value)
+{
+	const char *str = power_supply_property_string(supply, key);
+	char *endptr;
+	long val;
+
+	if (!str)
+	{
+		return false;
+	}
+
+	val = strtol(str, &endptr, 10);
+
+	if (endptr == str)
+	{
+		return false;
+	}
+
+	if (value)
+	{
+		*value = (int32_t)val;
+	}
+
+	return true;
+}
+
+void power_supply_set_critical_voltage_mv(int voltage_mv)
+{
+	psy_critical_voltage_mv = voltage_mv;
+}
+
+int power_supply_critical_voltage_mv(void)
+{
+	return psy_critical_voltage_mv;
+}
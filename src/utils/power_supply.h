@@ -0,0 +1,80 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+/**
+ * @file power_supply.h
+ *
+ * @brief Power supply uevent monitor shared by the battery and charger
+ * modules.
+ */
+
+#ifndef POWER_SUPPLY_H_
+#define POWER_SUPPLY_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <glib.h>
+
+#include <nyx/common/nyx_error.h>
+
+#define POWER_SUPPLY_NAME_LEN 64
+
+/* CTIA charging temperature range and battery temperature limit */
+#define CHARGE_MIN_TEMPERATURE_C 0
+#define CHARGE_MAX_TEMPERATURE_C 57
+#define BATTERY_MAX_TEMPERATURE_C  60
+
+/**
+ * Snapshot of one power supply, as reported by its last uevent.
+ */
+typedef struct
+{
+	char name[POWER_SUPPLY_NAME_LEN];   /* sysname, e.g. "battery" */
+	char action[POWER_SUPPLY_NAME_LEN]; /* action of the last uevent */
+	unsigned int version;               /* bumped on every uevent of this supply */
+	GHashTable *properties;             /* POWER_SUPPLY_<key> -> value, without the prefix */
+} power_supply_t;
+
+typedef void (*power_supply_callback_t)(const power_supply_t *supply,
+                                        void *context);
+
+/**
+ * Subscribe to power_supply uevents. The netlink monitor is created with the
+ * first subscription and shared by all of them; every uevent is decoded once
+ * into the supply snapshot before the subscribers are called in
+ * subscription order.
+ */
+nyx_error_t power_supply_subscribe(power_supply_callback_t callback,
+                                   void *context, guint *id);
+void power_supply_unsubscribe(guint id);
+
+const power_supply_t *power_supply_lookup(const char *name);
+unsigned int power_supply_generation(void);
+
+bool power_supply_property_int(const power_supply_t *supply, const char *key,
+                               int32_t *value);
+const char *power_supply_property_string(const power_supply_t *supply,
+        const char *key);
+
+/**
+ * Critical battery voltage in mV as configured through the battery module;
+ * 0 when disabled. Kept here so that the charger module raises its critical
+ * voltage event at the same threshold.
+ */
+void power_supply_set_critical_voltage_mv(int voltage_mv);
+int power_supply_critical_voltage_mv(void);
+
+#endif // POWER_SUPPLY_H_
@@ -0,0 +1,75 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+/**
+ * @file slot_handle.h
+ *
+ * @brief Handles for entries of small fixed-size tables.
+ *
+ * A handle carries the slot index in its low bits and a per-slot generation
+ * above them. The generation is bumped every time the slot is handed out, so
+ * a handle kept after its entry was freed no longer matches once the slot is
+ * reused and is rejected instead of addressing the new entry.
+ */
+
+#ifndef SLOT_HANDLE_H_
+#define SLOT_HANDLE_H_
+
+#define SLOT_HANDLE_SLOT_BITS 8
+#define SLOT_HANDLE_SLOT_MASK ((1 << SLOT_HANDLE_SLOT_BITS) - 1)
+/* keeps handles positive */
+#define SLOT_HANDLE_GENERATION_MASK (0x7fffffffu >> SLOT_HANDLE_SLOT_BITS)
+
+/**
+ * Bumps the generation of a slot that is being handed out and returns its
+ * new handle. Handles are never 0 or negative.
+ */
+static inline int slot_handle_issue(unsigned int *generation, int slot)
+{
+	*generation = (*generation + 1) & SLOT_HANDLE_GENERATION_MASK;
+
+	if (0 == *generation)
+	{
+		*generation = 1;
+	}
+
+	return (int)(*generation << SLOT_HANDLE_SLOT_BITS) | (slot + 1);
+}
+
+/**
+ * Returns the slot a handle refers to, or -1 if it is outside a table of
+ * count slots. The caller still compares the generation with
+ * slot_handle_matches() while holding the lock of the table.
+ */
+static inline int slot_handle_slot(int handle, int count)
+{
+	int slot = (handle & SLOT_HANDLE_SLOT_MASK) - 1;
+
+	if (handle <= 0 || slot < 0 || slot >= count)
+	{
+		return -1;
+	}
+
+	return slot;
+}
+
+static inline int slot_handle_matches(int handle, unsigned int generation)
+{
+	return ((unsigned int) handle >> SLOT_HANDLE_SLOT_BITS) == generation;
+}
+
+#endif // SLOT_HANDLE_H_
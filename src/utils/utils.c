@@ -28,8 +28,255 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <fcntl.h>
+#include <libudev.h>
 #include <nyx/module/nyx_log.h>
 #include "msgid.h"
+#include "utils.h"
+#include "perf_counters.h"
+
+/* reads through the helpers below, see sysfs_attr_read_count() */
+static uint64_t read_count = 0;
+
+/**
+ * Initializes a sysfs attribute handle for <dir>/<name>. The file is not
+ * opened until the first read.
+ */
+
+void sysfs_attr_init(sysfs_attr_t *attr, const char *dir, const char *name)
+{
+	if (!attr)
+	{
+		return;
+	}
+
+	attr->fd = -1;
+	snprintf(attr->path, SYSFS_ATTR_PATH_LEN, "%s/%s", dir ? dir : "",
+	         name ? name : "");
+}
+
+bool sysfs_attr_open(sysfs_attr_t *attr)
+{
+	if (!attr || !attr->path[0])
+	{
+		return false;
+	}
+
+	if (attr->fd >= 0)
+	{
+		return true;
+	}
+
+	attr->fd = open(attr->path, O_RDONLY | O_CLOEXEC);
+
+	return (attr->fd >= 0);
+}
+
+void sysfs_attr_close(sysfs_attr_t *attr)
+{
+	if (attr && attr->fd >= 0)
+	{
+		close(attr->fd);
+		attr->fd = -1;
+	}
+}
+
+bool sysfs_attr_exists(sysfs_attr_t *attr)
+{
+	return sysfs_attr_open(attr);
+}
+
+/**
+ * Reads the attribute into a pre-allocated buffer using pread() at offset 0
+ * on the cached descriptor. If the descriptor went stale (device removed and
+ * re-added) it is reopened once and the read retried.
+ */
+
+int sysfs_attr_read_string(sysfs_attr_t *attr, char *ret_string, size_t maxlen)
+{
+	ssize_t len;
+	int retry;
+
+	if (!attr || !ret_string || maxlen == 0)
+	{
+		return -1;
+	}
+
+	for (retry = 0; retry < 2; retry++)
+	{
+		if (!sysfs_attr_open(attr))
+		{
+			return -1;
+		}
+
+		PERF_COUNTER_INC(read_count);
+		len = pread(attr->fd, ret_string, maxlen - 1, 0);
+
+		if (len >= 0)
+		{
+			break;
+		}
+
+		if (errno != ENODEV && errno != EBADF && errno != ESTALE &&
+		        errno != ENOENT)
+		{
+			nyx_error(MSGID_NYX_MOD_SYSFS_ATTR_ERR, 0, "Failed to read %s: %s",
+			          attr->path, strerror(errno));
+			return -1;
+		}
+
+		sysfs_attr_close(attr);
+	}
+
+	if (len < 0)
+	{
+		return -1;
+	}
+
+	ret_string[len] = '\0';
+
+	while (len > 0 && g_ascii_isspace(ret_string[len - 1]))
+	{
+		ret_string[--len] = '\0';
+	}
+
+	return 0;
+}
+
+/**
+ * Reads a signed integer attribute. Unlike sysfs_attr_read_value() a
+ * negative value is not mistaken for an error.
+ */
+
+bool sysfs_attr_read_int(sysfs_attr_t *attr, int32_t *value)
+{
+	char buf[32];
+	char *endptr;
+	long val;
+
+	if (sysfs_attr_read_string(attr, buf, sizeof(buf)) < 0)
+	{
+		return false;
+	}
+
+	val = strtol(buf, &endptr, 10);
+
+	if (endptr == buf)
+	{
+		return false;
+	}
+
+	if (value)
+	{
+		*value = (int32_t)val;
+	}
+
+	return true;
+}
+
+int32_t sysfs_attr_read_value(sysfs_attr_t *attr)
+{
+	int32_t val;
+
+	if (!sysfs_attr_read_int(attr, &val))
+	{
+		return -1;
+	}
+
+	return val;
+}
+
+/**
+ * Writes an integer to a writable attribute (e.g. an alert threshold). The
+ * cached descriptor is read-only, so the file is opened for this write only.
+ */
+
+bool sysfs_attr_write_int(sysfs_attr_t *attr, int32_t value)
+{
+	char buf[32];
+	ssize_t len;
+	int fd;
+
+	if (!attr || !attr->path[0])
+	{
+		return false;
+	}
+
+	fd = open(attr->path, O_WRONLY | O_CLOEXEC);
+
+	if (fd < 0)
+	{
+		return false;
+	}
+
+	len = snprintf(buf, sizeof(buf), "%d", value);
+
+	if (write(fd, buf, len) != len)
+	{
+		nyx_error(MSGID_NYX_MOD_SYSFS_ATTR_ERR, 0, "Failed to write %s: %s",
+		          attr->path, strerror(errno));
+		close(fd);
+		return false;
+	}
+
+	close(fd);
+	return true;
+}
+
+/**
+ * Reads up to maxlen - 1 bytes of a file into a caller supplied buffer with a
+ * single read() and NUL-terminates it. Never allocates; returns the number of
+ * bytes read or -1 with errno set.
+ */
+
+ssize_t FileReadBuffer(const char *path, char *buf, size_t maxlen)
+{
+	ssize_t len;
+	int fd;
+	int saved_errno;
+
+	if (!path || !buf || maxlen == 0)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+
+	if (fd < 0)
+	{
+		return -1;
+	}
+
+	PERF_COUNTER_INC(read_count);
+
+	do
+	{
+		len = read(fd, buf, maxlen - 1);
+	}
+	while (len < 0 && errno == EINTR);
+
+	saved_errno = errno;
+	close(fd);
+	errno = saved_errno;
+
+	if (len < 0)
+	{
+		return -1;
+	}
+
+	buf[len] = '\0';
+
+	return len;
+}
+
+/**
+ * Number of sysfs and file reads made through these helpers so far.
+ */
+
+uint64_t sysfs_attr_read_count(void)
+{
+	return __atomic_load_n(&read_count, __ATOMIC_RELAXED);
+}
 
 /**
  * Returns string in pre-allocated buffer.
@@ -37,42 +284,34 @@
 
 int FileGetString(const char *path, char *ret_string, size_t maxlen)
 {
-	GError *gerror = NULL;
-	char *contents = NULL;
-	gsize len;
-
-	if (!path || !g_file_get_contents(path, &contents, &len, &gerror))
+	if (FileReadBuffer(path, ret_string, maxlen) < 0)
 	{
-		if (gerror)
+		if (path)
 		{
-			nyx_error(MSGID_NYX_MOD_GET_STRING_ERR, 0, "error: %s", gerror->message);
-			g_error_free(gerror);
+			nyx_error(MSGID_NYX_MOD_GET_STRING_ERR, 0, "error: Failed to read %s: %s",
+			          path, strerror(errno));
 		}
 
 		return -1;
 	}
 
-	g_strstrip(contents);
-	g_strlcpy(ret_string, contents, maxlen);
-	g_free(contents);
+	g_strstrip(ret_string);
 
 	return 0;
 }
 
 int FileGetDouble(const char *path, double *ret_data)
 {
-	GError *gerror = NULL;
-	char *contents = NULL;
+	char contents[64];
 	char *endptr;
-	gsize len;
 	float val;
 
-	if (!path || !g_file_get_contents(path, &contents, &len, &gerror))
+	if (FileReadBuffer(path, contents, sizeof(contents)) < 0)
 	{
-		if (gerror)
+		if (path)
 		{
-			nyx_error(MSGID_NYX_MOD_GET_DOUBLE_ERR, 0, "error: %s", gerror->message);
-			g_error_free(gerror);
+			nyx_error(MSGID_NYX_MOD_GET_DOUBLE_ERR, 0, "error: Failed to read %s: %s",
+			          path, strerror(errno));
 		}
 
 		return -1;
@@ -83,7 +322,7 @@ int FileGetDouble(const char *path, double *ret_data)
 	if (endptr == contents)
 	{
 		nyx_error(MSGID_NYX_MOD_GET_STRTOD_ERR, 0, "Invalid input in %s.", path);
-		goto end;
+		return 0;
 	}
 
 	if (ret_data)
@@ -91,74 +330,104 @@ int FileGetDouble(const char *path, double *ret_data)
 		*ret_data = val;
 	}
 
-end:
-	g_free(contents);
 	return 0;
 }
 
-char *find_power_supply_sysfs_path(const char *device_type)
+/* power supply type -> /sys/class/power_supply/<name>, built by one scan */
+static GHashTable *power_supply_paths = NULL;
+
+static bool scan_power_supplies(void)
 {
-	GError *gerror = NULL;
-	GDir *dir;
-	GDir *subdir;
-	gchar *dir_path = NULL;
-	gchar *full_path = NULL;
-	const char *sub_dir_name;
-	const char *file_name;
-	char file_contents[64];
-	char base_dir[64] = "/sys/class/power_supply/";
-
-	dir = g_dir_open(base_dir, 0, &gerror);
-
-	if (gerror)
-	{
-		nyx_error(MSGID_NYX_MOD_SYSFS_ERR, 0, "error: %s", gerror->message);
-		g_error_free(gerror);
-		return NULL;
+	struct udev *udev;
+	struct udev_enumerate *enumerate;
+	struct udev_list_entry *entry;
+	struct udev_device *dev;
+	const char *type;
+	const char *sysname;
+
+	udev = udev_new();
+
+	if (!udev)
+	{
+		nyx_error(MSGID_NYX_MOD_SYSFS_ERR, 0, "Could not initialize udev component");
+		return false;
 	}
 
-	while ((sub_dir_name = g_dir_read_name(dir)) != 0)
+	enumerate = udev_enumerate_new(udev);
+
+	if (!enumerate || udev_enumerate_add_match_subsystem(enumerate,
+	        "power_supply") < 0 || udev_enumerate_scan_devices(enumerate) < 0)
 	{
-		// ignore hidden files
-		if ('.' == sub_dir_name[0])
+		nyx_error(MSGID_NYX_MOD_SYSFS_ERR, 0, "Failed to enumerate power supplies");
+
+		if (enumerate)
+		{
+			udev_enumerate_unref(enumerate);
+		}
+
+		udev_unref(udev);
+		return false;
+	}
+
+	power_supply_paths = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+	                     g_free);
+
+	udev_list_entry_foreach(entry, udev_enumerate_get_list_entry(enumerate))
+	{
+		dev = udev_device_new_from_syspath(udev, udev_list_entry_get_name(entry));
+
+		if (!dev)
 		{
 			continue;
 		}
 
-		dir_path = g_build_filename(base_dir, sub_dir_name, NULL);
+		type = udev_device_get_sysattr_value(dev, "type");
+		sysname = udev_device_get_sysname(dev);
 
-		if (g_file_test(dir_path, G_FILE_TEST_IS_DIR))
+		// the first supply of a type wins, as with the old directory walk
+		if (type && sysname && !g_hash_table_contains(power_supply_paths, type))
 		{
-			subdir = g_dir_open(dir_path, 0, &gerror);
-
-			if (gerror)
-			{
-				nyx_error(MSGID_NYX_MOD_GET_DIR_ERR, 0, "error: %s", gerror->message);
-				g_error_free(gerror);
-				return NULL;
-			}
-
-			while ((file_name = g_dir_read_name(subdir)) != 0)
-			{
-				if (strcmp(file_name, "type") == 0)
-				{
-					full_path = g_build_filename(dir_path, file_name, NULL);
-					FileGetString(full_path, file_contents, 64);
-
-					if (strcmp(file_contents, device_type) == 0)
-					{
-						return dir_path;
-					}
-
-					g_free(full_path);
-					full_path = NULL;
-				}
-			}
+			g_hash_table_insert(power_supply_paths, g_strdup(type),
+			                    g_build_filename("/sys/class/power_supply", sysname, NULL));
 		}
 
-		g_free(dir_path);
-		dir_path = NULL;
+		udev_device_unref(dev);
 	}
 
-	return NULL;
+	udev_enumerate_unref(enumerate);
+	udev_unref(udev);
+
+	return true;
+}
+
+/**
+ * Returns the sysfs directory of the first power supply of the given type
+ * ("Battery", "USB", "Mains", ...), or NULL if there is none.
+ *
+ * All supplies are enumerated once on the first call; later calls are table
+ * lookups. The returned string is owned by the table and stays valid until
+ * release_power_supply_sysfs_paths().
+ */
+const char *find_power_supply_sysfs_path(const char *device_type)
+{
+	if (!device_type)
+	{
+		return NULL;
+	}
+
+	if (!power_supply_paths && !scan_power_supplies())
+	{
+		return NULL;
+	}
+
+	return g_hash_table_lookup(power_supply_paths, device_type);
+}
+
+void release_power_supply_sysfs_paths(void)
+{
+	if (power_supply_paths)
+	{
+		g_hash_table_destroy(power_supply_paths);
+		power_supply_paths = NULL;
+	}
 }
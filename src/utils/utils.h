@@ -21,8 +21,41 @@
 #ifndef UTILS_H_
 #define UTILS_H_
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define SYSFS_ATTR_PATH_LEN 256
+
+/**
+ * Persistent handle on a single sysfs attribute.
+ *
+ * The attribute file is opened once and re-read with pread() at offset 0,
+ * which makes sysfs regenerate the value without another open/close.
+ */
+typedef struct
+{
+	char path[SYSFS_ATTR_PATH_LEN];
+	int fd;
+} sysfs_attr_t;
+
+#define SYSFS_ATTR_INITIALIZER { {0,}, -1 }
+
+void sysfs_attr_init(sysfs_attr_t *attr, const char *dir, const char *name);
+bool sysfs_attr_open(sysfs_attr_t *attr);
+void sysfs_attr_close(sysfs_attr_t *attr);
+bool sysfs_attr_exists(sysfs_attr_t *attr);
+int sysfs_attr_read_string(sysfs_attr_t *attr, char *ret_string, size_t maxlen);
+bool sysfs_attr_read_int(sysfs_attr_t *attr, int32_t *value);
+int32_t sysfs_attr_read_value(sysfs_attr_t *attr);
+bool sysfs_attr_write_int(sysfs_attr_t *attr, int32_t value);
+uint64_t sysfs_attr_read_count(void);
+
+ssize_t FileReadBuffer(const char *path, char *buf, size_t maxlen);
 int FileGetString(const char *path, char *ret_string, size_t maxlen);
 int FileGetDouble(const char *path, double *ret_data);
-char *find_power_supply_sysfs_path(const char *device_type);
+const char *find_power_supply_sysfs_path(const char *device_type);
+void release_power_supply_sysfs_paths(void);
 
 #endif // UTILS_H_